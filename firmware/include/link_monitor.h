@@ -0,0 +1,19 @@
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+#include <Arduino.h>
+#include <rpcWiFi.h>
+#include <ping.h>
+
+// Watches the station link while it is up: the gateway is pinged in the
+// background and the RSSI sampled. Call pollLinkMonitor() from loop(), it
+// never blocks.
+void pollLinkMonitor();
+
+const RttTracker &linkRtt();
+int linkRSSI();                          // smoothed, dBm, 0 while down
+uint32_t linkTimeout(uint32_t base_ms);  // base_ms stretched to suit the link
+
+void printLinkStats(Print &out);         // one line summary
+
+#endif
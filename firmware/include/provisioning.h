@@ -0,0 +1,17 @@
+#ifndef PROVISIONING_H
+#define PROVISIONING_H
+
+#include <Arduino.h>
+#include <rpcWiFi.h>
+
+// Phone based Wi-Fi setup: the terminal opens its own access point with a
+// captive portal where the network name and password are entered.
+bool startProvisioning();
+bool handleProvisioning(String &ssid, String &password); // true once credentials arrived
+void stopProvisioning();                                  // close the portal and return to station mode
+
+const char *provisioningSSID();
+const char *provisioningPassphrase();
+IPAddress provisioningIP();
+
+#endif
@@ -481,6 +481,21 @@ namespace fs
         }
     }
 
+    boolean FS::stat(const char *filepath, FILINFO *info)
+    {
+        if (filepath == NULL || info == NULL)
+        {
+            return false;
+        }
+        FS::_path[0] = _T('0' + _pdrv);
+        FS::_path[1] = _T(':');
+        FS::_path[2] = _T('/');
+        FS::_path[3] = '\0';
+
+        strcat(FS::_path, filepath);
+        return f_stat(FS::_path, info) == FR_OK;
+    }
+
     boolean FS::mkdir(const char *filepath)
     {
         FRESULT ret = FR_OK;
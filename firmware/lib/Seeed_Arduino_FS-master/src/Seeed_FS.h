@@ -121,6 +121,14 @@ namespace fs
             return exists(filepath.c_str());
         }
 
+        // Fill in size, attributes and modification time of the requested
+        // path. Returns false if it does not exist.
+        boolean stat(const char *filepath, FILINFO *info);
+        boolean stat(const String &filepath, FILINFO *info)
+        {
+            return stat(filepath.c_str(), info);
+        }
+
         // Create the requested directory heirarchy--if intermediate directories
         // do not exist they will be created.
         boolean mkdir(const char *filepath);
@@ -114,6 +114,8 @@ void setup(void) {
     server.send(200, "text/plain", "this works as well");
   });
   server.onNotFound(handleNotFound);
+  // shed clients that hammer the board once it is reachable from the whole network
+  server.enableRateLimit();
   server.begin();
   Serial.println("HTTP server started");
 }
@@ -1,31 +1,71 @@
 #include "DNSServer.h"
 #include <lwip/def.h>
+#include <lwip/sockets.h>
 #include <Arduino.h>
 
+// The name is at most 255 bytes, so header, question and answer always fit
+static_assert(DNS_HEADER_SIZE + DNS_MAX_NAME_SIZE + 4 + DNS_ANSWER_SIZE <= DNS_MAX_PACKET_SIZE &&
+              DNS_HEADER_SIZE + DNS_MAX_NAME_SIZE + 4 + DNS_SOA_SIZE <= DNS_MAX_PACKET_SIZE,
+              "DNS_MAX_PACKET_SIZE cannot hold a reply");
+
+// Record order of zone tables: by name, then type
+static int compareRecord(const DNSRecord& record, const char* name, uint16_t type)
+{
+  int c = strcmp(record.name, name);
+  return c ? c : (int) record.type - (int) type;
+}
 
 DNSServer::DNSServer()
 {
   _ttl = htonl(DNS_DEFAULT_TTL);
+  _negativeTTL = htonl(DNS_DEFAULT_NEGATIVE_TTL);
+  _zone = nullptr;
+  _zoneSize = 0;
   _errorReplyCode = DNSReplyCode::NonExistentDomain;
-  _dnsHeader    = (DNSHeader*) malloc( sizeof(DNSHeader) ) ;
-  _dnsQuestion  = (DNSQuestion*) malloc( sizeof(DNSQuestion) ) ;     
-  _buffer     = NULL;
-  _currentPacketSize = 0;
+  _socket = -1;
   _port = 0;
+  _wildcard = true;
+  _domainNameLength = 0;
+  _remoteAddress = 0;
+  _remotePort = 0;
+}
+
+DNSServer::~DNSServer()
+{
+  stop();
 }
 
 bool DNSServer::start(const uint16_t &port, const String &domainName,
                      const IPAddress &resolvedIP)
 {
+  stop();
   _port = port;
-  _buffer = NULL;
-  _domainName = domainName;
+  _wildcard = domainName == "*";
+  _domainNameLength = _wildcard ? 0 : encodeDomainName(domainName);
   _resolvedIP[0] = resolvedIP[0];
   _resolvedIP[1] = resolvedIP[1];
   _resolvedIP[2] = resolvedIP[2];
   _resolvedIP[3] = resolvedIP[3];
-  downcaseAndRemoveWwwPrefix(_domainName);
-  return _udp.begin(_port) == 1;
+
+  if ((_socket = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+    log_e("could not create socket: %d", errno);
+    return false;
+  }
+  int yes = 1;
+  setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(_port);
+  addr.sin_addr.s_addr = INADDR_ANY;
+  if (bind(_socket, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+    log_e("could not bind socket: %d", errno);
+    stop();
+    return false;
+  }
+  fcntl(_socket, F_SETFL, O_NONBLOCK);
+  return true;
 }
 
 void DNSServer::setErrorReplyCode(const DNSReplyCode &replyCode)
@@ -38,162 +78,317 @@ void DNSServer::setTTL(const uint32_t &ttl)
   _ttl = htonl(ttl);
 }
 
-void DNSServer::stop()
+void DNSServer::setNegativeTTL(const uint32_t &ttl)
+{
+  _negativeTTL = htonl(ttl);
+}
+
+bool DNSServer::setZone(const DNSRecord* records, size_t count)
 {
-  _udp.stop();
-  free(_buffer);
-  _buffer = NULL;
-}
-
-void DNSServer::downcaseAndRemoveWwwPrefix(String &domainName)
-{
-  domainName.toLowerCase();
-  domainName.replace("www.", "");
-}
-
-void DNSServer::processNextRequest()
-{
-  _currentPacketSize = _udp.parsePacket();
-  if (_currentPacketSize)
-  {
-    // Allocate buffer for the DNS query
-    if (_buffer != NULL) 
-      free(_buffer);
-    _buffer = (unsigned char*)malloc(_currentPacketSize * sizeof(char));
-    if (_buffer == NULL) 
-      return;
-
-    // Put the packet received in the buffer and get DNS header (beginning of message)
-    // and the question
-    _udp.read(_buffer, _currentPacketSize);
-    memcpy( _dnsHeader, _buffer, DNS_HEADER_SIZE ) ; 
-    if ( requestIncludesOnlyOneQuestion() )
-    {
-      // The QName has a variable length, maximum 255 bytes and is comprised of multiple labels.
-      // Each label contains a byte to describe its length and the label itself. The list of 
-      // labels terminates with a zero-valued byte. In "github.com", we have two labels "github" & "com"
-      // Iterate through the labels and copy them as they come into a single buffer (for simplicity's sake)
-      _dnsQuestion->QNameLength = 0 ;
-      while ( _buffer[ DNS_HEADER_SIZE + _dnsQuestion->QNameLength ] != 0 )
-      {
-        memcpy( (void*) &_dnsQuestion->QName[_dnsQuestion->QNameLength], (void*) &_buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength], _buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength] + 1 ) ;
-        _dnsQuestion->QNameLength += _buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength] + 1 ; 
-      }
-      _dnsQuestion->QName[_dnsQuestion->QNameLength] = 0 ; 
-      _dnsQuestion->QNameLength++ ;   
-
-      // Copy the QType and QClass 
-      memcpy( &_dnsQuestion->QType, (void*) &_buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength], sizeof(_dnsQuestion->QType) ) ;
-      memcpy( &_dnsQuestion->QClass, (void*) &_buffer[DNS_HEADER_SIZE + _dnsQuestion->QNameLength + sizeof(_dnsQuestion->QType)], sizeof(_dnsQuestion->QClass) ) ;
+  for (size_t i = 1; i < count; i++) {
+    if (compareRecord(records[i], records[i - 1].name, records[i - 1].type) < 0) {
+      log_e("zone is not sorted at %s", records[i].name);
+      return false;
     }
-    
-
-    if (_dnsHeader->QR == DNS_QR_QUERY &&
-        _dnsHeader->OPCode == DNS_OPCODE_QUERY &&
-        requestIncludesOnlyOneQuestion() &&
-        (_domainName == "*" || getDomainNameWithoutWwwPrefix() == _domainName)
-       )
-    {
-      replyWithIP();
+  }
+  _zone = records;
+  _zoneSize = count;
+  return true;
+}
+
+void DNSServer::stop()
+{
+  if (_socket == -1)
+    return;
+  closesocket(_socket);
+  _socket = -1;
+}
+
+// Turn "www.Example.com" into the lower case wire form "\7example\3com\0" once,
+// so queries can be compared in place without building a String per packet
+size_t DNSServer::encodeDomainName(const String &domainName)
+{
+  const char* name = domainName.c_str();
+  if (strncasecmp(name, "www.", 4) == 0)
+    name += 4;
+
+  size_t length = 0;
+  while (*name) {
+    const char* dot = strchr(name, '.');
+    size_t label = dot ? dot - name : strlen(name);
+    if (label == 0 || label > 63 || length + label + 2 > sizeof(_domainName)) {
+      log_e("invalid domain name: %s", domainName.c_str());
+      return 0;
     }
-    else if (_dnsHeader->QR == DNS_QR_QUERY)
-    {
-      replyWithCustomCode();
+    _domainName[length++] = label;
+    for (size_t i = 0; i < label; i++)
+      _domainName[length++] = tolower((unsigned char) name[i]);
+    name += label;
+    if (*name == '.')
+      name++;
+  }
+  _domainName[length++] = 0;
+  return length;
+}
+
+bool DNSServer::processNextRequest()
+{
+  if (_socket == -1)
+    return false;
+
+  struct sockaddr_in from;
+  socklen_t fromLength = sizeof(from);
+  int length = recvfrom(_socket, _buffer, sizeof(_buffer), MSG_DONTWAIT, (struct sockaddr*) &from, &fromLength);
+  if (length < 0) {
+    if (errno != EWOULDBLOCK)
+      log_e("could not receive data: %d", errno);
+    return false;
+  }
+  _remoteAddress = from.sin_addr.s_addr;
+  _remotePort = from.sin_port;
+
+  // Ignore runts and responses so two servers can never keep each other busy
+  DNSHeader* header = (DNSHeader*) _buffer;
+  if (length < DNS_HEADER_SIZE || header->QR != DNS_QR_QUERY)
+    return true;
+
+  size_t end = questionEnd(length);
+  if (!end || header->OPCode != DNS_OPCODE_QUERY) {
+    replyWithCustomCode(0);
+    return true;
+  }
+
+  uint16_t type, qclass;
+  memcpy(&type, _buffer + end - 4, 2);
+  memcpy(&qclass, _buffer + end - 2, 2);
+  type = ntohs(type);
+  if (ntohs(qclass) != DNS_CLASS_IN) {
+    replyWithCustomCode(end);
+    return true;
+  }
+
+  bool known = false;
+  if (_zoneSize) {
+    char name[DNS_MAX_NAME_SIZE];
+    questionName(name);
+    size_t first = findRecords(name, type);
+    if (first < _zoneSize && compareRecord(_zone[first], name, type) == 0) {
+      replyWithRecords(end, first, type);
+      return true;
     }
+    first = findRecords(name, 0);
+    known = first < _zoneSize && strcmp(_zone[first].name, name) == 0;
+  }
 
-    free(_buffer);
-    _buffer = NULL;
+  if (!known && (_wildcard || questionMatches())) {
+    if (type == DNS_TYPE_A) {
+      replyWithIP(end);
+      return true;
+    }
+    known = true;
   }
+
+  // The name exists but has no record of this type (an AAAA lookup of the
+  // portal address, say): empty answer plus SOA, so the client caches the
+  // miss instead of asking again right away
+  if (known)
+    replyWithSOA(end, DNSReplyCode::NoError);
+  else
+    replyWithCustomCode(end);
+  return true;
 }
 
-bool DNSServer::requestIncludesOnlyOneQuestion()
+// Offset just past QTYPE and QCLASS of the only question, 0 if the packet does
+// not hold exactly one well formed question. Additional records such as EDNS
+// options are tolerated and left out of the reply.
+size_t DNSServer::questionEnd(size_t length)
 {
-  return ntohs(_dnsHeader->QDCount) == 1 &&
-         _dnsHeader->ANCount == 0 &&
-         _dnsHeader->NSCount == 0 &&
-         _dnsHeader->ARCount == 0;
+  DNSHeader* header = (DNSHeader*) _buffer;
+  if (ntohs(header->QDCount) != 1 || header->ANCount != 0 || header->NSCount != 0)
+    return 0;
+
+  // The QName is a list of labels, each a length byte followed by that many
+  // bytes, terminated by a zero length. Compression pointers never appear in
+  // a question.
+  size_t pos = DNS_HEADER_SIZE;
+  while (pos < length && _buffer[pos] != 0) {
+    if (_buffer[pos] > 63)
+      return 0;
+    pos += _buffer[pos] + 1;
+  }
+  if (pos - DNS_HEADER_SIZE >= DNS_MAX_NAME_SIZE || pos + 1 + 4 > length)
+    return 0;
+  return pos + 1 + 4;
 }
 
+// Compare the question name with the configured one, skipping a leading "www"
+// label and ignoring case
+bool DNSServer::questionMatches()
+{
+  const uint8_t* name = _buffer + DNS_HEADER_SIZE;
+  if (name[0] == 3 && strncasecmp((const char*) name + 1, "www", 3) == 0 && name[4] != 0)
+    name += 4;
+
+  for (size_t i = 0; i < _domainNameLength; i++) {
+    uint8_t c = name[i];
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    // label lengths never reach 'A', so folding them is harmless
+    if (c != _domainName[i])
+      return false;
+  }
+  return _domainNameLength > 0;
+}
 
-String DNSServer::getDomainNameWithoutWwwPrefix()
+// Dotted lower case form of the question name, for the zone lookup
+void DNSServer::questionName(char* name)
 {
-  // Error checking : if the buffer containing the DNS request is a null pointer, return an empty domain
-  String parsedDomainName = "";
-  if (_buffer == NULL) 
-    return parsedDomainName;
-  
-  // Set the start of the domain just after the header (12 bytes). If equal to null character, return an empty domain
-  unsigned char *start = _buffer + DNS_OFFSET_DOMAIN_NAME;
-  if (*start == 0)
-  {
-    return parsedDomainName;
+  const uint8_t* label = _buffer + DNS_HEADER_SIZE;
+  char* out = name;
+  while (*label) {
+    if (out != name)
+      *out++ = '.';
+    for (uint8_t i = 1; i <= *label; i++)
+      *out++ = tolower(label[i]);
+    label += *label + 1;
   }
+  *out = '\0';
+}
 
-  int pos = 0;
-  while(true)
-  {
-    unsigned char labelLength = *(start + pos);
-    for(int i = 0; i < labelLength; i++)
-    {
-      pos++;
-      parsedDomainName += (char)*(start + pos);
-    }
-    pos++;
-    if (*(start + pos) == 0)
-    {
-      downcaseAndRemoveWwwPrefix(parsedDomainName);
-      return parsedDomainName;
-    }
+// Index of the first record not ordered before (name, type)
+size_t DNSServer::findRecords(const char* name, uint16_t type)
+{
+  size_t low = 0, high = _zoneSize;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (compareRecord(_zone[middle], name, type) < 0)
+      low = middle + 1;
     else
-    {
-      parsedDomainName += ".";
-    }
+      high = middle;
   }
+  return low;
 }
 
-void DNSServer::replyWithIP()
+// Use DNS name compression : instead of repeating the name in this RNAME occurence,
+// set the two MSB of the byte corresponding normally to the length to 1. The following
+// 14 bits must be used to specify the offset of the domain name in the message 
+// (<255 here so the first byte has the 6 LSB at 0) 
+uint8_t* DNSServer::writeRecordHeader(uint8_t* p, uint16_t type, uint32_t ttl, uint16_t length)
 {
-  if (_buffer == NULL) return;
-  
-  _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-  
-  // Change the type of message to a response and set the number of answers equal to 
-  // the number of questions in the header
-  _dnsHeader->QR      = DNS_QR_RESPONSE;
-  _dnsHeader->ANCount = _dnsHeader->QDCount;
-  _udp.write( (unsigned char*) _dnsHeader, DNS_HEADER_SIZE ) ;
-
-  // Write the question
-  _udp.write(_dnsQuestion->QName, _dnsQuestion->QNameLength) ;
-  _udp.write( (unsigned char*) &_dnsQuestion->QType, 2 ) ;
-  _udp.write( (unsigned char*) &_dnsQuestion->QClass, 2 ) ;
+  uint16_t recordType = htons(type), recordClass = htons(DNS_CLASS_IN), recordLength = htons(length);
+  p[0] = 0xC0;
+  p[1] = DNS_OFFSET_DOMAIN_NAME;
+  memcpy(p + 2, &recordType, 2);
+  memcpy(p + 4, &recordClass, 2);
+  memcpy(p + 6, &ttl, 4);                   // DNS Time To Live, network order
+  memcpy(p + 10, &recordLength, 2);
+  return p + DNS_RECORD_HEADER_SIZE;
+}
 
-  // Write the answer 
-  // Use DNS name compression : instead of repeating the name in this RNAME occurence,
-  // set the two MSB of the byte corresponding normally to the length to 1. The following
-  // 14 bits must be used to specify the offset of the domain name in the message 
-  // (<255 here so the first byte has the 6 LSB at 0) 
-  _udp.write((uint8_t) 0xC0); 
-  _udp.write((uint8_t) DNS_OFFSET_DOMAIN_NAME);  
+void DNSServer::replyWithIP(size_t questionEnd)
+{
+  // Turn the query into the response in place: flags and counts in the header,
+  // the question stays and the answer goes right after it
+  DNSHeader* header = (DNSHeader*) _buffer;
+  header->QR      = DNS_QR_RESPONSE;
+  header->AA      = 1;
+  header->ANCount = header->QDCount;
+  header->ARCount = 0;
 
   // DNS type A : host address, DNS class IN for INternet, returning an IPv4 address 
-  uint16_t answerType = htons(DNS_TYPE_A), answerClass = htons(DNS_CLASS_IN), answerIPv4 = htons(DNS_RDLENGTH_IPV4)  ; 
-  _udp.write((unsigned char*) &answerType, 2 );
-  _udp.write((unsigned char*) &answerClass, 2 );
-  _udp.write((unsigned char*) &_ttl, 4);        // DNS Time To Live
-  _udp.write((unsigned char*) &answerIPv4, 2 );
-  _udp.write(_resolvedIP, sizeof(_resolvedIP)); // The IP address to return
-  _udp.endPacket();
+  uint8_t* answer = writeRecordHeader(_buffer + questionEnd, DNS_TYPE_A, _ttl, DNS_RDLENGTH_IPV4);
+  memcpy(answer, _resolvedIP, DNS_RDLENGTH_IPV4); // The IP address to return
+
+  sendReply(questionEnd + DNS_ANSWER_SIZE);
 }
 
-void DNSServer::replyWithCustomCode()
+void DNSServer::replyWithRecords(size_t questionEnd, size_t first, uint16_t type)
 {
-  if (_buffer == NULL) return;
-  _dnsHeader->QR = DNS_QR_RESPONSE;
-  _dnsHeader->RCode = (unsigned char)_errorReplyCode;
-  _dnsHeader->QDCount = 0;
+  DNSHeader* header = (DNSHeader*) _buffer;
+  header->QR = DNS_QR_RESPONSE;
+  header->AA = 1;
+  header->ARCount = 0;
 
-  _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
-  _udp.write(_buffer, sizeof(DNSHeader));
-  _udp.endPacket();
+  uint16_t length = type == DNS_TYPE_AAAA ? DNS_RDLENGTH_IPV6 : DNS_RDLENGTH_IPV4;
+  uint8_t* p = _buffer + questionEnd;
+  uint16_t answers = 0;
+  for (size_t i = first; i < _zoneSize && compareRecord(_zone[i], _zone[first].name, type) == 0; i++) {
+    if (p + DNS_RECORD_HEADER_SIZE + length > _buffer + sizeof(_buffer)) {
+      header->TC = 1;
+      break;
+    }
+    p = writeRecordHeader(p, type, htonl(_zone[i].ttl), length);
+    memcpy(p, _zone[i].address, length);
+    p += length;
+    answers++;
+  }
+  header->ANCount = htons(answers);
+
+  sendReply(p - _buffer);
+}
+
+// Negative answer with the SOA in the authority section. The SOA minimum, and
+// its own TTL, tell resolvers how long they may cache the miss (RFC 2308).
+void DNSServer::replyWithSOA(size_t questionEnd, DNSReplyCode replyCode)
+{
+  DNSHeader* header = (DNSHeader*) _buffer;
+  header->QR = DNS_QR_RESPONSE;
+  header->AA = 1;
+  header->RCode = (unsigned char) replyCode;
+  header->ANCount = 0;
+  header->NSCount = htons(1);
+  header->ARCount = 0;
+
+  // The server stands in for every name, so the zone is the root: owner, MNAME
+  // and RNAME are all the empty name
+  uint8_t* p = _buffer + questionEnd;
+  uint16_t soaType = htons(DNS_TYPE_SOA), soaClass = htons(DNS_CLASS_IN), soaLength = htons(DNS_SOA_SIZE - 11);
+  *p++ = 0;
+  memcpy(p, &soaType, 2);
+  memcpy(p + 2, &soaClass, 2);
+  memcpy(p + 4, &_negativeTTL, 4);
+  memcpy(p + 8, &soaLength, 2);
+  p += 10;
+  *p++ = 0;                                 // MNAME
+  *p++ = 0;                                 // RNAME
+  const uint32_t counters[5] = {
+    htonl(1),                               // serial
+    htonl(3600),                            // refresh
+    htonl(600),                             // retry
+    htonl(86400),                           // expire
+    _negativeTTL                            // minimum
+  };
+  memcpy(p, counters, sizeof(counters));
+
+  sendReply(questionEnd + DNS_SOA_SIZE);
+}
+
+void DNSServer::replyWithCustomCode(size_t questionEnd)
+{
+  if (questionEnd && _errorReplyCode == DNSReplyCode::NonExistentDomain) {
+    replyWithSOA(questionEnd, DNSReplyCode::NonExistentDomain);
+    return;
+  }
+
+  // Keep the question when there is a well formed one, clients match replies on it
+  DNSHeader* header = (DNSHeader*) _buffer;
+  header->QR = DNS_QR_RESPONSE;
+  header->RCode = (unsigned char)_errorReplyCode;
+  header->QDCount = questionEnd ? htons(1) : 0;
+  header->ANCount = 0;
+  header->NSCount = 0;
+  header->ARCount = 0;
+
+  sendReply(questionEnd ? questionEnd : DNS_HEADER_SIZE);
+}
+
+void DNSServer::sendReply(size_t length)
+{
+  struct sockaddr_in recipient;
+  memset(&recipient, 0, sizeof(recipient));
+  recipient.sin_family = AF_INET;
+  recipient.sin_addr.s_addr = _remoteAddress;
+  recipient.sin_port = _remotePort;
+  if (sendto(_socket, _buffer, length, 0, (struct sockaddr*) &recipient, sizeof(recipient)) < 0)
+    log_e("could not send data: %d", errno);
 }
@@ -1,13 +1,23 @@
 #ifndef DNSServer_h
 #define DNSServer_h
-#include <WiFiUdp.h>
+#include <Arduino.h>
 
 #define DNS_QR_QUERY 0
 #define DNS_QR_RESPONSE 1
 #define DNS_OPCODE_QUERY 0
 #define DNS_DEFAULT_TTL 60        // Default Time To Live : time interval in seconds that the resource record should be cached before being discarded
+#define DNS_DEFAULT_NEGATIVE_TTL 300 // How long resolvers may cache "no such name" and "no such record" answers
 #define DNS_OFFSET_DOMAIN_NAME 12 // Offset in bytes to reach the domain name in the DNS message 
 #define DNS_HEADER_SIZE 12 
+#define DNS_MAX_NAME_SIZE 255     // Longest domain name in label form, including the terminating zero
+#define DNS_ANSWER_SIZE 16        // Compressed name pointer, type, class, TTL, length and an IPv4 address
+#define DNS_RECORD_HEADER_SIZE 12 // Compressed name pointer, type, class, TTL and length
+#define DNS_SOA_SIZE 33           // Root owner, type, class, TTL, length, root MNAME and RNAME, five counters
+
+// Plain DNS over UDP is limited to 512 bytes, longer packets are truncated and dropped
+#ifndef DNS_MAX_PACKET_SIZE
+#define DNS_MAX_PACKET_SIZE 512
+#endif
 
 enum class DNSReplyCode
 {
@@ -39,9 +49,21 @@ enum DNSClass
 
 enum DNSRDLength
 {
-  DNS_RDLENGTH_IPV4 = 4 // 4 bytes for an IPv4 address 
+  DNS_RDLENGTH_IPV4 = 4, // 4 bytes for an IPv4 address 
+  DNS_RDLENGTH_IPV6 = 16 // 16 bytes for an IPv6 address
 } ; 
 
+// One entry of a static zone. Keep tables const so they stay in flash, and
+// sorted by name (lower case, no trailing dot, strcmp order) and then type;
+// several records of the same name and type are all returned.
+struct DNSRecord
+{
+  const char* name;
+  uint16_t    type;        // DNS_TYPE_A or DNS_TYPE_AAAA
+  uint32_t    ttl;         // seconds
+  uint8_t     address[16]; // the first 4 bytes for an A record
+};
+
 struct DNSHeader
 {
   uint16_t ID;               // identification number
@@ -64,21 +86,21 @@ struct DNSHeader
   uint16_t ARCount;          // number of resource entries
 };
 
-struct DNSQuestion
-{
-  uint8_t   QName[255] ;
-  int8_t    QNameLength ; 
-  uint16_t  QType ; 
-  uint16_t  QClass ; 
-} ; 
-
 class DNSServer
 {
   public:
     DNSServer();
-    void processNextRequest();
+    ~DNSServer();
+    // Returns true if a packet was consumed, so callers can drain a burst
+    bool processNextRequest();
     void setErrorReplyCode(const DNSReplyCode &replyCode);
     void setTTL(const uint32_t &ttl);
+    // TTL of the SOA sent with NXDOMAIN and empty answers, which bounds how
+    // long resolvers cache them
+    void setNegativeTTL(const uint32_t &ttl);
+    // Answer the names in records from the table, in addition to the domain
+    // passed to start(). The table is not copied and must be sorted.
+    bool setZone(const DNSRecord* records, size_t count);
 
     // Returns true if successful, false if there are no sockets available
     bool start(const uint16_t &port,
@@ -88,22 +110,32 @@ class DNSServer
     void stop();
 
   private:
-    WiFiUDP _udp;
+    int _socket;
     uint16_t _port;
-    String _domainName;
+    bool _wildcard;
+    uint8_t _domainName[DNS_MAX_NAME_SIZE];  // label encoded, lower case, no "www" label
+    size_t _domainNameLength;
     unsigned char _resolvedIP[4];
-    int _currentPacketSize;
-    unsigned char* _buffer;
-    DNSHeader* _dnsHeader;
     uint32_t _ttl;
+    uint32_t _negativeTTL;
+    const DNSRecord* _zone;
+    size_t _zoneSize;
     DNSReplyCode _errorReplyCode;
-    DNSQuestion*    _dnsQuestion ; 
-
+    uint32_t _remoteAddress;                // sender of the packet in _buffer, network order
+    uint16_t _remotePort;
+    // Queries are parsed and answered in place, nothing is allocated per packet
+    uint8_t _buffer[DNS_MAX_PACKET_SIZE] __attribute__((aligned(4)));
 
-    void downcaseAndRemoveWwwPrefix(String &domainName);
-    String getDomainNameWithoutWwwPrefix();
-    bool requestIncludesOnlyOneQuestion();
-    void replyWithIP();
-    void replyWithCustomCode();
+    size_t encodeDomainName(const String &domainName);
+    size_t questionEnd(size_t length);
+    bool questionMatches();
+    void questionName(char* name);
+    size_t findRecords(const char* name, uint16_t type);
+    void replyWithIP(size_t questionEnd);
+    void replyWithRecords(size_t questionEnd, size_t first, uint16_t type);
+    void replyWithSOA(size_t questionEnd, DNSReplyCode replyCode);
+    void replyWithCustomCode(size_t questionEnd);
+    uint8_t* writeRecordHeader(uint8_t* p, uint16_t type, uint32_t ttl, uint16_t length);
+    void sendReply(size_t length);
 };
 #endif
\ No newline at end of file
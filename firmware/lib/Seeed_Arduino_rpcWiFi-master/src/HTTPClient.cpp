@@ -57,6 +57,10 @@ public:
     {
         return true;
     }
+
+    virtual void setPins(const WiFiClientSecurePin* pins, size_t count)
+    {
+    }
 };
 
 class TLSTraits : public TransportTraits
@@ -78,16 +82,67 @@ public:
          wcs.setCACert(_cacert);
          wcs.setCertificate(_clicert);
          wcs.setPrivateKey(_clikey);
+         wcs.setPins(_pins, _pinCount);
          return true;
     }
 
+    void setPins(const WiFiClientSecurePin* pins, size_t count) override
+    {
+        _pins = pins;
+        _pinCount = count;
+    }
+
 protected:
     const char* _cacert;
     const char* _clicert;
     const char* _clikey;
+    const WiFiClientSecurePin* _pins = nullptr;
+    size_t _pinCount = 0;
 };
 #endif // HTTPCLIENT_1_1_COMPATIBLE
 
+// Lets writeToStream() hand the body to an onBody() callback as it comes in
+class BodyCallbackStream : public Stream
+{
+public:
+    BodyCallbackStream(HTTPClient::BodyCallback& callback) : _callback(callback)
+    {
+    }
+
+    size_t write(const uint8_t * data, size_t length) override
+    {
+        _callback(data, length);
+        return length;
+    }
+
+    size_t write(uint8_t c) override
+    {
+        return write(&c, 1);
+    }
+
+    int available() override
+    {
+        return 0;
+    }
+
+    int read() override
+    {
+        return -1;
+    }
+
+    int peek() override
+    {
+        return -1;
+    }
+
+    void flush() override
+    {
+    }
+
+protected:
+    HTTPClient::BodyCallback& _callback;
+};
+
 /**
  * constructor
  */
@@ -112,6 +167,8 @@ void HTTPClient::clear()
 {
     _returnCode = 0;
     _size = -1;
+    _retryAfter = 0;
+    _bodyDelivered = false;
     _headers = "";
 }
 
@@ -408,6 +465,18 @@ void HTTPClient::setReuse(bool reuse)
     _reuse = reuse;
 }
 
+/**
+ * check the certificate of the listed hosts by fingerprint instead of the CA chain,
+ * the CA stays the fallback when none matches
+ * @param pins const WiFiClientSecurePin *, must outlive the client
+ * @param count size_t
+ */
+void HTTPClient::setPins(const WiFiClientSecurePin * pins, size_t count)
+{
+    _pins = pins;
+    _pinCount = count;
+}
+
 /**
  * set User Agent
  * @param userAgent const char *
@@ -444,7 +513,8 @@ void HTTPClient::setAuthorization(const char * auth)
 }
 
 /**
- * set the timeout (ms) for establishing a connection to the server
+ * set the timeout (ms) for establishing a connection to the server,
+ * covering name lookup, TCP connect and TLS handshake together
  * @param connectTimeout int32_t
  */
 void HTTPClient::setConnectTimeout(int32_t connectTimeout)
@@ -453,7 +523,7 @@ void HTTPClient::setConnectTimeout(int32_t connectTimeout)
 }
 
 /**
- * set the timeout for the TCP connection
+ * set the timeout (ms) for the server's answer and each read of the body
  * @param timeout unsigned int
  */
 void HTTPClient::setTimeout(uint16_t timeout)
@@ -464,6 +534,29 @@ void HTTPClient::setTimeout(uint16_t timeout)
     }
 }
 
+/**
+ * retry failed requests, adapt the timeouts and stop calling a backend that is down,
+ * see HTTPRetryPolicy. A Stream body can't be sent twice, so
+ * sendRequest(type, stream) still goes out once and outside the policy.
+ * @param policy HTTPRetryPolicy *, must outlive the client
+ */
+void HTTPClient::setRetryPolicy(HTTPRetryPolicy * policy)
+{
+    _retryPolicy = policy;
+}
+
+/**
+ * take the body of 2xx responses as it arrives, identity or de-chunked, in slices of
+ * up to HTTP_TCP_BUFFER_SIZE bytes and mostly straight from the client's buffer, so
+ * a body of any size is handled in constant memory. The request returns once the
+ * whole body went through, other responses stay for getString() and friends.
+ * @param callback BodyCallback
+ */
+void HTTPClient::onBody(BodyCallback callback)
+{
+    _bodyCallback = callback;
+}
+
 /**
  * use HTTP1.0
  * @param use
@@ -548,6 +641,87 @@ int HTTPClient::sendRequest(const char * type, String payload)
  * @return -1 if no info or > 0 when Content-Length is set by server
  */
 int HTTPClient::sendRequest(const char * type, uint8_t * payload, size_t size)
+{
+    if(!_retryPolicy) {
+        return handleBody(type, sendRequestOnce(type, payload, size));
+    }
+
+    HTTPRetryPolicy& policy = *_retryPolicy;
+    if(!policy.allow()) {
+        return returnError(HTTPC_ERROR_CIRCUIT_OPEN);
+    }
+
+    // the response clears the headers, every attempt needs them again
+    String headers = _headers;
+    if((!strcmp(type, "POST") || !strcmp(type, "PATCH")) && _headers.indexOf(HTTPCLIENT_IDEMPOTENCY_HEADER ": ") < 0) {
+        addHeader(F(HTTPCLIENT_IDEMPOTENCY_HEADER), idempotencyKey());
+    }
+    String request = _headers;
+    int32_t connectTimeout = _connectTimeout;
+    uint16_t tcpTimeout = _tcpTimeout;
+
+    int code;
+    for(uint8_t attempt = 0;; attempt++) {
+        _headers = request;
+        _connectTimeout = policy.connectTimeout(connectTimeout);
+        uint32_t responseTimeout = policy.responseTimeout(tcpTimeout);
+        _tcpTimeout = responseTimeout > 0xFFFF ? 0xFFFF : responseTimeout;
+
+        code = sendRequestOnce(type, payload, size);
+
+        // a failed connect returns nothing else
+        if(code == HTTPC_ERROR_CONNECTION_REFUSED) {
+            if(_connectTime >= (uint32_t) _connectTimeout) {
+                policy._connect.expired();
+            }
+        } else if(_connectTime) {
+            policy._connect.sample(_connectTime);
+        }
+        if(code > 0) {
+            policy._response.sample(_responseTime);
+        } else if(code == HTTPC_ERROR_READ_TIMEOUT) {
+            policy._response.expired();
+        }
+
+        if(!HTTPRetryPolicy::retryable(code)) {
+            policy.succeeded();
+            break;
+        }
+        policy.failed();
+        if(attempt + 1 >= policy.attempts()) {
+            break;
+        }
+
+        uint32_t wait = _retryAfter ? _retryAfter : policy.backoff(attempt);
+        if(wait > policy._backoffMax) {
+            log_d("server asks to wait %lu ms, not retrying", (unsigned long) wait);
+            break;
+        }
+        // start over on a fresh connection, the answer may still be coming in
+        if(connected()) {
+            _client->stop();
+        }
+        log_d("retry %u of %s in %lu ms", attempt + 1, type, (unsigned long) wait);
+        delay(wait);
+        if(!policy.allow()) {
+            break;
+        }
+    }
+
+    _connectTimeout = connectTimeout;
+    _tcpTimeout = tcpTimeout;
+    // no response cleared them, keep the caller's but not the key for this request
+    if(_headers.length()) {
+        _headers = headers;
+    }
+    return handleBody(type, code);
+}
+
+/**
+ * one request and the redirects it leads to
+ * @return http code or error
+ */
+int HTTPClient::sendRequestOnce(const char * type, uint8_t * payload, size_t size)
 {
     int code;
     bool redirect = false;
@@ -571,6 +745,10 @@ int HTTPClient::sendRequest(const char * type, uint8_t * payload, size_t size)
             addHeader(F("Content-Length"), String(size));
         }
 
+        // hold the header back so a small body goes out in the same segment
+        // instead of waiting behind Nagle for the header's ACK
+        _client->setCork(true);
+
         // send Header
         if(!sendHeader(type)) {
             return returnError(HTTPC_ERROR_SEND_HEADER_FAILED);
@@ -586,8 +764,11 @@ int HTTPClient::sendRequest(const char * type, uint8_t * payload, size_t size)
                 }
             }
         }
+        _client->setCork(false);
 
+        unsigned long sent = millis();
         code = handleHeaderResponse();
+        _responseTime = millis() - sent;
         log_d("sendRequest code=%d\n", code);
 
         // Handle redirections as stated in RFC document:
@@ -791,7 +972,7 @@ int HTTPClient::sendRequest(const char * type, Stream * stream, size_t size)
     }
 
     // handle Server Response (Header)
-    return returnError(handleHeaderResponse());
+    return handleBody(type, returnError(handleHeaderResponse()));
 }
 
 /**
@@ -844,6 +1025,11 @@ int HTTPClient::writeToStream(Stream * stream)
         return returnError(HTTPC_ERROR_NO_STREAM);
     }
 
+    // onBody() has had it
+    if(_bodyDelivered) {
+        return 0;
+    }
+
     if(!connected()) {
         return returnError(HTTPC_ERROR_NOT_CONNECTED);
     }
@@ -925,7 +1111,7 @@ int HTTPClient::writeToStream(Stream * stream)
 StreamString HTTPClient::getString(void)
 {
     // _size can be -1 when Server sends no Content-Length header
-    if(_size > 0 || _size == -1) {
+    if(!_bodyDelivered && (_size > 0 || _size == -1)) {
         StreamString sstring;
         // try to reserve needed memory (noop if _size == -1)
         // Serial.printf("%d\n", (_size));
@@ -970,6 +1156,8 @@ String HTTPClient::errorToString(int error)
         return F("Stream write error");
     case HTTPC_ERROR_READ_TIMEOUT:
         return F("read Timeout");
+    case HTTPC_ERROR_CIRCUIT_OPEN:
+        return F("circuit open");
     default:
         return String();
     }
@@ -1069,6 +1257,7 @@ bool HTTPClient::hasHeader(const char* name)
  */
 bool HTTPClient::connect(void)
 {
+    _connectTime = 0;
     if(connected()) {
         if(_reuse) {
             log_d("already connected, reusing connection");
@@ -1097,13 +1286,19 @@ bool HTTPClient::connect(void)
         return false;
     }
 #ifdef HTTPCLIENT_1_1_COMPATIBLE
+    if (_tcpDeprecated) {
+        _transportTraits->setPins(_pins, _pinCount);
+    }
     if (_tcpDeprecated && !_transportTraits->verify(*_client, _host.c_str())) {
         log_d("transport level verify failed");
         _client->stop();
         return false;
     }	
 #endif
-    if(!_client->connect(_host.c_str(), _port, _connectTimeout)) {
+    unsigned long start = millis();
+    bool ok = _client->connect(_host.c_str(), _port, _connectTimeout);
+    _connectTime = millis() - start;
+    if(!ok) {
         log_d("failed connect to %s:%u ", _host.c_str(), _port);
         return false;
     }
@@ -1173,6 +1368,109 @@ bool HTTPClient::sendHeader(const char * type)
     return (_client->write((const uint8_t *) header.c_str(), header.length()) == header.length());
 }
 
+static bool spanEquals(const char * data, size_t length, const char * str)
+{
+    return strlen(str) == length && strncasecmp(data, str, length) == 0;
+}
+
+static int spanToInt(const char * data, size_t length)
+{
+    int value = 0;
+    for(size_t i = 0; i < length && isdigit((unsigned char) data[i]); i++) {
+        value = value * 10 + (data[i] - '0');
+    }
+    return value;
+}
+
+static String spanToString(const char * data, size_t length)
+{
+    String str;
+    if(str.reserve(length)) {
+        while(length--) {
+            str += *data++;
+        }
+    }
+    return str;
+}
+
+/**
+ * parse one status or header line where it lies
+ * @param line const char *, not terminated
+ * @param length size_t
+ * @param firstLine bool &
+ * @param transferEncoding String &
+ * @return true on the empty line that ends the header
+ */
+bool HTTPClient::parseHeaderLine(const char * line, size_t length, bool & firstLine, String & transferEncoding)
+{
+    // trim, which also drops the \r
+    while(length && isspace((unsigned char) line[length - 1])) {
+        length--;
+    }
+    while(length && isspace((unsigned char) *line)) {
+        line++;
+        length--;
+    }
+
+    log_v("RX: '%.*s'", (int) length, line);
+
+    if(firstLine) {
+        firstLine = false;
+        if(_canReuse && length > sizeof "HTTP/1." - 1 && strncmp(line, "HTTP/1.", sizeof "HTTP/1." - 1) == 0) {
+            _canReuse = (line[sizeof "HTTP/1." - 1] != '0');
+        }
+        const char * code = (const char *) memchr(line, ' ', length);
+        if(code) {
+            code++;
+            _returnCode = spanToInt(code, line + length - code);
+        }
+    } else if(length) {
+        const char * colon = (const char *) memchr(line, ':', length);
+        if(colon) {
+            size_t nameLength = colon - line;
+            const char * value = colon + 1;
+            size_t valueLength = line + length - value;
+            while(valueLength && isspace((unsigned char) *value)) {
+                value++;
+                valueLength--;
+            }
+
+            if(spanEquals(line, nameLength, "Content-Length")) {
+                _size = spanToInt(value, valueLength);
+            }
+
+            if(_canReuse && spanEquals(line, nameLength, "Connection")) {
+                String headerValue = spanToString(value, valueLength);
+                if(headerValue.indexOf("close") >= 0 && headerValue.indexOf("keep-alive") < 0) {
+                    _canReuse = false;
+                }
+            }
+
+            if(spanEquals(line, nameLength, "Transfer-Encoding")) {
+                transferEncoding = spanToString(value, valueLength);
+            }
+
+            if(spanEquals(line, nameLength, "Location")) {
+                _location = spanToString(value, valueLength);
+            }
+
+            // only the delay in seconds, not the HTTP-date form
+            if(spanEquals(line, nameLength, "Retry-After")) {
+                _retryAfter = spanToInt(value, valueLength) * 1000UL;
+            }
+
+            for(size_t i = 0; i < _headerKeysCount; i++) {
+                if(spanEquals(line, nameLength, _currentHeaders[i].key.c_str())) {
+                    _currentHeaders[i].value = spanToString(value, valueLength);
+                    break;
+                }
+            }
+        }
+    }
+
+    return length == 0;
+}
+
 /**
  * reads the response from the server
  * @return int http code
@@ -1189,90 +1487,84 @@ int HTTPClient::handleHeaderResponse()
     _canReuse = _reuse;
 
     String transferEncoding;
+    String partial; // start of a line cut off by the end of the buffered data
 
     _transferEncoding = HTTPC_TE_IDENTITY;
     unsigned long lastDataTime = millis();
     bool firstLine = true;
 
     while(connected()) {
-        size_t len = _client->available();
-        if(len > 0) {
-            String headerLine = _client->readStringUntil('\n');
-            headerLine.trim(); // remove \r
-
-            lastDataTime = millis();
-
-            log_v("RX: '%s'", headerLine.c_str());
-
-            if(firstLine) {
-		firstLine = false;
-                if(_canReuse && headerLine.startsWith("HTTP/1.")) {
-                    _canReuse = (headerLine[sizeof "HTTP/1." - 1] != '0');
-                }
-                int codePos = headerLine.indexOf(' ') + 1;
-                _returnCode = headerLine.substring(codePos, headerLine.indexOf(' ', codePos)).toInt();
-            } else if(headerLine.indexOf(':')) {
-                String headerName = headerLine.substring(0, headerLine.indexOf(':'));
-                String headerValue = headerLine.substring(headerLine.indexOf(':') + 1);
-                headerValue.trim();
-
-                if(headerName.equalsIgnoreCase("Content-Length")) {
-                    _size = headerValue.toInt();
-                }
-
-                if(_canReuse && headerName.equalsIgnoreCase("Connection")) {
-                    if(headerValue.indexOf("close") >= 0 && headerValue.indexOf("keep-alive") < 0) {
-                        _canReuse = false;
-                    }
-                }
-
-                if(headerName.equalsIgnoreCase("Transfer-Encoding")) {
-                    transferEncoding = headerValue;
-                }
-
-                if (headerName.equalsIgnoreCase("Location")) {
-                    _location = headerValue;
-                }
+        if(!_client->peekAvailable() && _client->available() <= 0) {
+            if((millis() - lastDataTime) > _tcpTimeout) {
+                return HTTPC_ERROR_READ_TIMEOUT;
+            }
+            delay(10);
+            continue;
+        }
+        lastDataTime = millis();
+
+        // lines are parsed in the client's buffer, only one that runs past
+        // its end is put together in partial
+        size_t len = _client->peekAvailable();
+        const char * data = (const char *) _client->peekBuffer();
+        bool borrowed = len > 0;
+        char c;
+        if(!borrowed) {
+            // a client without a buffer to lend
+            int res = _client->read();
+            if(res < 0) {
+                continue;
+            }
+            c = res;
+            data = &c;
+            len = 1;
+        }
 
-                for(size_t i = 0; i < _headerKeysCount; i++) {
-                    if(_currentHeaders[i].key.equalsIgnoreCase(headerName)) {
-                        _currentHeaders[i].value = headerValue;
-                        break;
-                    }
-                }
+        const char * eol = (const char *) memchr(data, '\n', len);
+        size_t used = eol ? eol - data + 1 : len;
+        const char * line = data;
+        size_t lineLength = eol ? eol - data : len;
+        if(!eol || partial.length()) {
+            partial.reserve(partial.length() + lineLength);
+            for(size_t i = 0; i < lineLength; i++) {
+                partial += data[i];
             }
+            line = partial.c_str();
+            lineLength = partial.length();
+        }
 
-            if(headerLine == "") {
-                log_d("code: %d", _returnCode);
+        bool headerEnd = eol && parseHeaderLine(line, lineLength, firstLine, transferEncoding);
+        if(borrowed) {
+            _client->consume(used);
+        }
+        if(eol) {
+            partial = "";
+        }
 
-                if(_size > 0) {
-                    log_d("size: %d", _size);
-                }
+        if(headerEnd) {
+            log_d("code: %d", _returnCode);
 
-                if(transferEncoding.length() > 0) {
-                    log_d("Transfer-Encoding: %s", transferEncoding.c_str());
-                    if(transferEncoding.equalsIgnoreCase("chunked")) {
-                        _transferEncoding = HTTPC_TE_CHUNKED;
-                    } else {
-                        return HTTPC_ERROR_ENCODING;
-                    }
-                } else {
-                    _transferEncoding = HTTPC_TE_IDENTITY;
-                }
+            if(_size > 0) {
+                log_d("size: %d", _size);
+            }
 
-                if(_returnCode) {
-                    return _returnCode;
+            if(transferEncoding.length() > 0) {
+                log_d("Transfer-Encoding: %s", transferEncoding.c_str());
+                if(transferEncoding.equalsIgnoreCase("chunked")) {
+                    _transferEncoding = HTTPC_TE_CHUNKED;
                 } else {
-                    log_d("Remote host is not an HTTP Server!");
-                    return HTTPC_ERROR_NO_HTTP_SERVER;
+                    return HTTPC_ERROR_ENCODING;
                 }
+            } else {
+                _transferEncoding = HTTPC_TE_IDENTITY;
             }
 
-        } else {
-            if((millis() - lastDataTime) > _tcpTimeout) {
-                return HTTPC_ERROR_READ_TIMEOUT;
+            if(_returnCode) {
+                return _returnCode;
+            } else {
+                log_d("Remote host is not an HTTP Server!");
+                return HTTPC_ERROR_NO_HTTP_SERVER;
             }
-            delay(10);
         }
     }
 
@@ -1296,105 +1588,136 @@ int HTTPClient::writeToStreamDataBlock(Stream * stream, int size)
         buff_size = len;
     }
 
-    // create buffer for read
-    uint8_t * buff = (uint8_t *) malloc(buff_size);
-
-    if(buff) {
-        // read all data from server
-        while(connected() && (len > 0 || len == -1)) {
+    // only allocated once something has to be read, a small body tends to
+    // arrive together with the header
+    uint8_t * buff = nullptr;
 
-            // get available data size
-            size_t sizeAvailable = _client->available();
+    // read all data from server
+    while(connected() && (len > 0 || len == -1)) {
 
-            if(sizeAvailable) {
+        // what the client holds already is written out where it lies; beyond
+        // that ask for a whole buffer rather than checking available() first,
+        // which would cost a receive of its own, and reads larger than the
+        // client's buffer go straight from the socket into buff
+        const uint8_t * data = _client->peekBuffer();
+        int readBytes = _client->peekAvailable();
+        bool borrowed = readBytes > 0;
+        if(!borrowed) {
+            readBytes = buff_size;
+        }
 
-                int readBytes = sizeAvailable;
+        // read only the asked bytes
+        if(len > 0 && readBytes > len) {
+            readBytes = len;
+        }
 
-                // read only the asked bytes
-                if(len > 0 && readBytes > len) {
-                    readBytes = len;
-                }
+        // and no more than a segment at a time
+        if(readBytes > buff_size) {
+            readBytes = buff_size;
+        }
 
-                // not read more the buffer can handle
-                if(readBytes > buff_size) {
-                    readBytes = buff_size;
+        if(!borrowed) {
+            if(!buff) {
+                buff = (uint8_t *) malloc(buff_size);
+                if(!buff) {
+                    log_w("too less ram! need %d", buff_size);
+                    return HTTPC_ERROR_TOO_LESS_RAM;
                 }
-		    
-		// stop if no more reading    
-		if (readBytes == 0)
-			break;
+            }
 
-                // read data
-                int bytesRead = _client->readBytes(buff, readBytes);
+            // read data, nothing has arrived yet if it comes back empty
+            int bytesRead = _client->read(buff, readBytes);
+            if(bytesRead <= 0) {
+                delay(1);
+                continue;
+            }
+            readBytes = bytesRead;
+            data = buff;
+        }
 
-                // write it to Stream
-                int bytesWrite = stream->write(buff, bytesRead);
-                bytesWritten += bytesWrite;
+        // write it to Stream
+        int bytesWrite = stream->write(data, readBytes);
+        bytesWritten += bytesWrite;
 
-                // are all Bytes a writen to stream ?
-                if(bytesWrite != bytesRead) {
-                    log_d("short write asked for %d but got %d retry...", bytesRead, bytesWrite);
+        // are all Bytes a writen to stream ?
+        if(bytesWrite != readBytes) {
+            log_d("short write asked for %d but got %d retry...", readBytes, bytesWrite);
 
-                    // check for write error
-                    if(stream->getWriteError()) {
-                        log_d("stream write error %d", stream->getWriteError());
+            // check for write error
+            if(stream->getWriteError()) {
+                log_d("stream write error %d", stream->getWriteError());
 
-                        //reset write error for retry
-                        stream->clearWriteError();
-                    }
+                //reset write error for retry
+                stream->clearWriteError();
+            }
 
-                    // some time for the stream
-                    delay(1);
+            // some time for the stream
+            delay(1);
 
-                    int leftBytes = (readBytes - bytesWrite);
+            int leftBytes = (readBytes - bytesWrite);
 
-                    // retry to send the missed bytes
-                    bytesWrite = stream->write((buff + bytesWrite), leftBytes);
-                    bytesWritten += bytesWrite;
+            // retry to send the missed bytes
+            bytesWrite = stream->write((data + bytesWrite), leftBytes);
+            bytesWritten += bytesWrite;
 
-                    if(bytesWrite != leftBytes) {
-                        // failed again
-                        log_w("short write asked for %d but got %d failed.", leftBytes, bytesWrite);
-                        free(buff);
-                        return HTTPC_ERROR_STREAM_WRITE;
-                    }
-                }
+            if(bytesWrite != leftBytes) {
+                // failed again
+                log_w("short write asked for %d but got %d failed.", leftBytes, bytesWrite);
+                free(buff);
+                return HTTPC_ERROR_STREAM_WRITE;
+            }
+        }
 
-                // check for write error
-                if(stream->getWriteError()) {
-                    log_w("stream write error %d", stream->getWriteError());
-                    free(buff);
-                    return HTTPC_ERROR_STREAM_WRITE;
-                }
+        if(borrowed) {
+            _client->consume(readBytes);
+        }
 
-                // count bytes to read left
-                if(len > 0) {
-                    len -= readBytes;
-                }
+        // check for write error
+        if(stream->getWriteError()) {
+            log_w("stream write error %d", stream->getWriteError());
+            free(buff);
+            return HTTPC_ERROR_STREAM_WRITE;
+        }
 
-                delay(0);
-            } else {
-                delay(1);
-            }
+        // count bytes to read left
+        if(len > 0) {
+            len -= readBytes;
         }
 
-        free(buff);
+        delay(0);
+    }
 
-        log_d("connection closed or file end (written: %d).", bytesWritten);
+    free(buff);
 
-        if((size > 0) && (size != bytesWritten)) {
-            log_d("bytesWritten %d and size %d mismatch!.", bytesWritten, size);
-            return HTTPC_ERROR_STREAM_WRITE;
-        }
+    log_d("connection closed or file end (written: %d).", bytesWritten);
 
-    } else {
-        log_w("too less ram! need %d", HTTP_TCP_BUFFER_SIZE);
-        return HTTPC_ERROR_TOO_LESS_RAM;
+    if((size > 0) && (size != bytesWritten)) {
+        log_d("bytesWritten %d and size %d mismatch!.", bytesWritten, size);
+        return HTTPC_ERROR_STREAM_WRITE;
     }
 
     return bytesWritten;
 }
 
+/**
+ * push the body of a successful response to the onBody() callback
+ * @param type const char *
+ * @param code int
+ * @return code, or the error that cut the body short
+ */
+int HTTPClient::handleBody(const char * type, int code)
+{
+    if(!_bodyCallback || code < HTTP_CODE_OK || code >= HTTP_CODE_MULTIPLE_CHOICES ||
+       code == HTTP_CODE_NO_CONTENT || !strcmp(type, "HEAD")) {
+        return code;
+    }
+
+    BodyCallbackStream sink(_bodyCallback);
+    int ret = writeToStream(&sink);
+    _bodyDelivered = true;
+    return ret < 0 ? ret : code;
+}
+
 /**
  * called to handle error return, may disconnect the connection if still exists
  * @param error
@@ -1460,3 +1783,193 @@ const String &HTTPClient::getLocation(void)
 {
     return _location;
 }
+
+// xorshift stirred with the clock, seeded from the MAC so devices don't share
+// a sequence. Unique rather than secret: random() is never seeded, so every
+// board would otherwise draw the same keys and the same retry jitter.
+static uint32_t deviceRandom()
+{
+    static uint32_t state = 0;
+    if(!state) {
+        uint8_t mac[6];
+        WiFi.macAddress(mac);
+        state = ((uint32_t) mac[2] << 24) | ((uint32_t) mac[3] << 16) | ((uint32_t) mac[4] << 8) | mac[5];
+    }
+    state ^= micros();
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    if(!state) {
+        state = 1;
+    }
+    return state;
+}
+
+/**
+ * a key to tell the server that requests carrying it are one and the same, made
+ * to be unique rather than secret
+ * @return String
+ */
+String HTTPClient::idempotencyKey()
+{
+    char key[33];
+    for(size_t i = 0; i < 4; i++) {
+        snprintf(key + i * 8, 9, "%08lx", (unsigned long) deviceRandom());
+    }
+    return String(key);
+}
+
+HTTPRetryPolicy::HTTPRetryPolicy(uint8_t attempts)
+{
+    setAttempts(attempts);
+}
+
+void HTTPRetryPolicy::setAttempts(uint8_t attempts)
+{
+    _attempts = attempts ? attempts : 1;
+}
+
+void HTTPRetryPolicy::setBackoff(uint32_t backoff_ms, uint32_t backoffMax_ms)
+{
+    _backoff = backoff_ms;
+    _backoffMax = backoffMax_ms;
+}
+
+void HTTPRetryPolicy::setTimeoutBounds(uint32_t min_ms, uint32_t max_ms)
+{
+    _minTimeout = min_ms;
+    _maxTimeout = max_ms;
+}
+
+void HTTPRetryPolicy::setBreaker(uint8_t failures, uint32_t cooldown_ms)
+{
+    _breakerFailures = failures;
+    _cooldown = cooldown_ms;
+}
+
+/**
+ * forget the measured times and close the circuit
+ */
+void HTTPRetryPolicy::reset()
+{
+    _connect = Estimate();
+    _response = Estimate();
+    _circuit = CIRCUIT_CLOSED;
+    _failures = 0;
+}
+
+/**
+ * whether an attempt that ended with code is worth repeating
+ * @param code int
+ * @return bool
+ */
+bool HTTPRetryPolicy::retryable(int code)
+{
+    switch(code) {
+    case HTTPC_ERROR_CONNECTION_REFUSED:
+    case HTTPC_ERROR_SEND_HEADER_FAILED:
+    case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+    case HTTPC_ERROR_NOT_CONNECTED:
+    case HTTPC_ERROR_CONNECTION_LOST:
+    case HTTPC_ERROR_READ_TIMEOUT:
+    case HTTP_CODE_REQUEST_TIMEOUT:
+    case HTTP_CODE_TOO_MANY_REQUESTS:
+    case HTTP_CODE_INTERNAL_SERVER_ERROR:
+    case HTTP_CODE_BAD_GATEWAY:
+    case HTTP_CODE_SERVICE_UNAVAILABLE:
+    case HTTP_CODE_GATEWAY_TIMEOUT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * whether a request may go out, the first one after the cooldown is let through
+ * as the trial and another only if it has not reported back a cooldown later
+ * @return bool
+ */
+bool HTTPRetryPolicy::allow()
+{
+    if(_circuit == CIRCUIT_CLOSED) {
+        return true;
+    }
+    if(millis() - _openedAt < _cooldown) {
+        return false;
+    }
+    _circuit = CIRCUIT_HALF_OPEN;
+    _openedAt = millis();
+    return true;
+}
+
+void HTTPRetryPolicy::succeeded()
+{
+    if(_circuit != CIRCUIT_CLOSED) {
+        log_i("circuit closed");
+    }
+    _circuit = CIRCUIT_CLOSED;
+    _failures = 0;
+}
+
+void HTTPRetryPolicy::failed()
+{
+    if(_failures < 0xFF) {
+        _failures++;
+    }
+    if(_circuit == CIRCUIT_HALF_OPEN || (_circuit == CIRCUIT_CLOSED && _breakerFailures && _failures >= _breakerFailures)) {
+        log_w("circuit open for %lu ms after %u failures", (unsigned long) _cooldown, _failures);
+        _circuit = CIRCUIT_OPEN;
+        _openedAt = millis();
+    }
+}
+
+/**
+ * the wait before a retry: "full jitter", anything up to the backoff for this
+ * retry, so clients that failed together don't come back together
+ * @param retry uint8_t, 0 for the first
+ * @return ms
+ */
+uint32_t HTTPRetryPolicy::backoff(uint8_t retry) const
+{
+    uint32_t cap = _backoffMax;
+    if(retry < 16 && (_backoff << retry) < cap) {
+        cap = _backoff << retry;
+    }
+    return cap == UINT32_MAX ? deviceRandom() : deviceRandom() % (cap + 1);
+}
+
+void HTTPRetryPolicy::Estimate::sample(uint32_t ms)
+{
+    if(!sampled) {
+        srtt = ms << 3;
+        rttvar = ms << 1;
+        sampled = true;
+    } else {
+        int32_t err = (int32_t) ms - (int32_t) (srtt >> 3);
+        srtt += err;
+        if(err < 0) {
+            err = -err;
+        }
+        err -= rttvar >> 2;
+        rttvar += err;
+    }
+    backoff = 0;
+}
+
+void HTTPRetryPolicy::Estimate::expired()
+{
+    if(backoff < 4) {
+        backoff++;
+    }
+}
+
+uint32_t HTTPRetryPolicy::Estimate::timeout(uint32_t initial, uint32_t min, uint32_t max) const
+{
+    if(!sampled) {
+        uint32_t t = initial << backoff;
+        uint32_t cap = max > initial ? max : initial;
+        return t > cap ? cap : t;
+    }
+    uint32_t t = ((srtt >> 3) + rttvar) << backoff;
+    return t < min ? min : t > max ? max : t;
+}
@@ -30,6 +30,7 @@
 #define HTTPCLIENT_1_1_COMPATIBLE
 
 #include <memory>
+#include <functional>
 #include <Arduino.h>
 #include <rpcWiFi.h>
 #include <WiFiClient.h>
@@ -50,6 +51,33 @@
 #define HTTPC_ERROR_ENCODING            (-9)
 #define HTTPC_ERROR_STREAM_WRITE        (-10)
 #define HTTPC_ERROR_READ_TIMEOUT        (-11)
+#define HTTPC_ERROR_CIRCUIT_OPEN        (-12)
+
+/// retry policy defaults, see HTTPRetryPolicy
+#ifndef HTTPCLIENT_RETRY_ATTEMPTS
+#define HTTPCLIENT_RETRY_ATTEMPTS (3)
+#endif
+#ifndef HTTPCLIENT_RETRY_BACKOFF
+#define HTTPCLIENT_RETRY_BACKOFF (250)          // ms before the first retry, doubled for each one after
+#endif
+#ifndef HTTPCLIENT_RETRY_BACKOFF_MAX
+#define HTTPCLIENT_RETRY_BACKOFF_MAX (4000)
+#endif
+#ifndef HTTPCLIENT_RETRY_TIMEOUT_MIN
+#define HTTPCLIENT_RETRY_TIMEOUT_MIN (1000)     // bounds of the estimated timeouts
+#endif
+#ifndef HTTPCLIENT_RETRY_TIMEOUT_MAX
+#define HTTPCLIENT_RETRY_TIMEOUT_MAX (30000)
+#endif
+#ifndef HTTPCLIENT_BREAKER_FAILURES
+#define HTTPCLIENT_BREAKER_FAILURES (5)         // failed attempts in a row that open the circuit
+#endif
+#ifndef HTTPCLIENT_BREAKER_COOLDOWN
+#define HTTPCLIENT_BREAKER_COOLDOWN (30000)     // ms the circuit stays open before a trial request
+#endif
+#ifndef HTTPCLIENT_IDEMPOTENCY_HEADER
+#define HTTPCLIENT_IDEMPOTENCY_HEADER "Idempotency-Key"
+#endif
 
 /// size for the stream handling
 #define HTTP_TCP_BUFFER_SIZE (1460)
@@ -139,6 +167,78 @@ typedef enum {
 } followRedirects_t;
 
 
+/**
+ * How a request is retried, shared by every HTTPClient talking to the same backend
+ * so what one learns about it the next one uses.
+ * + timeouts follow the measured connect and response times (Jacobson/Karels:
+ *      SRTT + 4 * RTTVAR), the configured ones only serve until the first sample.
+ *      An attempt that times out doubles its timeout until the next sample.
+ * + failed attempts are retried after a random wait of up to the backoff, which
+ *      doubles per retry up to its cap, or after the server's Retry-After.
+ *      Only transport errors, 408, 429, 500, 502, 503 and 504 are retried.
+ * + POST and PATCH carry an Idempotency-Key header, the same on every retry.
+ * + after a run of failed attempts the circuit opens and requests fail at once with
+ *      HTTPC_ERROR_CIRCUIT_OPEN, until one trial request after the cooldown succeeds.
+ */
+class HTTPRetryPolicy
+{
+public:
+    typedef enum {
+        CIRCUIT_CLOSED,
+        CIRCUIT_OPEN,
+        CIRCUIT_HALF_OPEN
+    } circuit_t;
+
+    HTTPRetryPolicy(uint8_t attempts = HTTPCLIENT_RETRY_ATTEMPTS);
+
+    void setAttempts(uint8_t attempts); // including the first one
+    void setBackoff(uint32_t backoff_ms, uint32_t backoffMax_ms);
+    void setTimeoutBounds(uint32_t min_ms, uint32_t max_ms);
+    void setBreaker(uint8_t failures, uint32_t cooldown_ms); // 0 failures never opens it
+    void reset();
+
+    uint8_t attempts() const { return _attempts; }
+    circuit_t circuit() const { return _circuit; }
+    uint32_t connectTimeout(uint32_t initial_ms) const { return _connect.timeout(initial_ms, _minTimeout, _maxTimeout); }
+    uint32_t responseTimeout(uint32_t initial_ms) const { return _response.timeout(initial_ms, _minTimeout, _maxTimeout); }
+
+    static bool retryable(int code);
+
+protected:
+    friend class HTTPClient;
+
+    // smoothed time in 1/8 ms and deviation in 1/4 ms, as in TCP
+    struct Estimate {
+        uint32_t srtt = 0;
+        uint32_t rttvar = 0;
+        uint8_t backoff = 0;
+        bool sampled = false;
+
+        void sample(uint32_t ms);
+        void expired();
+        uint32_t timeout(uint32_t initial, uint32_t min, uint32_t max) const;
+    };
+
+    bool allow();
+    void succeeded();
+    void failed();
+    uint32_t backoff(uint8_t retry) const;
+
+    uint8_t _attempts;
+    uint32_t _backoff = HTTPCLIENT_RETRY_BACKOFF;
+    uint32_t _backoffMax = HTTPCLIENT_RETRY_BACKOFF_MAX;
+    uint32_t _minTimeout = HTTPCLIENT_RETRY_TIMEOUT_MIN;
+    uint32_t _maxTimeout = HTTPCLIENT_RETRY_TIMEOUT_MAX;
+    uint8_t _breakerFailures = HTTPCLIENT_BREAKER_FAILURES;
+    uint32_t _cooldown = HTTPCLIENT_BREAKER_COOLDOWN;
+
+    Estimate _connect;
+    Estimate _response;
+    circuit_t _circuit = CIRCUIT_CLOSED;
+    uint8_t _failures = 0;      // in a row
+    uint32_t _openedAt = 0;
+};
+
 #ifdef HTTPCLIENT_1_1_COMPATIBLE
 class TransportTraits;
 typedef std::unique_ptr<TransportTraits> TransportTraitsPtr;
@@ -147,6 +247,8 @@ typedef std::unique_ptr<TransportTraits> TransportTraitsPtr;
 class HTTPClient
 {
 public:
+    typedef std::function<void(const uint8_t * data, size_t length)> BodyCallback;
+
     HTTPClient();
     ~HTTPClient();
 
@@ -170,11 +272,14 @@ public:
     bool connected(void);
 
     void setReuse(bool reuse); /// keep-alive
+    void setPins(const WiFiClientSecurePin * pins, size_t count);
     void setUserAgent(const String& userAgent);
     void setAuthorization(const char * user, const char * password);
     void setAuthorization(const char * auth);
     void setConnectTimeout(int32_t connectTimeout);
     void setTimeout(uint16_t timeout);
+    void setRetryPolicy(HTTPRetryPolicy * policy); /// must outlive the client, nullptr for none
+    void onBody(BodyCallback callback); /// 2xx bodies are pushed here, nullptr for none
 
     // Redirections
     void setFollowRedirects(followRedirects_t follow);
@@ -215,6 +320,7 @@ public:
     StreamString getString(void);
 
     static String errorToString(int error);
+    static String idempotencyKey(); /// 32 random hex digits
 
 protected:
     struct RequestArgument {
@@ -226,10 +332,13 @@ protected:
     void disconnect(bool preserveClient = false);
     void clear();
     int returnError(int error);
+    int sendRequestOnce(const char * type, uint8_t * payload, size_t size);
     bool connect(void);
     bool sendHeader(const char * type);
+    bool parseHeaderLine(const char * line, size_t length, bool & firstLine, String & transferEncoding);
     int handleHeaderResponse();
     int writeToStreamDataBlock(Stream * stream, int len);
+    int handleBody(const char * type, int code);
 
 
 #ifdef HTTPCLIENT_1_1_COMPATIBLE
@@ -247,6 +356,10 @@ protected:
     uint16_t _tcpTimeout = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
     bool _useHTTP10 = false;
     bool _secure = false;
+    const WiFiClientSecurePin* _pins = nullptr;
+    size_t _pinCount = 0;
+    HTTPRetryPolicy* _retryPolicy = nullptr;
+    BodyCallback _bodyCallback;
 
     String _uri;
     String _protocol;
@@ -264,6 +377,10 @@ protected:
     followRedirects_t _followRedirects = HTTPC_DISABLE_FOLLOW_REDIRECTS;
     uint16_t _redirectLimit = 10;
     String _location;
+    bool _bodyDelivered = false;
+    uint32_t _retryAfter = 0;   // ms, from the last response
+    uint32_t _connectTime = 0;  // ms the last new connection took, 0 when one was reused
+    uint32_t _responseTime = 0; // ms from the request going out to its status line
     transferEncoding_t _transferEncoding = HTTPC_TE_IDENTITY;
 };
 
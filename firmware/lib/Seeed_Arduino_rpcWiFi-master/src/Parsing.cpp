@@ -30,92 +30,289 @@
 #define WEBSERVER_MAX_POST_ARGS 32
 #endif
 
+#ifndef WEBSERVER_FORM_READ_BUFLEN
+#define WEBSERVER_FORM_READ_BUFLEN 1460
+#endif
+
 static const char Content_Type[] PROGMEM = "Content-Type";
 static const char filename[] PROGMEM = "filename";
 
-static char* readBytesWithTimeout(WiFiClient& client, size_t maxLength, size_t& dataLength, int timeout_ms)
+// The whole body has to arrive within timeout_ms, however slowly it trickles in
+static size_t readBytesWithTimeout(WiFiClient& client, char* buf, size_t length, int timeout_ms)
 {
-  char *buf = nullptr;
-  dataLength = 0;
-  while (dataLength < maxLength) {
-    int tries = timeout_ms;
-    size_t newLength;
-    while (!(newLength = client.available()) && tries--) delay(1);
+  size_t dataLength = 0;
+  unsigned long startMillis = millis();
+  while (dataLength < length) {
+    size_t newLength = client.available();
     if (!newLength) {
-      break;
-    }
-    if (!buf) {
-      buf = (char *) malloc(newLength + 1);
-      if (!buf) {
-        return nullptr;
+      if (millis() - startMillis >= (unsigned long)timeout_ms || !client.connected()) {
+        log_e("POST body timeout after %u of %u bytes", dataLength, length);
+        break;
       }
+      delay(1);
+      continue;
     }
-    else {
-      char* newBuf = (char *) realloc(buf, dataLength + newLength + 1);
-      if (!newBuf) {
-        free(buf);
+    if (newLength > length - dataLength)
+      newLength = length - dataLength;
+    int res = client.read((uint8_t *)buf + dataLength, newLength);
+    if (res <= 0)
+      break;
+    dataLength += res;
+  }
+  buf[dataLength] = '\0';
+  return dataLength;
+}
+
+// Read one line into the free end of the arena without keeping it; commit
+// length + 1 bytes to hold on to it. The CR LF terminator is not stored.
+// Fails once deadline passes, so a client cannot trickle headers forever,
+// and with tooLong set when the line does not fit.
+static char* readLine(WiFiClient& client, RequestArena& arena, size_t& length, unsigned long deadline, size_t& received, bool& tooLong)
+{
+  tooLong = arena.available() < 2;
+  if (tooLong)
+    return nullptr;
+  char* line = arena.scratch();
+  size_t capacity = arena.available() - 1;
+  length = 0;
+  for (;;) {
+    if (!client.available()) {
+      if ((long)(millis() - deadline) >= 0 || !client.connected()) {
+        log_e("request header timeout");
         return nullptr;
       }
-      buf = newBuf;
+      delay(1);
+      continue;
     }
-    client.readBytes(buf + dataLength, newLength);
-    dataLength += newLength;
-    buf[dataLength] = '\0';
+    int c = client.read();
+    if (c < 0)
+      return nullptr;
+    received++;
+    if (c == '\n')
+      break;
+    if (length == capacity) {
+      log_e("request line longer than %u bytes", capacity);
+      tooLong = true;
+      return nullptr;
+    }
+    line[length++] = c;
   }
-  return buf;
+  if (length && line[length - 1] == '\r')
+    length--;
+  line[length] = '\0';
+  return line;
 }
 
+static char* trim(char* s)
+{
+  while (*s == ' ' || *s == '\t')
+    s++;
+  char* end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '\t'))
+    end--;
+  *end = '\0';
+  return s;
+}
+
+// Drop any quotes around a header parameter, in place
+static char* unquote(char* s)
+{
+  char* out = s;
+  for (const char* in = s; *in; in++) {
+    if (*in != '"')
+      *out++ = *in;
+  }
+  *out = '\0';
+  return s;
+}
+
+static char* urlDecodeInPlace(char* text)
+{
+  char* out = text;
+  for (const char* in = text; *in; ) {
+    char c = *in++;
+    if (c == '%' && in[0] && in[1]) {
+      char hex[3] = { in[0], in[1], '\0' };
+      c = strtol(hex, NULL, 16);
+      in += 2;
+    } else if (c == '+') {
+      c = ' ';
+    }
+    *out++ = c;
+  }
+  *out = '\0';
+  return text;
+}
+
+// Buffered view of a multipart body. Reads the socket in blocks instead of
+// byte by byte and lets the form parser scan for part delimiters in place.
+// Every read gives up at deadline, so the body cannot be trickled in forever.
+class MultipartReader
+{
+public:
+  MultipartReader(WiFiClient& client, uint8_t* buf, size_t size, unsigned long deadline)
+  : _client(client)
+  , _buf(buf)
+  , _size(size)
+  , _pos(0)
+  , _end(0)
+  , _received(0)
+  , _deadline(deadline)
+  {
+  }
+
+  const uint8_t* data() const { return _buf + _pos; }
+  size_t received() const { return _received; }
+  size_t buffered() const { return _end - _pos; }
+  void consume(size_t n) { _pos += n; }
+
+  // Move unread bytes to the front and read as much as fits. Returns false
+  // if nothing arrived before the client timeout or the deadline, or the
+  // peer went away.
+  bool fill() {
+    if (_pos) {
+      memmove(_buf, _buf + _pos, _end - _pos);
+      _end -= _pos;
+      _pos = 0;
+    }
+    if (_end == _size)
+      return true;
+    unsigned long startMillis = millis();
+    unsigned long timeoutIntervalMillis = _client.getTimeout();
+    for (;;) {
+      if (!_client.connected())
+        return false;
+      if (_client.available()) {
+        int res = _client.read(_buf + _end, _size - _end);
+        if (res > 0) {
+          _end += res;
+          _received += res;
+          return true;
+        }
+      }
+      if (millis() - startMillis >= timeoutIntervalMillis)
+        return false;
+      if ((long)(millis() - _deadline) >= 0) {
+        log_e("form body timeout after %u bytes", _received);
+        return false;
+      }
+      delay(1);
+    }
+  }
+
+  // Read up to the next CRLF, the line terminator is not stored. The line
+  // points into the buffer and is valid until the next read.
+  bool readLine(char*& line, size_t& length) {
+    for (;;) {
+      uint8_t* start = _buf + _pos;
+      uint8_t* eol = (uint8_t*) memchr(start, '\n', _end - _pos);
+      if (eol) {
+        uint8_t* next = eol + 1;
+        if (eol > start && eol[-1] == '\r')
+          eol--;
+        *eol = '\0';
+        line = (char*) start;
+        length = eol - start;
+        _pos = next - _buf;
+        return true;
+      }
+      if (_pos == 0 && _end == _size) {
+        log_e("line longer than %u bytes", _size);
+        return false;
+      }
+      if (!fill())
+        return false;
+    }
+  }
+
+  // Return how many buffered bytes are certainly part body: everything up to
+  // the delimiter if it is buffered, otherwise up to a possible partial
+  // delimiter at the tail.
+  size_t scan(const uint8_t* delim, size_t delimLength, bool& found) {
+    const uint8_t* start = _buf + _pos;
+    const uint8_t* end = _buf + _end;
+    const uint8_t* p = start;
+    found = false;
+    while ((p = (const uint8_t*) memchr(p, delim[0], end - p)) != nullptr) {
+      size_t left = end - p;
+      if (left >= delimLength) {
+        if (memcmp(p, delim, delimLength) == 0) {
+          found = true;
+          break;
+        }
+      } else if (memcmp(p, delim, left) == 0) {
+        break;
+      }
+      p++;
+    }
+    return (p ? p : end) - start;
+  }
+
+private:
+  WiFiClient& _client;
+  uint8_t* _buf;
+  size_t _size;
+  size_t _pos;
+  size_t _end;
+  size_t _received;
+  unsigned long _deadline;
+};
+
 bool WebServer::_parseRequest(WiFiClient& client) {
-  // Read the first line of HTTP request
-  String req = client.readStringUntil('\r');
-  client.readStringUntil('\n');
-  //reset header value
-  for (int i = 0; i < _headerKeysCount; ++i) {
-    _currentHeaders[i].value =String();
-   }
+  _clearRequest();
+  _bytesReceived = 0;
+
+  // Read the first line of HTTP request, the query string is parsed in place
+  unsigned long headerDeadline = millis() + HTTP_MAX_HEADER_WAIT;
+  size_t length;
+  bool tooLong;
+  char* req = readLine(client, _arena, length, headerDeadline, _bytesReceived, tooLong);
+  if (!req) {
+    if (tooLong)
+      _parseError = 414;
+    return false;
+  }
+  _arena.commit(length + 1);
 
   // First line of HTTP request looks like "GET /path HTTP/1.1"
   // Retrieve the "/path" part by finding the spaces
-  int addr_start = req.indexOf(' ');
-  int addr_end = req.indexOf(' ', addr_start + 1);
-  if (addr_start == -1 || addr_end == -1) {
-    log_e("Invalid request: %s", req.c_str());
+  char* addr_start = strchr(req, ' ');
+  char* addr_end = addr_start ? strchr(addr_start + 1, ' ') : nullptr;
+  if (!addr_start || !addr_end) {
+    log_e("Invalid request: %s", req);
     return false;
   }
 
-  String methodStr = req.substring(0, addr_start);
-  String url = req.substring(addr_start + 1, addr_end);
-  String versionEnd = req.substring(addr_end + 8);
   // Parse for Android Captive Portal
-  if (req.indexOf("/generate_204") != -1)
-  {
-    url = "/generate_204";
-  }
-  _currentVersion = atoi(versionEnd.c_str());
-  String searchStr = "";
-  int hasSearch = url.indexOf('?');
-  if (hasSearch != -1){
-    searchStr = url.substring(hasSearch + 1);
-    url = url.substring(0, hasSearch);
+  bool generate204 = strstr(req, "/generate_204") != nullptr;
+  *addr_start = '\0';
+  *addr_end = '\0';
+  const char* methodStr = req;
+  char* url = addr_start + 1;
+  const char* versionStr = addr_end + 1;
+  _currentVersion = strlen(versionStr) > 7 ? atoi(versionStr + 7) : 0;
+  char* searchStr = strchr(url, '?');
+  if (searchStr) {
+    *searchStr++ = '\0';
   }
-  _currentUri = url;
+  _currentUri = generate204 ? "/generate_204" : url;
   _chunked = false;
 
   HTTPMethod method = HTTP_GET;
-  if (methodStr == F("POST")) {
+  if (strcmp(methodStr, "POST") == 0) {
     method = HTTP_POST;
-  } else if (methodStr == F("DELETE")) {
+  } else if (strcmp(methodStr, "DELETE") == 0) {
     method = HTTP_DELETE;
-  } else if (methodStr == F("OPTIONS")) {
+  } else if (strcmp(methodStr, "OPTIONS") == 0) {
     method = HTTP_OPTIONS;
-  } else if (methodStr == F("PUT")) {
+  } else if (strcmp(methodStr, "PUT") == 0) {
     method = HTTP_PUT;
-  } else if (methodStr == F("PATCH")) {
+  } else if (strcmp(methodStr, "PATCH") == 0) {
     method = HTTP_PATCH;
   }
   _currentMethod = method;
 
-  log_v("method: %s url: %s search: %s", methodStr.c_str(), url.c_str(), searchStr.c_str());
+  log_v("method: %s url: %s search: %s", methodStr, url, searchStr ? searchStr : "");
 
   //attach handler
   RequestHandler* handler;
@@ -125,122 +322,118 @@ bool WebServer::_parseRequest(WiFiClient& client) {
   }
   _currentHandler = handler;
 
-  String formData;
-  // below is needed only when POST type request
-  if (method == HTTP_POST || method == HTTP_PUT || method == HTTP_PATCH || method == HTTP_DELETE){
-    String boundaryStr;
-    String headerName;
-    String headerValue;
-    bool isForm = false;
-    bool isEncoded = false;
-    uint32_t contentLength = 0;
-    //parse headers
-    while(1){
-      req = client.readStringUntil('\r');
-      client.readStringUntil('\n');
-      if (req == "") break;//no moar headers
-      int headerDiv = req.indexOf(':');
-      if (headerDiv == -1){
-        break;
-      }
-      headerName = req.substring(0, headerDiv);
-      headerValue = req.substring(headerDiv + 1);
-      headerValue.trim();
-       _collectHeader(headerName.c_str(),headerValue.c_str());
-
-      log_v("headerName: %s", headerName.c_str());
-      log_v("headerValue: %s", headerValue.c_str());
-
-      if (headerName.equalsIgnoreCase(FPSTR(Content_Type))){
-        using namespace mime;
-        if (headerValue.startsWith(FPSTR(mimeTable[txt].mimeType))){
-          isForm = false;
-        } else if (headerValue.startsWith(F("application/x-www-form-urlencoded"))){
-          isForm = false;
-          isEncoded = true;
-        } else if (headerValue.startsWith(F("multipart/"))){
-          boundaryStr = headerValue.substring(headerValue.indexOf('=') + 1);
-          boundaryStr.replace("\"","");
-          isForm = true;
-        }
-      } else if (headerName.equalsIgnoreCase(F("Content-Length"))){
-        contentLength = headerValue.toInt();
-      } else if (headerName.equalsIgnoreCase(F("Host"))){
-        _hostHeader = headerValue;
+  const char* boundaryStr = "";
+  bool isForm = false;
+  bool isEncoded = false;
+  uint32_t contentLength = 0;
+  //parse headers, only the lines that are needed later stay in the arena
+  while(1){
+    char* line = readLine(client, _arena, length, headerDeadline, _bytesReceived, tooLong);
+    if (!line) {
+      if (tooLong)
+        _parseError = 431;
+      return false;
+    }
+    if (length == 0) break;//no moar headers
+    char* headerDiv = strchr(line, ':');
+    if (!headerDiv){
+      break;
+    }
+    *headerDiv = '\0';
+    const char* headerName = line;
+    char* headerValue = trim(headerDiv + 1);
+    bool keep = _collectHeader(headerName, headerValue);
+
+    log_v("headerName: %s", headerName);
+    log_v("headerValue: %s", headerValue);
+
+    if (strcasecmp(headerName, Content_Type) == 0){
+      using namespace mime;
+      if (strncmp(headerValue, mimeTable[txt].mimeType, strlen(mimeTable[txt].mimeType)) == 0){
+        isForm = false;
+      } else if (strncmp(headerValue, "application/x-www-form-urlencoded", 33) == 0){
+        isForm = false;
+        isEncoded = true;
+      } else if (strncmp(headerValue, "multipart/", 10) == 0){
+        char* boundary = strchr(headerValue, '=');
+        boundaryStr = boundary ? unquote(boundary + 1) : "";
+        isForm = true;
+        keep = true;
       }
+    } else if (strcasecmp(headerName, "Content-Length") == 0){
+      contentLength = atol(headerValue);
+    } else if (strcasecmp(headerName, "Host") == 0){
+      _hostHeader = headerValue;
+      keep = true;
     }
+    if (keep) {
+      _arena.commit(length + 1);
+    }
+  }
 
+  // below is needed only when POST type request
+  if (method == HTTP_POST || method == HTTP_PUT || method == HTTP_PATCH || method == HTTP_DELETE){
     if (!isForm){
-      size_t plainLength;
-      char* plainBuf = readBytesWithTimeout(client, contentLength, plainLength, HTTP_MAX_POST_WAIT);
-      if (plainLength < contentLength) {
-      	free(plainBuf);
-      	return false;
-      }
+      char* plainBuf = nullptr;
       if (contentLength > 0) {
-        if(isEncoded){
-          //url encoded form
-          if (searchStr != "") searchStr += '&';
-          searchStr += plainBuf;
+        // leave the arena room for the arguments, larger bodies go to the heap
+        bool inArena = contentLength + 1 + WEBSERVER_MAX_POST_ARGS * sizeof(RequestArgument) <= _arena.available();
+        if (inArena) {
+          plainBuf = _arena.scratch();
+        } else if (contentLength <= WEBSERVER_MAX_BODY_SIZE) {
+          plainBuf = _bodyBuffer = (char*) malloc(contentLength + 1);
         }
-        _parseArguments(searchStr);
-        if(!isEncoded){
-          //plain post json or other data
-          RequestArgument& arg = _currentArgs[_currentArgCount++];
-          arg.key = F("plain");
-          arg.value = String(plainBuf);
+        if (!plainBuf) {
+          log_e("Body of %u bytes is too large", contentLength);
+          _parseError = 413;
+          return false;
         }
-
+        size_t plainLength = readBytesWithTimeout(client, plainBuf, contentLength, HTTP_MAX_POST_WAIT);
+        _bytesReceived += plainLength;
+        if (plainLength < contentLength) {
+          return false;
+        }
+        if (inArena)
+          _arena.commit(contentLength + 1);
         log_v("Plain: %s", plainBuf);
-        free(plainBuf);
-      } else {
-        // No content - but we can still have arguments in the URL.
-        _parseArguments(searchStr);
+      }
+      //url encoded form data joins the query arguments, anything else becomes "plain"
+      bool isPlain = plainBuf && !isEncoded;
+      if (!_parseArguments(searchStr, isEncoded ? plainBuf : nullptr, isPlain ? 1 : 0)) {
+        return false;
+      }
+      if (isPlain){
+        //plain post json or other data
+        RequestArgument& arg = _currentArgs[_currentArgCount++];
+        arg.key = "plain";
+        arg.value = plainBuf;
       }
     }
 
     if (isForm){
-      _parseArguments(searchStr);
+      if (!_parseArguments(searchStr, nullptr, 0)) {
+        return false;
+      }
       if (!_parseForm(client, boundaryStr, contentLength)) {
         return false;
       }
     }
   } else {
-    String headerName;
-    String headerValue;
-    //parse headers
-    while(1){
-      req = client.readStringUntil('\r');
-      client.readStringUntil('\n');
-      if (req == "") break;//no moar headers
-      int headerDiv = req.indexOf(':');
-      if (headerDiv == -1){
-        break;
-      }
-      headerName = req.substring(0, headerDiv);
-      headerValue = req.substring(headerDiv + 2);
-      _collectHeader(headerName.c_str(),headerValue.c_str());
-
-	  log_v("headerName: %s", headerName.c_str());
-	  log_v("headerValue: %s", headerValue.c_str());
-
-	  if (headerName.equalsIgnoreCase("Host")){
-        _hostHeader = headerValue;
-      }
+    if (!_parseArguments(searchStr, nullptr, 0)) {
+      return false;
     }
-    _parseArguments(searchStr);
   }
   client.flush();
 
-  log_v("Request: %s", url.c_str());
-  log_v(" Arguments: %s", searchStr.c_str());
+  log_v("Request: %s", url);
+  log_v(" Arguments: %d", _currentArgCount);
 
   return true;
 }
 
 bool WebServer::_collectHeader(const char* headerName, const char* headerValue) {
   for (int i = 0; i < _headerKeysCount; i++) {
-    if (_currentHeaders[i].key.equalsIgnoreCase(headerName)) {
+    if (strcasecmp(_currentHeaders[i].key.c_str(), headerName) == 0) {
             _currentHeaders[i].value=headerValue;
             return true;
         }
@@ -248,179 +441,204 @@ bool WebServer::_collectHeader(const char* headerName, const char* headerValue)
   return false;
 }
 
-void WebServer::_parseArguments(String data) {
-  log_v("args: %s", data.c_str());
-  if (_currentArgs)
-    delete[] _currentArgs;
-  _currentArgs = 0;
-  if (data.length() == 0) {
-    _currentArgCount = 0;
-    _currentArgs = new RequestArgument[1];
-    return;
+// Split "a=1&b=2" into arguments in place, search first and then form. Pairs
+// without a value are skipped; extra leaves room for the caller to append to.
+bool WebServer::_parseArguments(char* search, char* form, int extra) {
+  char* parts[] = { search, form };
+  int count = extra;
+  for (char* part : parts) {
+    if (!part || !*part)
+      continue;
+    log_v("args: %s", part);
+    ++count;
+    for (const char* p = part; (p = strchr(p, '&')) != nullptr; ++p)
+      ++count;
   }
-  _currentArgCount = 1;
+  log_v("args count: %d", count);
 
-  for (int i = 0; i < (int)data.length(); ) {
-    i = data.indexOf('&', i);
-    if (i == -1)
-      break;
-    ++i;
-    ++_currentArgCount;
+  _currentArgCount = 0;
+  _currentArgs = (RequestArgument*) _arena.alloc(count * sizeof(RequestArgument));
+  if (!_currentArgs) {
+    log_e("%d args do not fit the request arena", count);
+    _parseError = 413;
+    return false;
   }
-  log_v("args count: %d", _currentArgCount);
-
-  _currentArgs = new RequestArgument[_currentArgCount+1];
-  int pos = 0;
-  int iarg;
-  for (iarg = 0; iarg < _currentArgCount;) {
-    int equal_sign_index = data.indexOf('=', pos);
-    int next_arg_index = data.indexOf('&', pos);
-    log_v("pos %d =@%d &@%d", pos, equal_sign_index, next_arg_index);
-    if ((equal_sign_index == -1) || ((equal_sign_index > next_arg_index) && (next_arg_index != -1))) {
-      log_e("arg missing value: %d", iarg);
-      if (next_arg_index == -1)
-        break;
-      pos = next_arg_index + 1;
-      continue;
+  for (char* part : parts) {
+    char* pos = part;
+    while (pos && *pos) {
+      char* next = strchr(pos, '&');
+      if (next)
+        *next++ = '\0';
+      char* equal = strchr(pos, '=');
+      if (!equal) {
+        log_e("arg missing value: %d", _currentArgCount);
+        pos = next;
+        continue;
+      }
+      *equal = '\0';
+      RequestArgument& arg = _currentArgs[_currentArgCount];
+      arg.key = urlDecodeInPlace(pos);
+      arg.value = urlDecodeInPlace(equal + 1);
+      log_v("arg %d key: %s value: %s", _currentArgCount, arg.key, arg.value);
+      ++_currentArgCount;
+      pos = next;
     }
-    RequestArgument& arg = _currentArgs[iarg];
-    arg.key = urlDecode(data.substring(pos, equal_sign_index));
-    arg.value = urlDecode(data.substring(equal_sign_index + 1, next_arg_index));
-    log_v("arg %d key: %s value: %s", iarg, arg.key.c_str(), arg.value.c_str());
-    ++iarg;
-    if (next_arg_index == -1)
-      break;
-    pos = next_arg_index + 1;
   }
-  _currentArgCount = iarg;
   log_v("args count: %d", _currentArgCount);
-
+  return true;
 }
 
-void WebServer::_uploadWriteByte(uint8_t b){
-  if (_currentUpload->currentSize == HTTP_UPLOAD_BUFLEN){
-    if(_currentHandler && _currentHandler->canUpload(_currentUri))
-      _currentHandler->upload(*this, _currentUri, *_currentUpload);
-    _currentUpload->totalSize += _currentUpload->currentSize;
-    _currentUpload->currentSize = 0;
+void WebServer::_uploadWriteBytes(const uint8_t* data, size_t length){
+  while (length) {
+    if (_currentUpload->currentSize == HTTP_UPLOAD_BUFLEN){
+      if(_currentHandler && _currentHandler->canUpload(_currentUri))
+        _currentHandler->upload(*this, _currentUri, *_currentUpload);
+      _currentUpload->totalSize += _currentUpload->currentSize;
+      _currentUpload->currentSize = 0;
+    }
+    size_t toCopy = HTTP_UPLOAD_BUFLEN - _currentUpload->currentSize;
+    if (toCopy > length)
+      toCopy = length;
+    memcpy(_currentUpload->buf + _currentUpload->currentSize, data, toCopy);
+    _currentUpload->currentSize += toCopy;
+    data += toCopy;
+    length -= toCopy;
   }
-  _currentUpload->buf[_currentUpload->currentSize++] = b;
 }
 
-int WebServer::_uploadReadByte(WiFiClient& client){
-  if (!client.connected()) return -1;
-  int res = client.read();
-  if(res < 0) {
-    // keep trying until you either read a valid byte or timeout
-    unsigned long startMillis = millis();
-    unsigned long timeoutIntervalMillis = client.getTimeout();
-    boolean timedOut = false;
-    for(;;) {
-      // loosely modeled after blinkWithoutDelay pattern
-      while(!timedOut && !client.available() && client.connected()){
-        delay(2);
-        timedOut = millis() - startMillis >= timeoutIntervalMillis;
-      }
-
-      res = client.read();
-      if(res >= 0) {
-        return res; // exit on a valid read
-      }
-      // NOTE: it is possible to get here and have all of the following
-      //       assertions hold true
-      //
-      //       -- client.available() > 0
-      //       -- client.connected == true
-      //       -- res == -1
-      //
-      //       a simple retry strategy overcomes this which is to say the
-      //       assertion is not permanent, but the reason that this works
-      //       is elusive, and possibly indicative of a more subtle underlying
-      //       issue
-
-      timedOut = millis() - startMillis >= timeoutIntervalMillis;
-      if(timedOut) {
-        return res; // exit on a timeout
-      }
-    }
+bool WebServer::_parseForm(WiFiClient& client, const char* boundary, uint32_t len){
+  log_v("Parse Form: Boundary: %s Length: %d", boundary, len);
+  uint8_t* readBuf = (uint8_t*) _arena.alloc(WEBSERVER_FORM_READ_BUFLEN);
+  if (!readBuf) {
+    log_e("Not enough memory to parse form");
+    _parseError = 413;
+    return false;
   }
+  // uploads may be large, so the budget grows with the announced length
+  unsigned long deadline = millis() + HTTP_MAX_POST_WAIT + (unsigned long)(len / HTTP_MIN_UPLOAD_RATE) * 1000;
+  MultipartReader reader(client, readBuf, WEBSERVER_FORM_READ_BUFLEN, deadline);
+  bool result = _parseFormParts(reader, boundary);
+  _bytesReceived += reader.received();
+  return result;
+}
 
-  return res;
+// Value of a name="value" parameter given its '=', cut at the closing quote
+static char* quotedValue(char* equal)
+{
+  char* value = equal + 1;
+  if (*value == '"')
+    value++;
+  char* quote = strchr(value, '"');
+  if (quote)
+    *quote = '\0';
+  return value;
 }
 
-bool WebServer::_parseForm(WiFiClient& client, String boundary, uint32_t len){
-  (void) len;
-  log_v("Parse Form: Boundary: %s Length: %d", boundary.c_str(), len);
-  String line;
+bool WebServer::_parseFormParts(MultipartReader& reader, const char* boundary){
+  // file data ends right before CRLF followed by the boundary line
+  size_t boundaryLength = strlen(boundary);
+  char* delimiter = _arena.append(_arena.copy("\r\n--", 4), boundary, boundaryLength);
+  _postArgs = (RequestArgument*) _arena.alloc(WEBSERVER_MAX_POST_ARGS * sizeof(RequestArgument));
+  _postArgsLen = 0;
+  if (!delimiter || !_postArgs) {
+    log_e("Not enough memory to parse form");
+    _parseError = 413;
+    return false;
+  }
+  const uint8_t* delim = (const uint8_t*) delimiter;
+  size_t delimLength = boundaryLength + 4;
+  const char* dashBoundary = delimiter + 2;
+  size_t dashLength = boundaryLength + 2;
+
+  char* line = nullptr;
+  size_t length = 0;
   int retry = 0;
   do {
-    line = client.readStringUntil('\r');
+    if (!reader.readLine(line, length)) {
+      line = nullptr;
+      break;
+    }
     ++retry;
-  } while (line.length() == 0 && retry < 3);
+  } while (length == 0 && retry < 3);
 
-  client.readStringUntil('\n');
   //start reading the form
-  if (line == ("--"+boundary)){
-	 if(_postArgs) delete[] _postArgs;
-	 _postArgs = new RequestArgument[WEBSERVER_MAX_POST_ARGS];
-     _postArgsLen = 0;
+  if (line && length == dashLength && memcmp(line, dashBoundary, dashLength) == 0){
     while(1){
-      String argName;
-      String argValue;
-      String argType;
-      String argFilename;
       bool argIsFile = false;
 
-      line = client.readStringUntil('\r');
-      client.readStringUntil('\n');
-      if (line.length() > 19 && line.substring(0, 19).equalsIgnoreCase(F("Content-Disposition"))){
-        int nameStart = line.indexOf('=');
-        if (nameStart != -1){
-          argName = line.substring(nameStart+2);
-          nameStart = argName.indexOf('=');
-          if (nameStart == -1){
-            argName = argName.substring(0, argName.length() - 1);
-          } else {
-            argFilename = argName.substring(nameStart+2, argName.length() - 1);
-            argName = argName.substring(0, argName.indexOf('"'));
+      if (!reader.readLine(line, length)) return false;
+      if (length > 19 && strncasecmp(line, "Content-Disposition", 19) == 0){
+        char* nameStart = strchr(line, '=');
+        if (nameStart){
+          // name="field" or name="field"; filename="file.txt"
+          char* filenameStart = strchr(nameStart + 1, '=');
+          char* argName = quotedValue(nameStart);
+          argName = _arena.copy(argName, strlen(argName));
+          const char* argFilename = nullptr;
+          if (filenameStart){
+            argFilename = quotedValue(filenameStart);
             argIsFile = true;
-            log_v("PostArg FileName: %s",argFilename.c_str());
+            log_v("PostArg FileName: %s",argFilename);
             //use GET to set the filename if uploading using blob
-            if (argFilename == F("blob") && hasArg(FPSTR(filename)))
-              argFilename = arg(FPSTR(filename));
+            if (strcmp(argFilename, "blob") == 0) {
+              for (int i = 0; i < _currentArgCount; ++i) {
+                if (strcmp(_currentArgs[i].key, filename) == 0)
+                  argFilename = _currentArgs[i].value;
+              }
+            }
+            argFilename = _arena.copy(argFilename, strlen(argFilename));
+          }
+          if (!argName || (argIsFile && !argFilename)) {
+            log_e("Not enough memory to parse form");
+            _parseError = 413;
+            return false;
           }
-          log_v("PostArg Name: %s", argName.c_str());
+          log_v("PostArg Name: %s", argName);
           using namespace mime;
-          argType = FPSTR(mimeTable[txt].mimeType);
-          line = client.readStringUntil('\r');
-          client.readStringUntil('\n');
-          if (line.length() > 12 && line.substring(0, 12).equalsIgnoreCase(FPSTR(Content_Type))){
-            argType = line.substring(line.indexOf(':')+2);
+          const char* argType = mimeTable[txt].mimeType;
+          if (!reader.readLine(line, length)) return false;
+          char* typeStart = strchr(line, ':');
+          if (length > 12 && strncasecmp(line, Content_Type, 12) == 0 && typeStart){
+            char* type = trim(typeStart + 1);
+            argType = _arena.copy(type, strlen(type));
+            if (!argType) {
+              log_e("Not enough memory to parse form");
+              _parseError = 413;
+              return false;
+            }
             //skip next line
-            client.readStringUntil('\r');
-            client.readStringUntil('\n');
+            if (!reader.readLine(line, length)) return false;
           }
-          log_v("PostArg Type: %s", argType.c_str());
+          log_v("PostArg Type: %s", argType);
           if (!argIsFile){
+            char* argValue = nullptr;
             while(1){
-              line = client.readStringUntil('\r');
-              client.readStringUntil('\n');
-              if (line.startsWith("--"+boundary)) break;
-              if (argValue.length() > 0) argValue += "\n";
-              argValue += line;
+              if (!reader.readLine(line, length)) return false;
+              if (length >= dashLength && memcmp(line, dashBoundary, dashLength) == 0) break;
+              if (argValue && *argValue) argValue = _arena.append(argValue, "\n", 1);
+              argValue = _arena.append(argValue, line, length);
+              if (!argValue) {
+                log_e("Form field %s does not fit the request arena", argName);
+                _parseError = 413;
+                return false;
+              }
             }
-            log_v("PostArg Value: %s", argValue.c_str());
+            log_v("PostArg Value: %s", argValue ? argValue : "");
 
-            RequestArgument& arg = _postArgs[_postArgsLen++];
-            arg.key = argName;
-            arg.value = argValue;
+            if (_postArgsLen < WEBSERVER_MAX_POST_ARGS) {
+              RequestArgument& arg = _postArgs[_postArgsLen++];
+              arg.key = argName;
+              arg.value = argValue ? argValue : "";
+            }
 
-            if (line == ("--"+boundary+"--")){
+            if (length == dashLength + 2 && memcmp(line + dashLength, "--", 2) == 0){
               log_v("Done Parsing POST");
               break;
             }
           } else {
-            _currentUpload.reset(new HTTPUpload());
+            // kept across requests so uploads do not allocate each time
+            if (!_currentUpload)
+              _currentUpload.reset(new HTTPUpload());
             _currentUpload->status = UPLOAD_FILE_START;
             _currentUpload->name = argName;
             _currentUpload->filename = argFilename;
@@ -431,100 +649,47 @@ bool WebServer::_parseForm(WiFiClient& client, String boundary, uint32_t len){
             if(_currentHandler && _currentHandler->canUpload(_currentUri))
               _currentHandler->upload(*this, _currentUri, *_currentUpload);
             _currentUpload->status = UPLOAD_FILE_WRITE;
-            int argByte = _uploadReadByte(client);
-readfile:
 
-            while(argByte != 0x0D){
-                if(argByte < 0) return _parseFormUploadAborted();
-                _uploadWriteByte(argByte);
-                argByte = _uploadReadByte(client);
+            bool found = false;
+            while (!found) {
+              size_t dataLength = reader.scan(delim, delimLength, found);
+              _uploadWriteBytes(reader.data(), dataLength);
+              reader.consume(dataLength);
+              if (!found && !reader.fill())
+                return _parseFormUploadAborted();
             }
+            reader.consume(delimLength);
 
-            argByte = _uploadReadByte(client);
-            if(argByte < 0) return _parseFormUploadAborted();
-            if (argByte == 0x0A){
-              argByte = _uploadReadByte(client);
-              if(argByte < 0) return _parseFormUploadAborted();
-              if ((char)argByte != '-'){
-                //continue reading the file
-                _uploadWriteByte(0x0D);
-                _uploadWriteByte(0x0A);
-                goto readfile;
-              } else {
-                argByte = _uploadReadByte(client);
-                if(argByte < 0) return _parseFormUploadAborted();
-                if ((char)argByte != '-'){
-                  //continue reading the file
-                  _uploadWriteByte(0x0D);
-                  _uploadWriteByte(0x0A);
-                  _uploadWriteByte((uint8_t)('-'));
-                  goto readfile;
-                }
-              }
-
-              uint8_t endBuf[boundary.length()];
-              client.readBytes(endBuf, boundary.length());
-
-              if (strstr((const char*)endBuf, boundary.c_str()) != NULL){
-                if(_currentHandler && _currentHandler->canUpload(_currentUri))
-                  _currentHandler->upload(*this, _currentUri, *_currentUpload);
-                _currentUpload->totalSize += _currentUpload->currentSize;
-                _currentUpload->status = UPLOAD_FILE_END;
-                if(_currentHandler && _currentHandler->canUpload(_currentUri))
-                  _currentHandler->upload(*this, _currentUri, *_currentUpload);
-                log_v("End File: %s Type: %s Size: %d", _currentUpload->filename.c_str(), _currentUpload->type.c_str(), _currentUpload->totalSize);
-                line = client.readStringUntil(0x0D);
-                client.readStringUntil(0x0A);
-                if (line == "--"){
-                  log_v("Done Parsing POST");
-                  break;
-                }
-                continue;
-              } else {
-                _uploadWriteByte(0x0D);
-                _uploadWriteByte(0x0A);
-                _uploadWriteByte((uint8_t)('-'));
-                _uploadWriteByte((uint8_t)('-'));
-                uint32_t i = 0;
-                while(i < boundary.length()){
-                  _uploadWriteByte(endBuf[i++]);
-                }
-                argByte = _uploadReadByte(client);
-                goto readfile;
-              }
-            } else {
-              _uploadWriteByte(0x0D);
-              goto readfile;
+            if(_currentHandler && _currentHandler->canUpload(_currentUri))
+              _currentHandler->upload(*this, _currentUri, *_currentUpload);
+            _currentUpload->totalSize += _currentUpload->currentSize;
+            _currentUpload->status = UPLOAD_FILE_END;
+            if(_currentHandler && _currentHandler->canUpload(_currentUri))
+              _currentHandler->upload(*this, _currentUri, *_currentUpload);
+            log_v("End File: %s Type: %s Size: %d", _currentUpload->filename.c_str(), _currentUpload->type.c_str(), _currentUpload->totalSize);
+            if (!reader.readLine(line, length)) return false;
+            if (strcmp(line, "--") == 0){
+              log_v("Done Parsing POST");
+              break;
             }
-            break;
           }
         }
       }
     }
 
+    // the query arguments follow the form fields
     int iarg;
     int totalArgs = ((WEBSERVER_MAX_POST_ARGS - _postArgsLen) < _currentArgCount)?(WEBSERVER_MAX_POST_ARGS - _postArgsLen):_currentArgCount;
     for (iarg = 0; iarg < totalArgs; iarg++){
-      RequestArgument& arg = _postArgs[_postArgsLen++];
-      arg.key = _currentArgs[iarg].key;
-      arg.value = _currentArgs[iarg].value;
-    }
-    if (_currentArgs) delete[] _currentArgs;
-    _currentArgs = new RequestArgument[_postArgsLen];
-    for (iarg = 0; iarg < _postArgsLen; iarg++){
-      RequestArgument& arg = _currentArgs[iarg];
-      arg.key = _postArgs[iarg].key;
-      arg.value = _postArgs[iarg].value;
-    }
-    _currentArgCount = iarg;
-    if (_postArgs) {
-      delete[] _postArgs;
-      _postArgs=nullptr;
-      _postArgsLen = 0;
+      _postArgs[_postArgsLen++] = _currentArgs[iarg];
     }
+    _currentArgs = _postArgs;
+    _currentArgCount = _postArgsLen;
+    _postArgs = nullptr;
+    _postArgsLen = 0;
     return true;
   }
-  log_e("Error: line: %s", line.c_str());
+  log_e("Error: line: %s", line ? line : "");
   return false;
 }
 
@@ -22,6 +22,7 @@
 
 
 #include <Arduino.h>
+#include <stdarg.h>
 #include "esp/esp_hal_log.h"
 #include <libb64/cencode.h>
 #include "WiFiServer.h"
@@ -37,10 +38,18 @@ static const char AUTHORIZATION_HEADER[] = "Authorization";
 static const char qop_auth[] = "qop=auth";
 static const char WWW_Authenticate[] = "WWW-Authenticate";
 static const char Content_Length[] = "Content-Length";
+static const char If_None_Match[] = "If-None-Match";
+static const char If_Modified_Since[] = "If-Modified-Since";
+static const char Accept_Encoding[] = "Accept-Encoding";
+static const char Upgrade[] = "Upgrade";
+static const char Sec_WebSocket_Key[] = "Sec-WebSocket-Key";
+static const char Sec_WebSocket_Version[] = "Sec-WebSocket-Version";
 
 
 WebServer::WebServer(IPAddress addr, int port)
 : _corsEnabled(false)
+, _compressionEnabled(false)
+, _rateLimitEnabled(false)
 , _server(addr, port)
 , _currentMethod(HTTP_ANY)
 , _currentVersion(0)
@@ -56,12 +65,22 @@ WebServer::WebServer(IPAddress addr, int port)
 , _headerKeysCount(0)
 , _currentHeaders(nullptr)
 , _contentLength(0)
+, _hostHeader(nullptr)
 , _chunked(false)
+, _outputLength(0)
+, _rateBuckets()
+, _responseCode(0)
+, _sendMicros(0)
+, _bytesReceived(0)
+, _bodyBuffer(nullptr)
+, _parseError(0)
 {
 }
 
 WebServer::WebServer(int port)
 : _corsEnabled(false)
+, _compressionEnabled(false)
+, _rateLimitEnabled(false)
 , _server(port)
 , _currentMethod(HTTP_ANY)
 , _currentVersion(0)
@@ -77,12 +96,21 @@ WebServer::WebServer(int port)
 , _headerKeysCount(0)
 , _currentHeaders(nullptr)
 , _contentLength(0)
+, _hostHeader(nullptr)
 , _chunked(false)
+, _outputLength(0)
+, _rateBuckets()
+, _responseCode(0)
+, _sendMicros(0)
+, _bytesReceived(0)
+, _bodyBuffer(nullptr)
+, _parseError(0)
 {
 }
 
 WebServer::~WebServer() {
   _server.close();
+  free(_bodyBuffer);
   if (_currentHeaders)
     delete[]_currentHeaders;
   RequestHandler* handler = _firstHandler;
@@ -277,12 +305,26 @@ void WebServer::serveStatic(const char* uri, FS& fs, const char* path, const cha
     _addRequestHandler(new StaticRequestHandler(fs, path, uri, cache_header));
 }
 
+void WebServer::onWebSocket(const String &uri, TWebSocketFunction fn) {
+    if (!_webSockets) {
+      _webSockets.reset(new WebSocketConnection[WEBSOCKET_MAX_CLIENTS]());
+    }
+    _addRequestHandler(new WebSocketRequestHandler(fn, uri));
+}
+
 void WebServer::handleClient() {
+  if (_webSockets) {
+    _handleWebSockets();
+  }
+
   if (_currentStatus == HC_NONE) {
     WiFiClient client = _server.available();
     if (!client) {
       return;
     }
+    if (_rateLimitEnabled && !_admitClient(client)) {
+      return;
+    }
 
     log_v("New client");
 
@@ -302,7 +344,17 @@ void WebServer::handleClient() {
     case HC_WAIT_READ:
       // Wait for data from client to become available
       if (_currentClient.available()) {
-        if (_parseRequest(_currentClient)) {
+        unsigned long parseStart = micros();
+        bool parsed = _parseRequest(_currentClient);
+        if (_metrics) {
+          _metrics->bytesIn += _bytesReceived;
+          if (parsed)
+            _metrics->parse.record(micros() - parseStart);
+        }
+        if (!parsed && _parseError) {
+          _rejectRequest();
+        }
+        if (parsed) {
           // because HTTP_MAX_SEND_WAIT is expressed in milliseconds,
           // it must be divided by 1000
           _currentClient.setTimeout(HTTP_MAX_SEND_WAIT / 1000);
@@ -316,15 +368,17 @@ void WebServer::handleClient() {
           }
         }
       } else { // !_currentClient.available()
-        if (millis() - _statusChange <= HTTP_MAX_DATA_WAIT) {
+        if (millis() - _statusChange <= HTTP_MAX_FIRST_BYTE_WAIT) {
           keepCurrentClient = true;
         }
         callYield = true;
       }
       break;
     case HC_WAIT_CLOSE:
-      // Wait for client to close the connection
-      if (millis() - _statusChange <= HTTP_MAX_CLOSE_WAIT) {
+      // Wait for client to close the connection, a read sees that at once
+      // where connected() only asks the socket every now and then
+      if (millis() - _statusChange <= HTTP_MAX_CLOSE_WAIT &&
+          (_currentClient.available() || _currentClient.connected())) {
         keepCurrentClient = true;
         callYield = true;
       }
@@ -332,9 +386,10 @@ void WebServer::handleClient() {
   }
 
   if (!keepCurrentClient) {
+    _outputLength = 0;
+    _gzip.cancel();
     _currentClient = WiFiClient();
     _currentStatus = HC_NONE;
-    _currentUpload.reset();
   }
 
   if (callYield) {
@@ -342,9 +397,65 @@ void WebServer::handleClient() {
   }
 }
 
+// Token bucket per remote address. The table is fixed so a flood of new
+// addresses recycles the least recently seen entry instead of growing it.
+bool WebServer::_admitClient(WiFiClient& client) {
+  uint32_t address = client.remoteIP();
+  unsigned long now = millis();
+  RateBucket* bucket = nullptr;
+  RateBucket* oldest = &_rateBuckets[0];
+  for (size_t i = 0; i < WEBSERVER_RATE_TABLE_SIZE; i++) {
+    if (_rateBuckets[i].address == address && _rateBuckets[i].lastSeen) {
+      bucket = &_rateBuckets[i];
+      break;
+    }
+    if (now - _rateBuckets[i].lastSeen > now - oldest->lastSeen)
+      oldest = &_rateBuckets[i];
+  }
+
+  if (!bucket) {
+    bucket = oldest;
+    bucket->address = address;
+    bucket->tokens = WEBSERVER_RATE_BURST;
+    bucket->refilled = now;
+  } else {
+    unsigned long earned = (now - bucket->refilled) / WEBSERVER_RATE_REFILL;
+    if (bucket->tokens + earned >= WEBSERVER_RATE_BURST) {
+      bucket->tokens = WEBSERVER_RATE_BURST;
+      bucket->refilled = now;
+    } else {
+      bucket->tokens += earned;
+      bucket->refilled += earned * WEBSERVER_RATE_REFILL;
+    }
+  }
+  bucket->lastSeen = now ? now : 1;
+
+  if (bucket->tokens) {
+    bucket->tokens--;
+    return true;
+  }
+
+  // answer without reading the request so the slot frees up right away
+  unsigned long retryAfter = (WEBSERVER_RATE_REFILL - (now - bucket->refilled) + 999) / 1000;
+  char response[128];
+  int len = snprintf(response, sizeof(response),
+                     "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %lu\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                     retryAfter);
+  size_t sent = client.write((const uint8_t *)response, len);
+  client.stop();
+  if (_metrics) {
+    _metrics->countStatus(503);
+    _metrics->rejected++;
+    _metrics->bytesOut += sent;
+  }
+  log_v("Rate limited %s", IPAddress(address).toString().c_str());
+  return false;
+}
+
 void WebServer::close() {
   _server.close();
   _currentStatus = HC_NONE;
+  _gzip.end();
   if(!_headerKeysCount)
     collectHeaders(0, 0);
 }
@@ -379,7 +490,168 @@ void WebServer::enableCrossOrigin(boolean value) {
   enableCORS(value);
 }
 
+void WebServer::enableCompression(boolean value) {
+  _compressionEnabled = value;
+}
+
+void WebServer::enableRateLimit(boolean value) {
+  _rateLimitEnabled = value;
+}
+
+void WebServer::onMetrics(TMetricsFunction fn) {
+  _metricsHandler = fn;
+}
+
+void WebServer::enableMetrics(const String& uri) {
+  if (_metrics)
+    return;
+  _metrics.reset(new ServerMetrics());
+  on(uri, HTTP_GET, [this]() { _sendMetrics(); });
+}
+
+void WebServer::_countSent(size_t sent, unsigned long start) {
+  _sendMicros += micros() - start;
+  if (_metrics)
+    _metrics->bytesOut += sent;
+}
+
+// Writing happens inside the handler, so its time is taken out of the handler phase
+void WebServer::_recordRequest(unsigned long start) {
+  unsigned long elapsed = micros() - start;
+  _metrics->handler.record(elapsed > _sendMicros ? elapsed - _sendMicros : 0);
+  _metrics->send.record(_sendMicros);
+  if (_responseCode)
+    _metrics->countStatus(_responseCode);
+  if (_currentHandler)
+    _currentHandler->countRequest();
+  else
+    _metrics->unrouted++;
+}
+
+// Gathers exposition lines into larger chunks instead of sending one chunk per line
+class MetricsWriter : public Print
+{
+public:
+  MetricsWriter(WebServer& server) : _server(server), _length(0) {}
+  ~MetricsWriter() { flush(); }
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    for (size_t i = 0; i < size; ) {
+      if (_length == sizeof(_buf))
+        flush();
+      size_t n = size - i < sizeof(_buf) - _length ? size - i : sizeof(_buf) - _length;
+      memcpy(_buf + _length, buffer + i, n);
+      _length += n;
+      i += n;
+    }
+    return size;
+  }
+
+  void printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(_buf + _length, sizeof(_buf) - _length, format, args);
+    va_end(args);
+    if (n >= (int)(sizeof(_buf) - _length)) {
+      flush();
+      va_start(args, format);
+      n = vsnprintf(_buf, sizeof(_buf), format, args);
+      va_end(args);
+      if (n >= (int)sizeof(_buf))
+        n = sizeof(_buf) - 1;
+    }
+    if (n > 0)
+      _length += n;
+  }
+
+  void flush() {
+    if (_length)
+      _server.sendContent_P(_buf, _length);
+    _length = 0;
+  }
+
+private:
+  WebServer& _server;
+  char       _buf[256];
+  size_t     _length;
+};
+
+// newlib nano has no %llu
+static const char* formatCount(char* buf, uint64_t value)
+{
+  char* p = buf + 20;
+  *p = '\0';
+  do {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  return p;
+}
+
+static void writeHistogram(MetricsWriter& out, const char* phase, const LatencyHistogram& histogram)
+{
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < WEBSERVER_METRICS_BUCKETS; i++) {
+    uint32_t bound = LatencyHistogram::bound(i);
+    cumulative += histogram.buckets[i];
+    out.printf("webserver_phase_seconds_bucket{phase=\"%s\",le=\"%lu.%06lu\"} %lu\n", phase,
+               (unsigned long)(bound / 1000000), (unsigned long)(bound % 1000000), (unsigned long)cumulative);
+  }
+  out.printf("webserver_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %lu\n", phase, (unsigned long)histogram.count);
+  out.printf("webserver_phase_seconds_sum{phase=\"%s\"} %lu.%06lu\n", phase,
+             (unsigned long)(histogram.sum / 1000000), (unsigned long)(histogram.sum % 1000000));
+  out.printf("webserver_phase_seconds_count{phase=\"%s\"} %lu\n", phase, (unsigned long)histogram.count);
+}
+
+void WebServer::_sendMetrics() {
+  setContentLength(CONTENT_LENGTH_UNKNOWN);
+  send(200, "text/plain; version=0.0.4", "");
+  MetricsWriter out(*this);
+  char count[21];
+
+  // handlers sharing a uri (one per method) are reported as one route
+  out.printf("# TYPE webserver_requests_total counter\n");
+  for (RequestHandler* handler = _firstHandler; handler; handler = handler->next()) {
+    RequestHandler* first = _firstHandler;
+    while (strcmp(first->route(), handler->route()) != 0)
+      first = first->next();
+    if (first != handler)
+      continue;
+    uint32_t requests = 0;
+    for (RequestHandler* same = handler; same; same = same->next()) {
+      if (strcmp(same->route(), handler->route()) == 0)
+        requests += same->requests();
+    }
+    out.printf("webserver_requests_total{route=\"%s\"} %lu\n", handler->route(), (unsigned long)requests);
+  }
+  out.printf("webserver_unrouted_requests_total %lu\n", (unsigned long)_metrics->unrouted);
+
+  out.printf("# TYPE webserver_responses_total counter\n");
+  for (size_t i = 0; i < WEBSERVER_METRICS_CODES && _metrics->codes[i].code; i++) {
+    out.printf("webserver_responses_total{code=\"%u\"} %lu\n", _metrics->codes[i].code, (unsigned long)_metrics->codes[i].count);
+  }
+  if (_metrics->otherCodes)
+    out.printf("webserver_responses_total{code=\"other\"} %lu\n", (unsigned long)_metrics->otherCodes);
+
+  out.printf("# TYPE webserver_rejected_total counter\nwebserver_rejected_total %lu\n", (unsigned long)_metrics->rejected);
+  out.printf("# TYPE webserver_received_bytes_total counter\nwebserver_received_bytes_total %s\n", formatCount(count, _metrics->bytesIn));
+  out.printf("# TYPE webserver_sent_bytes_total counter\nwebserver_sent_bytes_total %s\n", formatCount(count, _metrics->bytesOut));
+
+  out.printf("# TYPE webserver_phase_seconds histogram\n");
+  writeHistogram(out, "parse", _metrics->parse);
+  writeHistogram(out, "handler", _metrics->handler);
+  writeHistogram(out, "send", _metrics->send);
+
+  if (_metricsHandler)
+    _metricsHandler(out);
+}
+
 void WebServer::_prepareHeader(String& response, int code, const char* content_type, size_t contentLength) {
+    _responseCode = code;
     response = String(F("HTTP/1.")) + String(_currentVersion) + ' ';
     response += String(code);
     response += ' ';
@@ -390,16 +662,20 @@ void WebServer::_prepareHeader(String& response, int code, const char* content_t
     if (!content_type)
         content_type = mimeTable[html].mimeType;
 
-    sendHeader(String(F("Content-Type")), String(FPSTR(content_type)), true);
-    if (_contentLength == CONTENT_LENGTH_NOT_SET) {
-        sendHeader(String(FPSTR(Content_Length)), String(contentLength));
-    } else if (_contentLength != CONTENT_LENGTH_UNKNOWN) {
-        sendHeader(String(FPSTR(Content_Length)), String(_contentLength));
-    } else if(_contentLength == CONTENT_LENGTH_UNKNOWN && _currentVersion){ //HTTP/1.1 or above client
-      //let's do chunked
-      _chunked = true;
-      sendHeader(String(F("Accept-Ranges")),String(F("none")));
-      sendHeader(String(F("Transfer-Encoding")),String(F("chunked")));
+    // a 304 stands for the 200 the client has cached: no Content-Type, and no
+    // Content-Length that could differ from that one's (RFC 9110 15.4.5)
+    if (code != 304) {
+        sendHeader(String(F("Content-Type")), String(FPSTR(content_type)), true);
+        if (_contentLength == CONTENT_LENGTH_NOT_SET) {
+            sendHeader(String(FPSTR(Content_Length)), String(contentLength));
+        } else if (_contentLength != CONTENT_LENGTH_UNKNOWN) {
+            sendHeader(String(FPSTR(Content_Length)), String(_contentLength));
+        } else if(_contentLength == CONTENT_LENGTH_UNKNOWN && _currentVersion){ //HTTP/1.1 or above client
+          //let's do chunked
+          _chunked = true;
+          sendHeader(String(F("Accept-Ranges")),String(F("none")));
+          sendHeader(String(F("Transfer-Encoding")),String(F("chunked")));
+        }
     }
     if (_corsEnabled) {
         sendHeader(String(FPSTR("Access-Control-Allow-Origin")), String("*"));
@@ -416,8 +692,9 @@ void WebServer::send(int code, const char* content_type, const String& content)
     // Can we asume the following?
     //if(code == 200 && content.length() == 0 && _contentLength == CONTENT_LENGTH_NOT_SET)
     //  _contentLength = CONTENT_LENGTH_UNKNOWN;
+    _beginCompression(code, content.length());
     _prepareHeader(header, code, content_type, content.length());
-    _currentClientWrite(header.c_str(), header.length());
+    _bufferWrite(header.c_str(), header.length());
     if(content.length())
       sendContent(content);
 }
@@ -432,8 +709,9 @@ void WebServer::send_P(int code, PGM_P content_type, PGM_P content) {
     String header;
     char type[64];
     memccpy_P((void*)type, (PGM_VOID_P)content_type, 0, sizeof(type));
+    _beginCompression(code, contentLength);
     _prepareHeader(header, code, (const char* )type, contentLength);
-    _currentClientWrite(header.c_str(), header.length());
+    _bufferWrite(header.c_str(), header.length());
     sendContent_P(content);
 }
 
@@ -441,8 +719,9 @@ void WebServer::send_P(int code, PGM_P content_type, PGM_P content, size_t conte
     String header;
     char type[64];
     memccpy_P((void*)type, (PGM_VOID_P)content_type, 0, sizeof(type));
+    _beginCompression(code, contentLength);
     _prepareHeader(header, code, (const char* )type, contentLength);
-    sendContent(header);
+    _bufferWrite(header.c_str(), header.length());
     sendContent_P(content, contentLength);
 }
 
@@ -455,19 +734,17 @@ void WebServer::send(int code, const String& content_type, const String& content
 }
 
 void WebServer::sendContent(const String& content) {
-  const char * footer = "\r\n";
+  if (_gzip.active()) {
+    _compressContent((const uint8_t*)content.c_str(), content.length());
+    return;
+  }
   size_t len = content.length();
   if(_chunked) {
-    char * chunkSize = (char *)malloc(11);
-    if(chunkSize){
-      sprintf(chunkSize, "%x%s", len, footer);
-      _currentClientWrite(chunkSize, strlen(chunkSize));
-      free(chunkSize);
-    }
+    _bufferChunkSize(len);
   }
-  _currentClientWrite(content.c_str(), len);
+  _bufferWrite(content.c_str(), len);
   if(_chunked){
-    _currentClient.write(footer, 2);
+    _bufferWrite("\r\n", 2);
     if (len == 0) {
       _chunked = false;
     }
@@ -479,35 +756,148 @@ void WebServer::sendContent_P(PGM_P content) {
 }
 
 void WebServer::sendContent_P(PGM_P content, size_t size) {
-  const char * footer = "\r\n";
+  if (_gzip.active()) {
+    _compressContent((const uint8_t*)content, size);
+    return;
+  }
   if(_chunked) {
-    char * chunkSize = (char *)malloc(11);
-    if(chunkSize){
-      sprintf(chunkSize, "%x%s", size, footer);
-      _currentClientWrite(chunkSize, strlen(chunkSize));
-      free(chunkSize);
-    }
+    _bufferChunkSize(size);
   }
-  _currentClientWrite_P(content, size);
+  _bufferWrite_P(content, size);
   if(_chunked){
-    _currentClient.write(footer, 2);
+    _bufferWrite("\r\n", 2);
     if (size == 0) {
       _chunked = false;
     }
   }
 }
 
+void WebServer::_bufferChunkSize(size_t len) {
+  char chunkSize[11];
+  int n = sprintf(chunkSize, "%x\r\n", (unsigned int)len);
+  _bufferWrite(chunkSize, n);
+}
+
+// Decide whether this response gets gzipped on the fly. It needs a chunked
+// HTTP/1.1 response, a client that accepts gzip and a body worth compressing.
+bool WebServer::_beginCompression(int code, size_t contentLength) {
+  if (!_compressionEnabled || !_currentVersion || code < 200 || code == 204 || code == 304)
+    return false;
+  size_t length = (_contentLength == CONTENT_LENGTH_NOT_SET) ? contentLength : _contentLength;
+  if (length != CONTENT_LENGTH_UNKNOWN && length < WEBSERVER_GZIP_MIN_SIZE)
+    return false;
+  if (_responseHeaders.indexOf(F("Content-Encoding")) != -1)
+    return false;
+  String acceptEncoding = header(FPSTR(Accept_Encoding));
+  int gzipIndex = acceptEncoding.indexOf(F("gzip"));
+  if (gzipIndex == -1)
+    return false;
+  String params = acceptEncoding.substring(gzipIndex + 4);
+  params.replace(" ", "");
+  if (params.startsWith(F(";q=0")) && !params.startsWith(F(";q=0.")))
+    return false;
+
+  if (!_gzip.begin([this](const uint8_t* data, size_t length) { _sendChunk(data, length); })) {
+    log_e("Not enough memory for gzip, sending uncompressed");
+    return false;
+  }
+  _contentLength = CONTENT_LENGTH_UNKNOWN;
+  sendHeader(F("Content-Encoding"), F("gzip"));
+  sendHeader(F("Vary"), FPSTR(Accept_Encoding));
+  return true;
+}
+
+// An empty write ends the body, just like the terminating chunk does
+void WebServer::_compressContent(const uint8_t* data, size_t length) {
+  if (length) {
+    _gzip.write(data, length);
+    return;
+  }
+  _gzip.finish();
+  _bufferWrite("0\r\n\r\n", 5);
+  _chunked = false;
+}
+
+void WebServer::_sendChunk(const uint8_t* data, size_t length) {
+  _bufferChunkSize(length);
+  _bufferWrite((const char*)data, length);
+  _bufferWrite("\r\n", 2);
+}
+
+// Small writes are collected in _outputBuffer and go out in segment sized
+// pieces. Payloads at least one buffer long skip the copy once the pending
+// bytes have been topped up and sent.
+void WebServer::_bufferWrite(const char* b, size_t l) {
+  if (_outputLength + l <= HTTP_OUTPUT_BUFLEN) {
+    memcpy(_outputBuffer + _outputLength, b, l);
+    _outputLength += l;
+    return;
+  }
+  if (_outputLength) {
+    size_t fill = HTTP_OUTPUT_BUFLEN - _outputLength;
+    memcpy(_outputBuffer + _outputLength, b, fill);
+    _outputLength += fill;
+    b += fill;
+    l -= fill;
+    flush();
+  }
+  if (l >= HTTP_OUTPUT_BUFLEN) {
+    unsigned long start = micros();
+    _countSent(_currentClientWrite(b, l), start);
+    return;
+  }
+  memcpy(_outputBuffer, b, l);
+  _outputLength = l;
+}
 
-void WebServer::_streamFileCore(const size_t fileSize, const String & fileName, const String & contentType)
+void WebServer::_bufferWrite_P(PGM_P b, size_t l) {
+  if (_outputLength + l <= HTTP_OUTPUT_BUFLEN) {
+    memcpy_P(_outputBuffer + _outputLength, b, l);
+    _outputLength += l;
+    return;
+  }
+  if (_outputLength) {
+    size_t fill = HTTP_OUTPUT_BUFLEN - _outputLength;
+    memcpy_P(_outputBuffer + _outputLength, b, fill);
+    _outputLength += fill;
+    b += fill;
+    l -= fill;
+    flush();
+  }
+  if (l >= HTTP_OUTPUT_BUFLEN) {
+    unsigned long start = micros();
+    _countSent(_currentClientWrite_P(b, l), start);
+    return;
+  }
+  memcpy_P(_outputBuffer, b, l);
+  _outputLength = l;
+}
+
+bool WebServer::flush() {
+  if (!_outputLength)
+    return true;
+  unsigned long start = micros();
+  size_t sent = _currentClientWrite((const char*)_outputBuffer, _outputLength);
+  _countSent(sent, start);
+  bool complete = sent == _outputLength;
+  _outputLength = 0;
+  return complete;
+}
+
+
+void WebServer::_streamFileCore(const size_t fileSize, const String & fileName, const char* contentType)
 {
   using namespace mime;
   setContentLength(fileSize);
-  if (fileName.endsWith(String(FPSTR(mimeTable[gz].endsWith))) &&
-      contentType != String(FPSTR(mimeTable[gz].mimeType)) &&
-      contentType != String(FPSTR(mimeTable[none].mimeType))) {
+  if (fileName.endsWith(FPSTR(mimeTable[gz].endsWith)) &&
+      strcmp(contentType, mimeTable[gz].mimeType) != 0 &&
+      strcmp(contentType, mimeTable[none].mimeType) != 0) {
     sendHeader(F("Content-Encoding"), F("gzip"));
   }
-  send(200, contentType, "");
+  // file bytes go straight to the output buffer, so never gzip them here
+  String header;
+  _prepareHeader(header, 200, contentType, fileSize);
+  _bufferWrite(header.c_str(), header.length());
 }
 
 String WebServer::pathArg(unsigned int i) {
@@ -518,11 +908,11 @@ String WebServer::pathArg(unsigned int i) {
 
 String WebServer::arg(String name) {
   for (int j = 0; j < _postArgsLen; ++j) {
-	    if ( _postArgs[j].key == name )
+	    if ( strcmp(_postArgs[j].key, name.c_str()) == 0 )
 	      return _postArgs[j].value;
 	  }
   for (int i = 0; i < _currentArgCount; ++i) {
-    if ( _currentArgs[i].key == name )
+    if ( strcmp(_currentArgs[i].key, name.c_str()) == 0 )
       return _currentArgs[i].value;
   }
   return "";
@@ -546,11 +936,11 @@ int WebServer::args() {
 
 bool WebServer::hasArg(String  name) {
   for (int j = 0; j < _postArgsLen; ++j) {
-	    if (_postArgs[j].key == name)
+	    if (strcmp(_postArgs[j].key, name.c_str()) == 0)
 	      return true;
 	  }
   for (int i = 0; i < _currentArgCount; ++i) {
-    if (_currentArgs[i].key == name)
+    if (strcmp(_currentArgs[i].key, name.c_str()) == 0)
       return true;
   }
   return false;
@@ -560,24 +950,31 @@ bool WebServer::hasArg(String  name) {
 String WebServer::header(String name) {
   for (int i = 0; i < _headerKeysCount; ++i) {
     if (_currentHeaders[i].key.equalsIgnoreCase(name))
-      return _currentHeaders[i].value;
+      return _currentHeaders[i].value ? _currentHeaders[i].value : "";
   }
   return "";
 }
 
 void WebServer::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
-  _headerKeysCount = headerKeysCount + 1;
+  // Authorization first, then the user's keys, then the ones the server itself relies on
+  static const char* const serverHeaders[] = { If_None_Match, If_Modified_Since, Accept_Encoding,
+                                               Upgrade, Sec_WebSocket_Key, Sec_WebSocket_Version };
+  const size_t serverHeadersCount = sizeof(serverHeaders) / sizeof(serverHeaders[0]);
+  _headerKeysCount = headerKeysCount + 1 + serverHeadersCount;
   if (_currentHeaders)
      delete[]_currentHeaders;
-  _currentHeaders = new RequestArgument[_headerKeysCount];
+  _currentHeaders = new RequestHeader[_headerKeysCount]();
   _currentHeaders[0].key = FPSTR(AUTHORIZATION_HEADER);
-  for (int i = 1; i < _headerKeysCount; i++){
+  for (size_t i = 1; i <= headerKeysCount; i++){
     _currentHeaders[i].key = headerKeys[i-1];
   }
+  for (size_t i = 0; i < serverHeadersCount; i++){
+    _currentHeaders[headerKeysCount + 1 + i].key = FPSTR(serverHeaders[i]);
+  }
 }
 
 String WebServer::header(int i) {
-  if (i < _headerKeysCount)
+  if (i < _headerKeysCount && _currentHeaders[i].value)
     return _currentHeaders[i].value;
   return "";
 }
@@ -594,14 +991,14 @@ int WebServer::headers() {
 
 bool WebServer::hasHeader(String name) {
   for (int i = 0; i < _headerKeysCount; ++i) {
-    if ((_currentHeaders[i].key.equalsIgnoreCase(name)) &&  (_currentHeaders[i].value.length() > 0))
+    if ((_currentHeaders[i].key.equalsIgnoreCase(name)) && _currentHeaders[i].value && *_currentHeaders[i].value)
       return true;
   }
   return false;
 }
 
 String WebServer::hostHeader() {
-  return _hostHeader;
+  return _hostHeader ? _hostHeader : "";
 }
 
 void WebServer::onFileUpload(THandlerFunction fn) {
@@ -613,6 +1010,9 @@ void WebServer::onNotFound(THandlerFunction fn) {
 }
 
 void WebServer::_handleRequest() {
+  unsigned long handlerStart = micros();
+  _responseCode = 0;
+  _sendMicros = 0;
   bool handled = false;
   if (!_currentHandler){
     log_e("request handler not found");
@@ -635,6 +1035,10 @@ void WebServer::_handleRequest() {
   if (handled) {
     _finalizeResponse();
   }
+  if (_metrics) {
+    _recordRequest(handlerStart);
+  }
+  _clearRequest();
   _currentUri = "";
 }
 
@@ -643,6 +1047,38 @@ void WebServer::_finalizeResponse() {
   if (_chunked) {
     sendContent("");
   }
+  flush();
+}
+
+// Everything parsed from the request lives in the arena, drop the views before reusing it
+void WebServer::_clearRequest() {
+  log_v("request arena: %u bytes, high water %u", _arena.used(), _arena.highWater());
+  _currentArgs = nullptr;
+  _currentArgCount = 0;
+  _postArgs = nullptr;
+  _postArgsLen = 0;
+  for (int i = 0; i < _headerKeysCount; ++i) {
+    _currentHeaders[i].value = nullptr;
+  }
+  _hostHeader = nullptr;
+  free(_bodyBuffer);
+  _bodyBuffer = nullptr;
+  _parseError = 0;
+  _arena.reset();
+}
+
+// Answer a request that was too large to take in, instead of dropping it unanswered
+void WebServer::_rejectRequest() {
+  char response[128];
+  int len = snprintf(response, sizeof(response),
+                     "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                     _parseError, _responseCodeToString(_parseError).c_str());
+  size_t sent = _currentClient.write((const uint8_t *)response, len);
+  _currentClient.stop();
+  if (_metrics) {
+    _metrics->countStatus(_parseError);
+    _metrics->bytesOut += sent;
+  }
 }
 
 String WebServer::_responseCodeToString(int code) {
@@ -681,6 +1117,7 @@ String WebServer::_responseCodeToString(int code) {
     case 415: return F("Unsupported Media Type");
     case 416: return F("Requested range not satisfiable");
     case 417: return F("Expectation Failed");
+    case 431: return F("Request Header Fields Too Large");
     case 500: return F("Internal Server Error");
     case 501: return F("Not Implemented");
     case 502: return F("Bad Gateway");
@@ -28,20 +28,59 @@
 #include <memory>
 #include <rpcWiFi.h>
 #include "HTTP_Method.h"
+#include "detail/GzipEncoder.h"
+#include "detail/RequestArena.h"
+#include "detail/ServerMetrics.h"
 
 enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END,
                         UPLOAD_FILE_ABORTED };
 enum HTTPClientStatus { HC_NONE, HC_WAIT_READ, HC_WAIT_CLOSE };
 enum HTTPAuthMethod { BASIC_AUTH, DIGEST_AUTH };
+enum WebSocketEvent { WS_CONNECTED, WS_DISCONNECTED, WS_TEXT, WS_BINARY };
 
 #define HTTP_DOWNLOAD_UNIT_SIZE 1436
 
 #ifndef HTTP_UPLOAD_BUFLEN
-#define HTTP_UPLOAD_BUFLEN 1436
+#define HTTP_UPLOAD_BUFLEN 2048 // whole FAT sectors per upload callback
 #endif
 
-#define HTTP_MAX_DATA_WAIT 5000 //ms to wait for the client to send the request
-#define HTTP_MAX_POST_WAIT 5000 //ms to wait for POST data to arrive
+#ifndef HTTP_OUTPUT_BUFLEN
+#define HTTP_OUTPUT_BUFLEN HTTP_DOWNLOAD_UNIT_SIZE // one TCP segment worth of response
+#endif
+
+#ifndef WEBSERVER_GZIP_MIN_SIZE
+#define WEBSERVER_GZIP_MIN_SIZE 1024 // smaller bodies fit a segment or two anyway
+#endif
+
+#ifndef WEBSERVER_MAX_BODY_SIZE
+#define WEBSERVER_MAX_BODY_SIZE 16384 // plain bodies past the arena go to the heap up to this size
+#endif
+
+#ifndef WEBSOCKET_MAX_CLIENTS
+#define WEBSOCKET_MAX_CLIENTS 4
+#endif
+
+#ifndef WEBSOCKET_MAX_MESSAGE
+#define WEBSOCKET_MAX_MESSAGE 2048 // larger messages are refused with close code 1009
+#endif
+
+#ifndef WEBSERVER_RATE_TABLE_SIZE
+#define WEBSERVER_RATE_TABLE_SIZE 8 // remote addresses tracked for admission control
+#endif
+
+#ifndef WEBSERVER_RATE_BURST
+#define WEBSERVER_RATE_BURST 8 // requests a client may make back to back
+#endif
+
+#ifndef WEBSERVER_RATE_REFILL
+#define WEBSERVER_RATE_REFILL 250 //ms for a client to earn back one request
+#endif
+
+#define WEBSOCKET_PING_INTERVAL 30000 //ms of silence before a ping, and to wait for the pong
+#define HTTP_MAX_FIRST_BYTE_WAIT 1000 //ms for a new connection to send anything at all
+#define HTTP_MAX_HEADER_WAIT 3000 //ms for the request line and all headers to arrive
+#define HTTP_MAX_POST_WAIT 5000 //ms for the whole POST body to arrive
+#define HTTP_MIN_UPLOAD_RATE 4096 //bytes/s a multipart body must average, beyond HTTP_MAX_POST_WAIT
 #define HTTP_MAX_SEND_WAIT 5000 //ms to wait for data chunk to be ACKed
 #define HTTP_MAX_CLOSE_WAIT 2000 //ms to wait for the client to close the connection
 
@@ -49,6 +88,7 @@ enum HTTPAuthMethod { BASIC_AUTH, DIGEST_AUTH };
 #define CONTENT_LENGTH_NOT_SET ((size_t) -2)
 
 class WebServer;
+class MultipartReader;
 
 typedef struct {
   HTTPUploadStatus status;
@@ -92,9 +132,19 @@ public:
   void onNotFound(THandlerFunction fn);  //called when handler is not assigned
   void onFileUpload(THandlerFunction fn); //handle file uploads
 
+  // WebSocket endpoints, polled from handleClient()
+  typedef std::function<void(uint8_t client, WebSocketEvent event, const uint8_t* payload, size_t length)> TWebSocketFunction;
+  void onWebSocket(const String &uri, TWebSocketFunction fn);
+  bool sendText(uint8_t client, const String& text);
+  bool sendBinary(uint8_t client, const uint8_t* data, size_t length);
+  void broadcastText(const String& text);
+  void broadcastBinary(const uint8_t* data, size_t length);
+  void disconnectWebSocket(uint8_t client);
+  int webSocketClients();         // number of open WebSocket connections
+
   String uri() { return _currentUri; }
   HTTPMethod method() { return _currentMethod; }
-  virtual WiFiClient client() { return _currentClient; }
+  virtual WiFiClient client() { flush(); return _currentClient; }
   HTTPUpload& upload() { return *_currentUpload; }
 
   String pathArg(unsigned int i); // get request path argument by number
@@ -111,6 +161,7 @@ public:
   bool hasHeader(String name);       // check if header exists
 
   String hostHeader();            // get request host header if available or empty String if not
+  size_t arenaHighWater() { return _arena.highWater(); } // most request arena bytes used so far
 
   // send response to the client
   // code - HTTP response code, can be 200 or 404
@@ -124,62 +175,128 @@ public:
 
   void enableCORS(boolean value = true);
   void enableCrossOrigin(boolean value = true);
+  void enableCompression(boolean value = true); // gzip dynamic responses for clients that accept it
+  void enableRateLimit(boolean value = true);   // per address token bucket, off by default
+  void enableMetrics(const String& uri = "/metrics"); // count requests and serve them in Prometheus text format
+  typedef std::function<void(Print& out)> TMetricsFunction;
+  void onMetrics(TMetricsFunction fn);                // append the application's own lines to the metrics
 
   void setContentLength(const size_t contentLength);
   void sendHeader(const String& name, const String& value, bool first = false);
   void sendContent(const String& content);
   void sendContent_P(PGM_P content);
   void sendContent_P(PGM_P content, size_t size);
+  bool flush();                   // push buffered response bytes to the client
 
   static String urlDecode(const String& text);
 
   template<typename T>
   size_t streamFile(T &file, const String& contentType) {
+    return streamFile(file, contentType.c_str());
+  }
+
+  template<typename T>
+  size_t streamFile(T &file, const char* contentType) {
     _streamFileCore(file.size(), file.name(), contentType);
-    uint8_t buffer[512];
+    // read straight into the output buffer so the header shares the first segment
     uint32_t remain = file.size();
-    uint16_t bytesToWrite = 0;
     uint32_t count = 0;
 
-    while(true){
-    bytesToWrite = remain > 512 ? 512 : remain;
-    remain -= bytesToWrite;
-    file.read(buffer, bytesToWrite);
-    count += _currentClient.write(buffer, bytesToWrite);
-    if(remain == 0)
-      break;
+    while(remain){
+      size_t space = HTTP_OUTPUT_BUFLEN - _outputLength;
+      int got = file.read(_outputBuffer + _outputLength, remain > space ? space : remain);
+      if(got <= 0)
+        break;
+      _outputLength += got;
+      remain -= got;
+      if(_outputLength == HTTP_OUTPUT_BUFLEN && !flush())
+        return count;
+      count += got;
     }
+    flush();
     return count;
   }
 
 protected:
   virtual size_t _currentClientWrite(const char* b, size_t l) { return _currentClient.write( b, l ); }
   virtual size_t _currentClientWrite_P(PGM_P b, size_t l) { return _currentClient.write_P( b, l ); }
+  void _bufferWrite(const char* b, size_t l);
+  void _bufferWrite_P(PGM_P b, size_t l);
+  void _bufferChunkSize(size_t l);
+  bool _beginCompression(int code, size_t contentLength);
+  void _compressContent(const uint8_t* data, size_t length);
+  void _sendChunk(const uint8_t* data, size_t length);
+  bool _admitClient(WiFiClient& client);
+  void _countSent(size_t sent, unsigned long start);
+  void _recordRequest(unsigned long start);
+  void _sendMetrics();
   void _addRequestHandler(RequestHandler* handler);
   void _handleRequest();
   void _finalizeResponse();
+  void _clearRequest();
   bool _parseRequest(WiFiClient& client);
-  void _parseArguments(String data);
+  void _rejectRequest();
+  bool _parseArguments(char* search, char* form, int extra);
   static String _responseCodeToString(int code);
-  bool _parseForm(WiFiClient& client, String boundary, uint32_t len);
+  bool _parseForm(WiFiClient& client, const char* boundary, uint32_t len);
+  bool _parseFormParts(MultipartReader& reader, const char* boundary);
   bool _parseFormUploadAborted();
-  void _uploadWriteByte(uint8_t b);
-  int _uploadReadByte(WiFiClient& client);
+  void _uploadWriteBytes(const uint8_t* data, size_t length);
   void _prepareHeader(String& response, int code, const char* content_type, size_t contentLength);
   bool _collectHeader(const char* headerName, const char* headerValue);
 
-  void _streamFileCore(const size_t fileSize, const String & fileName, const String & contentType);
+  void _streamFileCore(const size_t fileSize, const String & fileName, const char* contentType);
+
+  friend class WebSocketRequestHandler;
+  bool _upgradeWebSocket(TWebSocketFunction fn);
+  void _handleWebSockets();
+  void _readWebSocket(uint8_t num);
+  void _webSocketFrameDone(uint8_t num);
+  bool _sendWebSocketFrame(uint8_t num, uint8_t opcode, const uint8_t* data, size_t length);
+  void _closeWebSocket(uint8_t num, uint16_t code);
 
   String _getRandomHexString();
   // for extracting Auth parameters
   String _extractParam(String& authReq,const String& param,const char delimit = '"');
 
+  // keys and values point into _arena, or _bodyBuffer for a large body,
+  // except the fixed "plain" key
   struct RequestArgument {
-    String key;
-    String value;
+    const char* key;
+    const char* value;
+  };
+
+  struct RequestHeader {
+    String      key;
+    const char* value;     // nullptr when the request did not carry it
+  };
+
+  struct RateBucket {
+    uint32_t      address;
+    uint16_t      tokens;
+    unsigned long refilled;   // when tokens were last topped up
+    unsigned long lastSeen;
+  };
+
+  struct WebSocketConnection {
+    WiFiClient         client;
+    TWebSocketFunction fn;
+    uint8_t            header[14];    // frame header being received
+    uint8_t            headerLength;
+    uint8_t            headerNeeded;
+    size_t             payloadLength;
+    size_t             payloadRead;
+    uint8_t*           message;       // reassembled data frames
+    size_t             messageLength;
+    uint8_t            messageOpcode;
+    uint8_t            control[125];  // ping and close payloads
+    unsigned long      lastSeen;
+    bool               pingSent;
   };
 
   boolean     _corsEnabled;
+  boolean     _compressionEnabled;
+  boolean     _rateLimitEnabled;
   WiFiServer  _server;
 
   WiFiClient  _currentClient;
@@ -203,17 +320,31 @@ protected:
   std::unique_ptr<HTTPUpload> _currentUpload;
 
   int              _headerKeysCount;
-  RequestArgument* _currentHeaders;
+  RequestHeader*   _currentHeaders;
   size_t           _contentLength;
   String           _responseHeaders;
 
-  String           _hostHeader;
+  const char*      _hostHeader;
   bool             _chunked;
 
   String           _snonce;  // Store noance and opaque for future comparison
   String           _sopaque;
   String           _srealm;  // Store the Auth realm between Calls
 
+  uint8_t          _outputBuffer[HTTP_OUTPUT_BUFLEN];
+  size_t           _outputLength;
+  RequestArena     _arena;
+  RateBucket       _rateBuckets[WEBSERVER_RATE_TABLE_SIZE];
+  GzipEncoder      _gzip;
+  std::unique_ptr<WebSocketConnection[]> _webSockets;
+  std::unique_ptr<ServerMetrics> _metrics;
+  TMetricsFunction               _metricsHandler;
+  int              _responseCode;
+  unsigned long    _sendMicros;    // spent writing the current response
+  size_t           _bytesReceived; // of the current request
+  char*            _bodyBuffer;    // plain body too large for the arena
+  int              _parseError;    // status to refuse an unparsable request with, 0 to just drop it
+
 };
 
 
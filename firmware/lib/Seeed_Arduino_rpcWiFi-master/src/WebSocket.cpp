@@ -0,0 +1,340 @@
+/*
+  WebSocket.cpp - RFC 6455 WebSocket endpoints for WebServer.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <Arduino.h>
+#include "esp/esp_hal_log.h"
+#include <libb64/cencode.h>
+#include "WiFiServer.h"
+#include "WiFiClient.h"
+#include "WebServer.h"
+#include "Seeed_mbedtls.h"
+#include "mbedtls/sha1.h"
+
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT         0x1
+#define WS_OPCODE_BINARY       0x2
+#define WS_OPCODE_CLOSE        0x8
+#define WS_OPCODE_PING         0x9
+#define WS_OPCODE_PONG         0xA
+
+#define WS_CLOSE_NORMAL        1000
+#define WS_CLOSE_PROTOCOL      1002
+#define WS_CLOSE_TOO_BIG       1009
+
+static const char WS_GUID[] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static String webSocketAccept(const String& key)
+{
+  mbedtls_sha1_context ctx;
+  uint8_t hash[20];
+  char encoded[base64_encode_expected_len(sizeof(hash)) + 1];
+  String input = key + FPSTR(WS_GUID);
+  mbedtls_sha1_init(&ctx);
+  mbedtls_sha1_starts(&ctx);
+  mbedtls_sha1_update(&ctx, (const uint8_t *)input.c_str(), input.length());
+  mbedtls_sha1_finish(&ctx, hash);
+  mbedtls_sha1_free(&ctx);
+  int len = base64_encode_chars((const char *)hash, sizeof(hash), encoded);
+  encoded[len > 0 ? len : 0] = '\0';
+  String accept(encoded);
+  accept.trim();
+  return accept;
+}
+
+bool WebServer::_upgradeWebSocket(TWebSocketFunction fn) {
+  String key = header(F("Sec-WebSocket-Key"));
+  if (!header(F("Upgrade")).equalsIgnoreCase(F("websocket")) || key.length() == 0) {
+    send(400, "text/plain", F("WebSocket upgrade required"));
+    return true;
+  }
+  if (header(F("Sec-WebSocket-Version")) != "13") {
+    sendHeader(F("Sec-WebSocket-Version"), F("13"));
+    send(426, "text/plain", F("Unsupported WebSocket version"));
+    return true;
+  }
+
+  uint8_t num;
+  for (num = 0; num < WEBSOCKET_MAX_CLIENTS; num++) {
+    if (!_webSockets[num].fn)
+      break;
+  }
+  if (num == WEBSOCKET_MAX_CLIENTS) {
+    log_e("no free WebSocket slot");
+    send(503, "text/plain", F("Too many WebSocket clients"));
+    return true;
+  }
+
+  String response = F("HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: ");
+  response += webSocketAccept(key);
+  response += F("\r\n\r\n");
+  _responseCode = 101;
+  _bufferWrite(response.c_str(), response.length());
+  if (!flush()) {
+    return true;
+  }
+
+  WebSocketConnection& ws = _webSockets[num];
+  free(ws.message);
+  ws = WebSocketConnection();
+  ws.client = _currentClient;
+  ws.fn = fn;
+  ws.headerNeeded = 2;
+  ws.lastSeen = millis();
+  // the socket now belongs to the WebSocket, so handleClient() can move on
+  _currentClient = WiFiClient();
+  log_v("WebSocket %u connected on %s", num, _currentUri.c_str());
+  fn(num, WS_CONNECTED, (const uint8_t *)_currentUri.c_str(), _currentUri.length());
+  return true;
+}
+
+void WebServer::_handleWebSockets() {
+  for (uint8_t num = 0; num < WEBSOCKET_MAX_CLIENTS; num++) {
+    WebSocketConnection& ws = _webSockets[num];
+    if (!ws.fn)
+      continue;
+    if (!ws.client.connected()) {
+      _closeWebSocket(num, 0);
+      continue;
+    }
+    _readWebSocket(num);
+    if (!ws.fn || millis() - ws.lastSeen <= WEBSOCKET_PING_INTERVAL)
+      continue;
+    if (ws.pingSent) {
+      log_v("WebSocket %u ping timeout", num);
+      _closeWebSocket(num, 0);
+    } else {
+      _sendWebSocketFrame(num, WS_OPCODE_PING, nullptr, 0);
+      ws.pingSent = true;
+      ws.lastSeen = millis();
+    }
+  }
+}
+
+// Consume whatever has arrived without blocking; frame state survives between calls
+void WebServer::_readWebSocket(uint8_t num) {
+  WebSocketConnection& ws = _webSockets[num];
+  while (ws.fn && ws.client.available()) {
+    if (ws.headerLength < ws.headerNeeded) {
+      int res = ws.client.read(ws.header + ws.headerLength, ws.headerNeeded - ws.headerLength);
+      if (res <= 0)
+        return;
+      ws.headerLength += res;
+      if (ws.headerLength == 2) {
+        uint8_t len7 = ws.header[1] & 0x7F;
+        if (!(ws.header[1] & 0x80)) {
+          // clients must mask every frame
+          _closeWebSocket(num, WS_CLOSE_PROTOCOL);
+          return;
+        }
+        ws.headerNeeded = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + 4;
+      }
+      if (ws.headerLength < ws.headerNeeded)
+        continue;
+
+      uint8_t opcode = ws.header[0] & 0x0F;
+      bool fin = ws.header[0] & 0x80;
+      uint64_t length = ws.header[1] & 0x7F;
+      if (length == 126) {
+        length = ((uint16_t)ws.header[2] << 8) | ws.header[3];
+      } else if (length == 127) {
+        // the most significant bit must be 0 (RFC 6455 5.2)
+        if (ws.header[2] & 0x80) {
+          _closeWebSocket(num, WS_CLOSE_PROTOCOL);
+          return;
+        }
+        length = 0;
+        for (int i = 2; i < 10; i++)
+          length = (length << 8) | ws.header[i];
+      }
+
+      if (opcode & 0x08) {
+        if (!fin || length > sizeof(ws.control) ||
+            (opcode != WS_OPCODE_CLOSE && opcode != WS_OPCODE_PING && opcode != WS_OPCODE_PONG)) {
+          _closeWebSocket(num, WS_CLOSE_PROTOCOL);
+          return;
+        }
+      } else {
+        bool continuation = opcode == WS_OPCODE_CONTINUATION;
+        if ((continuation && !ws.messageOpcode) || (!continuation && ws.messageOpcode) ||
+            (!continuation && opcode != WS_OPCODE_TEXT && opcode != WS_OPCODE_BINARY)) {
+          _closeWebSocket(num, WS_CLOSE_PROTOCOL);
+          return;
+        }
+        // not added up, a huge length would wrap the sum past the check
+        if (length > WEBSOCKET_MAX_MESSAGE - ws.messageLength) {
+          _closeWebSocket(num, WS_CLOSE_TOO_BIG);
+          return;
+        }
+        // one spare byte so text messages can be handed out NUL terminated
+        uint8_t* message = (uint8_t *)realloc(ws.message, ws.messageLength + length + 1);
+        if (!message) {
+          log_e("Not enough memory for WebSocket message");
+          _closeWebSocket(num, WS_CLOSE_TOO_BIG);
+          return;
+        }
+        ws.message = message;
+        if (!continuation)
+          ws.messageOpcode = opcode;
+      }
+      ws.payloadLength = length;
+      ws.payloadRead = 0;
+      if (length == 0)
+        _webSocketFrameDone(num);
+      continue;
+    }
+
+    uint8_t* payload = (ws.header[0] & 0x08) ? ws.control : ws.message + ws.messageLength;
+    int res = ws.client.read(payload + ws.payloadRead, ws.payloadLength - ws.payloadRead);
+    if (res <= 0)
+      return;
+    ws.payloadRead += res;
+    if (ws.payloadRead == ws.payloadLength)
+      _webSocketFrameDone(num);
+  }
+}
+
+void WebServer::_webSocketFrameDone(uint8_t num) {
+  WebSocketConnection& ws = _webSockets[num];
+  uint8_t opcode = ws.header[0] & 0x0F;
+  bool fin = ws.header[0] & 0x80;
+  const uint8_t* mask = ws.header + ws.headerNeeded - 4;
+  uint8_t* payload = (opcode & 0x08) ? ws.control : ws.message + ws.messageLength;
+  for (size_t i = 0; i < ws.payloadLength; i++)
+    payload[i] ^= mask[i & 3];
+
+  size_t length = ws.payloadLength;
+  ws.headerLength = 0;
+  ws.headerNeeded = 2;
+  ws.payloadLength = 0;
+  ws.payloadRead = 0;
+  ws.lastSeen = millis();
+  ws.pingSent = false;
+
+  switch (opcode) {
+  case WS_OPCODE_PING:
+    _sendWebSocketFrame(num, WS_OPCODE_PONG, ws.control, length);
+    break;
+  case WS_OPCODE_PONG:
+    break;
+  case WS_OPCODE_CLOSE: {
+    uint16_t code = length >= 2 ? ((uint16_t)ws.control[0] << 8) | ws.control[1] : WS_CLOSE_NORMAL;
+    _closeWebSocket(num, code);
+    break;
+  }
+  default:
+    ws.messageLength += length;
+    if (fin) {
+      WebSocketEvent event = ws.messageOpcode == WS_OPCODE_TEXT ? WS_TEXT : WS_BINARY;
+      ws.message[ws.messageLength] = '\0';
+      // the callback may close this connection, which resets the slot and its fn
+      TWebSocketFunction fn = ws.fn;
+      uint8_t* message = ws.message;
+      ws.message = nullptr;
+      fn(num, event, message, ws.messageLength);
+      free(message);
+      ws.messageLength = 0;
+      ws.messageOpcode = 0;
+    }
+    break;
+  }
+}
+
+bool WebServer::_sendWebSocketFrame(uint8_t num, uint8_t opcode, const uint8_t* data, size_t length) {
+  if (!_webSockets || num >= WEBSOCKET_MAX_CLIENTS)
+    return false;
+  WebSocketConnection& ws = _webSockets[num];
+  if (!ws.fn || !ws.client.connected())
+    return false;
+
+  // server frames are never masked; small frames leave in a single write
+  uint8_t frame[10 + 125];
+  size_t headerLength = 2;
+  frame[0] = 0x80 | opcode;
+  if (length < 126) {
+    frame[1] = length;
+  } else if (length <= 0xFFFF) {
+    frame[1] = 126;
+    frame[2] = length >> 8;
+    frame[3] = length;
+    headerLength = 4;
+  } else {
+    frame[1] = 127;
+    for (int i = 0; i < 8; i++)
+      frame[2 + i] = (uint64_t)length >> (8 * (7 - i));
+    headerLength = 10;
+  }
+  if (headerLength + length <= sizeof(frame)) {
+    if (length)
+      memcpy(frame + headerLength, data, length);
+    return ws.client.write(frame, headerLength + length) == headerLength + length;
+  }
+  if (ws.client.write(frame, headerLength) != headerLength)
+    return false;
+  return ws.client.write(data, length) == length;
+}
+
+// code 0 drops the connection without a closing handshake
+void WebServer::_closeWebSocket(uint8_t num, uint16_t code) {
+  WebSocketConnection& ws = _webSockets[num];
+  if (code) {
+    uint8_t status[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+    _sendWebSocketFrame(num, WS_OPCODE_CLOSE, status, sizeof(status));
+  }
+  log_v("WebSocket %u closed: %u", num, code);
+  TWebSocketFunction fn = ws.fn;
+  ws.client.stop();
+  free(ws.message);
+  ws = WebSocketConnection();
+  if (fn)
+    fn(num, WS_DISCONNECTED, nullptr, 0);
+}
+
+bool WebServer::sendText(uint8_t client, const String& text) {
+  return _sendWebSocketFrame(client, WS_OPCODE_TEXT, (const uint8_t *)text.c_str(), text.length());
+}
+
+bool WebServer::sendBinary(uint8_t client, const uint8_t* data, size_t length) {
+  return _sendWebSocketFrame(client, WS_OPCODE_BINARY, data, length);
+}
+
+void WebServer::broadcastText(const String& text) {
+  for (uint8_t num = 0; _webSockets && num < WEBSOCKET_MAX_CLIENTS; num++)
+    _sendWebSocketFrame(num, WS_OPCODE_TEXT, (const uint8_t *)text.c_str(), text.length());
+}
+
+void WebServer::broadcastBinary(const uint8_t* data, size_t length) {
+  for (uint8_t num = 0; _webSockets && num < WEBSOCKET_MAX_CLIENTS; num++)
+    _sendWebSocketFrame(num, WS_OPCODE_BINARY, data, length);
+}
+
+void WebServer::disconnectWebSocket(uint8_t client) {
+  if (_webSockets && client < WEBSOCKET_MAX_CLIENTS && _webSockets[client].fn)
+    _closeWebSocket(client, WS_CLOSE_NORMAL);
+}
+
+int WebServer::webSocketClients() {
+  int count = 0;
+  for (uint8_t num = 0; _webSockets && num < WEBSOCKET_MAX_CLIENTS; num++) {
+    if (_webSockets[num].fn)
+      count++;
+  }
+  return count;
+}
@@ -39,6 +39,7 @@ private:
         size_t _fill;
         int _fd;
         bool _failed;
+        bool _closed;
 
         size_t r_available()
         {
@@ -77,18 +78,22 @@ private:
                 }
                 return 0;
             }
+            if(res == 0) {
+                _closed = true;
+            }
             _fill += res;
             return res;
         }
 
 public:
-    WiFiClientRxBuffer(int fd, size_t size=1024)
+    WiFiClientRxBuffer(int fd, size_t size=WIFI_CLIENT_RX_BUFFER_SIZE)
         :_size(size)
         ,_buffer(NULL)
         ,_pos(0)
         ,_fill(0)
         ,_fd(fd)
         ,_failed(false)
+        ,_closed(false)
     {
         //_buffer = (uint8_t *)malloc(_size);
     }
@@ -102,39 +107,86 @@ public:
         return _failed;
     }
 
+    // The peer closed and everything it sent has been read
+    bool closed(){
+        return _closed && _pos == _fill;
+    }
+
+    // Change the capacity, keeping whatever is still unread
+    bool resize(size_t size){
+        size_t pending = _fill - _pos;
+        if(!size || size < pending){
+            return false;
+        }
+        if(_buffer){
+            memmove(_buffer, _buffer + _pos, pending);
+            uint8_t * buffer = (uint8_t *)realloc(_buffer, size);
+            if(!buffer){
+                log_e("Not enough memory to allocate buffer");
+                return false;
+            }
+            _buffer = buffer;
+        }
+        _pos = 0;
+        _fill = pending;
+        _size = size;
+        return true;
+    }
+
+    // Copies what is buffered, then reads the socket without blocking until len
+    // bytes are in or nothing more has arrived. Whenever at least a buffer's
+    // worth is still wanted, recv() goes straight into dst.
+    size_t fill(uint8_t * dst, size_t len){
+        size_t done = 0;
+        while(done < len){
+            size_t left = len - done;
+            size_t a = _fill - _pos;
+            if(a){
+                size_t toRead = (a > left)?left:a;
+                if(toRead == 1){
+                    dst[done] = _buffer[_pos];
+                } else {
+                    memcpy(dst + done, _buffer + _pos, toRead);
+                }
+                _pos += toRead;
+                done += toRead;
+            } else if(left >= _size){
+                int res = recv(_fd, dst + done, left, MSG_DONTWAIT);
+                if(res <= 0){
+                    if(res < 0 && errno != EWOULDBLOCK){
+                        _failed = true;
+                    }
+                    if(res == 0){
+                        _closed = true;
+                    }
+                    break;
+                }
+                done += res;
+            } else if(!fillBuffer()){
+                break;
+            }
+        }
+        return done;
+    }
+
     int read(uint8_t * dst, size_t len){
-        if(!dst || !len || (_pos == _fill && !fillBuffer())){
+        if(!dst || !len){
             return -1;
         }
-        size_t a = _fill - _pos;
-        if(len <= a || ((len - a) <= (_size - _fill) && fillBuffer() >= (len - a))){
-            if(len == 1){
-                *dst = _buffer[_pos];
-            } else {
-                memcpy(dst, _buffer + _pos, len);
-            }
-            _pos += len;
-            return len;
-        }
-        size_t left = len;
-        size_t toRead = a;
-        uint8_t * buf = dst;
-        memcpy(buf, _buffer + _pos, toRead);
-        _pos += toRead;
-        left -= toRead;
-        buf += toRead;
-        while(left){
-            if(!fillBuffer()){
-                return len - left;
+        size_t res = fill(dst, len);
+        return res ? res : -1;
+    }
+
+    int readv(const WiFiClientIOVec * iov, size_t count){
+        size_t total = 0;
+        for(size_t i = 0; i < count; i++){
+            size_t res = fill((uint8_t *)iov[i].base, iov[i].length);
+            total += res;
+            if(res < iov[i].length){
+                break;
             }
-            a = _fill - _pos;
-            toRead = (a > left)?left:a;
-            memcpy(buf, _buffer + _pos, toRead);
-            _pos += toRead;
-            left -= toRead;
-            buf += toRead;
         }
-        return len;
+        return total ? total : -1;
     }
 
     int peek(){
@@ -144,6 +196,18 @@ public:
         return _buffer[_pos];
     }
 
+    size_t buffered(){
+        return _fill - _pos;
+    }
+
+    const uint8_t * front(){
+        return _buffer ? _buffer + _pos : NULL;
+    }
+
+    void consume(size_t len){
+        _pos += (len < _fill - _pos)?len:(_fill - _pos);
+    }
+
     size_t available(){
         if (_fill - _pos > 0)
             return _fill - _pos;
@@ -159,6 +223,92 @@ public:
     }
 };
 
+class WiFiClientTxBuffer {
+private:
+        size_t _size;
+        uint8_t *_buffer;
+        size_t _head;   // oldest unsent byte
+        size_t _length;
+        int _fd;
+
+public:
+    WiFiClientTxBuffer(int fd, size_t size=WIFI_CLIENT_TX_BUFFER_SIZE)
+        :_size(size)
+        ,_buffer(NULL)
+        ,_head(0)
+        ,_length(0)
+        ,_fd(fd)
+    {
+    }
+
+    ~WiFiClientTxBuffer()
+    {
+        free(_buffer);
+    }
+
+    size_t pending(){
+        return _length;
+    }
+
+    size_t room(){
+        return _size - _length;
+    }
+
+    // Oldest unsent bytes that sit in one piece
+    const uint8_t * front(size_t &len){
+        len = _length;
+        if(_head + len > _size){
+            len = _size - _head;
+        }
+        return _buffer + _head;
+    }
+
+    void consume(size_t len){
+        _head = (_head + len) % _size;
+        _length -= len;
+        if(!_length){
+            _head = 0;
+        }
+    }
+
+    // Queue up to len bytes, returns how many fit
+    size_t push(const uint8_t * data, size_t len){
+        if(!_buffer){
+            _buffer = (uint8_t *)malloc(_size);
+            if(!_buffer){
+                log_e("Not enough memory to allocate buffer");
+                return 0;
+            }
+        }
+        if(len > room()){
+            len = room();
+        }
+        size_t tail = (_head + _length) % _size;
+        size_t first = (tail + len > _size) ? _size - tail : len;
+        memcpy(_buffer + tail, data, first);
+        memcpy(_buffer, data + first, len - first);
+        _length += len;
+        return len;
+    }
+
+    // Hand the socket what it takes without waiting, false on a hard error
+    bool send(){
+        while(_length){
+            size_t len;
+            const uint8_t * data = front(len);
+            int res = ::send(_fd, data, len, MSG_DONTWAIT);
+            if(res < 0){
+                return errno == EWOULDBLOCK || errno == EAGAIN;
+            }
+            consume(res);
+            if((size_t)res < len){
+                break;
+            }
+        }
+        return true;
+    }
+};
+
 class WiFiClientSocketHandle {
 private:
     int sockfd;
@@ -179,14 +329,45 @@ public:
     }
 };
 
-WiFiClient::WiFiClient():_connected(false),next(NULL)
+WiFiClient::WiFiClient()
+    :_rxBufferSize(WIFI_CLIENT_RX_BUFFER_SIZE)
+    ,_txBufferSize(WIFI_CLIENT_TX_BUFFER_SIZE)
+    ,_nonBlocking(false)
+    ,_corked(false)
+    ,_writableWanted(false)
+    ,_connected(false)
+    ,next(NULL)
 {
 }
 
-WiFiClient::WiFiClient(int fd):_connected(true),next(NULL)
+WiFiClient::WiFiClient(int fd)
+    :_rxBufferSize(WIFI_CLIENT_RX_BUFFER_SIZE)
+    ,_txBufferSize(WIFI_CLIENT_TX_BUFFER_SIZE)
+    ,_nonBlocking(false)
+    ,_corked(false)
+    ,_writableWanted(false)
+    ,_connected(true)
+    ,next(NULL)
 {
     clientSocketHandle.reset(new WiFiClientSocketHandle(fd));
-    _rxBuffer.reset(new WiFiClientRxBuffer(fd));
+    _rxBuffer.reset(new WiFiClientRxBuffer(fd, _rxBufferSize));
+}
+
+// Shares the connection and settings, like operator=
+WiFiClient::WiFiClient(const WiFiClient &other)
+    :ESPLwIPClient(other)
+    ,clientSocketHandle(other.clientSocketHandle)
+    ,_rxBuffer(other._rxBuffer)
+    ,_rxBufferSize(other._rxBufferSize)
+    ,_txBuffer(other._txBuffer)
+    ,_txBufferSize(other._txBufferSize)
+    ,_nonBlocking(other._nonBlocking)
+    ,_corked(other._corked)
+    ,_writableWanted(other._writableWanted)
+    ,_writableCallback(other._writableCallback)
+    ,_connected(other._connected)
+    ,next(NULL)
+{
 }
 
 WiFiClient::~WiFiClient()
@@ -199,15 +380,57 @@ WiFiClient & WiFiClient::operator=(const WiFiClient &other)
     stop();
     clientSocketHandle = other.clientSocketHandle;
     _rxBuffer = other._rxBuffer;
+    _rxBufferSize = other._rxBufferSize;
+    _txBuffer = other._txBuffer;
+    _txBufferSize = other._txBufferSize;
+    _nonBlocking = other._nonBlocking;
+    _corked = other._corked;
+    _writableWanted = other._writableWanted;
+    _writableCallback = other._writableCallback;
     _connected = other._connected;
     return *this;
 }
 
+// Send what is queued before the socket closes, waiting for room like a
+// blocking write but no longer than WIFI_CLIENT_STOP_DRAIN_MS in all
+static void drainBeforeClose(WiFiClientTxBuffer &tx, int fd)
+{
+    unsigned long start = millis();
+    while(tx.send() && tx.pending()) {
+        unsigned long waited = millis() - start;
+        if(waited >= WIFI_CLIENT_STOP_DRAIN_MS) {
+            break;
+        }
+        unsigned long left = WIFI_CLIENT_STOP_DRAIN_MS - waited;
+        fd_set set;
+        struct timeval tv;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        tv.tv_sec = left / 1000;
+        tv.tv_usec = (left % 1000) * 1000;
+        if(lwip_select(fd + 1, NULL, &set, NULL, &tv) <= 0) {
+            break;
+        }
+    }
+    if(tx.pending()) {
+        log_w("fd %d closed with %u queued bytes unsent", fd, (unsigned) tx.pending());
+    }
+}
+
 void WiFiClient::stop()
 {
+    // the ring is taken first, so a send error while draining cannot come back here
+    std::shared_ptr<WiFiClientTxBuffer> tx;
+    tx.swap(_txBuffer);
+    // only the last handle closes the socket, copies keep using the ring
+    if(tx && tx->pending() && _connected && clientSocketHandle.use_count() == 1) {
+        drainBeforeClose(*tx, clientSocketHandle->fd());
+    }
     clientSocketHandle = NULL;
     _rxBuffer.reset();
     _rxBuffer = NULL;
+    _corked = false;
+    _writableWanted = false;
     _connected = false;
 }
 
@@ -216,11 +439,17 @@ int WiFiClient::connect(IPAddress ip, uint16_t port)
     return connect(ip,port,-1);
 }
 int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+    return connect(&ip, 1, port, timeout);
+}
+
+// Opens a non-blocking socket and starts connecting it
+static int startConnect(const IPAddress &ip, uint16_t port)
 {
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
         log_e("socket: %d", errno);
-        return 0;
+        return -1;
     }
     fcntl( sockfd, F_SETFL, fcntl( sockfd, F_GETFL, 0 ) | O_NONBLOCK );
 
@@ -230,50 +459,115 @@ int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
     serveraddr.sin_family = AF_INET;
     bcopy((const void *)(&ip_addr), (void *)&serveraddr.sin_addr.s_addr, 4);
     serveraddr.sin_port = htons(port);
-    fd_set fdset;
-    struct timeval tv;
-    FD_ZERO(&fdset);
-    FD_SET(sockfd, &fdset);
-    tv.tv_sec = 0;
-    tv.tv_usec = timeout * 1000;
 
     int res = lwip_connect_r(sockfd, (struct sockaddr*)&serveraddr, sizeof(serveraddr));
     if (res < 0 && errno != EINPROGRESS) {
         log_e("connect on fd %d, errno: %d, \"%s\"", sockfd, errno, strerror(errno));
         lwip_close(sockfd);
-        return 0;
+        return -1;
     }
+    return sockfd;
+}
 
-    res = lwip_select(sockfd + 1, nullptr, &fdset, nullptr, timeout<0 ? nullptr : &tv);
-    if (res < 0) {
-        log_e("select on fd %d, errno: %d, \"%s\"", sockfd, errno, strerror(errno));
-        lwip_close(sockfd);
-        return 0;
-    } else if (res == 0) {
-        log_i("select returned due to timeout %d ms for fd %d", timeout, sockfd);
-        lwip_close(sockfd);
-        return 0;
-    } else {
-        int sockerr;
-        socklen_t len = (socklen_t)sizeof(int);
-        res = getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &sockerr, &len);
+int WiFiClient::connect(const IPAddress *addresses, size_t count, uint16_t port, int32_t timeout)
+{
+    int sockets[WIFI_CLIENT_CONNECT_MAX];
+    size_t started = 0;
+    size_t pending = 0;
+    int sockfd = -1;
+    uint32_t start = millis();
+
+    if (count > WIFI_CLIENT_CONNECT_MAX) {
+        count = WIFI_CLIENT_CONNECT_MAX;
+    }
+
+    while (sockfd < 0) {
+        uint32_t elapsed = millis() - start;
+        // the next address gets its turn after the stagger, or at once when
+        // every attempt so far has failed
+        if (started < count && (!pending || elapsed >= started * WIFI_CLIENT_CONNECT_STAGGER)) {
+            sockets[started] = startConnect(addresses[started], port);
+            if (sockets[started] >= 0) {
+                pending++;
+            }
+            started++;
+            continue;
+        }
+        if (!pending) {
+            break;
+        }
+
+        // wait for an attempt to finish, the next start or the end of the budget
+        int32_t wait = -1;
+        if (started < count) {
+            wait = started * WIFI_CLIENT_CONNECT_STAGGER - elapsed;
+        }
+        if (timeout >= 0) {
+            if (elapsed >= (uint32_t)timeout) {
+                log_i("select returned due to timeout %d ms", timeout);
+                break;
+            }
+            int32_t left = timeout - elapsed;
+            if (wait < 0 || left < wait) {
+                wait = left;
+            }
+        }
+        fd_set fdset;
+        int maxfd = -1;
+        FD_ZERO(&fdset);
+        for (size_t i = 0; i < started; i++) {
+            if (sockets[i] >= 0) {
+                FD_SET(sockets[i], &fdset);
+                if (sockets[i] > maxfd) {
+                    maxfd = sockets[i];
+                }
+            }
+        }
+        struct timeval tv;
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
 
+        int res = lwip_select(maxfd + 1, nullptr, &fdset, nullptr, wait < 0 ? nullptr : &tv);
         if (res < 0) {
-            log_e("getsockopt on fd %d, errno: %d, \"%s\"", sockfd, errno, strerror(errno));
-            lwip_close(sockfd);
-            return 0;
+            log_e("select, errno: %d, \"%s\"", errno, strerror(errno));
+            break;
+        }
+        for (size_t i = 0; i < started && res > 0; i++) {
+            if (sockets[i] < 0 || !FD_ISSET(sockets[i], &fdset)) {
+                continue;
+            }
+            int sockerr;
+            socklen_t len = (socklen_t)sizeof(int);
+            if (getsockopt(sockets[i], SOL_SOCKET, SO_ERROR, &sockerr, &len) < 0) {
+                log_e("getsockopt on fd %d, errno: %d, \"%s\"", sockets[i], errno, strerror(errno));
+            } else if (sockerr != 0) {
+                log_e("socket error on fd %d, errno: %d, \"%s\"", sockets[i], sockerr, strerror(sockerr));
+            } else {
+                sockfd = sockets[i];
+                sockets[i] = -1;
+                break;
+            }
+            lwip_close(sockets[i]);
+            sockets[i] = -1;
+            pending--;
         }
+    }
 
-        if (sockerr != 0) {
-            log_e("socket error on fd %d, errno: %d, \"%s\"", sockfd, sockerr, strerror(sockerr));
-            lwip_close(sockfd);
-            return 0;
+    // the attempts that lost the race
+    for (size_t i = 0; i < started; i++) {
+        if (sockets[i] >= 0) {
+            lwip_close(sockets[i]);
         }
     }
+    if (sockfd < 0) {
+        return 0;
+    }
 
     fcntl( sockfd, F_SETFL, fcntl( sockfd, F_GETFL, 0 ) & (~O_NONBLOCK) );
     clientSocketHandle.reset(new WiFiClientSocketHandle(sockfd));
-    _rxBuffer.reset(new WiFiClientRxBuffer(sockfd));
+    _rxBuffer.reset(new WiFiClientRxBuffer(sockfd, _rxBufferSize));
+    _txBuffer.reset();
+    _corked = false;
     conn_staus = millis();
     _connected = true;
     return 1;
@@ -283,13 +577,21 @@ int WiFiClient::connect(const char *host, uint16_t port)
 {
     return connect(host,port,-1);
 }
+
+// The timeout is the budget for the lookup and the connect together
 int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout)
 {
-    IPAddress srv((uint32_t)0);
-    if(!WiFiGenericClass::hostByName(host, srv)){
+    IPAddress addresses[WIFI_CLIENT_CONNECT_MAX];
+    uint32_t start = millis();
+    int count = WiFiGenericClass::hostByName(host, addresses, WIFI_CLIENT_CONNECT_MAX, timeout);
+    if(!count){
         return 0;
     }
-    return connect(srv, port, timeout);
+    if(timeout >= 0) {
+        uint32_t spent = millis() - start;
+        timeout = spent < (uint32_t)timeout ? timeout - spent : 0;
+    }
+    return connect(addresses, count, port, timeout);
 }
 
 int WiFiClient::setSocketOption(int option, char* value, size_t len)
@@ -313,6 +615,18 @@ int WiFiClient::setTimeout(uint32_t seconds)
     return setSocketOption(SO_SNDTIMEO, (char *)&tv, sizeof(struct timeval));
 }
 
+bool WiFiClient::setRxBufferSize(size_t size)
+{
+    if(!size){
+        return false;
+    }
+    if(_rxBuffer && !_rxBuffer->resize(size)){
+        return false;
+    }
+    _rxBufferSize = size;
+    return true;
+}
+
 int WiFiClient::setOption(int option, int *value)
 {
     int res = setsockopt(fd(), IPPROTO_TCP, option, (char *) value, sizeof(int));
@@ -361,6 +675,161 @@ int WiFiClient::read()
 }
 
 size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+    int socketFileDescriptor = fd();
+    if(!_connected || (socketFileDescriptor < 0)) {
+        return 0;
+    }
+    if(!_nonBlocking && !_corked && !_txBuffer) {
+        return writeSocket(buf, size);
+    }
+    if(!_txBuffer) {
+        _txBuffer.reset(new WiFiClientTxBuffer(socketFileDescriptor, _txBufferSize));
+    }
+
+    size_t accepted = 0;
+    while(accepted < size) {
+        // nothing queued: try the socket first, no copy if it takes everything
+        if(!_corked && !_txBuffer->pending()) {
+            int res = send(socketFileDescriptor, (void*) (buf + accepted), size - accepted, MSG_DONTWAIT);
+            if(res < 0 && errno != EWOULDBLOCK && errno != EAGAIN) {
+                log_e("fail on fd %d, errno: %d, \"%s\"", socketFileDescriptor, errno, strerror(errno));
+                stop();
+                return accepted;
+            }
+            if(res > 0) {
+                accepted += res;
+                continue;
+            }
+        }
+        accepted += _txBuffer->push(buf + accepted, size - accepted);
+        if(accepted == size) {
+            break;
+        }
+        // the ring is full, make room: right away without waiting, or by
+        // draining it in the old blocking way
+        if(_nonBlocking ? (!pumpTx() || !_txBuffer || !_txBuffer->room()) : !drainTx()) {
+            break;
+        }
+    }
+    if(!_corked) {
+        // a blocking write only returns once its bytes are on the socket
+        if(_nonBlocking) {
+            pumpTx();
+        } else {
+            drainTx();
+        }
+    }
+    if(accepted < size) {
+        _writableWanted = true;
+    }
+    return accepted;
+}
+
+// Push queued bytes without waiting and run the writable hook when a short
+// write can go on; false once the connection has failed
+bool WiFiClient::pumpTx()
+{
+    if(!_txBuffer) {
+        return _connected;
+    }
+    if(!_txBuffer->send()) {
+        log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
+        stop();
+        return false;
+    }
+    size_t room = _txBuffer->room();
+    if(_writableWanted && room) {
+        _writableWanted = false;
+        if(_writableCallback) {
+            _writableCallback(room);
+        }
+    }
+    return true;
+}
+
+// Send everything queued, waiting on the socket like a blocking write does
+bool WiFiClient::drainTx()
+{
+    while(_txBuffer && _txBuffer->pending()) {
+        size_t len;
+        const uint8_t * data = _txBuffer->front(len);
+        size_t sent = writeSocket(data, len);
+        if(!_txBuffer) {
+            return false;
+        }
+        _txBuffer->consume(sent);
+        if(sent < len) {
+            return false;
+        }
+    }
+    return _connected;
+}
+
+void WiFiClient::setNonBlocking(bool enable, size_t txBufferSize)
+{
+    if(!enable) {
+        drainTx();
+    }
+    _nonBlocking = enable;
+    _txBufferSize = txBufferSize;
+    releaseTx();
+}
+
+// Drop an empty ring that is no longer needed or has the wrong size
+void WiFiClient::releaseTx()
+{
+    if(_txBuffer && !_txBuffer->pending() && (_txBuffer->room() != _txBufferSize || (!_nonBlocking && !_corked))) {
+        _txBuffer.reset();
+    }
+}
+
+size_t WiFiClient::writeAvailable()
+{
+    if(!_connected || fd() < 0) {
+        return 0;
+    }
+    if(_txBuffer) {
+        if(!_corked && !pumpTx()) {
+            return 0;
+        }
+        return _txBuffer->room();
+    }
+    if(!_nonBlocking && !_corked) {
+        // no ring: the socket's own readiness is what counts
+        fd_set set;
+        struct timeval tv = {0, 0};
+        FD_ZERO(&set);
+        FD_SET(fd(), &set);
+        return lwip_select(fd() + 1, NULL, &set, NULL, &tv) > 0 ? _txBufferSize : 0;
+    }
+    return _txBufferSize;
+}
+
+size_t WiFiClient::writePending()
+{
+    return _txBuffer ? _txBuffer->pending() : 0;
+}
+
+void WiFiClient::onWritable(std::function<void(size_t)> callback)
+{
+    _writableCallback = callback;
+}
+
+void WiFiClient::setCork(bool corked)
+{
+    _corked = corked;
+    if(!corked) {
+        if(_nonBlocking) {
+            pumpTx();
+        } else {
+            drainTx();
+        }
+        releaseTx();
+    }
+}
+
+size_t WiFiClient::writeSocket(const uint8_t *buf, size_t size)
 {
     int res =0;
     int retry = WIFI_CLIENT_MAX_WRITE_RETRY;
@@ -450,6 +919,19 @@ int WiFiClient::read(uint8_t *buf, size_t size)
     return res;
 }
 
+int WiFiClient::readv(const WiFiClientIOVec *iov, size_t count)
+{
+    if(!_rxBuffer){
+        return -1;
+    }
+    int res = _rxBuffer->readv(iov, count);
+    if(_rxBuffer->failed()) {
+        log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
+        stop();
+    }
+    return res;
+}
+
 int WiFiClient::peek()
 {
     int res = _rxBuffer->peek();
@@ -460,12 +942,35 @@ int WiFiClient::peek()
     return res;
 }
 
+size_t WiFiClient::peekAvailable()
+{
+    return _rxBuffer ? _rxBuffer->buffered() : 0;
+}
+
+const uint8_t *WiFiClient::peekBuffer()
+{
+    return _rxBuffer ? _rxBuffer->front() : NULL;
+}
+
+void WiFiClient::consume(size_t length)
+{
+    if(_rxBuffer) {
+        _rxBuffer->consume(length);
+    }
+}
+
 int WiFiClient::available()
 {
     if(!_rxBuffer)
     {
         return 0;
     }
+    if(_txBuffer && !_corked && _txBuffer->pending()) {
+        pumpTx();
+        if(!_rxBuffer) {
+            return 0;
+        }
+    }
     int res = _rxBuffer->available();
     if(_rxBuffer->failed()) {
         log_e("fail on fd %d, errno: %d, \"%s\"", fd(), errno, strerror(errno));
@@ -474,7 +979,10 @@ int WiFiClient::available()
     return res;
 }
 
-void WiFiClient::flush() {}
+void WiFiClient::flush()
+{
+    drainTx();
+}
 
 void WiFiClient::clear(){
     if(_rxBuffer != nullptr){
@@ -484,6 +992,13 @@ void WiFiClient::clear(){
 
 uint8_t WiFiClient::connected()
 {
+    if(_txBuffer && !_corked && _txBuffer->pending()) {
+        pumpTx();
+    }
+    if(_connected && _rxBuffer && _rxBuffer->closed()) {
+        // a read already saw the end of the stream, no need to ask the socket
+        _connected = false;
+    }
     uint32_t interval = millis() - conn_staus;
     if (_connected && interval > WIFI_CLIENT_KEEPALIVE_TIMEOUT) {
         uint8_t dummy;
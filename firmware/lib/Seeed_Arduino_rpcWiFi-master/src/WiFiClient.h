@@ -26,9 +26,50 @@
 #undef max
 #undef min
 #include <memory>
+#include <functional>
+
+// Receive buffer per connection. Reads at least this large bypass it and go
+// straight into the caller's memory, so it only has to absorb small reads.
+#ifndef WIFI_CLIENT_RX_BUFFER_SIZE
+#if defined(ESP32)
+#define WIFI_CLIENT_RX_BUFFER_SIZE (4096)
+#else
+#define WIFI_CLIENT_RX_BUFFER_SIZE (512)
+#endif
+#endif
+
+// Send ring used by non-blocking and corked writes
+#ifndef WIFI_CLIENT_TX_BUFFER_SIZE
+#if defined(ESP32)
+#define WIFI_CLIENT_TX_BUFFER_SIZE (4096)
+#else
+#define WIFI_CLIENT_TX_BUFFER_SIZE (1460)
+#endif
+#endif
+
+// How long stop() waits for what is left in the send ring before it closes
+// the connection anyway (ms)
+#ifndef WIFI_CLIENT_STOP_DRAIN_MS
+#define WIFI_CLIENT_STOP_DRAIN_MS (2000)
+#endif
+
+// Addresses of a host are tried in parallel, a new attempt starting this long
+// after the previous one (ms); the first connection to come up is kept
+#ifndef WIFI_CLIENT_CONNECT_STAGGER
+#define WIFI_CLIENT_CONNECT_STAGGER (250)
+#endif
+#define WIFI_CLIENT_CONNECT_MAX (4)
 
 class WiFiClientSocketHandle;
 class WiFiClientRxBuffer;
+class WiFiClientTxBuffer;
+
+// One destination of WiFiClient::readv()
+struct WiFiClientIOVec
+{
+    void *base;
+    size_t length;
+};
 
 class ESPLwIPClient : public Client
 {
@@ -43,26 +84,65 @@ class WiFiClient : public ESPLwIPClient
 protected:
     std::shared_ptr<WiFiClientSocketHandle> clientSocketHandle;
     std::shared_ptr<WiFiClientRxBuffer> _rxBuffer;
+    size_t _rxBufferSize;
+    std::shared_ptr<WiFiClientTxBuffer> _txBuffer;
+    size_t _txBufferSize;
+    bool _nonBlocking;
+    bool _corked;
+    bool _writableWanted;
+    std::function<void(size_t)> _writableCallback;
     bool _connected;
 
+    size_t writeSocket(const uint8_t *buf, size_t size);
+    bool pumpTx();
+    bool drainTx();
+    void releaseTx();
+
 public:
     WiFiClient *next;
     WiFiClient();
     WiFiClient(int fd);
+    WiFiClient(const WiFiClient &other);
     ~WiFiClient();
     int connect(IPAddress ip, uint16_t port);
     int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const IPAddress *addresses, size_t count, uint16_t port, int32_t timeout);
     int connect(const char *host, uint16_t port);
     int connect(const char *host, uint16_t port, int32_t timeout);
     size_t write(uint8_t data);
     size_t write(const uint8_t *buf, size_t size);
     size_t write_P(PGM_P buf, size_t size);
     size_t write(Stream &stream);
+    // Non-blocking mode: write() never waits. What the socket does not take at
+    // once is queued in a ring of txBufferSize bytes; the return value is how
+    // much was accepted, which is less than asked once the ring is full.
+    // stop() still sends what is queued, waiting up to WIFI_CLIENT_STOP_DRAIN_MS.
+    void setNonBlocking(bool enable, size_t txBufferSize = WIFI_CLIENT_TX_BUFFER_SIZE);
+    // Bytes write() can take right now without blocking or a short count
+    size_t writeAvailable();
+    // Bytes accepted by write() but not yet handed to the socket
+    size_t writePending();
+    // Called with the free room once a short write can continue. The queue is
+    // pushed whenever the client is used: write(), writeAvailable(),
+    // available() and connected().
+    void onWritable(std::function<void(size_t)> callback);
+    // Corked writes are held back, so headers and body leave together, until
+    // the ring is full or setCork(false). Resets on stop().
+    void setCork(bool corked);
     int available();
     int read();
     int read(uint8_t *buf, size_t size);
+    // Fills the buffers in order with what has arrived, returns the number of
+    // bytes read or -1 if there was nothing
+    int readv(const WiFiClientIOVec *iov, size_t count);
     int peek();
-    void flush();
+    // Borrow what is already buffered instead of copying it out. peekBuffer()
+    // points at peekAvailable() bytes, valid until consume() or the next read;
+    // neither call does I/O, available() does the refill.
+    virtual size_t peekAvailable();
+    virtual const uint8_t *peekBuffer();
+    virtual void consume(size_t length);
+    void flush(); // waits until queued writes are out
     void clear();
     void stop();
     uint8_t connected();
@@ -92,6 +172,12 @@ public:
     int setOption(int option, int *value);
     int getOption(int option, int *value);
     int setTimeout(uint32_t seconds);
+    // Takes effect on the current connection as well as later ones
+    bool setRxBufferSize(size_t size);
+    size_t getRxBufferSize() const
+    {
+        return _rxBufferSize;
+    }
     int setNoDelay(bool nodelay);
     bool getNoDelay();
 
@@ -88,7 +88,7 @@ private:
     }
 
 public:
-    WiFiClientSecureRxBuffer(sslclient_context *sslclient, size_t size = 1024)
+    WiFiClientSecureRxBuffer(sslclient_context *sslclient, size_t size = WIFI_CLIENT_SECURE_RX_BUFFER_SIZE)
         : _size(size), _buffer(NULL), _pos(0), _fill(0), _sslclient(sslclient), _failed(false)
     {
         //_buffer = (uint8_t *)malloc(_size);
@@ -104,47 +104,63 @@ public:
         return _failed;
     }
 
+    size_t buffered()
+    {
+        return _fill - _pos;
+    }
+
+    const uint8_t *front()
+    {
+        return _buffer ? _buffer + _pos : NULL;
+    }
+
+    void consume(size_t len)
+    {
+        _pos += (len < _fill - _pos) ? len : (_fill - _pos);
+    }
+
+    // Whenever at least a buffer's worth is still wanted the plaintext goes
+    // straight into dst, so bulk reads are not copied twice
     int read(uint8_t *dst, size_t len)
     {
-        if (!dst || !len || (_pos == _fill && !fillBuffer()))
+        if (!dst || !len)
         {
             return -1;
         }
-        size_t a = _fill - _pos;
-        if (len <= a || ((len - a) <= (_size - _fill) && fillBuffer() >= (len - a)))
+        size_t done = 0;
+        while (done < len)
         {
-            if (len == 1)
+            size_t left = len - done;
+            size_t a = _fill - _pos;
+            if (a)
             {
-                *dst = _buffer[_pos];
+                size_t toRead = (a > left) ? left : a;
+                if (toRead == 1)
+                {
+                    dst[done] = _buffer[_pos];
+                }
+                else
+                {
+                    memcpy(dst + done, _buffer + _pos, toRead);
+                }
+                _pos += toRead;
+                done += toRead;
             }
-            else
+            else if (left >= _size)
             {
-                memcpy(dst, _buffer + _pos, len);
+                int res = get_ssl_receive(_sslclient, dst + done, left);
+                if (res <= 0)
+                {
+                    break;
+                }
+                done += res;
             }
-            _pos += len;
-            return len;
-        }
-        size_t left = len;
-        size_t toRead = a;
-        uint8_t *buf = dst;
-        memcpy(buf, _buffer + _pos, toRead);
-        _pos += toRead;
-        left -= toRead;
-        buf += toRead;
-        while (left)
-        {
-            if (!fillBuffer())
+            else if (!fillBuffer())
             {
-                return len - left;
+                break;
             }
-            a = _fill - _pos;
-            toRead = (a > left) ? left : a;
-            memcpy(buf, _buffer + _pos, toRead);
-            _pos += toRead;
-            left -= toRead;
-            buf += toRead;
         }
-        return len;
+        return done ? done : -1;
     }
 
     int peek()
@@ -165,6 +181,45 @@ public:
     }
 };
 
+// A session parked by stop(). The handshake on the coprocessor cannot be
+// resumed from here, so the connection itself is kept instead.
+struct ParkedSession
+{
+    sslclient_context *sslclient;
+    int socket;
+    uint16_t port;
+    uint32_t since;
+    const char *CA_cert;
+    const char *cert;
+    const char *private_key;
+    const char *pskIdent;
+    const char *psKey;
+    const WiFiClientSecurePin *pins;
+    char host[WIFI_CLIENT_SECURE_HOST_MAX];
+};
+
+static ParkedSession parkedSessions[WIFI_CLIENT_SECURE_SESSION_CACHE];
+
+static void closeParkedSession(ParkedSession &parked)
+{
+    if (parked.sslclient == NULL)
+    {
+        return;
+    }
+    close(parked.socket);
+    stop_ssl_socket(parked.sslclient, parked.CA_cert, parked.cert, parked.private_key);
+    ssl_client_destroy(parked.sslclient);
+    parked.sslclient = NULL;
+}
+
+// Open with nothing unread: neither a late response nor the peer's close
+static bool sessionIdle(int socket)
+{
+    uint8_t dummy;
+    int res = recv(socket, &dummy, 1, MSG_PEEK | MSG_DONTWAIT);
+    return res < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
+}
+
 WiFiClientSecure::WiFiClientSecure()
 {
     _connected = false;
@@ -210,6 +265,10 @@ WiFiClientSecure &WiFiClientSecure::operator=(const WiFiClientSecure &other)
 
 void WiFiClientSecure::stop()
 {
+    if (_parkSession())
+    {
+        return;
+    }
     if (_socket >= 0)
     {
         close(_socket);
@@ -259,23 +318,43 @@ int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char *_CA_cert,
 
 int WiFiClientSecure::connect(const char *host, uint16_t port, const char *_CA_cert, const char *_cert, const char *_private_key)
 {
-    if (sslclient == NULL)
+    if (_resumeSession(host, port))
     {
-        sslclient = ssl_client_create();
-        _rxBuffer.reset(new WiFiClientSecureRxBuffer(sslclient));
-        if (sslclient == NULL)
+        return 1;
+    }
+    // from here on stop() must not park: the session is not verified yet, and
+    // _host would still name an earlier connection
+    _connected = false;
+    _host = String();
+    // a pinned host is checked by fingerprint below, so skip building the chain
+    bool pinned = _isPinned(host);
+    unsigned long start = millis();
+    int ret = _startClient(host, port, _timeout, pinned ? NULL : _CA_cert, _cert, _private_key);
+    if (ret >= 0 && pinned && !_verifyPins(host))
+    {
+        stop();
+        if (_CA_cert == NULL)
         {
-            log_e("ssl_client_create: error");
-            stop();
+            log_e("certificate of %s matches no pin", host);
+            _lastError = WIFI_CLIENT_SECURE_PIN_MISMATCH;
             return 0;
         }
-        ssl_init(sslclient);
-    }
-    if (_timeout > 0)
-    {
-        ssl_set_timeout(sslclient, _timeout);
+        // the second handshake only gets what is left of the timeout
+        int timeout = _timeout;
+        if (timeout > 0)
+        {
+            unsigned long spent = millis() - start;
+            timeout = spent < (unsigned long)timeout ? timeout - spent : 0;
+        }
+        if (timeout == 0)
+        {
+            log_e("certificate of %s matches no pin, no time left to validate the chain", host);
+            _lastError = WIFI_CLIENT_SECURE_PIN_MISMATCH;
+            return 0;
+        }
+        log_w("certificate of %s matches no pin, validating the chain", host);
+        ret = _startClient(host, port, timeout, _CA_cert, _cert, _private_key);
     }
-    int ret = start_ssl_client(sslclient, host, port, _timeout, _CA_cert, _cert, _private_key, NULL, NULL);
     _lastError = ret;
     if (ret < 0)
     {
@@ -285,9 +364,31 @@ int WiFiClientSecure::connect(const char *host, uint16_t port, const char *_CA_c
     }
     _socket = ssl_get_socket(sslclient);
     _connected = true;
+    _host = host;
+    _port = port;
     return 1;
 }
 
+int WiFiClientSecure::_startClient(const char *host, uint16_t port, int timeout, const char *_CA_cert, const char *_cert, const char *_private_key)
+{
+    if (sslclient == NULL)
+    {
+        sslclient = ssl_client_create();
+        _rxBuffer.reset(new WiFiClientSecureRxBuffer(sslclient));
+        if (sslclient == NULL)
+        {
+            log_e("ssl_client_create: error");
+            return -1;
+        }
+        ssl_init(sslclient);
+    }
+    if (timeout > 0)
+    {
+        ssl_set_timeout(sslclient, timeout);
+    }
+    return start_ssl_client(sslclient, host, port, timeout, _CA_cert, _cert, _private_key, NULL, NULL);
+}
+
 int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char *pskIdent, const char *psKey)
 {
     return connect(ip.toString().c_str(), port, _pskIdent, _psKey);
@@ -296,6 +397,12 @@ int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char *pskIdent,
 int WiFiClientSecure::connect(const char *host, uint16_t port, const char *pskIdent, const char *psKey)
 {
     log_v("start_ssl_client with PSK");
+    if (_resumeSession(host, port))
+    {
+        return 1;
+    }
+    _connected = false;
+    _host = String();
     if (sslclient == NULL)
     {
         sslclient = ssl_client_create();
@@ -323,6 +430,8 @@ int WiFiClientSecure::connect(const char *host, uint16_t port, const char *pskId
     _socket = ssl_get_socket(sslclient);
 
     _connected = true;
+    _host = host;
+    _port = port;
     return 1;
 }
 
@@ -380,6 +489,24 @@ int WiFiClientSecure::read(uint8_t *buf, size_t size)
     return res;
 }
 
+size_t WiFiClientSecure::peekAvailable()
+{
+    return _rxBuffer ? _rxBuffer->buffered() : 0;
+}
+
+const uint8_t *WiFiClientSecure::peekBuffer()
+{
+    return _rxBuffer ? _rxBuffer->front() : NULL;
+}
+
+void WiFiClientSecure::consume(size_t length)
+{
+    if (_rxBuffer)
+    {
+        _rxBuffer->consume(length);
+    }
+}
+
 int WiFiClientSecure::available()
 {
     if (!_rxBuffer)
@@ -460,6 +587,36 @@ bool WiFiClientSecure::verify(const char *fp, const char *domain_name)
     return verify_ssl_fingerprint(sslclient, fp, domain_name);
 }
 
+void WiFiClientSecure::setPins(const WiFiClientSecurePin *pins, size_t count)
+{
+    _pins = pins;
+    _pinCount = pins ? count : 0;
+}
+
+bool WiFiClientSecure::_isPinned(const char *host)
+{
+    for (size_t i = 0; i < _pinCount; i++)
+    {
+        if (strcasecmp(_pins[i].host, host) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WiFiClientSecure::_verifyPins(const char *host)
+{
+    for (size_t i = 0; i < _pinCount; i++)
+    {
+        if (strcasecmp(_pins[i].host, host) == 0 && verify(_pins[i].fingerprint, host))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 char *WiFiClientSecure::_streamLoad(Stream &stream, size_t size)
 {
     char *dest = (char *)malloc(size + 1);
@@ -530,6 +687,105 @@ void WiFiClientSecure::setHandshakeTimeout(unsigned long handshake_timeout)
     ssl_set_timeout(sslclient, handshake_timeout * 1000);
 }
 
+void WiFiClientSecure::setSessionReuse(bool reuse)
+{
+    _reuseSession = reuse;
+}
+
+void WiFiClientSecure::clearSessionCache()
+{
+    for (size_t i = 0; i < WIFI_CLIENT_SECURE_SESSION_CACHE; i++)
+    {
+        closeParkedSession(parkedSessions[i]);
+    }
+}
+
+// Take over a parked session for the same host, port and credentials
+bool WiFiClientSecure::_resumeSession(const char *host, uint16_t port)
+{
+    if (!_reuseSession || sslclient != NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < WIFI_CLIENT_SECURE_SESSION_CACHE; i++)
+    {
+        ParkedSession &parked = parkedSessions[i];
+        if (parked.sslclient == NULL || parked.port != port || strcmp(parked.host, host) != 0 ||
+            parked.CA_cert != _CA_cert || parked.cert != _cert || parked.private_key != _private_key ||
+            parked.pskIdent != _pskIdent || parked.psKey != _psKey || parked.pins != _pins)
+        {
+            continue;
+        }
+        if (millis() - parked.since > WIFI_CLIENT_SECURE_SESSION_IDLE || !sessionIdle(parked.socket))
+        {
+            log_d("parked session to %s:%d expired", host, port);
+            closeParkedSession(parked);
+            return false;
+        }
+        sslclient = parked.sslclient;
+        _socket = parked.socket;
+        parked.sslclient = NULL;
+        _rxBuffer.reset(new WiFiClientSecureRxBuffer(sslclient));
+        _connected = true;
+        _lastError = 0;
+        _host = host;
+        _port = port;
+        conn_staus = millis();
+        log_d("reusing session to %s:%d", host, port);
+        return true;
+    }
+    return false;
+}
+
+// Hand a healthy, fully read session to the cache instead of closing it.
+// Unread data may sit in the client buffer, in the TLS layer already
+// decrypted, or still on the socket; any of it would reach the next request.
+bool WiFiClientSecure::_parkSession()
+{
+    if (!_reuseSession || sslclient == NULL || !_connected || _socket < 0 ||
+        _host.length() == 0 || _host.length() >= WIFI_CLIENT_SECURE_HOST_MAX ||
+        (_rxBuffer && _rxBuffer->buffered()) || data_to_read(sslclient) > 0 || !sessionIdle(_socket))
+    {
+        return false;
+    }
+
+    // take a free slot, otherwise close the oldest session
+    ParkedSession *slot = &parkedSessions[0];
+    for (size_t i = 0; i < WIFI_CLIENT_SECURE_SESSION_CACHE; i++)
+    {
+        ParkedSession &parked = parkedSessions[i];
+        if (parked.sslclient == NULL)
+        {
+            slot = &parked;
+            break;
+        }
+        if (millis() - parked.since > millis() - slot->since)
+        {
+            slot = &parked;
+        }
+    }
+    closeParkedSession(*slot);
+
+    slot->sslclient = sslclient;
+    slot->socket = _socket;
+    slot->port = _port;
+    slot->since = millis();
+    slot->CA_cert = _CA_cert;
+    slot->cert = _cert;
+    slot->private_key = _private_key;
+    slot->pskIdent = _pskIdent;
+    slot->psKey = _psKey;
+    slot->pins = _pins;
+    strcpy(slot->host, _host.c_str());
+
+    sslclient = NULL;
+    _socket = -1;
+    _connected = false;
+    _rxBuffer.reset();
+    log_d("parked session to %s:%d", _host.c_str(), _port);
+    return true;
+}
+
 int WiFiClientSecure::fd() const
 {
     return _socket;
@@ -26,6 +26,35 @@
 #include "seeed_rpcUnified.h"
 #include "rtl_wifi/ssl_client.h"
 
+// Decrypted data waiting to be read. get_ssl_receive() hands over at most
+// what is left of the current record, so up to a full record (16 KB) here
+// saves round trips; reads of at least this size bypass it.
+#ifndef WIFI_CLIENT_SECURE_RX_BUFFER_SIZE
+#define WIFI_CLIENT_SECURE_RX_BUFFER_SIZE (1024)
+#endif
+
+// Established sessions kept open after stop() for the next connect() to the
+// same host, port and credentials, which then skips TCP and TLS handshakes
+#ifndef WIFI_CLIENT_SECURE_SESSION_CACHE
+#define WIFI_CLIENT_SECURE_SESSION_CACHE (2)
+#endif
+// Parked sessions older than this are closed instead of reused (ms)
+#ifndef WIFI_CLIENT_SECURE_SESSION_IDLE
+#define WIFI_CLIENT_SECURE_SESSION_IDLE (60000)
+#endif
+#define WIFI_CLIENT_SECURE_HOST_MAX (64)
+// lastError() of a pinned host whose certificate matched no pin and that had
+// no CA to fall back to; the code mbedtls uses for a failed verification
+#define WIFI_CLIENT_SECURE_PIN_MISMATCH (-0x2700)
+
+// Expected certificate of a host, compared after a handshake that skips
+// chain building. The fingerprint is the SHA-256 of the DER certificate in
+// hex, as taken by verify(); list a host more than once to accept a rollover.
+struct WiFiClientSecurePin
+{
+    const char *host;
+    const char *fingerprint;
+};
 
 class WiFiClientSecureRxBuffer;
 
@@ -45,6 +74,11 @@ protected:
     const char *_private_key;
     const char *_pskIdent; // identity for PSK cipher suites
     const char *_psKey; // key in hex for PSK cipher suites
+    String _host;
+    uint16_t _port = 0;
+    bool _reuseSession = true;
+    const WiFiClientSecurePin *_pins = NULL;
+    size_t _pinCount = 0;
 
 public:
     WiFiClientSecure *next;
@@ -65,6 +99,9 @@ public:
     int available();
     int read();
     int read(uint8_t *buf, size_t size);
+    size_t peekAvailable();
+    const uint8_t *peekBuffer();
+    void consume(size_t length);
     void flush() {}
     void stop();
     uint8_t connected();
@@ -78,6 +115,13 @@ public:
     bool loadPrivateKey(Stream& stream, size_t size);
     bool verify(const char* fingerprint, const char* domain_name);
     void setHandshakeTimeout(unsigned long handshake_timeout);
+    // Trust the listed hosts by fingerprint, falling back to the CA when the
+    // certificate matches none. The table must outlive the client.
+    void setPins(const WiFiClientSecurePin *pins, size_t count);
+    // Park the session on stop() for reuse, on by default
+    void setSessionReuse(bool reuse);
+    // Close every parked session, e.g. once the network went away
+    static void clearSessionCache();
     int fd() const;
     int setTimeout(uint32_t seconds){ return 0; }
 
@@ -107,6 +151,11 @@ public:
 
 private:
     char *_streamLoad(Stream& stream, size_t size);
+    int _startClient(const char *host, uint16_t port, int timeout, const char *rootCABuff, const char *cli_cert, const char *cli_key);
+    bool _isPinned(const char *host);
+    bool _verifyPins(const char *host);
+    bool _resumeSession(const char *host, uint16_t port);
+    bool _parkSession();
 
     //friend class WiFiServer;
     using Print::write;
@@ -206,9 +206,10 @@ typedef struct WiFiEventCbList
     WiFiEventCb cb;
     WiFiEventFuncCb fcb;
     WiFiEventSysCb scb;
+    WiFiStatusCb stcb;
     system_event_id_t event;
 
-    WiFiEventCbList() : id(current_id++), cb(NULL), fcb(NULL), scb(NULL), event(SYSTEM_EVENT_WIFI_READY) {}
+    WiFiEventCbList() : id(current_id++), cb(NULL), fcb(NULL), scb(NULL), stcb(NULL), event(SYSTEM_EVENT_WIFI_READY) {}
 } WiFiEventCbList_t;
 wifi_event_id_t WiFiEventCbList::current_id = 1;
 
@@ -314,6 +315,23 @@ wifi_event_id_t WiFiGenericClass::onEvent(WiFiEventSysCb cbEvent, system_event_i
     return newEventHandler.id;
 }
 
+/**
+ * set callback function for changes of the STA status
+ * @param cbStatus WiFiStatusCb
+ */
+wifi_event_id_t WiFiGenericClass::onStatus(WiFiStatusCb cbStatus)
+{
+    if (!cbStatus)
+    {
+        return 0;
+    }
+    WiFiEventCbList_t newEventHandler;
+    newEventHandler.stcb = cbStatus;
+    newEventHandler.event = SYSTEM_EVENT_MAX;
+    cbEventList.push_back(newEventHandler);
+    return newEventHandler.id;
+}
+
 /**
  * removes a callback form event handler
  * @param cbEvent WiFiEventCb
@@ -395,6 +413,7 @@ esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event)
     {
         WiFiSTAClass::_setStatus(WL_NO_SHIELD);
         clearStatusBits(STA_STARTED_BIT | STA_CONNECTED_BIT | STA_HAS_IP_BIT | STA_HAS_IP6_BIT);
+        clearDNSCache();
     }
     else if (event->event_id == SYSTEM_EVENT_STA_CONNECTED)
     {
@@ -425,6 +444,8 @@ esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event)
             WiFiSTAClass::_setStatus(WL_DISCONNECTED);
         }
         clearStatusBits(STA_CONNECTED_BIT | STA_HAS_IP_BIT | STA_HAS_IP6_BIT);
+        // the next network may resolve names differently
+        clearDNSCache();
         if (((reason == WIFI_REASON_AUTH_EXPIRE) ||
              (reason >= WIFI_REASON_BEACON_TIMEOUT && reason != WIFI_REASON_AUTH_FAIL)) &&
             WiFi.getAutoReconnect())
@@ -451,6 +472,7 @@ esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event)
     {
         WiFiSTAClass::_setStatus(WL_IDLE_STATUS);
         clearStatusBits(STA_HAS_IP_BIT);
+        clearDNSCache();
     }
     else if (event->event_id == SYSTEM_EVENT_AP_START)
     {
@@ -541,6 +563,22 @@ esp_err_t WiFiGenericClass::_eventCallback(void *arg, system_event_t *event)
     return ESP_OK;
 }
 
+/**
+ * pass a new STA status on to the status callbacks
+ * @param status wl_status_t
+ */
+void WiFiGenericClass::_statusChanged(wl_status_t status)
+{
+    for (uint32_t i = 0; i < cbEventList.size(); i++)
+    {
+        WiFiEventCbList_t entry = cbEventList[i];
+        if (entry.stcb)
+        {
+            entry.stcb(status);
+        }
+    }
+}
+
 /**
  * Return the current channel associated with the network
  * @return channel (1-13)
@@ -719,6 +757,11 @@ wifi_power_t WiFiGenericClass::getTxPower()
 // ------------------------------------------------ Generic Network function ---------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
 
+// Answer of the foreground lookup. The callback is told which lookup it
+// belongs to, so one hostByName() gave up on cannot answer a later one.
+static volatile uint32_t dnsAnswer;
+static volatile uint32_t dnsQuery;
+
 /**
  * DNS callback
  * @param name
@@ -727,13 +770,190 @@ wifi_power_t WiFiGenericClass::getTxPower()
  */
 static void wifi_dns_found_callback(const char *name, const ip_addr_t *ipaddr, void *callback_arg)
 {
+    if ((uint32_t)(uintptr_t)callback_arg != dnsQuery)
+    {
+        return;
+    }
     if (ipaddr)
     {
-        (*reinterpret_cast<IPAddress *>(callback_arg)) = ipaddr->u_addr.ip4.addr;
+        dnsAnswer = ipaddr->u_addr.ip4.addr;
     }
     xEventGroupSetBits(_network_event_group, WIFI_DNS_DONE_BIT);
 }
 
+// One name resolved by hostByName(), with the addresses it had lately
+struct DNSCacheEntry
+{
+    char host[WIFI_DNS_HOST_MAX];
+    struct
+    {
+        uint32_t address;
+        uint32_t resolved; // when the resolver last answered with it
+    } addresses[WIFI_DNS_CACHE_ADDRESSES]; // newest first
+    uint32_t used;
+};
+
+static DNSCacheEntry dnsCache[WIFI_DNS_CACHE_SIZE];
+static uint32_t dnsCacheTTL = WIFI_DNS_CACHE_TTL;
+static uint32_t dnsCacheStale = WIFI_DNS_CACHE_STALE;
+static bool dnsCacheRefresh = true;
+
+// The lookup a refresh has in flight. The callback only stores the answer,
+// the next hostByName() files it, so the cache is only touched by callers.
+// Each refresh has its own generation, so an answer to one that was given up
+// on can neither be filed nor free the resolver for someone else.
+static struct
+{
+    char host[WIFI_DNS_HOST_MAX];
+    uint32_t started;
+    volatile uint32_t generation;
+    volatile uint32_t address;
+    volatile bool pending;
+    volatile bool done;
+} dnsRefresh;
+
+static DNSCacheEntry *dnsCacheFind(const char *host)
+{
+    for (size_t i = 0; i < WIFI_DNS_CACHE_SIZE; i++)
+    {
+        if (dnsCache[i].host[0] && strcasecmp(dnsCache[i].host, host) == 0)
+        {
+            return &dnsCache[i];
+        }
+    }
+    return NULL;
+}
+
+// Put address in front, keeping earlier different answers behind it
+static void dnsEntryUpdate(DNSCacheEntry *entry, uint32_t address)
+{
+    size_t i = 0;
+    while (i < WIFI_DNS_CACHE_ADDRESSES - 1 && entry->addresses[i].address != address)
+    {
+        i++;
+    }
+    for (; i > 0; i--)
+    {
+        entry->addresses[i] = entry->addresses[i - 1];
+    }
+    entry->addresses[0].address = address;
+    entry->addresses[0].resolved = millis();
+}
+
+// Age of the newest answer
+static uint32_t dnsEntryAge(const DNSCacheEntry *entry)
+{
+    return millis() - entry->addresses[0].resolved;
+}
+
+static DNSCacheEntry *dnsCacheStore(const char *host, uint32_t address)
+{
+    if (!dnsCacheTTL || strlen(host) >= WIFI_DNS_HOST_MAX)
+    {
+        return NULL;
+    }
+    DNSCacheEntry *entry = dnsCacheFind(host);
+    if (!entry)
+    {
+        // take a free entry, otherwise the least recently used one
+        entry = &dnsCache[0];
+        for (size_t i = 0; i < WIFI_DNS_CACHE_SIZE && entry->host[0]; i++)
+        {
+            if (!dnsCache[i].host[0] || millis() - dnsCache[i].used > millis() - entry->used)
+            {
+                entry = &dnsCache[i];
+            }
+        }
+        memset(entry, 0, sizeof(*entry));
+        strcpy(entry->host, host);
+        entry->used = millis();
+    }
+    dnsEntryUpdate(entry, address);
+    return entry;
+}
+
+// The addresses not older than max_age, an alternate the resolver stopped
+// giving out long ago may not belong to the host any more
+static size_t dnsEntryAddresses(const DNSCacheEntry *entry, IPAddress *results, size_t count, uint32_t max_age)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < WIFI_DNS_CACHE_ADDRESSES && n < count && entry->addresses[i].address; i++)
+    {
+        if (millis() - entry->addresses[i].resolved < max_age)
+        {
+            results[n++] = entry->addresses[i].address;
+        }
+    }
+    return n;
+}
+
+static void wifi_dns_refresh_callback(const char *name, const ip_addr_t *ipaddr, void *callback_arg)
+{
+    if ((uint32_t)(uintptr_t)callback_arg != dnsRefresh.generation)
+    {
+        return;
+    }
+    dnsRefresh.address = ipaddr ? ipaddr->u_addr.ip4.addr : 0;
+    dnsRefresh.done = true;
+    xEventGroupSetBits(_network_event_group, WIFI_DNS_IDLE_BIT);
+}
+
+static void dnsRefreshCollect()
+{
+    if (dnsRefresh.done)
+    {
+        if (dnsRefresh.address)
+        {
+            DNSCacheEntry *entry = dnsCacheFind(dnsRefresh.host);
+            if (entry)
+            {
+                dnsEntryUpdate(entry, dnsRefresh.address);
+            }
+        }
+        dnsRefresh.pending = false;
+        dnsRefresh.done = false;
+    }
+    else if (dnsRefresh.pending && millis() - dnsRefresh.started > 5000)
+    {
+        // the answer never came, drop it and hand the resolver back
+        dnsRefresh.generation++;
+        dnsRefresh.pending = false;
+        xEventGroupSetBits(_network_event_group, WIFI_DNS_IDLE_BIT);
+    }
+}
+
+// The shorter of cap and what is left of timeout_ms since start
+static uint32_t dnsWait(uint32_t cap, uint32_t start, int32_t timeout_ms)
+{
+    if (timeout_ms < 0)
+    {
+        return cap;
+    }
+    uint32_t spent = millis() - start;
+    if (spent >= (uint32_t)timeout_ms)
+    {
+        return 0;
+    }
+    uint32_t left = (uint32_t)timeout_ms - spent;
+    return left < cap ? left : cap;
+}
+
+void WiFiGenericClass::setDNSCache(uint32_t ttl_ms, bool refresh, uint32_t stale_ms)
+{
+    dnsCacheTTL = ttl_ms;
+    dnsCacheRefresh = refresh;
+    dnsCacheStale = stale_ms;
+    clearDNSCache();
+}
+
+void WiFiGenericClass::clearDNSCache()
+{
+    for (size_t i = 0; i < WIFI_DNS_CACHE_SIZE; i++)
+    {
+        dnsCache[i].host[0] = '\0';
+    }
+}
+
 /**
  * Resolve the given hostname to an IP address.
  * @param aHostname     Name to be resolved
@@ -743,22 +963,88 @@ static void wifi_dns_found_callback(const char *name, const ip_addr_t *ipaddr, v
  */
 int WiFiGenericClass::hostByName(const char *aHostname, IPAddress &aResult)
 {
-    ip_addr_t addr;
     aResult = static_cast<uint32_t>(0);
-    waitStatusBits(WIFI_DNS_IDLE_BIT, 5000);
+    return hostByName(aHostname, &aResult, 1);
+}
+
+/**
+ * Resolve the given hostname to the addresses it had lately, newest first.
+ * @param aHostname     Name to be resolved
+ * @param aResults      where to store up to count addresses
+ * @param count         size of aResults
+ * @param timeout_ms    how long the lookup may take, -1 for the resolver's own limits
+ * @return number of addresses stored, 0 if the name did not resolve
+ */
+int WiFiGenericClass::hostByName(const char *aHostname, IPAddress *aResults, size_t count, int32_t timeout_ms)
+{
+    ip_addr_t addr;
+    uint32_t start = millis();
+    if(!count) {
+        return 0;
+    }
+    IPAddress literal;
+    if(literal.fromString(aHostname)) {
+        aResults[0] = literal;
+        return 1;
+    }
+
+    dnsRefreshCollect();
+    DNSCacheEntry *entry = dnsCacheTTL ? dnsCacheFind(aHostname) : NULL;
+    if(entry) {
+        uint32_t age = dnsEntryAge(entry);
+        entry->used = millis();
+        if(age < dnsCacheTTL) {
+            // refresh late in the TTL without waiting, unless a lookup is running
+            if(dnsCacheRefresh && age > dnsCacheTTL - dnsCacheTTL / 4 && !dnsRefresh.pending &&
+               waitStatusBits(WIFI_DNS_IDLE_BIT, 0)) {
+                clearStatusBits(WIFI_DNS_IDLE_BIT);
+                strcpy(dnsRefresh.host, entry->host);
+                dnsRefresh.started = millis();
+                dnsRefresh.done = false;
+                dnsRefresh.pending = true;
+                dnsRefresh.generation++;
+                err_t err = dns_gethostbyname(aHostname, &addr, &wifi_dns_refresh_callback,
+                                              (void *)(uintptr_t)dnsRefresh.generation);
+                if(err != ERR_INPROGRESS) {
+                    dnsRefresh.address = (err == ERR_OK) ? addr.u_addr.ip4.addr : 0;
+                    dnsRefresh.done = true;
+                    setStatusBits(WIFI_DNS_IDLE_BIT);
+                }
+            }
+            return dnsEntryAddresses(entry, aResults, count, dnsCacheTTL);
+        }
+    }
+
+    waitStatusBits(WIFI_DNS_IDLE_BIT, dnsWait(5000, start, timeout_ms));
     clearStatusBits(WIFI_DNS_IDLE_BIT);
-    err_t err = dns_gethostbyname(aHostname, &addr, &wifi_dns_found_callback, &aResult);
+    dnsAnswer = 0;
+    dnsQuery++;
+    err_t err = dns_gethostbyname(aHostname, &addr, &wifi_dns_found_callback, (void *)(uintptr_t)dnsQuery);
     if(err == ERR_OK && addr.u_addr.ip4.addr) {
-        aResult = addr.u_addr.ip4.addr;
+        dnsAnswer = addr.u_addr.ip4.addr;
     } else if(err == ERR_INPROGRESS) {
-        waitStatusBits(WIFI_DNS_DONE_BIT, 4000);
+        waitStatusBits(WIFI_DNS_DONE_BIT, dnsWait(4000, start, timeout_ms));
         clearStatusBits(WIFI_DNS_DONE_BIT);
     }
+    uint32_t answer = dnsAnswer;
+    dnsQuery++;
     setStatusBits(WIFI_DNS_IDLE_BIT);
-    if((uint32_t)aResult == 0){
+    dnsRefreshCollect();
+    if(answer == 0){
+        // an expired answer beats none while the resolver is unreachable
+        if(entry && entry->host[0] && dnsEntryAge(entry) < dnsCacheTTL + dnsCacheStale) {
+            log_w("DNS Failed for %s, using the cached address", aHostname);
+            return dnsEntryAddresses(entry, aResults, count, dnsCacheTTL + dnsCacheStale);
+        }
         log_e("DNS Failed for %s", aHostname);
+        return 0;
+    }
+    entry = dnsCacheStore(aHostname, answer);
+    if(!entry) {
+        aResults[0] = answer;
+        return 1;
     }
-    return (uint32_t)aResult != 0;
+    return dnsEntryAddresses(entry, aResults, count, dnsCacheTTL);
 }
 
 IPAddress WiFiGenericClass::calculateNetworkID(IPAddress ip, IPAddress subnet)
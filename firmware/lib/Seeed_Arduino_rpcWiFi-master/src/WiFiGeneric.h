@@ -35,6 +35,7 @@ int htoi(const char *s);
 typedef void (*WiFiEventCb)(system_event_id_t event);
 typedef std::function<void(system_event_id_t event, system_event_info_t info)> WiFiEventFuncCb;
 typedef void (*WiFiEventSysCb)(system_event_t *event);
+typedef std::function<void(wl_status_t status)> WiFiStatusCb;
 
 typedef size_t wifi_event_id_t;
 
@@ -69,6 +70,24 @@ static const int WIFI_SCAN_DONE_BIT= BIT12;
 static const int WIFI_DNS_IDLE_BIT = BIT13;
 static const int WIFI_DNS_DONE_BIT = BIT14;
 
+// Names hostByName() keeps resolved, least recently used ones go first
+#ifndef WIFI_DNS_CACHE_SIZE
+#define WIFI_DNS_CACHE_SIZE (4)
+#endif
+// The rpc resolver does not report record TTLs, so entries live this long (ms)
+#ifndef WIFI_DNS_CACHE_TTL
+#define WIFI_DNS_CACHE_TTL (300000)
+#endif
+// How long past its TTL an entry still answers when a lookup fails (ms)
+#ifndef WIFI_DNS_CACHE_STALE
+#define WIFI_DNS_CACHE_STALE (3600000)
+#endif
+// Different answers remembered per name, offered as alternatives to connect()
+#ifndef WIFI_DNS_CACHE_ADDRESSES
+#define WIFI_DNS_CACHE_ADDRESSES (2)
+#endif
+#define WIFI_DNS_HOST_MAX (64)
+
 class WiFiGenericClass
 {
   public:
@@ -80,6 +99,8 @@ class WiFiGenericClass
     void removeEvent(WiFiEventCb cbEvent, system_event_id_t event = SYSTEM_EVENT_MAX);
     void removeEvent(WiFiEventSysCb cbEvent, system_event_id_t event = SYSTEM_EVENT_MAX);
     void removeEvent(wifi_event_id_t id);
+    // Called with the new STA status whenever it changes, removed with removeEvent(id)
+    wifi_event_id_t onStatus(WiFiStatusCb cbStatus);
 
     static int getStatusBits();
     static int waitStatusBits(int bits, uint32_t timeout_ms);
@@ -101,6 +122,7 @@ class WiFiGenericClass
     wifi_power_t getTxPower();
 
     static esp_err_t _eventCallback(void *arg, system_event_t *event);
+    static void _statusChanged(wl_status_t status);
 
   protected:
     static bool _persistent;
@@ -113,6 +135,11 @@ class WiFiGenericClass
 
   public:
     static int hostByName(const char *aHostname, IPAddress &aResult);
+    static int hostByName(const char *aHostname, IPAddress *aResults, size_t count, int32_t timeout_ms = -1);
+    // A ttl of 0 turns the cache off. With refresh, a hit in the last quarter
+    // of its TTL starts a lookup in the background and answers from the cache.
+    static void setDNSCache(uint32_t ttl_ms, bool refresh = true, uint32_t stale_ms = WIFI_DNS_CACHE_STALE);
+    static void clearDNSCache();
 
     static IPAddress calculateNetworkID(IPAddress ip, IPAddress subnet);
     static IPAddress calculateBroadcast(IPAddress ip, IPAddress subnet);
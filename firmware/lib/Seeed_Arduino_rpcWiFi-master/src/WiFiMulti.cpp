@@ -85,120 +85,282 @@ bool WiFiMulti::addAP(const char* ssid, const char *passphrase)
     return true;
 }
 
-uint8_t WiFiMulti::run(uint32_t connectTimeout)
+int WiFiMulti::_score(const WifiBSS_t &bss) const
 {
-    int8_t scanResult;
-    uint8_t status = WiFi.status();
-    if(status == WL_CONNECTED) {
-        for(uint32_t x = 0; x < APlist.size(); x++) {
-            if(WiFi.SSID()==APlist[x].ssid) {
-                return status;
-            }
+    return bss.rssi - WIFI_MULTI_FAIL_PENALTY * bss.failures;
+}
+
+// Highest scoring entry other than exclude that may be tried now, -1 if none
+int WiFiMulti::_best(int exclude, uint32_t now) const
+{
+    int best = -1;
+    for(int i = 0; i < _bssCount; i++) {
+        const WifiBSS_t &bss = _bss[i];
+        if(i == exclude || now - bss.seen > WIFI_MULTI_STALE) {
+            continue;
+        }
+        if(bss.failures && (int32_t)(now - bss.retryAt) < 0) {
+            continue;
+        }
+        if(best < 0 || _score(bss) > _score(_bss[best])) {
+            best = i;
         }
-        WiFi.disconnect(false,false);
-        delay(10);
-        status = WiFi.status();
     }
+    return best;
+}
 
-    scanResult = WiFi.scanNetworks();
-    if(scanResult == WIFI_SCAN_RUNNING) {
-        // scan is running
-        return WL_NO_SSID_AVAIL;
-    } else if(scanResult >= 0) {
-        // scan done analyze
-        WifiAPlist_t bestNetwork { NULL, NULL };
-        int bestNetworkDb = INT_MIN;
-        uint8_t bestBSSID[6];
-        int32_t bestChannel = 0;
-
-        log_i("[WIFI] scan done");
-
-        if(scanResult == 0) {
-            log_e("[WIFI] no networks found");
+WifiBSS_t *WiFiMulti::_remember(const uint8_t *bssid, uint8_t ap, uint8_t channel, int8_t rssi, uint32_t now)
+{
+    int slot = -1;
+    for(int i = 0; i < _bssCount; i++) {
+        if(memcmp(_bss[i].bssid, bssid, 6) == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0) {
+        if(_bssCount < WIFI_MULTI_BSS_MAX) {
+            slot = _bssCount++;
         } else {
-            log_i("[WIFI] %d networks found", scanResult);
-            for(int8_t i = 0; i < scanResult; ++i) {
-
-                String ssid_scan;
-                int32_t rssi_scan;
-                uint8_t sec_scan;
-                uint8_t* BSSID_scan;
-                int32_t chan_scan;
-
-                WiFi.getNetworkInfo(i, ssid_scan, sec_scan, rssi_scan, BSSID_scan, chan_scan);
-
-                bool known = false;
-                for(uint32_t x = 0; x < APlist.size(); x++) {
-                    WifiAPlist_t entry = APlist[x];
-
-                    if(ssid_scan == entry.ssid) { // SSID match
-                        known = true;
-                        if(rssi_scan > bestNetworkDb) { // best network
-                            if(sec_scan == WIFI_AUTH_OPEN || entry.passphrase) { // check for passphrase if not open wlan
-                                bestNetworkDb = rssi_scan;
-                                bestChannel = chan_scan;
-                                memcpy((void*) &bestNetwork, (void*) &entry, sizeof(bestNetwork));
-                                memcpy((void*) &bestBSSID, (void*) BSSID_scan, sizeof(bestBSSID));
-                            }
-                        }
-                        break;
-                    }
+            // make room by forgetting the one not seen for the longest
+            for(int i = 0; i < _bssCount; i++) {
+                if(i != _current && (slot < 0 || now - _bss[i].seen > now - _bss[slot].seen)) {
+                    slot = i;
                 }
+            }
+            if(slot == _target) {
+                _target = -1;
+            }
+        }
+        memset(&_bss[slot], 0, sizeof(WifiBSS_t));
+        memcpy(_bss[slot].bssid, bssid, 6);
+    } else if(now - _bss[slot].seen <= WIFI_MULTI_STALE) {
+        rssi = (3 * _bss[slot].rssi + rssi) / 4;
+    }
+    WifiBSS_t &bss = _bss[slot];
+    bss.ap = ap;
+    bss.channel = channel;
+    bss.rssi = rssi;
+    bss.seen = now;
+    return &bss;
+}
 
-                if(known) {
-                    log_d(" --->   %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
-                } else {
-                    log_d("       %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
+// Folds the finished scan into the table and frees it
+void WiFiMulti::_scanResults(uint32_t now)
+{
+    int16_t count = WiFi.scanComplete();
+    _scanning = false;
+    for(int16_t i = 0; i < count; i++) {
+        wifi_ap_record_t *it = reinterpret_cast<wifi_ap_record_t *>(WiFi.getScanInfoByIndex(i));
+        if(!it) {
+            continue;
+        }
+        for(uint32_t x = 0; x < APlist.size(); x++) {
+            if(strcmp((const char *)it->ssid, APlist[x].ssid) == 0) {
+                // check for passphrase if not open wlan
+                if(it->authmode == WIFI_AUTH_OPEN || APlist[x].passphrase) {
+                    _remember(it->bssid, x, it->primary, it->rssi, now);
+                    log_d(" --->   %d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d)", i, it->primary, it->bssid[0], it->bssid[1], it->bssid[2], it->bssid[3], it->bssid[4], it->bssid[5], APlist[x].ssid, it->rssi);
                 }
+                break;
             }
         }
+    }
+    log_i("[WIFI] scan done, %d networks found, %d access points known", count, _bssCount);
+
+    // clean up ram
+    WiFi.scanDelete();
+}
+
+// Scans only the channels of the access points we know, or all of them if none
+int16_t WiFiMulti::_scanKnown(bool async)
+{
+    uint8_t channels[WIFI_SCAN_CHANNELS_MAX];
+    uint8_t count = 0;
+    for(int i = 0; i < _bssCount && count < WIFI_SCAN_CHANNELS_MAX; i++) {
+        if(_bss[i].channel && !memchr(channels, _bss[i].channel, count)) {
+            channels[count++] = _bss[i].channel;
+        }
+    }
+    _lastScan = millis();
+    if(!count) {
+        return WiFi.scanNetworks(async);
+    }
+    return WiFi.scanChannels(channels, count, async);
+}
+
+// Backs off from an access point that refused us or dropped the link
+void WiFiMulti::_failed(WifiBSS_t &bss, uint32_t now)
+{
+    if(bss.failures < 8) {
+        bss.failures++;
+    }
+    bss.retryAt = now + (WIFI_MULTI_RETRY << (bss.failures - 1));
+}
+
+uint8_t WiFiMulti::_connect(int index, uint32_t connectTimeout)
+{
+    WifiBSS_t &bss = _bss[index];
+    const WifiAPlist_t &ap = APlist[bss.ap];
 
-        // clean up ram
-        WiFi.scanDelete();
+    log_i("[WIFI] Connecting BSSID: %02X:%02X:%02X:%02X:%02X:%02X SSID: %s Channal: %d (%d)", bss.bssid[0], bss.bssid[1], bss.bssid[2], bss.bssid[3], bss.bssid[4], bss.bssid[5], ap.ssid, bss.channel, bss.rssi);
 
-        if(bestNetwork.ssid) {
-            log_i("[WIFI] Connecting BSSID: %02X:%02X:%02X:%02X:%02X:%02X SSID: %s Channal: %d (%d)", bestBSSID[0], bestBSSID[1], bestBSSID[2], bestBSSID[3], bestBSSID[4], bestBSSID[5], bestNetwork.ssid, bestChannel, bestNetworkDb);
+    uint8_t status = WiFi.begin(ap.ssid, ap.passphrase, bss.channel, bss.bssid);
+    if(status != WL_CONNECT_FAILED && status != WL_NO_SHIELD) {
+        // wait for connection, fail, or timeout
+        status = WiFi.waitForConnectResult(connectTimeout);
+    }
+    uint32_t now = millis();
 
-            WiFi.begin(bestNetwork.ssid, bestNetwork.passphrase, bestChannel, bestBSSID);
-            status = WiFi.status();
+    switch(status) {
+    case WL_CONNECTED:
+        log_i("[WIFI] Connecting done.");
+        log_d("[WIFI] SSID: %s", WiFi.SSID().c_str());
+        log_d("[WIFI] IP: %s", WiFi.localIP().toString().c_str());
+        log_d("[WIFI] MAC: %s", WiFi.BSSIDstr().c_str());
+        log_d("[WIFI] Channel: %d", WiFi.channel());
+        break;
+    case WL_NO_SSID_AVAIL:
+        log_e("[WIFI] Connecting Failed AP not found.");
+        break;
+    case WL_CONNECT_FAILED:
+        log_e("[WIFI] Connecting Failed.");
+        break;
+    default:
+        log_e("[WIFI] Connecting Failed (%d).", status);
+        break;
+    }
 
-            auto startTime = millis();
-            // wait for connection, fail, or timeout
-            while(status != WL_CONNECTED && status != WL_NO_SSID_AVAIL && status != WL_CONNECT_FAILED && (millis() - startTime) <= connectTimeout) {
-                delay(10);
-                status = WiFi.status();
+    if(status == WL_CONNECTED) {
+        bss.failures = 0;
+        if(bss.connects < UINT16_MAX) {
+            bss.connects++;
+        }
+        _current = index;
+        _target = -1;
+        _connectedAt = now;
+        _lastSample = now;
+    } else {
+        _failed(bss, now);
+        _current = -1;
+    }
+    return status;
+}
+
+// Keeps the entry of the current link up to date, false if it is not one of ours
+bool WiFiMulti::_track(uint32_t now)
+{
+    if(_current < 0) {
+        // joined outside of run(), e.g. by the auto reconnect
+        String ssid = WiFi.SSID();
+        uint8_t *bssid = WiFi.BSSID();
+        for(uint32_t x = 0; x < APlist.size() && bssid; x++) {
+            if(ssid == APlist[x].ssid) {
+                _current = _remember(bssid, x, WiFi.channel(), WiFi.RSSI(), now) - _bss;
+                _connectedAt = now;
+                _lastSample = now;
+                return true;
             }
+        }
+        return false;
+    }
+    if(now - _lastSample >= WIFI_MULTI_SAMPLE_INTERVAL) {
+        _lastSample = now;
+        int8_t rssi = WiFi.RSSI();
+        if(rssi) {
+            WifiBSS_t &bss = _bss[_current];
+            _remember(bss.bssid, bss.ap, bss.channel, rssi, now);
+        }
+    }
+    return true;
+}
 
-            switch(status) {
-            case WL_CONNECTED:
-                log_i("[WIFI] Connecting done.");
-                log_d("[WIFI] SSID: %s", WiFi.SSID().c_str());
-                log_d("[WIFI] IP: %s", WiFi.localIP().toString().c_str());
-                log_d("[WIFI] MAC: %s", WiFi.BSSIDstr().c_str());
-                log_d("[WIFI] Channel: %d", WiFi.channel());
-                break;
-            case WL_NO_SSID_AVAIL:
-                log_e("[WIFI] Connecting Failed AP not found.");
-                break;
-            case WL_CONNECT_FAILED:
-                log_e("[WIFI] Connecting Failed.");
-                break;
-            default:
-                log_e("[WIFI] Connecting Failed (%d).", status);
-                break;
+/**
+ * Keeps the station on the best of the added networks. Access points are
+ * remembered by BSSID with their signal and connect history. A weak link
+ * rescans their channels in the background and moves to a clearly better
+ * access point; when the link drops, the best remembered one is joined
+ * right away without a scan.
+ * @param connectTimeout uint32_t
+ * @return wl_status_t
+ */
+uint8_t WiFiMulti::run(uint32_t connectTimeout)
+{
+    uint8_t status = WiFi.status();
+    uint32_t now = millis();
+
+    if(_scanning && WiFi.scanComplete() != WIFI_SCAN_RUNNING) {
+        _scanResults(now);
+    }
+
+    if(status == WL_CONNECTED) {
+        if(_track(now)) {
+            WifiBSS_t &current = _bss[_current];
+            if(current.rssi >= WIFI_MULTI_ROAM_RSSI) {
+                _target = -1;
+                return status;
             }
-        } else {
-            log_e("[WIFI] no matching wifi found!");
+            if(!_scanning && now - _lastScan >= WIFI_MULTI_SCAN_INTERVAL) {
+                // mostly the known channels, every third time all of them
+                _scanning = (++_scans % 3 ? _scanKnown(true) : WiFi.scanNetworks(true)) == WIFI_SCAN_RUNNING;
+                _lastScan = now;
+            }
+            _target = _best(_current, now);
+            if(_target >= 0 && _score(_bss[_target]) >= _score(current) + WIFI_MULTI_HYSTERESIS &&
+               now - _connectedAt >= WIFI_MULTI_DWELL) {
+                log_i("[WIFI] roaming from %d dBm to %d dBm", current.rssi, _bss[_target].rssi);
+                WiFi.disconnect(false,false);
+                return _connect(_target, connectTimeout);
+            }
+            return status;
         }
-    } else {
-        // start scan
-        log_d("[WIFI] delete old wifi config...");
-        WiFi.disconnect();
+        WiFi.disconnect(false,false);
+        delay(10);
+        status = WiFi.status();
+    } else if(_current >= 0) {
+        log_w("[WIFI] link lost");
+        _failed(_bss[_current], now);
+    }
+    _current = -1;
 
-        log_d("[WIFI] start scan");
-        // scan wifi async mode
-        WiFi.scanNetworks(true);
+    if(_scanning) {
+        // scan is running
+        return WL_NO_SSID_AVAIL;
     }
 
-    return status;
+    int next = _best(-1, now);
+    if(next < 0) {
+        // nothing fresh to go to: recheck the channels we know, then sweep them all
+        bool stale = false;
+        for(int i = 0; i < _bssCount; i++) {
+            stale |= now - _bss[i].seen > WIFI_MULTI_STALE;
+        }
+        if(stale && _scanKnown(false) >= 0) {
+            _scanResults(millis());
+            next = _best(-1, millis());
+        }
+    }
+    if(next < 0) {
+        int16_t scanResult = WiFi.scanNetworks();
+        if(scanResult == WIFI_SCAN_RUNNING) {
+            // scan is running
+            return WL_NO_SSID_AVAIL;
+        } else if(scanResult < 0) {
+            // start scan
+            log_d("[WIFI] delete old wifi config...");
+            WiFi.disconnect();
+
+            log_d("[WIFI] start scan");
+            // scan wifi async mode
+            _scanning = WiFi.scanNetworks(true) == WIFI_SCAN_RUNNING;
+            return status;
+        }
+        _scanResults(millis());
+        next = _best(-1, millis());
+    }
+    if(next < 0) {
+        log_e("[WIFI] no matching wifi found!");
+        return status;
+    }
+    return _connect(next, connectTimeout);
 }
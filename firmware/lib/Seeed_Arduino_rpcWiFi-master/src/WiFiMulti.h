@@ -29,11 +29,45 @@
 #include "WiFi.h"
 #include <vector>
 
+// Access points remembered by BSSID, the least recently seen is replaced
+#ifndef WIFI_MULTI_BSS_MAX
+#define WIFI_MULTI_BSS_MAX (8)
+#endif
+// Below this RSSI (dBm) the known channels are rescanned in the background
+// and a clearly better access point is joined
+#ifndef WIFI_MULTI_ROAM_RSSI
+#define WIFI_MULTI_ROAM_RSSI (-72)
+#endif
+// How much (dB) a candidate has to beat the current access point by
+#ifndef WIFI_MULTI_HYSTERESIS
+#define WIFI_MULTI_HYSTERESIS (8)
+#endif
+// Least time (ms) spent on an access point before roaming away from it
+#ifndef WIFI_MULTI_DWELL
+#define WIFI_MULTI_DWELL (30000)
+#endif
+#define WIFI_MULTI_SCAN_INTERVAL (10000)    // between background scans of a weak link
+#define WIFI_MULTI_SAMPLE_INTERVAL (1000)   // between RSSI samples of the current link
+#define WIFI_MULTI_STALE (300000)           // an access point unseen this long is rescanned first
+#define WIFI_MULTI_RETRY (10000)            // wait after a failed connect, doubles per failure
+#define WIFI_MULTI_FAIL_PENALTY (10)        // dB taken off the score per failed connect
+
 typedef struct {
     char * ssid;
     char * passphrase;
 } WifiAPlist_t;
 
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ap;             // index into APlist
+    uint8_t channel;
+    int8_t rssi;            // smoothed, dBm
+    uint8_t failures;       // connects failed in a row
+    uint16_t connects;
+    uint32_t seen;          // millis() of the last scan or sample that saw it
+    uint32_t retryAt;       // not tried before this after a failure
+} WifiBSS_t;
+
 class WiFiMulti
 {
 public:
@@ -46,6 +80,25 @@ public:
 
 private:
     std::vector<WifiAPlist_t> APlist;
+
+    WifiBSS_t _bss[WIFI_MULTI_BSS_MAX];
+    uint8_t _bssCount = 0;
+    int8_t _current = -1;           // entry of the access point we are on
+    int8_t _target = -1;            // where to go next, picked while the link is up
+    bool _scanning = false;
+    uint8_t _scans = 0;
+    uint32_t _lastScan = 0;
+    uint32_t _lastSample = 0;
+    uint32_t _connectedAt = 0;
+
+    int _score(const WifiBSS_t &bss) const;
+    int _best(int exclude, uint32_t now) const;
+    WifiBSS_t *_remember(const uint8_t *bssid, uint8_t ap, uint8_t channel, int8_t rssi, uint32_t now);
+    void _scanResults(uint32_t now);
+    int16_t _scanKnown(bool async);
+    void _failed(WifiBSS_t &bss, uint32_t now);
+    uint8_t _connect(int index, uint32_t connectTimeout);
+    bool _track(uint32_t now);
 };
 
 #endif /* WIFICLIENTMULTI_H_ */
@@ -45,10 +45,17 @@ extern "C"
 bool WiFiSTAClass::_autoReconnect = true;
 bool WiFiSTAClass::_useStaticIp = false;
 
-static wl_status_t _sta_status = WL_NO_SHIELD;
+static volatile wl_status_t _sta_status = WL_NO_SHIELD;
 static EventGroupHandle_t _sta_status_group = NULL;
+static uint32_t _sta_status_checked = 0;
 
-void WiFiSTAClass::_setStatus(wl_status_t status)
+// The group holds one bit per status, so a waiter can ask for any of several
+static EventBits_t _statusBit(wl_status_t status)
+{
+    return (status <= WL_DISCONNECTED) ? (1 << status) : BIT7;
+}
+
+static EventGroupHandle_t _statusGroup()
 {
     if (!_sta_status_group)
     {
@@ -56,30 +63,73 @@ void WiFiSTAClass::_setStatus(wl_status_t status)
         if (!_sta_status_group)
         {
             log_e("STA Status Group Create Failed!");
-            _sta_status = status;
-            return;
+            return NULL;
         }
+        xEventGroupSetBits(_sta_status_group, _statusBit(_sta_status));
+    }
+    return _sta_status_group;
+}
+
+static wl_status_t _waitStatus(EventBits_t bits, uint32_t timeout_ms)
+{
+    EventGroupHandle_t group = _statusGroup();
+    if (!group)
+    {
+        delay(timeout_ms);
+    }
+    else
+    {
+        xEventGroupWaitBits(group, bits, pdFALSE, pdFALSE, timeout_ms / portTICK_PERIOD_MS);
+    }
+    return WiFiSTAClass::status();
+}
+
+void WiFiSTAClass::_setStatus(wl_status_t status)
+{
+    wl_status_t previous = _sta_status;
+    _sta_status = status;
+    _sta_status_checked = millis();
+    EventGroupHandle_t group = _statusGroup();
+    if (group)
+    {
+        xEventGroupClearBits(group, 0x00FFFFFF & ~_statusBit(status));
+        xEventGroupSetBits(group, _statusBit(status));
+    }
+    if (status != previous)
+    {
+        WiFiGenericClass::_statusChanged(status);
     }
-    xEventGroupClearBits(_sta_status_group, 0x00FFFFFF);
-    xEventGroupSetBits(_sta_status_group, status);
 }
 
 /**
  * Return Connection status.
+ * Answered from the events of the module, only a connected link is confirmed
+ * with it every WIFI_STA_STATUS_CHECK ms.
  * @return one of the value defined in wl_status_t
  *
  */
 wl_status_t WiFiSTAClass::status()
 {
-    if (!_sta_status_group)
+    if (_sta_status == WL_CONNECTED && millis() - _sta_status_checked >= WIFI_STA_STATUS_CHECK)
     {
-        return _sta_status;
-    }
-    if(wifi_is_connected_to_ap() != RTW_SUCCESS)
-    {
-        _setStatus(WL_DISCONNECTED);
+        _sta_status_checked = millis();
+        if (wifi_is_connected_to_ap() != RTW_SUCCESS)
+        {
+            _setStatus(WL_DISCONNECTED);
+        }
     }
-    return (wl_status_t)xEventGroupClearBits(_sta_status_group, 0);
+    return _sta_status;
+}
+
+/**
+ * Wait for the STA status to become status
+ * @param status wl_status_t
+ * @param timeout_ms uint32_t
+ * @return the status when the wait ended
+ */
+wl_status_t WiFiSTAClass::waitStatus(wl_status_t status, uint32_t timeout_ms)
+{
+    return _waitStatus(_statusBit(status), timeout_ms);
 }
 
 /**
@@ -133,6 +183,8 @@ wl_status_t WiFiSTAClass::begin(const char *ssid, const char *passphrase, int32_
         }
     }
 
+    // a result left by an earlier attempt would end waitForConnectResult() at once
+    _setStatus(WL_DISCONNECTED);
     if (bssid != NULL)
     {
         ret = wifi_connect_bssid((unsigned char *)bssid, (char *)ssid, security_type, (char *)passphrase, ETH_ALEN, strlen(ssid), strlen(passphrase), -1, NULL);
@@ -195,6 +247,7 @@ wl_status_t WiFiSTAClass::begin()
     const uint32_t security_type = wifi_info.security_type;
     const int key_id = (char)(wifi_info.channel >> 28);
 
+    _setStatus(WL_DISCONNECTED);
     if (security_type == RTW_SECURITY_OPEN)
     {
         ret = wifi_connect((char *)wifi_info.psk_essid, security_type, NULL, strlen((char *)wifi_info.psk_essid), 0, key_id, NULL);
@@ -433,21 +486,19 @@ bool WiFiSTAClass::getAutoReconnect()
 /**
  * Wait for WiFi connection to reach a result
  * returns the status reached or disconnect if STA is off
+ * @param timeout_ms uint32_t
  * @return wl_status_t
  */
-uint8_t WiFiSTAClass::waitForConnectResult()
+uint8_t WiFiSTAClass::waitForConnectResult(uint32_t timeout_ms)
 {
     //1 and 3 have STA enabled
     if ((WiFiGenericClass::getMode() & WIFI_MODE_STA) == 0)
     {
         return WL_DISCONNECTED;
     }
-    int i = 0;
-    while ((!status() || status() >= WL_DISCONNECTED) && i++ < 100)
-    {
-        delay(100);
-    }
-    return status();
+    return _waitStatus(_statusBit(WL_NO_SSID_AVAIL) | _statusBit(WL_SCAN_COMPLETED) |
+                       _statusBit(WL_CONNECTED) | _statusBit(WL_CONNECT_FAILED) |
+                       _statusBit(WL_CONNECTION_LOST), timeout_ms);
 }
 
 /**
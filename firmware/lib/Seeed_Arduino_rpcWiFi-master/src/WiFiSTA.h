@@ -27,6 +27,12 @@
 #include "WiFiType.h"
 #include "WiFiGeneric.h"
 
+// status() follows the events of the module. A lost link is normally reported
+// too, but is confirmed with the module this often (ms) in case it was missed.
+#ifndef WIFI_STA_STATUS_CHECK
+#define WIFI_STA_STATUS_CHECK (1000)
+#endif
+
 
 class WiFiSTAClass
 {
@@ -53,7 +59,7 @@ public:
     bool setAutoReconnect(bool autoReconnect);
     bool getAutoReconnect();
 
-    uint8_t waitForConnectResult();
+    uint8_t waitForConnectResult(uint32_t timeout_ms = 10000);
 
     // STA network info
     IPAddress localIP();
@@ -77,6 +83,7 @@ public:
 
     // STA WiFi info
     static wl_status_t status();
+    static wl_status_t waitStatus(wl_status_t status, uint32_t timeout_ms);
     String SSID() const;
     String psk() const;
 
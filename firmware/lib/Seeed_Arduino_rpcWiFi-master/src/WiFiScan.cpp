@@ -98,6 +98,37 @@ int16_t WiFiScanClass::scanNetworks(bool async, bool show_hidden, bool passive,
     return WIFI_SCAN_FAILED;
 }
 
+/**
+ * Scan only the given channels, which is much quicker than sweeping all of them
+ * @param channels      channel numbers
+ * @param count         number of channels, at most WIFI_SCAN_CHANNELS_MAX
+ * @param async         run in async mode
+ * @return Number of discovered networks
+ */
+int16_t WiFiScanClass::scanChannels(const uint8_t *channels, uint8_t count, bool async)
+{
+    if (WiFiGenericClass::getStatusBits() & WIFI_SCANNING_BIT)
+    {
+        return WIFI_SCAN_RUNNING;
+    }
+    if (!count || count > WIFI_SCAN_CHANNELS_MAX)
+    {
+        return WIFI_SCAN_FAILED;
+    }
+
+    // the channel list applies to the next scan only
+    uint8_t list[WIFI_SCAN_CHANNELS_MAX];
+    uint8_t config[WIFI_SCAN_CHANNELS_MAX];
+    memcpy(list, channels, count);
+    memset(config, PSCAN_ENABLE, count);
+    if (wifi_set_pscan_chan(list, config, count) < 0)
+    {
+        log_e("partial scan setup failed!");
+        return WIFI_SCAN_FAILED;
+    }
+    return scanNetworks(async);
+}
+
 /**
  * private
  * scan callback
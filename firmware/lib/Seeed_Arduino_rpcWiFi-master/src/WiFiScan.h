@@ -26,12 +26,15 @@
 #include "WiFiType.h"
 #include "WiFiGeneric.h"
 
+#define WIFI_SCAN_CHANNELS_MAX (14)
+
 class WiFiScanClass
 {
 
 public:
 
     int16_t scanNetworks(bool async = false, bool show_hidden = false, bool passive = false, uint32_t max_ms_per_chan = 300);
+    int16_t scanChannels(const uint8_t *channels, uint8_t count, bool async = false);
 
     int16_t scanComplete();
     void scanDelete();
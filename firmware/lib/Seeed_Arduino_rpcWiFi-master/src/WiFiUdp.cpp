@@ -32,6 +32,8 @@ WiFiUDP::WiFiUDP()
 , tx_buffer(0)
 , tx_buffer_len(0)
 , rx_buffer(0)
+, rx_buffer_len(0)
+, rx_buffer_pos(0)
 {}
 
 WiFiUDP::~WiFiUDP(){
@@ -43,12 +45,6 @@ uint8_t WiFiUDP::begin(IPAddress address, uint16_t port){
 
   server_port = port;
 
-  tx_buffer = new char[1460];
-  if(!tx_buffer){
-    log_e("could not create tx buffer: %d", errno);
-    return 0;
-  }
-
   if ((udp_server=socket(AF_INET, SOCK_DGRAM, 0)) == -1){
     log_e("could not create socket: %d", errno);
     return 0;
@@ -104,10 +100,11 @@ void WiFiUDP::stop(){
   }
   tx_buffer_len = 0;
   if(rx_buffer){
-    cbuf *b = rx_buffer;
+    delete[] rx_buffer;
     rx_buffer = NULL;
-    delete b;
   }
+  rx_buffer_len = 0;
+  rx_buffer_pos = 0;
   if(udp_server == -1)
     return;
   if(multicast_ip != 0){
@@ -133,17 +130,27 @@ int WiFiUDP::beginPacket(){
   if(!remote_port)
     return 0;
 
-  // allocate tx_buffer if is necessary
+  if(!allocTxBuffer())
+    return 0;
+
+  tx_buffer_len = 0;
+
+  return openSocket();
+}
+
+// allocate tx_buffer if is necessary, write() may come without beginPacket()
+int WiFiUDP::allocTxBuffer(){
   if(!tx_buffer){
-    tx_buffer = new char[1460];
+    tx_buffer = new char[WIFIUDP_MAX_DATAGRAM];
     if(!tx_buffer){
       log_e("could not create tx buffer: %d", errno);
       return 0;
     }
   }
+  return 1;
+}
 
-  tx_buffer_len = 0;
-
+int WiFiUDP::openSocket(){
   // check whereas socket is already open
   if (udp_server != -1)
     return 1;
@@ -188,7 +195,9 @@ int WiFiUDP::endPacket(){
 }
 
 size_t WiFiUDP::write(uint8_t data){
-  if(tx_buffer_len == 1460){
+  if(!allocTxBuffer())
+    return 0;
+  if(tx_buffer_len == WIFIUDP_MAX_DATAGRAM){
     endPacket();
     tx_buffer_len = 0;
   }
@@ -197,53 +206,66 @@ size_t WiFiUDP::write(uint8_t data){
 }
 
 size_t WiFiUDP::write(const uint8_t *buffer, size_t size){
-  size_t i;
-  for(i=0;i<size;i++)
-    write(buffer[i]);
-  return i;
+  if(!allocTxBuffer())
+    return 0;
+  size_t written = 0;
+  while(written < size){
+    if(tx_buffer_len == WIFIUDP_MAX_DATAGRAM){
+      endPacket();
+      tx_buffer_len = 0;
+    }
+    size_t chunk = WIFIUDP_MAX_DATAGRAM - tx_buffer_len;
+    if(chunk > size - written)
+      chunk = size - written;
+    memcpy(tx_buffer + tx_buffer_len, buffer + written, chunk);
+    tx_buffer_len += chunk;
+    written += chunk;
+  }
+  return written;
 }
 
-int WiFiUDP::parsePacket(){
-  if(rx_buffer)
-    return 0;
+// Length of the next datagram copied into buffer, -1 if none is waiting
+int WiFiUDP::receive(uint8_t *buffer, size_t size, IPAddress &ip, uint16_t &port){
+  if(udp_server == -1)
+    return -1;
   struct sockaddr_in si_other;
   int slen = sizeof(si_other) , len;
-  char * buf = new char[1460];
-  if(!buf){
-    return 0;
+  if ((len = recvfrom(udp_server, buffer, size, MSG_DONTWAIT, (struct sockaddr *) &si_other, (socklen_t *)&slen)) == -1){
+    if(errno != EWOULDBLOCK){
+      log_e("could not receive data: %d", errno);
+    }
+    return -1;
   }
-  if ((len = recvfrom(udp_server, buf, 1460, MSG_DONTWAIT, (struct sockaddr *) &si_other, (socklen_t *)&slen)) == -1){
-    delete[] buf;
-    if(errno == EWOULDBLOCK){
+  ip = IPAddress(si_other.sin_addr.s_addr);
+  port = ntohs(si_other.sin_port);
+  return len;
+}
+
+int WiFiUDP::parsePacket(){
+  if(rx_buffer_pos < rx_buffer_len)
+    return 0;
+  if(!rx_buffer){
+    rx_buffer = new char[WIFIUDP_MAX_DATAGRAM];
+    if(!rx_buffer){
       return 0;
     }
-    log_e("could not receive data: %d", errno);
-    return 0;
   }
-  remote_ip = IPAddress(si_other.sin_addr.s_addr);
-  remote_port = ntohs(si_other.sin_port);
-  if (len > 0) {
-    rx_buffer = new cbuf(len);
-    rx_buffer->write(buf, len);
-  }
-  delete[] buf;
+  rx_buffer_pos = 0;
+  rx_buffer_len = 0;
+  int len = receive((uint8_t *)rx_buffer, WIFIUDP_MAX_DATAGRAM, remote_ip, remote_port);
+  if(len <= 0)
+    return 0;
+  rx_buffer_len = len;
   return len;
 }
 
 int WiFiUDP::available(){
-  if(!rx_buffer) return 0;
-  return rx_buffer->available();
+  return rx_buffer_len - rx_buffer_pos;
 }
 
 int WiFiUDP::read(){
-  if(!rx_buffer) return -1;
-  int out = rx_buffer->read();
-  if(!rx_buffer->available()){
-    cbuf *b = rx_buffer;
-    rx_buffer = 0;
-    delete b;
-  }
-  return out;
+  if(rx_buffer_pos == rx_buffer_len) return -1;
+  return (uint8_t)rx_buffer[rx_buffer_pos++];
 }
 
 int WiFiUDP::read(unsigned char* buffer, size_t len){
@@ -251,28 +273,25 @@ int WiFiUDP::read(unsigned char* buffer, size_t len){
 }
 
 int WiFiUDP::read(char* buffer, size_t len){
-  if(!rx_buffer) return 0;
-  int out = rx_buffer->read(buffer, len);
-  if(!rx_buffer->available()){
-    cbuf *b = rx_buffer;
-    rx_buffer = 0;
-    delete b;
-  }
+  size_t out = rx_buffer_len - rx_buffer_pos;
+  if(out > len)
+    out = len;
+  if(!out)
+    return 0;
+  memcpy(buffer, rx_buffer + rx_buffer_pos, out);
+  rx_buffer_pos += out;
   return out;
 }
 
 int WiFiUDP::peek(){
-  if(!rx_buffer) return -1;
-  return rx_buffer->peek();
+  if(rx_buffer_pos == rx_buffer_len) return -1;
+  return (uint8_t)rx_buffer[rx_buffer_pos];
 }
 
 void WiFiUDP::flush(){}
 
 void WiFiUDP::clear(){
-  if(!rx_buffer) return;
-  cbuf *b = rx_buffer;
-  rx_buffer = 0;
-  delete b;
+  rx_buffer_pos = rx_buffer_len;
 }
 
 IPAddress WiFiUDP::remoteIP(){
@@ -282,3 +301,49 @@ IPAddress WiFiUDP::remoteIP(){
 uint16_t WiFiUDP::remotePort(){
   return remote_port;
 }
+
+int WiFiUDP::recvPacket(uint8_t *buffer, size_t size){
+  int len = receive(buffer, size, remote_ip, remote_port);
+  return len < 0 ? 0 : len;
+}
+
+int WiFiUDP::sendPacket(const uint8_t *buffer, size_t size, IPAddress ip, uint16_t port){
+  if(!openSocket())
+    return 0;
+  struct sockaddr_in recipient;
+  recipient.sin_addr.s_addr = (uint32_t)ip;
+  recipient.sin_family = AF_INET;
+  recipient.sin_port = htons(port);
+  int sent = sendto(udp_server, buffer, size, 0, (struct sockaddr*) &recipient, sizeof(recipient));
+  if(sent < 0){
+    log_e("could not send data: %d", errno);
+    return 0;
+  }
+  return 1;
+}
+
+// lwIP has no recvmmsg()/sendmmsg(), so the batch calls are loops over the
+// socket; what they save is the staging copies and the per-call setup
+int WiFiUDP::recvBatch(UDPDatagram *datagrams, size_t count){
+  size_t received = 0;
+  while(received < count){
+    UDPDatagram &d = datagrams[received];
+    int len = receive(d.data, d.size, d.ip, d.port);
+    if(len < 0)
+      break;
+    d.length = len;
+    received++;
+  }
+  if(received){
+    remote_ip = datagrams[received - 1].ip;
+    remote_port = datagrams[received - 1].port;
+  }
+  return received;
+}
+
+int WiFiUDP::sendBatch(const UDPDatagram *datagrams, size_t count){
+  size_t sent = 0;
+  while(sent < count && sendPacket(datagrams[sent].data, datagrams[sent].length, datagrams[sent].ip, datagrams[sent].port))
+    sent++;
+  return sent;
+}
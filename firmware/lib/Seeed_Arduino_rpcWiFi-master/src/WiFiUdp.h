@@ -37,7 +37,22 @@
 
 #include <Arduino.h>
 #include <Udp.h>
-#include <cbuf.h>
+
+// Largest datagram the packet buffers hold, one Ethernet MTU of UDP payload
+#ifndef WIFIUDP_MAX_DATAGRAM
+#define WIFIUDP_MAX_DATAGRAM 1460
+#endif
+
+// One datagram of recvBatch()/sendBatch(). For receiving, data and size
+// describe the caller's buffer and length, ip and port are filled in; for
+// sending, data and length are the payload and ip and port the destination.
+struct UDPDatagram {
+  uint8_t * data;
+  size_t size;
+  size_t length;
+  IPAddress ip;
+  uint16_t port;
+};
 
 class WiFiUDP : public UDP {
 private:
@@ -48,7 +63,12 @@ private:
   uint16_t remote_port;
   char * tx_buffer;
   size_t tx_buffer_len;
-  cbuf * rx_buffer;
+  char * rx_buffer;       // allocated on first use and kept, datagrams are received straight into it
+  size_t rx_buffer_len;
+  size_t rx_buffer_pos;
+  int allocTxBuffer();
+  int openSocket();
+  int receive(uint8_t *buffer, size_t size, IPAddress &ip, uint16_t &port);
 public:
   WiFiUDP();
   ~WiFiUDP();
@@ -73,6 +93,17 @@ public:
   void clear();
   IPAddress remoteIP();
   uint16_t remotePort();
+
+  // Datagram API without the internal buffers: received straight into the
+  // caller's buffer and sent straight from it. recvPacket() returns the
+  // datagram length (truncated to size), 0 if none is waiting, and sets
+  // remoteIP()/remotePort().
+  int recvPacket(uint8_t *buffer, size_t size);
+  int sendPacket(const uint8_t *buffer, size_t size, IPAddress ip, uint16_t port);
+  // Up to count datagrams per call; returns how many were received (stopping
+  // when none is waiting) or sent (stopping at the first failure)
+  int recvBatch(UDPDatagram *datagrams, size_t count);
+  int sendBatch(const UDPDatagram *datagrams, size_t count);
 };
 
 #endif /* _WIFIUDP_H_ */
@@ -0,0 +1,278 @@
+#include "GzipEncoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+#define GZIP_HASH_SIZE (1 << GZIP_HASH_BITS)
+
+// Base values and extra bit counts for deflate length codes 257..285
+static const uint16_t lengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+// Base values and extra bit counts for deflate distance codes 0..29
+static const uint16_t distanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// CRC-32 (IEEE 802.3), one nibble at a time to keep the table at 64 bytes
+static const uint32_t crcTable[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length)
+{
+  while (length--) {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+    crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+  }
+  return crc;
+}
+
+static inline uint32_t hash3(const uint8_t* p)
+{
+  uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+  return (v * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+GzipEncoder::GzipEncoder()
+: _window(nullptr)
+, _head(nullptr)
+, _out(nullptr)
+, _outLength(0)
+, _pos(0)
+, _fill(0)
+, _bits(0)
+, _bitCount(0)
+, _crc(0)
+, _inputSize(0)
+{
+}
+
+GzipEncoder::~GzipEncoder()
+{
+  end();
+}
+
+bool GzipEncoder::begin(Sink sink)
+{
+  if (_window) {
+    // positions from the last stream mean nothing in this one
+    memset(_head, 0, GZIP_HASH_SIZE * sizeof(uint16_t));
+  } else {
+    _window = (uint8_t*) malloc(2 * GZIP_WINDOW_SIZE);
+    _head = (uint16_t*) calloc(GZIP_HASH_SIZE, sizeof(uint16_t));
+    _out = (uint8_t*) malloc(GZIP_OUTPUT_BUFLEN);
+    if (!_window || !_head || !_out) {
+      end();
+      return false;
+    }
+  }
+  _sink = sink;
+  _outLength = 0;
+  _pos = 0;
+  _fill = 0;
+  _bits = 0;
+  _bitCount = 0;
+  _crc = 0xFFFFFFFF;
+  _inputSize = 0;
+
+  // magic, deflate, no flags, no mtime, no extra flags, unknown OS
+  static const uint8_t header[10] = { 0x1F, 0x8B, 0x08, 0x00, 0, 0, 0, 0, 0x00, 0xFF };
+  for (size_t i = 0; i < sizeof(header); i++)
+    _putByte(header[i]);
+  return true;
+}
+
+void GzipEncoder::end()
+{
+  free(_window);
+  free(_head);
+  free(_out);
+  _window = nullptr;
+  _head = nullptr;
+  _out = nullptr;
+  _sink = nullptr;
+}
+
+void GzipEncoder::cancel()
+{
+  _sink = nullptr;
+}
+
+void GzipEncoder::write(const uint8_t* data, size_t length)
+{
+  if (!_sink)
+    return;
+  _crc = crc32Update(_crc, data, length);
+  _inputSize += length;
+  while (length) {
+    if (_fill == 2 * GZIP_WINDOW_SIZE) {
+      _compress(_fill);
+      _slide();
+    }
+    size_t toCopy = 2 * GZIP_WINDOW_SIZE - _fill;
+    if (toCopy > length)
+      toCopy = length;
+    memcpy(_window + _fill, data, toCopy);
+    _fill += toCopy;
+    data += toCopy;
+    length -= toCopy;
+  }
+}
+
+void GzipEncoder::finish()
+{
+  if (!_sink)
+    return;
+  _compress(_fill);
+  // empty final block: BFINAL, fixed Huffman, end of block
+  _putBits(1, 1);
+  _putBits(1, 2);
+  _putCode(0, 7);
+  _alignByte();
+  uint32_t crc = ~_crc;
+  for (int i = 0; i < 4; i++)
+    _putByte(crc >> (8 * i));
+  for (int i = 0; i < 4; i++)
+    _putByte(_inputSize >> (8 * i));
+  _flushOutput();
+  _sink = nullptr;
+}
+
+// Encode _window[_pos, end) as one fixed Huffman block
+void GzipEncoder::_compress(size_t end)
+{
+  if (_pos >= end)
+    return;
+  _putBits(0, 1);
+  _putBits(1, 2);
+  size_t i = _pos;
+  while (i < end) {
+    size_t matchLength = 0;
+    size_t distance = 0;
+    if (end - i >= GZIP_MIN_MATCH) {
+      uint32_t h = hash3(_window + i);
+      size_t candidate = _head[h];
+      _head[h] = i + 1;
+      if (candidate) {
+        candidate--;
+        const uint8_t* a = _window + candidate;
+        const uint8_t* b = _window + i;
+        size_t maxLength = end - i;
+        if (maxLength > GZIP_MAX_MATCH)
+          maxLength = GZIP_MAX_MATCH;
+        size_t length = 0;
+        while (length < maxLength && a[length] == b[length])
+          length++;
+        if (length >= GZIP_MIN_MATCH) {
+          matchLength = length;
+          distance = i - candidate;
+        }
+      }
+    }
+    if (matchLength) {
+      _putMatch(matchLength, distance);
+      for (size_t k = i + 1; k < i + matchLength && k + GZIP_MIN_MATCH <= end; k++)
+        _head[hash3(_window + k)] = k + 1;
+      i += matchLength;
+    } else {
+      _putLiteral(_window[i]);
+      i++;
+    }
+  }
+  _putCode(0, 7);
+  _pos = end;
+}
+
+// Drop the oldest half of the window and rebase the hash heads
+void GzipEncoder::_slide()
+{
+  memmove(_window, _window + GZIP_WINDOW_SIZE, _fill - GZIP_WINDOW_SIZE);
+  _fill -= GZIP_WINDOW_SIZE;
+  _pos -= GZIP_WINDOW_SIZE;
+  for (size_t i = 0; i < GZIP_HASH_SIZE; i++)
+    _head[i] = _head[i] > GZIP_WINDOW_SIZE ? _head[i] - GZIP_WINDOW_SIZE : 0;
+}
+
+void GzipEncoder::_putBits(uint32_t value, uint8_t count)
+{
+  _bits |= value << _bitCount;
+  _bitCount += count;
+  while (_bitCount >= 8) {
+    _putByte(_bits);
+    _bits >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+// Huffman codes are defined MSB first but packed LSB first
+void GzipEncoder::_putCode(uint16_t code, uint8_t length)
+{
+  uint16_t reversed = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  _putBits(reversed, length);
+}
+
+void GzipEncoder::_putLiteral(uint8_t literal)
+{
+  if (literal < 144)
+    _putCode(0x30 + literal, 8);
+  else
+    _putCode(0x190 + literal - 144, 9);
+}
+
+void GzipEncoder::_putMatch(uint16_t length, uint16_t distance)
+{
+  int code = 28;
+  while (lengthBase[code] > length)
+    code--;
+  uint16_t symbol = 257 + code;
+  if (symbol < 280)
+    _putCode(symbol - 256, 7);
+  else
+    _putCode(0xC0 + symbol - 280, 8);
+  _putBits(length - lengthBase[code], lengthExtra[code]);
+
+  code = 29;
+  while (distanceBase[code] > distance)
+    code--;
+  _putCode(code, 5);
+  _putBits(distance - distanceBase[code], distanceExtra[code]);
+}
+
+void GzipEncoder::_alignByte()
+{
+  if (_bitCount)
+    _putBits(0, 8 - _bitCount);
+}
+
+void GzipEncoder::_putByte(uint8_t b)
+{
+  _out[_outLength++] = b;
+  if (_outLength == GZIP_OUTPUT_BUFLEN)
+    _flushOutput();
+}
+
+void GzipEncoder::_flushOutput()
+{
+  if (_outLength && _sink)
+    _sink(_out, _outLength);
+  _outLength = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef __GZIPENCODER_H__
+#define __GZIPENCODER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// History kept for back references. Memory use is about
+// 2 * window + 2 << GZIP_HASH_BITS + GZIP_OUTPUT_BUFLEN bytes.
+#ifndef GZIP_WINDOW_SIZE
+#define GZIP_WINDOW_SIZE 1024
+#endif
+
+#ifndef GZIP_HASH_BITS
+#define GZIP_HASH_BITS 10
+#endif
+
+#ifndef GZIP_OUTPUT_BUFLEN
+#define GZIP_OUTPUT_BUFLEN 512
+#endif
+
+// Streaming gzip (RFC 1952) encoder using single probe LZ77 matching and the
+// fixed deflate Huffman codes. Trades some ratio for a small, constant footprint
+// and no tree building, which suits text and JSON on the microcontrollers.
+// The buffers outlive a stream, so one encoder can compress one response after
+// another without going back to the heap; end() gives them back.
+class GzipEncoder
+{
+public:
+  typedef std::function<void(const uint8_t* data, size_t length)> Sink;
+
+  GzipEncoder();
+  ~GzipEncoder();
+
+  bool begin(Sink sink);            // allocate buffers on first use and emit the gzip header
+  void write(const uint8_t* data, size_t length);
+  void finish();                    // emit the last block and the trailer
+  void cancel();                    // drop the stream without finishing it
+  void end();                       // release buffers
+
+  bool active() const { return (bool)_sink; }
+  size_t inputSize() const { return _inputSize; }
+
+protected:
+  void _compress(size_t end);
+  void _slide();
+  void _putBits(uint32_t value, uint8_t count);
+  void _putCode(uint16_t code, uint8_t length);
+  void _putLiteral(uint8_t literal);
+  void _putMatch(uint16_t length, uint16_t distance);
+  void _alignByte();
+  void _putByte(uint8_t b);
+  void _flushOutput();
+
+  Sink      _sink;
+  uint8_t*  _window;
+  uint16_t* _head;
+  uint8_t*  _out;
+  size_t    _outLength;
+  size_t    _pos;       // first byte not yet encoded
+  size_t    _fill;      // bytes present in _window
+  uint32_t  _bits;
+  uint8_t   _bitCount;
+  uint32_t  _crc;
+  size_t    _inputSize;
+};
+
+#endif
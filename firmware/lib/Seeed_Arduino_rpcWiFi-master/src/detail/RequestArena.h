@@ -0,0 +1,88 @@
+#ifndef __REQUESTARENA_H__
+#define __REQUESTARENA_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Holds one request's arguments, header values and body. A plain body too big
+// for it goes to a heap buffer of up to WEBSERVER_MAX_BODY_SIZE, anything else
+// that does not fit is refused.
+#ifndef WEBSERVER_ARENA_SIZE
+#define WEBSERVER_ARENA_SIZE 4096
+#endif
+
+// Bump allocator over a fixed pool. Everything handed out stays valid until
+// reset(), which the server calls once the response has been finalized.
+class RequestArena
+{
+public:
+  RequestArena() : _used(0), _highWater(0), _last(nullptr) {}
+
+  // Word aligned block for arrays of structs, nullptr if the pool is exhausted
+  void* alloc(size_t size) {
+    size_t start = (_used + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    if (start > sizeof(_pool) || size > sizeof(_pool) - start)
+      return nullptr;
+    _used = start + size;
+    _touch();
+    _last = nullptr;
+    return _pool + start;
+  }
+
+  // NUL terminated copy of length bytes of s
+  char* copy(const char* s, size_t length) {
+    if (length >= available())
+      return nullptr;
+    char* p = scratch();
+    memcpy(p, s, length);
+    p[length] = '\0';
+    return commit(length + 1);
+  }
+
+  // Grow str, which must be the last string handed out, by length bytes of s
+  char* append(char* str, const char* s, size_t length) {
+    if (!str)
+      return copy(s, length);
+    if (str != _last || length >= available() + 1)
+      return nullptr;
+    char* end = (char*) _pool + _used - 1;
+    memcpy(end, s, length);
+    end[length] = '\0';
+    _used += length;
+    _touch();
+    return str;
+  }
+
+  // Free space can be filled in place through scratch() and then kept with commit()
+  char* scratch() { return (char*) _pool + _used; }
+  size_t available() const { return sizeof(_pool) - _used; }
+  char* commit(size_t length) {
+    char* p = scratch();
+    _used += length;
+    _touch();
+    _last = p;
+    return p;
+  }
+
+  void reset() {
+    _used = 0;
+    _last = nullptr;
+  }
+
+  size_t used() const { return _used; }
+  size_t highWater() const { return _highWater; }
+
+protected:
+  void _touch() {
+    if (_used > _highWater)
+      _highWater = _used;
+  }
+
+  uint8_t _pool[WEBSERVER_ARENA_SIZE] __attribute__((aligned(sizeof(void*))));
+  size_t  _used;
+  size_t  _highWater;
+  char*   _last;      // string that append() may still extend
+};
+
+#endif
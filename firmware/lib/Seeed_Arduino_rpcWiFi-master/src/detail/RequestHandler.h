@@ -15,8 +15,14 @@ public:
     RequestHandler* next() { return _next; }
     void next(RequestHandler* r) { _next = r; }
 
+    // route label and request count for the metrics endpoint
+    virtual const char* route() { return ""; }
+    uint32_t requests() const { return _requests; }
+    void countRequest() { _requests++; }
+
 private:
     RequestHandler* _next = nullptr;
+    uint32_t _requests = 0;
 
 protected:
     std::vector<String> pathArgs;
@@ -89,6 +89,10 @@ public:
             _ufn();
     }
 
+    const char* route() override {
+        return _uri.c_str();
+    }
+
 protected:
     WebServer::THandlerFunction _fn;
     WebServer::THandlerFunction _ufn;
@@ -96,6 +100,38 @@ protected:
     HTTPMethod _method;
 };
 
+class WebSocketRequestHandler : public RequestHandler {
+public:
+    WebSocketRequestHandler(WebServer::TWebSocketFunction fn, const String &uri)
+    : _fn(fn)
+    , _uri(uri)
+    {
+    }
+
+    bool canHandle(HTTPMethod requestMethod, String requestUri) override  {
+        return requestMethod == HTTP_GET && requestUri == _uri;
+    }
+
+    bool handle(WebServer& server, HTTPMethod requestMethod, String requestUri) override {
+        if (!canHandle(requestMethod, requestUri))
+            return false;
+
+        return server._upgradeWebSocket(_fn);
+    }
+
+    const char* route() override {
+        return _uri.c_str();
+    }
+
+protected:
+    WebServer::TWebSocketFunction _fn;
+    String _uri;
+};
+
+#ifndef STATIC_VALIDATOR_CACHE_SIZE
+#define STATIC_VALIDATOR_CACHE_SIZE 8
+#endif
+
 class StaticRequestHandler : public RequestHandler {
 public:
     StaticRequestHandler(FS& fs, const char* path, const char* uri, const char* cache_header)
@@ -103,6 +139,7 @@ public:
     , _uri(uri)
     , _path(path)
     , _cache_header(cache_header)
+    , _validatorClock(0)
     {
         _isFile = fs.exists(path);
         log_v("StaticRequestHandler: path=%s uri=%s isFile=%d, cache_header=%s\r\n", path, uri, _isFile, cache_header);
@@ -138,49 +175,142 @@ public:
         }
         log_v("StaticRequestHandler::handle: path=%s, isFile=%d\r\n", path.c_str(), _isFile);
 
-        String contentType = getContentType(path);
+        const char* contentType = getContentType(path);
+
+        // A cached validator remembers which file (plain or .gz) answered this path,
+        // so a revalidation costs one f_stat instead of two exists() and an open.
+        FILINFO info;
+        Validator* v = _findValidator(path);
+        if (!v || !_fs.stat(v->file, &info)) {
+            String file = path;
+            // look for gz file, only if the original specified path is not a gz.  So part only works to send gzip via content encoding when a non compressed is asked for
+            // if you point the the path to gzip you will serve the gzip as content type "application/x-gzip", not text or javascript etc...
+            if (!path.endsWith(FPSTR(mimeTable[gz].endsWith)) && !_fs.exists(path))  {
+                String pathWithGz = path + FPSTR(mimeTable[gz].endsWith);
+                if(_fs.exists(pathWithGz))
+                    file += FPSTR(mimeTable[gz].endsWith);
+            }
+            if (!_fs.stat(file, &info) || (info.fattrib & AM_DIR)) {
+                if (v)
+                    v->path = String();
+                return false;
+            }
+            v = _storeValidator(path, file);
+        }
+
+        char etag[24];
+        char lastModified[32];
+        _formatETag(etag, info);
+        _formatHttpDate(lastModified, info.fdate, info.ftime);
 
-        // look for gz file, only if the original specified path is not a gz.  So part only works to send gzip via content encoding when a non compressed is asked for
-        // if you point the the path to gzip you will serve the gzip as content type "application/x-gzip", not text or javascript etc...
-        if (!path.endsWith(FPSTR(mimeTable[gz].endsWith)) && !_fs.exists(path))  {
-            String pathWithGz = path + FPSTR(mimeTable[gz].endsWith);
-            if(_fs.exists(pathWithGz))
-                path += FPSTR(mimeTable[gz].endsWith);
+        if (_isNotModified(server, etag, lastModified)) {
+            log_v("StaticRequestHandler::handle: not modified %s\r\n", v->file.c_str());
+            _sendValidators(server, etag, lastModified);
+            server.send(304);
+            return true;
         }
 
-        File f = _fs.open(path, "r");
+        File f = _fs.open(v->file, "r");
         if (!f)
             return false;
 
-        if (_cache_header.length() != 0)
-            server.sendHeader("Cache-Control", _cache_header);
-
+        _sendValidators(server, etag, lastModified);
         server.streamFile(f, contentType);
         return true;
     }
 
-    static String getContentType(const String& path) {
-        char buff[sizeof(mimeTable[0].mimeType)];
-        // Check all entries but last one for match, return if found
-        for (size_t i=0; i < sizeof(mimeTable)/sizeof(mimeTable[0])-1; i++) {
-            strcpy_P(buff, mimeTable[i].endsWith);
-            if (path.endsWith(buff)) {
-                strcpy_P(buff, mimeTable[i].mimeType);
-                return String(buff);
+    static const char* getContentType(const String& path) {
+        return mime::getContentType(path.c_str(), path.length());
+    }
+
+    const char* route() override {
+        return _uri.c_str();
+    }
+
+protected:
+    struct Validator {
+        String path;       // requested path, the cache key
+        String file;       // file actually served, may carry the .gz suffix
+        uint32_t lastUsed = 0;
+    };
+
+    Validator* _findValidator(const String& path) {
+        for (size_t i = 0; i < STATIC_VALIDATOR_CACHE_SIZE; i++) {
+            if (_validators[i].path.length() && _validators[i].path == path) {
+                _validators[i].lastUsed = ++_validatorClock;
+                return &_validators[i];
             }
         }
-        // Fall-through and just return default type
-        strcpy_P(buff, mimeTable[sizeof(mimeTable)/sizeof(mimeTable[0])-1].mimeType);
-        return String(buff);
+        return nullptr;
+    }
+
+    Validator* _storeValidator(const String& path, const String& file) {
+        // reuse the entry for this path if any, otherwise evict the least recently used
+        Validator* slot = &_validators[0];
+        for (size_t i = 0; i < STATIC_VALIDATOR_CACHE_SIZE; i++) {
+            if (_validators[i].path == path) {
+                slot = &_validators[i];
+                break;
+            }
+            if (_validators[i].lastUsed < slot->lastUsed)
+                slot = &_validators[i];
+        }
+        slot->path = path;
+        slot->file = file;
+        slot->lastUsed = ++_validatorClock;
+        return slot;
+    }
+
+    // Strong validator built from size and FAT modification stamp, e.g. "5a3-4f2a6b1c"
+    static void _formatETag(char* out, const FILINFO& info) {
+        sprintf(out, "\"%lx-%04x%04x\"", (unsigned long)info.fsize, info.fdate, info.ftime);
+    }
+
+    // RFC 7231 IMF-fixdate from a FAT date/time pair, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    static void _formatHttpDate(char* out, uint16_t fdate, uint16_t ftime) {
+        static const char days[] = "SunMonTueWedThuFriSat";
+        static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        int year = 1980 + (fdate >> 9);
+        int month = (fdate >> 5) & 0x0F;
+        int day = fdate & 0x1F;
+        if (month < 1 || month > 12)
+            month = 1;
+        if (day < 1)
+            day = 1;
+        // Sakamoto's day of week
+        static const uint8_t t[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+        int y = year - (month < 3);
+        int wday = (y + y / 4 - y / 100 + y / 400 + t[month - 1] + day) % 7;
+        sprintf(out, "%.3s, %02d %.3s %04d %02d:%02d:%02d GMT",
+                days + wday * 3, day, months + (month - 1) * 3, year,
+                ftime >> 11, (ftime >> 5) & 0x3F, (ftime & 0x1F) * 2);
+    }
+
+    static bool _isNotModified(WebServer& server, const char* etag, const char* lastModified) {
+        // If-None-Match takes precedence over If-Modified-Since (RFC 7232 section 6)
+        String inm = server.header(F("If-None-Match"));
+        if (inm.length())
+            return inm == "*" || inm.indexOf(etag) >= 0;
+        // Clients echo back the Last-Modified we sent, so an exact match is sufficient
+        String ims = server.header(F("If-Modified-Since"));
+        return ims.length() && ims == lastModified;
+    }
+
+    void _sendValidators(WebServer& server, const char* etag, const char* lastModified) {
+        server.sendHeader(F("ETag"), etag);
+        server.sendHeader(F("Last-Modified"), lastModified);
+        if (_cache_header.length() != 0)
+            server.sendHeader("Cache-Control", _cache_header);
     }
 
-protected:
     FS _fs;
     String _uri;
     String _path;
     String _cache_header;
     bool _isFile;
     size_t _baseUriLength;
+    Validator _validators[STATIC_VALIDATOR_CACHE_SIZE];
+    uint32_t _validatorClock;
 };
 
 
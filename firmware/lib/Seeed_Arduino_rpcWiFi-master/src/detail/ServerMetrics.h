@@ -0,0 +1,74 @@
+#ifndef __SERVERMETRICS_H__
+#define __SERVERMETRICS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Latency buckets double from 64us, the last bound is about 4.2s
+#ifndef WEBSERVER_METRICS_BUCKETS
+#define WEBSERVER_METRICS_BUCKETS 17
+#endif
+
+// Distinct status codes counted on their own, later ones only as "other"
+#ifndef WEBSERVER_METRICS_CODES
+#define WEBSERVER_METRICS_CODES 12
+#endif
+
+#define METRICS_BUCKET_SHIFT 6
+
+// Log2 bucketed latency histogram. Recording is a count leading zeros and a
+// few adds; buckets are stored per range and made cumulative when rendered.
+struct LatencyHistogram
+{
+  uint32_t buckets[WEBSERVER_METRICS_BUCKETS + 1];  // the extra one is past the last bound
+  uint32_t count;
+  uint64_t sum;                                     // microseconds
+
+  void record(uint32_t us) {
+    uint32_t i = us <= (1UL << METRICS_BUCKET_SHIFT) ? 0 : 32 - __builtin_clz((us - 1) >> METRICS_BUCKET_SHIFT);
+    if (i > WEBSERVER_METRICS_BUCKETS)
+      i = WEBSERVER_METRICS_BUCKETS;
+    buckets[i]++;
+    count++;
+    sum += us;
+  }
+
+  static uint32_t bound(size_t i) { return (1UL << METRICS_BUCKET_SHIFT) << i; }
+};
+
+// Counters behind the metrics endpoint. Only handleClient() updates them and
+// it runs on one thread, so plain increments are enough.
+struct ServerMetrics
+{
+  struct StatusCount {
+    uint16_t code;
+    uint32_t count;
+  };
+
+  LatencyHistogram parse;
+  LatencyHistogram handler;
+  LatencyHistogram send;
+  StatusCount      codes[WEBSERVER_METRICS_CODES];
+  uint32_t         otherCodes;
+  uint32_t         unrouted;      // requests no handler claimed
+  uint32_t         rejected;      // turned away by admission control
+  uint64_t         bytesIn;
+  uint64_t         bytesOut;
+
+  void countStatus(int code) {
+    for (size_t i = 0; i < WEBSERVER_METRICS_CODES; i++) {
+      if (codes[i].code == code) {
+        codes[i].count++;
+        return;
+      }
+      if (!codes[i].code) {
+        codes[i].code = code;
+        codes[i].count = 1;
+        return;
+      }
+    }
+    otherCodes++;
+  }
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "mimetable.h"
 #include "avr/pgmspace.h"
+#include <string.h>
+#include <strings.h>
 
 namespace mime
 {
@@ -32,4 +34,60 @@ const Entry mimeTable[maxType] =
     { "", "application/octet-stream" } 
 };
 
+// Type stored at each extensionHash() slot, none where no extension lands
+constexpr uint8_t extensionSlots[MIME_HASH_SIZE] =
+{
+    none, none, js, none, none, eot, none, woff2,
+    html, appcache, none, none, none, none, none, none,
+    htm, none, none, sfnt, txt, none, none, gif,
+    xml, none, json, none, none, none, none, otf,
+    pdf, ico, jpg, none, ttf, none, none, woff,
+    png, none, none, svg, none, none, none, none,
+    none, none, none, none, none, none, none, gz,
+    none, none, zip, css, none, none, none, none,
+};
+
+#define MIME_HASH_CHECK(ext, type) \
+  static_assert(extensionSlots[extensionHash(ext[1], ext[sizeof(ext) - 2])] == type, "mime hash collision on " ext)
+
+MIME_HASH_CHECK(".html", html);
+MIME_HASH_CHECK(".htm", htm);
+MIME_HASH_CHECK(".css", css);
+MIME_HASH_CHECK(".txt", txt);
+MIME_HASH_CHECK(".js", js);
+MIME_HASH_CHECK(".json", json);
+MIME_HASH_CHECK(".png", png);
+MIME_HASH_CHECK(".gif", gif);
+MIME_HASH_CHECK(".jpg", jpg);
+MIME_HASH_CHECK(".ico", ico);
+MIME_HASH_CHECK(".svg", svg);
+MIME_HASH_CHECK(".ttf", ttf);
+MIME_HASH_CHECK(".otf", otf);
+MIME_HASH_CHECK(".woff", woff);
+MIME_HASH_CHECK(".woff2", woff2);
+MIME_HASH_CHECK(".eot", eot);
+MIME_HASH_CHECK(".sfnt", sfnt);
+MIME_HASH_CHECK(".xml", xml);
+MIME_HASH_CHECK(".pdf", pdf);
+MIME_HASH_CHECK(".zip", zip);
+MIME_HASH_CHECK(".gz", gz);
+MIME_HASH_CHECK(".appcache", appcache);
+
+const char* getContentType(const char* path, size_t length)
+{
+  // the extension follows the last dot of the last path segment
+  const char* end = path + length;
+  const char* ext = end;
+  while (ext > path && ext[-1] != '.' && ext[-1] != '/')
+    ext--;
+  size_t extLength = end - ext;
+  if (ext == path || ext[-1] != '.' || extLength == 0 || extLength > sizeof(mimeTable[0].endsWith) - 2)
+    return mimeTable[none].mimeType;
+
+  const Entry& entry = mimeTable[extensionSlots[extensionHash(ext[0], ext[extLength - 1])]];
+  if (strncasecmp(entry.endsWith + 1, ext, extLength) == 0 && entry.endsWith[extLength + 1] == '\0')
+    return entry.mimeType;
+  return mimeTable[none].mimeType;
+}
+
 }
@@ -1,6 +1,8 @@
 #ifndef __MIMETABLE_H__
 #define __MIMETABLE_H__
 
+#include <stddef.h>
+#include <stdint.h>
 
 namespace mime
 {
@@ -41,6 +43,18 @@ struct Entry
 
 
 extern const Entry mimeTable[maxType];
+
+// Perfect hash of an extension, taken from its first and last character with
+// ASCII letters folded to lower case. Every table entry is checked against
+// extensionSlots at compile time, so a new extension that collides fails the build.
+#define MIME_HASH_SIZE 64
+constexpr uint8_t extensionHash(char first, char last)
+{
+  return ((first | 0x20) + 8 * (last | 0x20)) & (MIME_HASH_SIZE - 1);
+}
+
+// Content type for a path by its extension; points into mimeTable, nothing is copied
+const char* getContentType(const char* path, size_t length);
 }
 
 
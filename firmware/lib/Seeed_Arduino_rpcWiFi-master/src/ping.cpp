@@ -79,40 +79,38 @@
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
 #include "lwip/mem.h"
-static uint16_t ping_seq_num;
-static uint8_t stopped = 0;
-
 /*
-* Statistics
+* Statistics of one ping_start() run, kept on its stack so that runs do not
+* share state
 */
-static uint32_t transmitted = 0;
-static uint32_t received = 0;
-static float min_time = 0;
-static float max_time = 0;
-static float mean_time = 0;
-static float last_mean_time = 0;
-static float var_time = 0;
+struct ping_stats {
+    uint32_t transmitted;
+    uint32_t received;
+    float min_time;
+    float max_time;
+    float mean_time;
+    float var_time;
+};
 
 #define PING_ID 0xAFAF
 
 #define PING_DEFAULT_COUNT    10
 #define PING_DEFAULT_INTERVAL  1
-#define PING_DEFAULT_SIZE     32
 #define PING_DEFAULT_TIMEOUT   1
 
 /*
 * Helper functions
 *
 */
-static void ping_prepare_echo(struct icmp_echo_hdr *iecho, uint16_t len) {
+static void ping_prepare_echo(struct icmp_echo_hdr *iecho, uint16_t len, uint16_t id, uint16_t seqno) {
     size_t i;
     size_t data_len = len - sizeof(struct icmp_echo_hdr);
 
     ICMPH_TYPE_SET(iecho, ICMP_ECHO);
     ICMPH_CODE_SET(iecho, 0);
     iecho->chksum = 0;
-    iecho->id = PING_ID;
-    iecho->seqno = htons(++ping_seq_num);
+    iecho->id = id;
+    iecho->seqno = htons(seqno);
 
     /* fill the additional data buffer with some data */
     for (i = 0; i < data_len; i++) {
@@ -122,7 +120,7 @@ static void ping_prepare_echo(struct icmp_echo_hdr *iecho, uint16_t len) {
     iecho->chksum = inet_chksum(iecho, len);
 }
 
-static err_t ping_send(int s, ip4_addr_t *addr, int size) {
+static err_t ping_send(int s, ip4_addr_t *addr, int size, uint16_t id, uint16_t seqno) {
     struct icmp_echo_hdr *iecho;
     struct sockaddr_in to;
     size_t ping_size = sizeof(struct icmp_echo_hdr) + size;
@@ -130,29 +128,46 @@ static err_t ping_send(int s, ip4_addr_t *addr, int size) {
 
     iecho = (struct icmp_echo_hdr *)mem_malloc((mem_size_t)ping_size);
     if (!iecho) {
-	mem_free(iecho);    
         return ERR_MEM;
     }
 
-    ping_prepare_echo(iecho, (uint16_t)ping_size);
+    ping_prepare_echo(iecho, (uint16_t)ping_size, id, seqno);
 
     to.sin_len = sizeof(to);
     to.sin_family = AF_INET;
     inet_addr_from_ip4addr(&to.sin_addr, addr);
 
-    if ((err = sendto(s, iecho, ping_size, 0, (struct sockaddr*)&to, sizeof(to)))) {
-        transmitted++;
-    }
+    err = sendto(s, iecho, ping_size, 0, (struct sockaddr*)&to, sizeof(to));
     mem_free(iecho);
-    return (err ? ERR_OK : ERR_VAL);
+    return (err > 0 ? ERR_OK : ERR_VAL);
 }
 
-static void ping_recv(int s) {
-    char buf[64];
-    int fromlen, len;
+// Takes one datagram off the socket, the echo reply in it if it is ours
+static struct icmp_echo_hdr *ping_reply(int s, char *buf, size_t size, int *len, uint16_t id) {
     struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
     struct ip_hdr *iphdr;
-    struct icmp_echo_hdr *iecho = NULL;
+    struct icmp_echo_hdr *iecho;
+
+    *len = recvfrom(s, buf, size, 0, (struct sockaddr*)&from, &fromlen);
+    if (*len < (int)(sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr))) {
+        return NULL;
+    }
+    iphdr = (struct ip_hdr *)buf;
+    if ((size_t)(IPH_HL(iphdr) * 4 + sizeof(struct icmp_echo_hdr)) > (size_t)*len) {
+        return NULL;
+    }
+    iecho = (struct icmp_echo_hdr *)(buf + (IPH_HL(iphdr) * 4));
+    if (ICMPH_TYPE(iecho) != ICMP_ER || iecho->id != id) {
+        return NULL;
+    }
+    return iecho;
+}
+
+static void ping_recv(int s, ip4_addr_t *addr, uint16_t seqno, struct ping_stats *stats) {
+    char buf[64];
+    int len;
+    struct icmp_echo_hdr *iecho;
     char ipa[16];
     struct timeval begin;
     struct timeval end;
@@ -164,76 +179,56 @@ static void ping_recv(int s) {
     gettimeofday(&begin, NULL);
 
     // Send
-    while ((len = recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr*)&from, (socklen_t*)&fromlen)) > 0) {
-        if (len >= (int)(sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr))) {
+    do {
+        iecho = ping_reply(s, buf, sizeof(buf), &len, PING_ID);
+        if (iecho && iecho->seqno == htons(seqno)) {
             // Register end time
             gettimeofday(&end, NULL);
 
-            /// Get from IP address
-            ip4_addr_t fromaddr;
-            inet_addr_to_ip4addr(&fromaddr, &from.sin_addr);
-
-            strcpy(ipa, inet_ntoa(fromaddr));
+            strcpy(ipa, inet_ntoa(*addr));
 
-            // Get echo
-            iphdr = (struct ip_hdr *)buf;
-            iecho = (struct icmp_echo_hdr *)(buf + (IPH_HL(iphdr) * 4));
+            stats->received++;
 
-            // Print ....
-            if ((iecho->id == PING_ID) && (iecho->seqno == htons(ping_seq_num))) {
-                received++;
+            // Get elapsed time in milliseconds
+            micros_begin = begin.tv_sec * 1000000;
+            micros_begin += begin.tv_usec;
 
-                // Get elapsed time in milliseconds
-                micros_begin = begin.tv_sec * 1000000;
-                micros_begin += begin.tv_usec;
+            micros_end = end.tv_sec * 1000000;
+            micros_end += end.tv_usec;
 
-                micros_end = end.tv_sec * 1000000;
-                micros_end += end.tv_usec;
+            elapsed = (float)(micros_end - micros_begin) / (float)1000.0;
 
-                elapsed = (float)(micros_end - micros_begin) / (float)1000.0;
-
-                // Update statistics
-                // Mean and variance are computed in an incremental way
-                if (elapsed < min_time) {
-                    min_time = elapsed;
-                }
+            // Update statistics
+            // Mean and variance are computed in an incremental way
+            if (elapsed < stats->min_time) {
+                stats->min_time = elapsed;
+            }
 
-                if (elapsed > max_time) {
-                    max_time = elapsed;
-                }
+            if (elapsed > stats->max_time) {
+                stats->max_time = elapsed;
+            }
 
-                last_mean_time = mean_time;
-                mean_time = (((received - 1) * mean_time) + elapsed) / received;
+            float last_mean_time = stats->mean_time;
+            stats->mean_time = (((stats->received - 1) * stats->mean_time) + elapsed) / stats->received;
 
-                if (received > 1) {
-                    var_time = var_time + ((elapsed - last_mean_time) * (elapsed - mean_time));
-                }
+            if (stats->received > 1) {
+                stats->var_time = stats->var_time + ((elapsed - last_mean_time) * (elapsed - stats->mean_time));
+            }
 
-                // Print ...
-               rpc_printf("%d bytes from %s: icmp_seq=%d time=%.3f ms\r\n", len, ipa,
-                     ntohs(iecho->seqno), elapsed
-               );
+            // Print ...
+           rpc_printf("%d bytes from %s: icmp_seq=%d time=%.3f ms\r\n", len, ipa,
+                 ntohs(iecho->seqno), elapsed
+           );
 
-                return;
-            }
-            else {
-                // TODO
-            }
+            return;
         }
-    }
+    } while (len > 0);
 
     if (len < 0) {
-//        log_d("Request timeout for icmp_seq %d\r\n", ping_seq_num);
+//        log_d("Request timeout for icmp_seq %d\r\n", seqno);
     }
 }
 /*
-static void stop_action(int i) {
-	signal(i, SIG_DFL);
-
-	stopped = 1;
-}
-*/
-/*
 * Operation functions
 *
 */
@@ -299,16 +294,13 @@ bool ping_start(IPAddress adr, int count=0, int interval=0, int size=0, int time
         return false;
     }
 
-    stopped = 0;
-    transmitted = 0;
-    received = 0;
-    min_time = 1.E+9;// FLT_MAX;
-    max_time = 0.0;
-    mean_time = 0.0;
-    var_time = 0.0;
-
-    // Register signal for stop ping
-    //signal(SIGINT, stop_action);
+    struct ping_stats stats;
+    stats.transmitted = 0;
+    stats.received = 0;
+    stats.min_time = 1.E+9;// FLT_MAX;
+    stats.max_time = 0.0;
+    stats.mean_time = 0.0;
+    stats.var_time = 0.0;
 
     // Begin ping ...
     char ipa[16];
@@ -316,12 +308,13 @@ bool ping_start(IPAddress adr, int count=0, int interval=0, int size=0, int time
     strcpy(ipa, inet_ntoa(ping_target));
 //    log_i("PING %s: %d data bytes\r\n",  ipa, size);
 
-    ping_seq_num = 0;
-    
+    uint16_t seqno = 0;
+
     unsigned long ping_started_time = millis();
-    while ((ping_seq_num < count) && (!stopped)) {
-        if (ping_send(s, &ping_target, size) == ERR_OK) {
-            ping_recv(s);
+    while (seqno < count) {
+        if (ping_send(s, &ping_target, size, PING_ID, ++seqno) == ERR_OK) {
+            stats.transmitted++;
+            ping_recv(s, &ping_target, seqno, &stats);
         }
         delay( interval*1000L);
     }
@@ -329,29 +322,189 @@ bool ping_start(IPAddress adr, int count=0, int interval=0, int size=0, int time
     closesocket(s);
 
    rpc_printf("%d packets transmitted, %d packets received, %.1f%% packet loss\r\n",
-         transmitted,
-         received,
-         ((((float)transmitted - (float)received) / (float)transmitted) * 100.0)
+         stats.transmitted,
+         stats.received,
+         ((((float)stats.transmitted - (float)stats.received) / (float)stats.transmitted) * 100.0)
    );
     
     
     if (ping_o) {
         ping_resp pingresp;
-//        log_i("round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\r\n", min_time, mean_time, max_time, sqrt(var_time / received));
+//        log_i("round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\r\n", stats.min_time, stats.mean_time, stats.max_time, sqrt(stats.var_time / stats.received));
         pingresp.total_count = count; //Number of pings
-        pingresp.resp_time = mean_time; //Average time for the pings
+        pingresp.resp_time = stats.mean_time; //Average time for the pings
         pingresp.seqno = 0; //not relevant
-        pingresp.timeout_count = transmitted - received; //number of pings which failed
+        pingresp.timeout_count = stats.transmitted - stats.received; //number of pings which failed
         pingresp.bytes = size; //number of bytes received for 1 ping
         pingresp.total_bytes = size * count; //number of bytes for all pings
         pingresp.total_time = (millis() - ping_started_time) / 1000.0; //Time consumed for all pings; it takes into account also timeout pings
-        pingresp.ping_err = transmitted - received; //number of pings failed
+        pingresp.ping_err = stats.transmitted - stats.received; //number of pings failed
         // Call the callback function
         ping_o->recv_function(ping_o, &pingresp);
     }
     
     // Return true if at least one ping had a successfull "pong" 
-    return (received > 0);
+    return (stats.received > 0);
+}
+
+void RttTracker::reset() {
+    _count = 0;
+    _next = 0;
+    _lost = 0;
+    _probes = 0;
+    _srtt = 0;
+    _rttvar = 0;
+    _sent = 0;
+    _received = 0;
+}
+
+void RttTracker::_outcome(bool lost) {
+    _sent++;
+    _lost = (_lost << 1) | (lost ? 1 : 0);
+    if (_probes < 32) {
+        _probes++;
+    }
+}
+
+void RttTracker::add(uint32_t rtt) {
+    _outcome(false);
+    _received++;
+    _samples[_next] = rtt;
+    _next = (_next + 1) % PING_RTT_WINDOW;
+    if (_count < PING_RTT_WINDOW) {
+        _count++;
+    }
+
+    if (_received == 1) {
+        _srtt = rtt;
+        _rttvar = rtt / 2;
+    } else {
+        uint32_t delta = rtt > _srtt ? rtt - _srtt : _srtt - rtt;
+        _rttvar = _rttvar - _rttvar / 4 + delta / 4;
+        _srtt = _srtt - _srtt / 8 + rtt / 8;
+    }
+}
+
+void RttTracker::lost() {
+    _outcome(true);
+}
+
+uint32_t RttTracker::percentile(uint8_t p) const {
+    if (!_count) {
+        return 0;
+    }
+    uint32_t sorted[PING_RTT_WINDOW];
+    memcpy(sorted, _samples, _count * sizeof(uint32_t));
+    for (uint8_t i = 1; i < _count; i++) {
+        uint32_t v = sorted[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+    // nearest rank
+    uint32_t rank = ((uint32_t)p * _count + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+uint8_t RttTracker::loss() const {
+    if (!_probes) {
+        return 0;
+    }
+    uint32_t window = _probes < 32 ? _lost & ((1UL << _probes) - 1) : _lost;
+    return __builtin_popcount(window) * 100 / _probes;
+}
+
+uint16_t PingProber::_nextId = PING_ID + 1;
+
+PingProber::PingProber()
+    : _socket(-1), _id(0), _seqno(0), _interval(0), _timeout(0), _size(PING_DEFAULT_SIZE), _waiting(false), _sentAt(0), _sentMicros(0) {
+}
+
+PingProber::~PingProber() {
+    end();
+}
+
+bool PingProber::begin(IPAddress target, uint32_t interval_ms, uint32_t timeout_ms, uint16_t size) {
+    end();
+    if ((_socket = socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP)) < 0) {
+        log_e("ping socket: %d", errno);
+        return false;
+    }
+    fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL, 0) | O_NONBLOCK);
+
+    _id = _nextId++;
+    if (_nextId == PING_ID) {
+        _nextId++;
+    }
+    _seqno = 0;
+    _target = target;
+    _interval = interval_ms;
+    _timeout = timeout_ms < interval_ms ? timeout_ms : interval_ms;
+    _size = size;
+    _waiting = false;
+    _sentAt = millis() - interval_ms;
+    _stats.reset();
+    return true;
+}
+
+void PingProber::end() {
+    if (_socket >= 0) {
+        closesocket(_socket);
+        _socket = -1;
+    }
+}
+
+void PingProber::poll() {
+    if (_socket < 0) {
+        return;
+    }
+
+    // every raw socket sees all echo replies, the id picks ours
+    char buf[64];
+    int len;
+    do {
+        struct icmp_echo_hdr *iecho = ping_reply(_socket, buf, sizeof(buf), &len, _id);
+        if (iecho && _waiting && iecho->seqno == htons(_seqno)) {
+            _stats.add(micros() - _sentMicros);
+            _waiting = false;
+        }
+    } while (len > 0);
+
+    uint32_t now = millis();
+    if (_waiting && now - _sentAt >= _timeout) {
+        _stats.lost();
+        _waiting = false;
+    }
+    if (!_waiting && now - _sentAt >= _interval) {
+        ip4_addr_t addr;
+        addr.addr = _target;
+        _sentAt = now;
+        _sentMicros = micros();
+        if (ping_send(_socket, &addr, _size, _id, ++_seqno) == ERR_OK) {
+            _waiting = true;
+        } else {
+            // the request never left, which says as much about the link as a lost reply
+            _stats.lost();
+        }
+    }
+}
+
+void PingProber::report(Print &out, const char *name) const {
+    static const uint8_t quantiles[] = {50, 90, 99};
+    for (uint8_t i = 0; i < sizeof(quantiles); i++) {
+        uint32_t rtt = _stats.percentile(quantiles[i]);
+        out.printf("ping_rtt_seconds{probe=\"%s\",quantile=\"0.%u\"} %lu.%06lu\n", name, quantiles[i],
+                   (unsigned long)(rtt / 1000000), (unsigned long)(rtt % 1000000));
+    }
+    out.printf("ping_rtt_smoothed_seconds{probe=\"%s\"} %lu.%06lu\n", name,
+               (unsigned long)(_stats.srtt() / 1000000), (unsigned long)(_stats.srtt() % 1000000));
+    out.printf("ping_rtt_deviation_seconds{probe=\"%s\"} %lu.%06lu\n", name,
+               (unsigned long)(_stats.rttvar() / 1000000), (unsigned long)(_stats.rttvar() % 1000000));
+    out.printf("ping_sent_total{probe=\"%s\"} %lu\n", name, (unsigned long)_stats.sent());
+    out.printf("ping_received_total{probe=\"%s\"} %lu\n", name, (unsigned long)_stats.received());
+    out.printf("ping_loss_percent{probe=\"%s\"} %u\n", name, _stats.loss());
 }
 
 bool ping_regist_recv(struct ping_option *ping_opt, ping_recv_function ping_recv)
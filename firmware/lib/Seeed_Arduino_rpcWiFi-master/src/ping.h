@@ -28,6 +28,86 @@ struct ping_resp {
     int8_t  ping_err;
 };
 
+#define PING_DEFAULT_SIZE     32
+
+// Replies kept by RttTracker for its percentiles
+#ifndef PING_RTT_WINDOW
+#define PING_RTT_WINDOW 32
+#endif
+
+// Round trip statistics of a probe: a smoothed mean and deviation with the
+// TCP gains (RFC 6298), percentiles over the last PING_RTT_WINDOW replies and
+// the loss over the last 32 probes. Times are in microseconds.
+class RttTracker {
+public:
+    RttTracker() { reset(); }
+
+    void reset();
+    void add(uint32_t rtt);
+    void lost();
+
+    uint32_t srtt() const { return _srtt; }
+    uint32_t rttvar() const { return _rttvar; }
+    uint32_t last() const { return _count ? _samples[(_next + PING_RTT_WINDOW - 1) % PING_RTT_WINDOW] : 0; }
+    uint32_t percentile(uint8_t p) const;   // 0 before the first reply
+    uint8_t loss() const;                   // percent
+    uint32_t sent() const { return _sent; }
+    uint32_t received() const { return _received; }
+
+protected:
+    void _outcome(bool lost);
+
+    uint32_t _samples[PING_RTT_WINDOW];
+    uint8_t  _count;
+    uint8_t  _next;
+    uint32_t _lost;         // one bit per probe, newest lowest
+    uint8_t  _probes;       // bits of _lost in use
+    uint32_t _srtt;
+    uint32_t _rttvar;
+    uint32_t _sent;
+    uint32_t _received;
+};
+
+// Pings one address every interval without blocking: poll() sends, collects
+// the reply or gives up on it, and returns at once. A reply later than the
+// interval counts as lost. Every prober has its own socket and echo id, so any
+// number of them can run side by side.
+class PingProber {
+public:
+    PingProber();
+    ~PingProber();
+
+    // owns its socket, a copy would close it a second time
+    PingProber(const PingProber &) = delete;
+    PingProber &operator=(const PingProber &) = delete;
+
+    bool begin(IPAddress target, uint32_t interval_ms = 1000, uint32_t timeout_ms = 1000, uint16_t size = PING_DEFAULT_SIZE);
+    void end();
+    void poll();
+
+    bool running() const { return _socket >= 0; }
+    IPAddress target() const { return _target; }
+    const RttTracker &stats() const { return _stats; }
+
+    // Prometheus text lines, labelled with probe="name"
+    void report(Print &out, const char *name) const;
+
+protected:
+    int       _socket;
+    uint16_t  _id;
+    uint16_t  _seqno;
+    IPAddress _target;
+    uint32_t  _interval;
+    uint32_t  _timeout;
+    uint16_t  _size;
+    bool      _waiting;     // a request is out
+    uint32_t  _sentAt;      // millis() of the last request
+    uint32_t  _sentMicros;
+    RttTracker _stats;
+
+    static uint16_t _nextId;
+};
+
 bool ping_start(struct ping_option *ping_opt);
 void ping(const char *name, int count, int interval, int size, int timeout);
 bool ping_start(IPAddress adr, int count, int interval, int size, int timeout, struct ping_option *ping_o = NULL);
@@ -1,7 +1,55 @@
 #include "firebase_helper.h"
+#include "link_monitor.h"
 
 // Firebase configuration
-#define FIREBASE_DATABASE_URL "https://digisave-21992-default-rtdb.europe-west1.firebasedatabase.app"
+#define FIREBASE_DATABASE_HOST "digisave-21992-default-rtdb.europe-west1.firebasedatabase.app"
+#define FIREBASE_DATABASE_URL "https://" FIREBASE_DATABASE_HOST
+
+// Budgets (ms) on a good link, stretched by linkTimeout() when it is slow or lossy.
+// They only hold until firebaseRetry has timed a few requests.
+#define FIREBASE_CONNECT_TIMEOUT 5000
+#define FIREBASE_RESPONSE_TIMEOUT 5000
+
+// SHA-256 of the database host's DER certificate, set through build_flags as
+//   -D FIREBASE_CERT_SHA256=\"<hex>\"
+// from: openssl s_client -connect <host>:443 </dev/null | openssl x509 -outform der | sha256sum
+// A pinned handshake skips chain building; FIREBASE_CERT_SHA256_NEXT carries the
+// renewed certificate over a rollover. Without a pin the connection is unverified.
+#ifdef FIREBASE_CERT_SHA256
+static constexpr WiFiClientSecurePin firebasePins[] = {
+    {FIREBASE_DATABASE_HOST, FIREBASE_CERT_SHA256},
+#ifdef FIREBASE_CERT_SHA256_NEXT
+    {FIREBASE_DATABASE_HOST, FIREBASE_CERT_SHA256_NEXT},
+#endif
+};
+#endif
+
+// Shared by every request so timings and the circuit carry over between them
+static HTTPRetryPolicy firebaseRetry;
+
+static void beginFirebase(HTTPClient &http, const String &url)
+{
+#ifdef FIREBASE_CERT_SHA256
+    http.setPins(firebasePins, sizeof(firebasePins) / sizeof(firebasePins[0]));
+#endif
+    http.begin(url);
+    http.setConnectTimeout(linkTimeout(FIREBASE_CONNECT_TIMEOUT));
+    http.setTimeout(linkTimeout(FIREBASE_RESPONSE_TIMEOUT));
+    http.setRetryPolicy(&firebaseRetry);
+}
+
+static void reportFirebase(const char *what, int httpCode, const String &response)
+{
+    Serial.printf("[Firebase] %s: %d\n", what, httpCode);
+    if (httpCode < 0)
+    {
+        Serial.println("[Firebase] Error: " + HTTPClient::errorToString(httpCode));
+    }
+    else if (httpCode != 200)
+    {
+        Serial.println("[Firebase] Response: " + response);
+    }
+}
 
 unsigned long getTimestamp()
 {
@@ -16,9 +64,11 @@ void sendTransactionToFirebase(String type, float amount, float newBalance)
         return;
     }
 
+    // The database ignores Idempotency-Key and a retried POST would push the
+    // transaction twice, so it goes to a key of our own with a PUT instead
     HTTPClient http;
     String url = FIREBASE_DATABASE_URL;
-    url += "/transactions.json";
+    url += "/transactions/" + HTTPClient::idempotencyKey() + ".json";
 
     String payload = "{";
     payload += "\"type\":\"" + type + "\",";
@@ -28,19 +78,15 @@ void sendTransactionToFirebase(String type, float amount, float newBalance)
     payload += "\"device\":\"wio_terminal\"";
     payload += "}";
 
-    http.begin(url);
+    beginFirebase(http, url);
     http.addHeader("Content-Type", "application/json");
 
-    int httpCode = http.POST(payload);
+    int httpCode = http.PUT(payload);
     String response = http.getString();
 
     http.end();
 
-    Serial.printf("[Firebase] POST transaction: %d\n", httpCode);
-    if (httpCode != 200)
-    {
-        Serial.println("[Firebase] Response: " + response);
-    }
+    reportFirebase("PUT transaction", httpCode, response);
 }
 
 void updateBalanceInFirebase(float balance)
@@ -57,7 +103,7 @@ void updateBalanceInFirebase(float balance)
 
     String payload = String(balance, 2);
 
-    http.begin(url);
+    beginFirebase(http, url);
     http.addHeader("Content-Type", "application/json");
 
     int httpCode = http.PUT(payload);
@@ -65,9 +111,5 @@ void updateBalanceInFirebase(float balance)
 
     http.end();
 
-    Serial.printf("[Firebase] PUT balance: %d\n", httpCode);
-    if (httpCode != 200)
-    {
-        Serial.println("[Firebase] Response: " + response);
-    }
+    reportFirebase("PUT balance", httpCode, response);
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "link_monitor.h"
+
+#define LINK_PROBE_INTERVAL 2000  // ms between pings to the gateway
+#define LINK_PROBE_TIMEOUT 1000
+#define LINK_RSSI_INTERVAL 2000
+#define LINK_REPORT_INTERVAL 60000 // summary on Serial
+#define LINK_ROUND_TRIPS 4         // a request costs about this many: TCP, TLS and HTTP
+#define LINK_TIMEOUT_MAX 30000
+
+static PingProber gatewayProbe;
+static int rssiAverage = 0;
+static unsigned long lastRSSI = 0;
+static unsigned long lastReport = 0;
+
+void pollLinkMonitor()
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        if (gatewayProbe.running())
+        {
+            gatewayProbe.end();
+            rssiAverage = 0;
+        }
+        return;
+    }
+    // the gateway may be another one after a reconnect
+    if (!gatewayProbe.running() && !gatewayProbe.begin(WiFi.gatewayIP(), LINK_PROBE_INTERVAL, LINK_PROBE_TIMEOUT))
+        return;
+    gatewayProbe.poll();
+
+    unsigned long now = millis();
+    if (now - lastRSSI >= LINK_RSSI_INTERVAL)
+    {
+        lastRSSI = now;
+        int rssi = WiFi.RSSI();
+        if (rssi)
+            rssiAverage = rssiAverage ? (3 * rssiAverage + rssi) / 4 : rssi;
+    }
+    if (now - lastReport >= LINK_REPORT_INTERVAL)
+    {
+        lastReport = now;
+        printLinkStats(Serial);
+    }
+}
+
+const RttTracker &linkRtt()
+{
+    return gatewayProbe.stats();
+}
+
+int linkRSSI()
+{
+    return rssiAverage;
+}
+
+// base_ms plus a retransmission timeout (RFC 6298: srtt + 4 rttvar) for every
+// round trip of a request, doubled while replies go missing
+uint32_t linkTimeout(uint32_t base_ms)
+{
+    const RttTracker &rtt = gatewayProbe.stats();
+    if (!rtt.received())
+        return base_ms;
+    uint32_t rto = (rtt.srtt() + 4 * rtt.rttvar()) / 1000;
+    uint32_t timeout = base_ms + LINK_ROUND_TRIPS * rto;
+    if (rtt.loss() >= 10)
+        timeout *= 2;
+    return timeout < LINK_TIMEOUT_MAX ? timeout : LINK_TIMEOUT_MAX;
+}
+
+void printLinkStats(Print &out)
+{
+    const RttTracker &rtt = gatewayProbe.stats();
+    out.printf("[Link] rssi %d dBm, rtt %lu/%lu/%lu us (p50/p90/p99), srtt %lu us, loss %u%%, %lu/%lu replies\n",
+               rssiAverage,
+               (unsigned long)rtt.percentile(50), (unsigned long)rtt.percentile(90), (unsigned long)rtt.percentile(99),
+               (unsigned long)rtt.srtt(), rtt.loss(),
+               (unsigned long)rtt.received(), (unsigned long)rtt.sent());
+}
@@ -4,6 +4,8 @@
 #include <TFT_eSPI.h>
 #include <HTTPClient.h>
 #include "firebase_helper.h"
+#include "provisioning.h"
+#include "link_monitor.h"
 #include <Seeed_FS.h>
 #include <SD/Seeed_SD.h>
 
@@ -45,7 +47,8 @@ enum Screen
   PASSWORD_INPUT,
   CONNECTING,
   TRACKPAD_BANKING,
-  PIN_INPUT
+  PIN_INPUT,
+  PROVISIONING
 };
 Screen currentScreen = WIFI_SCAN;
 
@@ -53,6 +56,7 @@ String selectedSSID = "";
 String inputPassword = "";
 int selectedIndex = 0;
 int totalNetworks = 0;
+unsigned long provisioningStarted = 0; // millis() when the setup portal opened, 0 when not provisioning
 
 bool useUpperCase = false; // Toggle for Shift key
 bool showPassword = false; // Toggle for password visibility
@@ -152,6 +156,8 @@ void drawSignalBars(int x, int y, int rssi, uint16_t color);
 void drawKeyboard();
 void updateModeIndicator();
 void drawConnectingScreen();
+void drawProvisioningScreen();
+void handleProvisioningScreen();
 void drawTrackpadScreen();
 void drawErrorScreen();
 void updatePINDisplay();
@@ -218,6 +224,8 @@ void setup()
 
 void loop()
 {
+  pollLinkMonitor();
+
   switch (currentScreen)
   {
   case WIFI_SCAN:
@@ -235,6 +243,9 @@ void loop()
   case PIN_INPUT:
     handlePINInput();
     break;
+  case PROVISIONING:
+    handleProvisioningScreen();
+    break;
   }
 }
 
@@ -256,7 +267,7 @@ void drawWiFiScreen()
   tft.fillRect(0, 215, 320, 25, 0x2104);
   tft.setTextColor(TEXT_SECONDARY, 0x2104);
   tft.setTextSize(1);
-  tft.drawString("Use UP/DOWN to navigate, CENTER to select", 10, 222);
+  tft.drawString("UP/DOWN: move, CENTER: select, C: setup by phone", 10, 222);
 }
 
 void drawAllNetworks()
@@ -370,6 +381,69 @@ void handleWiFiSelection()
     drawKeyboard();
     delay(300);
   }
+  if (digitalRead(WIO_KEY_C) == LOW)
+  {
+    if (startProvisioning())
+    {
+      provisioningStarted = millis();
+      currentScreen = PROVISIONING;
+      drawProvisioningScreen();
+    }
+    delay(300);
+  }
+}
+
+// ────────────── Phone Setup Screen ──────────────
+void drawProvisioningScreen()
+{
+  tft.fillScreen(TFT_BLACK);
+
+  // Title bar
+  tft.fillRect(0, 0, 320, 35, ACCENT_COLOR);
+  tft.setTextColor(TEXT_PRIMARY, ACCENT_COLOR);
+  tft.setTextSize(2);
+  tft.drawString("Setup by Phone", 10, 8);
+
+  tft.setTextColor(TEXT_SECONDARY, TFT_BLACK);
+  tft.setTextSize(1);
+  tft.drawString("1. Join this network on your phone:", 10, 50);
+  tft.drawString("2. Enter this password:", 10, 100);
+  tft.drawString("3. Pick your WiFi on the page that opens, or visit", 10, 150);
+
+  tft.setTextColor(TEXT_PRIMARY, TFT_BLACK);
+  tft.setTextSize(2);
+  tft.drawString(provisioningSSID(), 20, 68);
+  tft.drawString(provisioningPassphrase(), 20, 118);
+  tft.drawString("http://" + provisioningIP().toString(), 20, 168);
+
+  tft.fillRect(0, 215, 320, 25, 0x2104);
+  tft.setTextColor(TEXT_SECONDARY, 0x2104);
+  tft.setTextSize(1);
+  tft.drawString("Press B to cancel", 10, 222);
+}
+
+void handleProvisioningScreen()
+{
+  String ssid, password;
+  if (handleProvisioning(ssid, password))
+  {
+    Serial.printf("[Provisioning] Credentials received after %lu ms\n", millis() - provisioningStarted);
+    stopProvisioning();
+    selectedSSID = ssid;
+    inputPassword = password;
+    currentScreen = CONNECTING;
+    drawConnectingScreen();
+    return;
+  }
+
+  if (digitalRead(WIO_KEY_B) == LOW)
+  {
+    stopProvisioning();
+    provisioningStarted = 0;
+    currentScreen = WIFI_SCAN;
+    drawWiFiScreen();
+    delay(300);
+  }
 }
 
 // ────────────── Password Input Screen ──────────────
@@ -1002,7 +1076,7 @@ void connectToWiFi()
     }
     tft.drawString("Connecting" + dots, 10, 160);
 
-    delay(500);
+    WiFi.waitStatus(WL_CONNECTED, 500);
     tries++;
     dotCount++;
   }
@@ -1011,6 +1085,11 @@ void connectToWiFi()
   {
     // Save credentials to EEPROM
     saveWiFiCredentials(selectedSSID, inputPassword);
+    if (provisioningStarted)
+    {
+      Serial.printf("[Provisioning] Connected %lu ms after the portal opened\n", millis() - provisioningStarted);
+      provisioningStarted = 0;
+    }
 
     // Go directly to banking terminal after successful WiFi connection
     trackpadAmount = "";
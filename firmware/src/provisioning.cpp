@@ -0,0 +1,223 @@
+#include "provisioning.h"
+#include <DNSServer.h>
+#include <WebServer.h>
+
+#define PROVISIONING_DNS_PORT 53
+#define PROVISIONING_DNS_BURST 16 // queries answered per loop pass, phones send a burst of checks on join
+
+// Setup page, gzip -9 of:
+// <!DOCTYPE html><html><head><meta name=viewport content="width=device-width,initial-scale=1"><title>DigiSave setup</title><style>body{font-family:sans-serif;max-width:22em;margin:2em auto;padding:0 1em}input,button{width:100%;padding:.7em;margin:.3em 0;box-sizing:border-box;font-size:1em}button{background:#2b5fd9;color:#fff;border:0}</style></head><body><h2>DigiSave Wi-Fi</h2><form method=post action=/save><input name=ssid list=n placeholder=Network required autocapitalize=off><datalist id=n></datalist><input name=password type=password placeholder=Password><button>Connect</button></form><script>fetch('/networks').then(r=>r.json()).then(l=>l.forEach(s=>{var o=document.createElement('option');o.value=s;n.appendChild(o)}))</script></body></html>
+static const uint8_t PROVISIONING_PAGE_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x55, 0x52, 0xc1, 0x8e, 0xd3, 0x30,
+    0x10, 0xfd, 0x15, 0xb3, 0x2b, 0xd4, 0x46, 0xda, 0x24, 0x6d, 0x11, 0x42, 0x24, 0x76, 0x2e, 0xdd,
+    0x72, 0x84, 0x95, 0x40, 0x42, 0x1c, 0x5d, 0x7b, 0xd2, 0x0c, 0xeb, 0xd8, 0xc6, 0x9e, 0xb4, 0x5b,
+    0xaa, 0xfd, 0x77, 0x9c, 0xa4, 0xb0, 0xcb, 0xc5, 0xf6, 0x1b, 0x7b, 0xde, 0xcc, 0x7b, 0x63, 0xfe,
+    0xe6, 0xfe, 0xcb, 0xf6, 0xdb, 0x8f, 0x87, 0x1d, 0xeb, 0xa8, 0x37, 0x0d, 0xbf, 0xae, 0x20, 0x75,
+    0xc3, 0x7b, 0x20, 0xc9, 0xac, 0xec, 0x41, 0x1c, 0x11, 0x4e, 0xde, 0x05, 0x62, 0xca, 0x59, 0x02,
+    0x4b, 0xe2, 0xe6, 0x84, 0x9a, 0x3a, 0xa1, 0xe1, 0x88, 0x0a, 0xf2, 0x09, 0xdc, 0xa1, 0x45, 0x42,
+    0x69, 0xf2, 0xa8, 0xa4, 0x01, 0xb1, 0xbe, 0x69, 0x38, 0x21, 0x19, 0x68, 0xee, 0xf1, 0x80, 0x5f,
+    0xe5, 0x11, 0x58, 0x04, 0x1a, 0x3c, 0x2f, 0xe7, 0x28, 0x8f, 0x74, 0x4e, 0xdb, 0xde, 0xe9, 0xf3,
+    0xa5, 0x4d, 0xac, 0x79, 0x2b, 0x7b, 0x34, 0xe7, 0x2a, 0x4a, 0x1b, 0xf3, 0x08, 0x01, 0xdb, 0xba,
+    0x97, 0x4f, 0x33, 0x75, 0xb5, 0xd9, 0x40, 0x9f, 0x60, 0x38, 0xa0, 0xad, 0xd2, 0x91, 0xc9, 0x81,
+    0x5c, 0xed, 0xa5, 0xd6, 0x68, 0x0f, 0xd5, 0x8a, 0xad, 0xa1, 0x7f, 0x46, 0xeb, 0x07, 0xba, 0xdb,
+    0x0f, 0x44, 0xce, 0x5e, 0xe6, 0xac, 0xf5, 0x6a, 0xf5, 0xf6, 0xdf, 0xab, 0xe2, 0xc3, 0x0b, 0x45,
+    0xf1, 0x2e, 0x71, 0xac, 0xea, 0xbd, 0x7b, 0xca, 0x23, 0xfe, 0x1e, 0x6f, 0xf7, 0x2e, 0x68, 0x08,
+    0x79, 0x8a, 0xd4, 0x53, 0x33, 0x29, 0x0c, 0xd5, 0x48, 0x7b, 0x25, 0xdc, 0x4b, 0xf5, 0x78, 0x08,
+    0x6e, 0xb0, 0xba, 0xba, 0xdd, 0xec, 0xdf, 0xb7, 0xfa, 0x63, 0xad, 0x9c, 0x71, 0xa1, 0xba, 0x6d,
+    0xdb, 0xb6, 0x9e, 0xb3, 0xab, 0xd5, 0x33, 0x2f, 0x67, 0x55, 0xbc, 0x9c, 0x1d, 0x1c, 0xd5, 0x25,
+    0x37, 0x37, 0x2f, 0x1e, 0x7c, 0xc7, 0xfc, 0x13, 0xa6, 0xeb, 0x4d, 0xc3, 0x5b, 0x17, 0x7a, 0x96,
+    0x3c, 0xee, 0x9c, 0x16, 0xde, 0x45, 0x62, 0x52, 0x11, 0x3a, 0x2b, 0xca, 0x98, 0x1e, 0x36, 0x7c,
+    0x12, 0x34, 0xdb, 0x1f, 0x23, 0x6a, 0x66, 0x30, 0x92, 0xb0, 0xcc, 0x1b, 0xa9, 0xa0, 0x73, 0x26,
+    0x15, 0x14, 0x9f, 0x81, 0x4e, 0x2e, 0x3c, 0xb2, 0x00, 0xbf, 0x06, 0x0c, 0xa0, 0x27, 0x5f, 0x94,
+    0xf4, 0x48, 0xd2, 0x24, 0x01, 0xc2, 0xb5, 0x6d, 0xc3, 0xb5, 0x1c, 0x51, 0xa2, 0x47, 0x2d, 0x6c,
+    0xea, 0xec, 0x2f, 0xfe, 0xaf, 0x82, 0x97, 0x31, 0x26, 0x2a, 0xcd, 0xe8, 0xec, 0x5f, 0xa1, 0xd7,
+    0xc5, 0x1e, 0xae, 0xc1, 0xa4, 0x6a, 0xf2, 0xa4, 0xd9, 0x3a, 0x6b, 0x41, 0x11, 0x2f, 0xaf, 0x98,
+    0x97, 0xa3, 0xa2, 0x34, 0x58, 0x15, 0xd0, 0x53, 0xd3, 0x02, 0xa9, 0x6e, 0xb9, 0x28, 0xed, 0xdc,
+    0x64, 0x5c, 0x64, 0x05, 0x75, 0x60, 0x97, 0x41, 0x34, 0xa1, 0xf8, 0x19, 0x9d, 0x5d, 0x66, 0xd7,
+    0x88, 0x11, 0x8d, 0x29, 0x52, 0xee, 0x4e, 0xa6, 0x84, 0x28, 0x9a, 0xcb, 0x51, 0x06, 0xe6, 0x84,
+    0x76, 0x6a, 0xe8, 0xd3, 0x67, 0x2b, 0x54, 0x00, 0x49, 0xb0, 0x33, 0x30, 0xa2, 0xe5, 0xc2, 0xf9,
+    0xd1, 0xa6, 0x45, 0x56, 0xbb, 0xe2, 0x28, 0xcd, 0x90, 0xec, 0xa9, 0x6d, 0x21, 0xbd, 0x07, 0xab,
+    0xb7, 0x1d, 0x1a, 0xbd, 0x74, 0xd9, 0x73, 0x96, 0xa5, 0x51, 0xcc, 0x7d, 0xa4, 0xfe, 0xa6, 0x29,
+    0x94, 0xd3, 0xd7, 0xfe, 0x03, 0x28, 0xdf, 0xd4, 0x51, 0xf0, 0x02, 0x00, 0x00,
+};
+
+static DNSServer dnsServer;
+static WebServer *portal = nullptr;
+static char apSSID[24];
+static char apPassphrase[9];
+static String networksJson;
+static String receivedSSID;
+static String receivedPassword;
+static bool credentialsReceived = false;
+
+static void handleRoot()
+{
+    portal->sendHeader("Content-Encoding", "gzip");
+    portal->sendHeader("Cache-Control", "no-store");
+    portal->send_P(200, "text/html", (PGM_P)PROVISIONING_PAGE_GZ, sizeof(PROVISIONING_PAGE_GZ));
+}
+
+static void handleNetworks()
+{
+    portal->send(200, "application/json", networksJson);
+}
+
+static void handleSave()
+{
+    String ssid = portal->arg("ssid");
+    if (ssid.length() == 0 || ssid.length() > 32 || portal->arg("password").length() > 64)
+    {
+        portal->send(400, "text/plain", "Invalid network name or password");
+        return;
+    }
+    receivedSSID = ssid;
+    receivedPassword = portal->arg("password");
+    credentialsReceived = true;
+    portal->send(200, "text/html",
+                 "<meta name=viewport content=\"width=device-width\"><p style=\"font-family:sans-serif\">"
+                 "The terminal is connecting now, you can close this page.</p>");
+}
+
+// Captive portal checks (generate_204, hotspot-detect.html, connecttest.txt, ...)
+// and every other URL get redirected to the setup page
+static void handleRedirect()
+{
+    portal->sendHeader("Location", "http://" + provisioningIP().toString() + "/", true);
+    portal->send(302);
+}
+
+// Offer the networks seen by the last scan so the name does not have to be typed
+static void collectNetworks()
+{
+    networksJson = "[";
+    int count = WiFi.scanComplete();
+    for (int i = 0; i < count; i++)
+    {
+        String ssid = WiFi.SSID(i);
+        if (ssid.length() == 0)
+            continue;
+        if (networksJson.length() > 1)
+            networksJson += ',';
+        networksJson += '"';
+        for (unsigned int c = 0; c < ssid.length(); c++)
+        {
+            if (ssid[c] == '"' || ssid[c] == '\\')
+                networksJson += '\\';
+            networksJson += ssid[c];
+        }
+        networksJson += '"';
+    }
+    networksJson += ']';
+}
+
+// 32 bits from the SAMD51's true random number generator. random() is never
+// seeded, so it would hand every device the same passphrase.
+static uint32_t trngRandom()
+{
+    MCLK->APBCMASK.bit.TRNG_ = 1;
+    TRNG->CTRLA.bit.ENABLE = 1;
+    while (!TRNG->INTFLAG.bit.DATARDY)
+        ;
+    uint32_t value = TRNG->DATA.reg;
+    TRNG->CTRLA.bit.ENABLE = 0;
+    return value;
+}
+
+// Uniform in [0, bound), values past the last whole multiple are drawn again
+static uint32_t trngRandom(uint32_t bound)
+{
+    uint32_t limit = UINT32_MAX - UINT32_MAX % bound;
+    uint32_t value;
+    do
+    {
+        value = trngRandom();
+    } while (value >= limit);
+    return value % bound;
+}
+
+bool startProvisioning()
+{
+    collectNetworks();
+
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(apSSID, sizeof(apSSID), "DigiSave-%02X%02X", mac[4], mac[5]);
+    // WPA2 with a code shown on screen, so the home network password never travels in the clear
+    snprintf(apPassphrase, sizeof(apPassphrase), "%08lu", (unsigned long)trngRandom(100000000));
+
+    WiFi.mode(WIFI_AP);
+    if (!WiFi.softAP(apSSID, apPassphrase))
+    {
+        Serial.println("[Provisioning] Could not start access point");
+        return false;
+    }
+
+    dnsServer.start(PROVISIONING_DNS_PORT, "*", provisioningIP());
+
+    portal = new WebServer(80);
+    portal->on("/", HTTP_GET, handleRoot);
+    portal->on("/networks", HTTP_GET, handleNetworks);
+    portal->on("/save", HTTP_POST, handleSave);
+    portal->onNotFound(handleRedirect);
+    portal->begin();
+
+    credentialsReceived = false;
+    Serial.printf("[Provisioning] Access point %s started\n", apSSID);
+    return true;
+}
+
+bool handleProvisioning(String &ssid, String &password)
+{
+    if (!portal)
+        return false;
+
+    // drain a burst of lookups now instead of one query per loop pass
+    for (int i = 0; i < PROVISIONING_DNS_BURST && dnsServer.processNextRequest(); i++)
+    {
+    }
+    portal->handleClient();
+
+    if (!credentialsReceived)
+        return false;
+    ssid = receivedSSID;
+    password = receivedPassword;
+    receivedPassword = "";
+    credentialsReceived = false;
+    return true;
+}
+
+void stopProvisioning()
+{
+    if (!portal)
+        return;
+    // give the phone a moment to receive the last response before the AP goes away
+    unsigned long start = millis();
+    while (millis() - start < 500)
+        portal->handleClient();
+
+    portal->stop();
+    delete portal;
+    portal = nullptr;
+    dnsServer.stop();
+    networksJson = "";
+
+    // back to station mode without a reboot
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_STA);
+    Serial.println("[Provisioning] Access point closed");
+}
+
+const char *provisioningSSID()
+{
+    return apSSID;
+}
+
+const char *provisioningPassphrase()
+{
+    return apPassphrase;
+}
+
+IPAddress provisioningIP()
+{
+    return WiFi.softAPIP();
+}
@@ -0,0 +1,69 @@
+// Just enough of the Arduino core for the rpcWiFi sources to build and run on
+// the host. The clock is real unless a test switches to virtual time, see
+// host.h; sockets are the host's own.
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <algorithm>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PGM_P const char *
+#define PGM_VOID_P const void *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define memcpy_P memcpy
+#define memccpy_P memccpy
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+#define HEX 16
+#define DEC 10
+
+// Mixed types allowed, like the core's macros
+template <typename T, typename U>
+inline auto min(const T &a, const U &b) -> decltype(a < b ? a : b)
+{
+    return b < a ? b : a;
+}
+template <typename T, typename U>
+inline auto max(const T &a, const U &b) -> decltype(a < b ? a : b)
+{
+    return a < b ? b : a;
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "HardwareSerial.h"
+#include "esp/esp_hal_log.h"
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef NATIVE_HARDWARESERIAL_H
+#define NATIVE_HARDWARESERIAL_H
+
+#include "Stream.h"
+
+// Serial goes to stdout
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "WString.h"
+
+// An IPv4 address in network order, as the lwip based cores keep it
+class IPAddress
+{
+public:
+    IPAddress() { _address.dword = 0; }
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+    {
+        _address.bytes[0] = first;
+        _address.bytes[1] = second;
+        _address.bytes[2] = third;
+        _address.bytes[3] = fourth;
+    }
+    IPAddress(uint32_t address) { _address.dword = address; }
+    IPAddress(const uint8_t *address) { memcpy(_address.bytes, address, 4); }
+
+    bool fromString(const char *address);
+    bool fromString(const String &address) { return fromString(address.c_str()); }
+    String toString() const;
+
+    operator uint32_t() const { return _address.dword; }
+    bool operator==(const IPAddress &addr) const { return _address.dword == addr._address.dword; }
+    bool operator==(const uint8_t *addr) const { return memcmp(addr, _address.bytes, 4) == 0; }
+    uint8_t operator[](int index) const { return _address.bytes[index]; }
+    uint8_t &operator[](int index) { return _address.bytes[index]; }
+    IPAddress &operator=(uint32_t address)
+    {
+        _address.dword = address;
+        return *this;
+    }
+
+private:
+    union
+    {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } _address;
+};
+
+#endif
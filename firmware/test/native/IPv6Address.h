@@ -0,0 +1,20 @@
+#ifndef NATIVE_IPV6ADDRESS_H
+#define NATIVE_IPV6ADDRESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "WString.h"
+
+class IPv6Address
+{
+public:
+    IPv6Address() { memset(_address, 0, sizeof(_address)); }
+    IPv6Address(const uint8_t *address) { memcpy(_address, address, sizeof(_address)); }
+    operator const uint8_t *() const { return _address; }
+    String toString() const { return String(); }
+
+private:
+    uint8_t _address[16];
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef NATIVE_PRINT_H
+#define NATIVE_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size-- && write(*buffer++))
+            n++;
+        return n;
+    }
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    int getWriteError() { return _writeError; }
+    void clearWriteError() { _writeError = 0; }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(const char *str) { return write(str); }
+    size_t print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n, int base = 10) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = 10) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = 10) { return print(String(n, base)); }
+    size_t print(unsigned long n, int base = 10) { return print(String(n, base)); }
+    size_t print(double n, int digits = 2) { return print(String(n, digits)); }
+
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    size_t println() { return write("\r\n", 2); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+protected:
+    void setWriteError(int err = 1) { _writeError = err; }
+
+private:
+    int _writeError = 0;
+};
+
+#endif
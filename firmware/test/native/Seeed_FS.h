@@ -0,0 +1,100 @@
+#ifndef NATIVE_SEEED_FS_H
+#define NATIVE_SEEED_FS_H
+
+// The Seeed FatFs wrapper as a view of a host directory, for serveStatic()
+
+#include <Arduino.h>
+#include <memory>
+#include <sys/stat.h>
+#include <time.h>
+
+#define AM_DIR 0x10
+
+typedef struct
+{
+    uint32_t fsize;
+    uint16_t fdate;
+    uint16_t ftime;
+    uint8_t fattrib;
+} FILINFO;
+
+namespace fs
+{
+
+class File : public Stream
+{
+public:
+    File() {}
+    File(FILE *f, const String &name) : _f(f, fclose), _name(name) {}
+
+    size_t write(uint8_t c) override { return _f ? fwrite(&c, 1, 1, _f.get()) : 0; }
+    size_t write(const uint8_t *buf, size_t size) override { return _f ? fwrite(buf, 1, size, _f.get()) : 0; }
+    int available() override { return size() - position(); }
+    int read() override { return _f ? fgetc(_f.get()) : -1; }
+    int read(uint8_t *buf, size_t size) { return _f ? (int)fread(buf, 1, size, _f.get()) : -1; }
+    int peek() override
+    {
+        if (!_f)
+            return -1;
+        int c = fgetc(_f.get());
+        if (c != EOF)
+            ungetc(c, _f.get());
+        return c;
+    }
+    size_t position() const { return _f ? ftell(_f.get()) : 0; }
+    size_t size() const
+    {
+        struct stat st;
+        return _f && fstat(fileno(_f.get()), &st) == 0 ? st.st_size : 0;
+    }
+    const char *name() const { return _name.c_str(); }
+    void close() { _f.reset(); }
+    operator bool() const { return (bool)_f; }
+
+private:
+    std::shared_ptr<FILE> _f;
+    String _name;
+};
+
+class FS
+{
+public:
+    FS(const char *root = ".") : _root(root) {}
+
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool exists(const char *path)
+    {
+        struct stat st;
+        return ::stat((_root + path).c_str(), &st) == 0;
+    }
+    File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+    File open(const char *path, const char *mode = "r")
+    {
+        FILE *f = fopen((_root + path).c_str(), mode);
+        return f ? File(f, path) : File();
+    }
+    // FAT style date and time of the last modification, like f_stat
+    bool stat(const String &path, FILINFO *info) { return stat(path.c_str(), info); }
+    bool stat(const char *path, FILINFO *info)
+    {
+        struct stat st;
+        if (::stat((_root + path).c_str(), &st) != 0)
+            return false;
+        struct tm tm;
+        gmtime_r(&st.st_mtime, &tm);
+        info->fsize = st.st_size;
+        info->fdate = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+        info->ftime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+        info->fattrib = S_ISDIR(st.st_mode) ? AM_DIR : 0;
+        return true;
+    }
+
+private:
+    String _root;
+};
+
+} // namespace fs
+
+using namespace fs;
+
+#endif
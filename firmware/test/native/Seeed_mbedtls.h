@@ -0,0 +1,7 @@
+#ifndef NATIVE_SEEED_MBEDTLS_H
+#define NATIVE_SEEED_MBEDTLS_H
+
+#include "mbedtls/md5.h"
+#include "mbedtls/sha1.h"
+
+#endif
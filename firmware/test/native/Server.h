@@ -0,0 +1,12 @@
+#ifndef NATIVE_SERVER_H
+#define NATIVE_SERVER_H
+
+#include "Print.h"
+
+class Server : public Print
+{
+public:
+    virtual void begin() = 0;
+};
+
+#endif
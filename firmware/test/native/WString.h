@@ -0,0 +1,236 @@
+// Arduino String over std::string, with the members the rpcWiFi sources use
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+class __FlashStringHelper;
+
+class String
+{
+public:
+    String() {}
+    String(const char *cstr) : _s(cstr ? cstr : "") {}
+    String(const char *cstr, unsigned int length) : _s(cstr, length) {}
+    String(const __FlashStringHelper *str) : _s(reinterpret_cast<const char *>(str)) {}
+    String(const String &other) = default;
+    String(String &&other) = default;
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : String((unsigned long)value, base) {}
+    explicit String(int value, unsigned char base = 10) : String((long)value, base) {}
+    explicit String(unsigned int value, unsigned char base = 10) : String((unsigned long)value, base) {}
+    explicit String(long value, unsigned char base = 10)
+    {
+        char buf[40];
+        if (base == 16)
+            snprintf(buf, sizeof(buf), "%lx", value);
+        else
+            snprintf(buf, sizeof(buf), "%ld", value);
+        _s = buf;
+    }
+    explicit String(unsigned long value, unsigned char base = 10)
+    {
+        char buf[40];
+        snprintf(buf, sizeof(buf), base == 16 ? "%lx" : "%lu", value);
+        _s = buf;
+    }
+    explicit String(float value, unsigned char decimals = 2) : String((double)value, decimals) {}
+    explicit String(double value, unsigned char decimals = 2)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        _s = buf;
+    }
+
+    String &operator=(const String &rhs) = default;
+    String &operator=(String &&rhs) = default;
+    String &operator=(const char *cstr)
+    {
+        _s = cstr ? cstr : "";
+        return *this;
+    }
+    String &operator=(const __FlashStringHelper *str) { return *this = reinterpret_cast<const char *>(str); }
+
+    unsigned char reserve(unsigned int size)
+    {
+        _s.reserve(size);
+        return 1;
+    }
+    unsigned int length() const { return _s.size(); }
+    const char *c_str() const { return _s.c_str(); }
+    char *begin() { return &_s[0]; }
+    char *end() { return &_s[0] + _s.size(); }
+    explicit operator bool() const { return true; }
+
+    unsigned char concat(const String &str)
+    {
+        _s += str._s;
+        return 1;
+    }
+    unsigned char concat(const char *cstr)
+    {
+        if (cstr)
+            _s += cstr;
+        return 1;
+    }
+    unsigned char concat(const char *cstr, unsigned int length)
+    {
+        _s.append(cstr, length);
+        return 1;
+    }
+    unsigned char concat(const __FlashStringHelper *str) { return concat(reinterpret_cast<const char *>(str)); }
+    unsigned char concat(char c)
+    {
+        _s += c;
+        return 1;
+    }
+    unsigned char concat(unsigned char num) { return concat(String(num)); }
+    unsigned char concat(int num) { return concat(String(num)); }
+    unsigned char concat(unsigned int num) { return concat(String(num)); }
+    unsigned char concat(long num) { return concat(String(num)); }
+    unsigned char concat(unsigned long num) { return concat(String(num)); }
+    unsigned char concat(float num) { return concat(String(num)); }
+    unsigned char concat(double num) { return concat(String(num)); }
+    template <typename T>
+    String &operator+=(const T &rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+    String &operator+=(const char *cstr)
+    {
+        concat(cstr);
+        return *this;
+    }
+
+    int compareTo(const String &s) const { return _s.compare(s._s); }
+    unsigned char equals(const String &s) const { return _s == s._s; }
+    unsigned char equals(const char *cstr) const { return _s == (cstr ? cstr : ""); }
+    unsigned char equalsIgnoreCase(const String &s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    unsigned char equalsConstantTime(const String &s) const { return equals(s); }
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+    bool operator<(const String &rhs) const { return _s < rhs._s; }
+
+    unsigned char startsWith(const String &prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    unsigned char startsWith(const String &prefix, unsigned int offset) const
+    {
+        return offset <= _s.size() && _s.compare(offset, prefix._s.size(), prefix._s) == 0;
+    }
+    unsigned char endsWith(const String &suffix) const
+    {
+        return _s.size() >= suffix._s.size() && _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+    }
+
+    char charAt(unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+    void setCharAt(unsigned int index, char c)
+    {
+        if (index < _s.size())
+            _s[index] = c;
+    }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return _s[index]; }
+    void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const
+    {
+        if (!bufsize)
+            return;
+        size_t n = index < _s.size() ? std::min<size_t>(bufsize - 1, _s.size() - index) : 0;
+        memcpy(buf, _s.data() + index, n);
+        buf[n] = 0;
+    }
+    void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const { getBytes((unsigned char *)buf, bufsize, index); }
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const { return found(_s.find(ch, fromIndex)); }
+    int indexOf(const String &str, unsigned int fromIndex = 0) const { return found(_s.find(str._s, fromIndex)); }
+    int lastIndexOf(char ch) const { return found(_s.rfind(ch)); }
+    int lastIndexOf(const String &str) const { return found(_s.rfind(str._s)); }
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, _s.size()); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const
+    {
+        if (beginIndex > endIndex)
+            std::swap(beginIndex, endIndex);
+        if (beginIndex >= _s.size())
+            return String();
+        return String(_s.substr(beginIndex, endIndex - beginIndex).c_str());
+    }
+
+    void replace(char find, char replace)
+    {
+        for (char &c : _s)
+        {
+            if (c == find)
+                c = replace;
+        }
+    }
+    void replace(const String &find, const String &replace)
+    {
+        if (find._s.empty())
+            return;
+        for (size_t pos = 0; (pos = _s.find(find._s, pos)) != std::string::npos; pos += replace._s.size())
+            _s.replace(pos, find._s.size(), replace._s);
+    }
+    void remove(unsigned int index)
+    {
+        if (index < _s.size())
+            _s.erase(index);
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < _s.size())
+            _s.erase(index, count);
+    }
+    void toLowerCase()
+    {
+        for (char &c : _s)
+            c = tolower((unsigned char)c);
+    }
+    void toUpperCase()
+    {
+        for (char &c : _s)
+            c = toupper((unsigned char)c);
+    }
+    void trim()
+    {
+        size_t first = 0;
+        while (first < _s.size() && isspace((unsigned char)_s[first]))
+            first++;
+        size_t last = _s.size();
+        while (last > first && isspace((unsigned char)_s[last - 1]))
+            last--;
+        _s = _s.substr(first, last - first);
+    }
+
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+    double toDouble() const { return atof(c_str()); }
+
+private:
+    static int found(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+    std::string _s;
+};
+
+// String + anything, left to right into one temporary like the Arduino core
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(const char *p) : String(p) {}
+};
+
+template <typename T>
+inline StringSumHelper &operator+(const StringSumHelper &lhs, const T &rhs)
+{
+    StringSumHelper &sum = const_cast<StringSumHelper &>(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef NATIVE_PGMSPACE_H
+#define NATIVE_PGMSPACE_H
+
+#include <Arduino.h>
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef NATIVE_BASE64_H
+#define NATIVE_BASE64_H
+
+#include "WString.h"
+
+class base64
+{
+public:
+    static String encode(const uint8_t *data, size_t length);
+    static String encode(const String &text) { return encode((const uint8_t *)text.c_str(), text.length()); }
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef NATIVE_ESP_HAL_LOG_H
+#define NATIVE_ESP_HAL_LOG_H
+
+#include <stdio.h>
+
+// 1 errors, 2 warnings, 3 info, 4 debug, 5 verbose; quiet unless asked for
+#ifndef NATIVE_LOG_LEVEL
+#define NATIVE_LOG_LEVEL 0
+#endif
+
+#define native_log(level, letter, format, ...)                                  \
+    do                                                                          \
+    {                                                                           \
+        if (NATIVE_LOG_LEVEL >= level)                                          \
+            fprintf(stderr, "[" letter "][%s] " format "\n", __func__, ##__VA_ARGS__); \
+    } while (0)
+
+#define log_e(format, ...) native_log(1, "E", format, ##__VA_ARGS__)
+#define log_w(format, ...) native_log(2, "W", format, ##__VA_ARGS__)
+#define log_i(format, ...) native_log(3, "I", format, ##__VA_ARGS__)
+#define log_d(format, ...) native_log(4, "D", format, ##__VA_ARGS__)
+#define log_v(format, ...) native_log(5, "V", format, ##__VA_ARGS__)
+
+#endif
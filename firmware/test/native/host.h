@@ -0,0 +1,81 @@
+#ifndef NATIVE_HOST_H
+#define NATIVE_HOST_H
+
+// What the tests can see and steer of the host stand-ins for the board: the
+// clock, the socket calls, the radio and the TLS client.
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+// millis() and delay() follow a simulated clock that only delay() and
+// hostAdvance() move, so minutes of radio behaviour run in a moment
+void hostVirtualClock(bool enable);
+void hostAdvance(unsigned long ms);
+
+// send() calls made by the library, whatever the socket
+unsigned long hostSendCalls();
+void hostResetSendCalls();
+
+// recv() calls of the library that returned data; probes and calls that
+// found nothing waiting do not count
+unsigned long hostRecvCalls();
+void hostResetRecvCalls();
+
+// An access point the simulated radio can see, rssi is asked with millis().
+// Below -92 dBm it drops out of scans, below -90 dBm the link breaks.
+struct HostAccessPoint
+{
+    const char *ssid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    std::function<int(unsigned long)> rssi;
+    bool on;      // powered
+    bool accepts; // lets stations associate
+};
+
+struct HostRadioCounters
+{
+    unsigned scans;        // every scan started
+    unsigned partialScans; // of which restricted to some channels
+    unsigned connects;     // WiFi.begin() calls
+    unsigned rssiReads;    // WiFi.RSSI() calls, one rpc each on the board
+};
+
+#define HOST_SCAN_CHANNEL_MS 110 // simulated dwell per channel
+#define HOST_ASSOCIATE_MS 1200   // simulated time to associate and get an address
+
+void hostRadioReset();
+size_t hostRadioAdd(const char *ssid, const uint8_t bssid[6], uint8_t channel, std::function<int(unsigned long)> rssi);
+HostAccessPoint &hostRadioAccessPoint(size_t index);
+int hostRadioAssociated(); // index of the access point, -1 while down
+const HostRadioCounters &hostRadioCounters();
+
+// Handshakes the TLS stand-in went through, sessions resumed do not count
+unsigned long hostTlsHandshakes();
+void hostResetTlsHandshakes();
+
+// Loopback plumbing for the tests, blocking sockets to 127.0.0.1
+uint16_t hostFreePort();
+int hostConnect(uint16_t port);
+bool hostWriteAll(int fd, const void *data, size_t length);
+std::string hostReadAll(int fd, unsigned long timeout_ms); // until the peer closes
+// One HTTP response, complete by its Content-Length, last chunk or the close
+std::string hostReadResponse(int fd, unsigned long timeout_ms);
+
+// Calls poll() on a thread of its own until stopped, e.g. handleClient()
+class HostPoller
+{
+public:
+    ~HostPoller() { stop(); }
+    void start(std::function<void()> poll);
+    void stop();
+
+private:
+    std::atomic<bool> _running{false};
+    std::thread _thread;
+};
+
+#endif
@@ -0,0 +1,221 @@
+// The Arduino core functions behind the headers in this directory
+#include <Arduino.h>
+#include <base64.h>
+#include <libb64/cencode.h>
+#include "host.h"
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <atomic>
+#include <random>
+
+static bool virtualClock = false;
+static std::atomic<unsigned long long> virtualMicros{1000};
+
+static unsigned long long monotonicMicros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void hostVirtualClock(bool enable)
+{
+    virtualClock = enable;
+    virtualMicros = 1000;
+}
+
+void hostAdvance(unsigned long ms)
+{
+    virtualMicros += (unsigned long long)ms * 1000;
+}
+
+unsigned long micros()
+{
+    return virtualClock ? virtualMicros.load() : monotonicMicros();
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+    if (virtualClock)
+        hostAdvance(ms);
+    else
+        usleep(ms * 1000);
+}
+
+void yield()
+{
+    if (!virtualClock)
+        usleep(0);
+}
+
+static std::mt19937 generator;
+
+void randomSeed(unsigned long seed)
+{
+    generator.seed(seed);
+}
+
+long random(long howbig)
+{
+    return howbig > 0 ? (long)(generator() % (unsigned long)howbig) : 0;
+}
+
+long random(long howsmall, long howbig)
+{
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0)
+        return 0;
+    if ((size_t)len < sizeof(buf))
+        return write((const uint8_t *)buf, len);
+    char *out = (char *)malloc(len + 1);
+    va_start(args, format);
+    vsnprintf(out, len + 1, format, args);
+    va_end(args);
+    size_t n = write((const uint8_t *)out, len);
+    free(out);
+    return n;
+}
+
+int Stream::timedRead()
+{
+    unsigned long start = millis();
+    do
+    {
+        int c = read();
+        if (c >= 0)
+            return c;
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = timedRead();
+        if (c < 0)
+            break;
+        buffer[count++] = (char)c;
+    }
+    return count;
+}
+
+String Stream::readString()
+{
+    String ret;
+    int c;
+    while ((c = timedRead()) >= 0)
+        ret += (char)c;
+    return ret;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    String ret;
+    int c;
+    while ((c = timedRead()) >= 0 && c != terminator)
+        ret += (char)c;
+    return ret;
+}
+
+bool IPAddress::fromString(const char *address)
+{
+    uint8_t parts[4];
+    int part = 0;
+    unsigned value = 0;
+    bool digits = false;
+    for (const char *p = address; ; p++)
+    {
+        if (*p >= '0' && *p <= '9')
+        {
+            value = value * 10 + (*p - '0');
+            if (value > 255)
+                return false;
+            digits = true;
+        }
+        else if (*p == '.' || *p == 0)
+        {
+            if (!digits || part > 3)
+                return false;
+            parts[part++] = value;
+            value = 0;
+            digits = false;
+            if (*p == 0)
+                break;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (part != 4)
+        return false;
+    memcpy(_address.bytes, parts, 4);
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _address.bytes[0], _address.bytes[1], _address.bytes[2], _address.bytes[3]);
+    return String(buf);
+}
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
+
+int base64_encode_chars(const char *plaintext_in, int length_in, char *code_out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t *in = (const uint8_t *)plaintext_in;
+    char *out = code_out;
+    for (int i = 0; i < length_in; i += 3)
+    {
+        uint32_t n = in[i] << 16;
+        if (i + 1 < length_in)
+            n |= in[i + 1] << 8;
+        if (i + 2 < length_in)
+            n |= in[i + 2];
+        *out++ = alphabet[(n >> 18) & 63];
+        *out++ = alphabet[(n >> 12) & 63];
+        *out++ = i + 1 < length_in ? alphabet[(n >> 6) & 63] : '=';
+        *out++ = i + 2 < length_in ? alphabet[n & 63] : '=';
+    }
+    *out = 0;
+    return out - code_out;
+}
+
+String base64::encode(const uint8_t *data, size_t length)
+{
+    char *out = (char *)malloc(base64_encode_expected_len(length) + 1);
+    base64_encode_chars((const char *)data, length, out);
+    String ret(out);
+    free(out);
+    return ret;
+}
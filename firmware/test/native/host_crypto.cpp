@@ -0,0 +1,211 @@
+// MD5 for digest authentication and SHA-1 for the WebSocket handshake, which
+// the board gets from mbedtls on the coprocessor side
+#include "mbedtls/md5.h"
+#include "mbedtls/sha1.h"
+#include <string.h>
+
+static inline uint32_t rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static void md5Block(uint32_t state[4], const unsigned char block[64])
+{
+    static const uint32_t k[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+    static const int r[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+                              5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+                              4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                              6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++)
+        w[i] = block[i * 4] | block[i * 4 + 1] << 8 | block[i * 4 + 2] << 16 | (uint32_t)block[i * 4 + 3] << 24;
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t f;
+        int g;
+        if (i < 16)
+        {
+            f = (b & c) | (~b & d);
+            g = i;
+        }
+        else if (i < 32)
+        {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        }
+        else if (i < 48)
+        {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        }
+        else
+        {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t t = d;
+        d = c;
+        c = b;
+        b = b + rotl(a + f + k[i] + w[g], r[i]);
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+static void sha1Block(uint32_t state[5], const unsigned char block[64])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i * 4] << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 80; i++)
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// Both hashes pad the same way and differ in the byte order of the length
+// and the digest
+template <typename Block>
+static void hashUpdate(uint32_t total[2], unsigned char buffer[64], uint32_t *state, Block block,
+                       const unsigned char *input, size_t ilen)
+{
+    size_t fill = total[0] & 63;
+    total[0] += ilen;
+    if (total[0] < ilen)
+        total[1]++;
+    while (ilen)
+    {
+        size_t n = 64 - fill < ilen ? 64 - fill : ilen;
+        memcpy(buffer + fill, input, n);
+        fill += n;
+        input += n;
+        ilen -= n;
+        if (fill == 64)
+        {
+            block(state, buffer);
+            fill = 0;
+        }
+    }
+}
+
+static void hashPad(uint32_t total[2], unsigned char buffer[64], uint32_t *state,
+                    void (*block)(uint32_t *, const unsigned char *), bool bigEndian)
+{
+    uint64_t bits = ((uint64_t)total[1] << 32 | total[0]) * 8;
+    size_t fill = total[0] & 63;
+    buffer[fill++] = 0x80;
+    if (fill > 56)
+    {
+        memset(buffer + fill, 0, 64 - fill);
+        block(state, buffer);
+        fill = 0;
+    }
+    memset(buffer + fill, 0, 56 - fill);
+    for (int i = 0; i < 8; i++)
+        buffer[56 + i] = bigEndian ? bits >> (56 - 8 * i) : bits >> (8 * i);
+    block(state, buffer);
+}
+
+void mbedtls_md5_init(mbedtls_md5_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md5_free(mbedtls_md5_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md5_starts(mbedtls_md5_context *ctx)
+{
+    static const uint32_t init[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    ctx->total[0] = ctx->total[1] = 0;
+    memcpy(ctx->state, init, sizeof(init));
+}
+
+void mbedtls_md5_update(mbedtls_md5_context *ctx, const unsigned char *input, size_t ilen)
+{
+    hashUpdate(ctx->total, ctx->buffer, ctx->state, md5Block, input, ilen);
+}
+
+void mbedtls_md5_finish(mbedtls_md5_context *ctx, unsigned char output[16])
+{
+    hashPad(ctx->total, ctx->buffer, ctx->state, md5Block, false);
+    for (int i = 0; i < 16; i++)
+        output[i] = ctx->state[i / 4] >> (8 * (i % 4));
+}
+
+void mbedtls_sha1_init(mbedtls_sha1_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha1_free(mbedtls_sha1_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha1_starts(mbedtls_sha1_context *ctx)
+{
+    static const uint32_t init[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    ctx->total[0] = ctx->total[1] = 0;
+    memcpy(ctx->state, init, sizeof(init));
+}
+
+void mbedtls_sha1_update(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
+{
+    hashUpdate(ctx->total, ctx->buffer, ctx->state, sha1Block, input, ilen);
+}
+
+void mbedtls_sha1_finish(mbedtls_sha1_context *ctx, unsigned char output[20])
+{
+    hashPad(ctx->total, ctx->buffer, ctx->state, sha1Block, true);
+    for (int i = 0; i < 20; i++)
+        output[i] = ctx->state[i / 4] >> (24 - 8 * (i % 4));
+}
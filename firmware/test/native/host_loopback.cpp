@@ -0,0 +1,114 @@
+// Loopback sockets and a polling thread for the tests
+#include "host.h"
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+uint16_t hostFreePort()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+int hostConnect(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        return fd;
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+bool hostWriteAll(int fd, const void *data, size_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (length)
+    {
+        ssize_t res = write(fd, p, length);
+        if (res <= 0)
+            return false;
+        p += res;
+        length -= res;
+    }
+    return true;
+}
+
+std::string hostReadAll(int fd, unsigned long timeout_ms)
+{
+    std::string out;
+    char buf[4096];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, timeout_ms) > 0)
+    {
+        ssize_t res = read(fd, buf, sizeof(buf));
+        if (res <= 0)
+            break;
+        out.append(buf, res);
+    }
+    return out;
+}
+
+static bool responseComplete(const std::string &response)
+{
+    size_t end = response.find("\r\n\r\n");
+    if (end == std::string::npos)
+        return false;
+    std::string head = response.substr(0, end + 2);
+    for (char &c : head)
+        c = tolower((unsigned char)c);
+    size_t length = head.find("\r\ncontent-length:");
+    if (length != std::string::npos)
+        return response.size() - end - 4 >= strtoul(head.c_str() + length + 17, NULL, 10);
+    if (head.find("\r\ntransfer-encoding: chunked") != std::string::npos)
+        return response.size() >= end + 9 && response.compare(response.size() - 5, 5, "0\r\n\r\n") == 0;
+    return false;
+}
+
+std::string hostReadResponse(int fd, unsigned long timeout_ms)
+{
+    std::string out;
+    char buf[4096];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (!responseComplete(out) && poll(&pfd, 1, timeout_ms) > 0)
+    {
+        ssize_t res = read(fd, buf, sizeof(buf));
+        if (res <= 0)
+            break;
+        out.append(buf, res);
+    }
+    return out;
+}
+
+void HostPoller::start(std::function<void()> poll)
+{
+    stop();
+    _running = true;
+    _thread = std::thread([this, poll]() {
+        while (_running)
+        {
+            poll();
+            usleep(100);
+        }
+    });
+}
+
+void HostPoller::stop()
+{
+    _running = false;
+    if (_thread.joinable())
+        _thread.join();
+}
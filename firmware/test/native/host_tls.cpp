@@ -0,0 +1,125 @@
+// Stands in for the TLS client on the coprocessor: the "handshake" is a plain
+// TCP connect that gets counted, records are the bytes as they are.
+#include <rtl_wifi/ssl_client.h>
+#include "host.h"
+#include <atomic>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::atomic<unsigned long> handshakes{0};
+
+unsigned long hostTlsHandshakes()
+{
+    return handshakes;
+}
+
+void hostResetTlsHandshakes()
+{
+    handshakes = 0;
+}
+
+sslclient_context *ssl_client_create()
+{
+    sslclient_context *ssl_client = new sslclient_context;
+    ssl_init(ssl_client);
+    return ssl_client;
+}
+
+void ssl_client_destroy(sslclient_context *ssl_client)
+{
+    delete ssl_client;
+}
+
+void ssl_init(sslclient_context *ssl_client)
+{
+    ssl_client->socket = -1;
+    ssl_client->handshake_timeout = 120000;
+}
+
+void ssl_set_socket(sslclient_context *ssl_client, int socket)
+{
+    ssl_client->socket = socket;
+}
+
+void ssl_set_timeout(sslclient_context *ssl_client, unsigned long handshake_timeout)
+{
+    ssl_client->handshake_timeout = handshake_timeout;
+}
+
+int ssl_get_socket(sslclient_context *ssl_client)
+{
+    return ssl_client->socket;
+}
+
+int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, int timeout, const char *rootCABuff,
+                     const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey)
+{
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, service, &hints, &res) != 0)
+        return -1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    ssl_client->socket = fd;
+    handshakes++;
+    return fd;
+}
+
+// WiFiClientSecure has closed the socket already, closing it again could hit
+// a descriptor another thread just got
+void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key)
+{
+    ssl_client->socket = -1;
+}
+
+int data_to_read(sslclient_context *ssl_client)
+{
+    char buf[1];
+    int res = recv(ssl_client->socket, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+    return res > 0 ? res : 0;
+}
+
+int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, uint16_t len)
+{
+    return send(ssl_client->socket, data, len, MSG_NOSIGNAL);
+}
+
+int get_ssl_receive(sslclient_context *ssl_client, uint8_t *data, int length)
+{
+    int res = recv(ssl_client->socket, data, length, MSG_DONTWAIT);
+    return res < 0 ? -1 : res;
+}
+
+bool verify_ssl_fingerprint(sslclient_context *ssl_client, const char *fp, const char *domain_name)
+{
+    return false;
+}
+
+bool verify_ssl_dn(sslclient_context *ssl_client, const char *domain_name)
+{
+    return false;
+}
+
+int ssl_get_peer_fingerprint(sslclient_context *ssl_client, char *out, size_t size)
+{
+    return -1;
+}
+
+void ssl_strerror(int err, char *buf, size_t size)
+{
+    snprintf(buf, size, "TLS stand-in error %d", err);
+}
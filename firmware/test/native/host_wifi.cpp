@@ -0,0 +1,272 @@
+// A simulated radio behind the WiFi object: access points come from the test
+// through host.h, names resolve with the host's resolver.
+#include <rpcWiFi.h>
+#include "host.h"
+#include <netdb.h>
+#include <vector>
+
+WiFiClass WiFi;
+
+static std::vector<HostAccessPoint> accessPoints;
+static std::vector<wifi_ap_record_t> scanResults;
+static HostRadioCounters counters;
+static int associated = -1;
+static int joining = -1;
+static bool scanRunning = false;
+static bool scanDone = false;
+static unsigned long scanEnds = 0;
+
+void hostRadioReset()
+{
+    accessPoints.clear();
+    scanResults.clear();
+    counters = HostRadioCounters();
+    associated = joining = -1;
+    scanRunning = scanDone = false;
+}
+
+size_t hostRadioAdd(const char *ssid, const uint8_t bssid[6], uint8_t channel, std::function<int(unsigned long)> rssi)
+{
+    HostAccessPoint ap = {ssid, {}, channel, rssi, true, true};
+    memcpy(ap.bssid, bssid, 6);
+    accessPoints.push_back(ap);
+    return accessPoints.size() - 1;
+}
+
+HostAccessPoint &hostRadioAccessPoint(size_t index)
+{
+    return accessPoints[index];
+}
+
+const HostRadioCounters &hostRadioCounters()
+{
+    return counters;
+}
+
+static bool audible(const HostAccessPoint &ap, int floor)
+{
+    return ap.on && ap.rssi(millis()) >= floor;
+}
+
+// Drops a link that faded out and finishes a scan whose time is up
+static void radioTick()
+{
+    if (associated >= 0 && !audible(accessPoints[associated], -90))
+        associated = -1;
+    if (scanRunning && (long)(millis() - scanEnds) >= 0)
+    {
+        scanRunning = false;
+        scanDone = true;
+    }
+}
+
+int hostRadioAssociated()
+{
+    radioTick();
+    return associated;
+}
+
+static int16_t startScan(const uint8_t *channels, uint8_t count, bool async)
+{
+    radioTick();
+    if (scanRunning)
+        return WIFI_SCAN_RUNNING;
+    counters.scans++;
+    if (count)
+        counters.partialScans++;
+    scanResults.clear();
+    for (const HostAccessPoint &ap : accessPoints)
+    {
+        if (!audible(ap, -92) || (count && !memchr(channels, ap.channel, count)))
+            continue;
+        wifi_ap_record_t record = {};
+        memcpy(record.bssid, ap.bssid, 6);
+        strncpy((char *)record.ssid, ap.ssid, sizeof(record.ssid) - 1);
+        record.primary = ap.channel;
+        record.rssi = ap.rssi(millis());
+        record.authmode = WIFI_AUTH_WPA2_PSK;
+        scanResults.push_back(record);
+    }
+    unsigned long cost = (count ? count : 13) * HOST_SCAN_CHANNEL_MS;
+    scanDone = false;
+    if (async)
+    {
+        scanRunning = true;
+        scanEnds = millis() + cost;
+        return WIFI_SCAN_RUNNING;
+    }
+    delay(cost);
+    scanDone = true;
+    return scanResults.size();
+}
+
+int16_t WiFiScanClass::scanNetworks(bool async, bool show_hidden, bool passive, uint32_t max_ms_per_chan)
+{
+    return startScan(NULL, 0, async);
+}
+
+int16_t WiFiScanClass::scanChannels(const uint8_t *channels, uint8_t count, bool async)
+{
+    return startScan(channels, count, async);
+}
+
+int16_t WiFiScanClass::scanComplete()
+{
+    radioTick();
+    if (scanDone)
+        return scanResults.size();
+    return scanRunning ? WIFI_SCAN_RUNNING : WIFI_SCAN_FAILED;
+}
+
+void WiFiScanClass::scanDelete()
+{
+    scanResults.clear();
+    scanDone = false;
+}
+
+void *WiFiScanClass::_getScanInfoByIndex(int i)
+{
+    return i >= 0 && (size_t)i < scanResults.size() ? &scanResults[i] : NULL;
+}
+
+String WiFiScanClass::SSID(uint8_t i)
+{
+    wifi_ap_record_t *it = (wifi_ap_record_t *)_getScanInfoByIndex(i);
+    return it ? String((const char *)it->ssid) : String();
+}
+
+int32_t WiFiScanClass::RSSI(uint8_t i)
+{
+    wifi_ap_record_t *it = (wifi_ap_record_t *)_getScanInfoByIndex(i);
+    return it ? it->rssi : 0;
+}
+
+uint8_t *WiFiScanClass::BSSID(uint8_t i)
+{
+    wifi_ap_record_t *it = (wifi_ap_record_t *)_getScanInfoByIndex(i);
+    return it ? it->bssid : NULL;
+}
+
+int32_t WiFiScanClass::channel(uint8_t i)
+{
+    wifi_ap_record_t *it = (wifi_ap_record_t *)_getScanInfoByIndex(i);
+    return it ? it->primary : 0;
+}
+
+wl_status_t WiFiSTAClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool connect)
+{
+    counters.connects++;
+    associated = joining = -1;
+    for (size_t i = 0; i < accessPoints.size(); i++)
+    {
+        if (strcmp(accessPoints[i].ssid, ssid) == 0 && (!bssid || memcmp(accessPoints[i].bssid, bssid, 6) == 0))
+        {
+            joining = i;
+            break;
+        }
+    }
+    return WL_DISCONNECTED;
+}
+
+uint8_t WiFiSTAClass::waitForConnectResult(uint32_t timeout_ms)
+{
+    if (joining >= 0 && accessPoints[joining].accepts && audible(accessPoints[joining], -85))
+    {
+        delay(HOST_ASSOCIATE_MS);
+        associated = joining;
+        joining = -1;
+        return WL_CONNECTED;
+    }
+    delay(timeout_ms);
+    joining = -1;
+    return WL_CONNECT_FAILED;
+}
+
+bool WiFiSTAClass::disconnect(bool wifioff, bool eraseap)
+{
+    associated = joining = -1;
+    return true;
+}
+
+wl_status_t WiFiSTAClass::status()
+{
+    radioTick();
+    return associated >= 0 ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+String WiFiSTAClass::SSID() const
+{
+    return associated >= 0 ? String(accessPoints[associated].ssid) : String();
+}
+
+uint8_t *WiFiSTAClass::BSSID()
+{
+    return associated >= 0 ? accessPoints[associated].bssid : NULL;
+}
+
+String WiFiSTAClass::BSSIDstr()
+{
+    uint8_t *bssid = BSSID();
+    if (!bssid)
+        return String();
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+    return String(mac);
+}
+
+int8_t WiFiSTAClass::RSSI()
+{
+    counters.rssiReads++;
+    return associated >= 0 ? accessPoints[associated].rssi(millis()) : 0;
+}
+
+IPAddress WiFiSTAClass::localIP()
+{
+    return associated >= 0 ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+uint8_t *WiFiSTAClass::macAddress(uint8_t *mac)
+{
+    static const uint8_t host[6] = {0x2c, 0xf7, 0xf1, 0x00, 0x00, 0x01};
+    memcpy(mac, host, 6);
+    return mac;
+}
+
+String WiFiSTAClass::macAddress()
+{
+    uint8_t mac[6];
+    macAddress(mac);
+    char str[18];
+    snprintf(str, sizeof(str), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return String(str);
+}
+
+WiFiGenericClass::WiFiGenericClass()
+{
+}
+
+int32_t WiFiGenericClass::channel()
+{
+    return associated >= 0 ? accessPoints[associated].channel : 0;
+}
+
+int WiFiGenericClass::hostByName(const char *aHostname, IPAddress &aResult)
+{
+    return hostByName(aHostname, &aResult, 1) > 0;
+}
+
+int WiFiGenericClass::hostByName(const char *aHostname, IPAddress *aResults, size_t count, int32_t timeout_ms)
+{
+    if (aResults[0].fromString(aHostname))
+        return 1;
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(aHostname, NULL, &hints, &res) != 0)
+        return 0;
+    size_t found = 0;
+    for (struct addrinfo *it = res; it && found < count; it = it->ai_next)
+        aResults[found++] = IPAddress(((struct sockaddr_in *)it->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(res);
+    return found;
+}
@@ -0,0 +1,2 @@
+// DNSServer.cpp from the library, built for the host
+#include <DNSServer.cpp>
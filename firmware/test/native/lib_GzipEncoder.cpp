@@ -0,0 +1,2 @@
+// GzipEncoder.cpp from the library, built for the host
+#include <detail/GzipEncoder.cpp>
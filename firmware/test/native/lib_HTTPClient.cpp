@@ -0,0 +1,2 @@
+// HTTPClient.cpp from the library, built for the host
+#include <HTTPClient.cpp>
@@ -0,0 +1,2 @@
+// Parsing.cpp from the library, built for the host
+#include <Parsing.cpp>
@@ -0,0 +1,2 @@
+// WebServer.cpp from the library, built for the host
+#include <WebServer.cpp>
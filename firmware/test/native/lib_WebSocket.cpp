@@ -0,0 +1,2 @@
+// WebSocket.cpp from the library, built for the host
+#include <WebSocket.cpp>
@@ -0,0 +1,2 @@
+// WiFiClient.cpp from the library, built for the host
+#include <WiFiClient.cpp>
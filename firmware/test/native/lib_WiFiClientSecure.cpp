@@ -0,0 +1,2 @@
+// WiFiClientSecure.cpp from the library, built for the host
+#include <WiFiClientSecure.cpp>
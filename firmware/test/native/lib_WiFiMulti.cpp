@@ -0,0 +1,2 @@
+// WiFiMulti.cpp from the library, built for the host
+#include <WiFiMulti.cpp>
@@ -0,0 +1,2 @@
+// WiFiServer.cpp from the library, built for the host
+#include <WiFiServer.cpp>
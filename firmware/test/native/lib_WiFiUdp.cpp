@@ -0,0 +1,2 @@
+// WiFiUdp.cpp from the library, built for the host
+#include <WiFiUdp.cpp>
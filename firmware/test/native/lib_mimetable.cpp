@@ -0,0 +1,2 @@
+// mimetable.cpp from the library, built for the host
+#include <detail/mimetable.cpp>
@@ -0,0 +1,9 @@
+#ifndef NATIVE_CENCODE_H
+#define NATIVE_CENCODE_H
+
+#define base64_encode_expected_len(n) ((((4 * (n)) / 3) + 3) & ~3)
+
+// Returns the length written to code_out, which is NUL terminated
+int base64_encode_chars(const char *plaintext_in, int length_in, char *code_out);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef NATIVE_LWIP_DEF_H
+#define NATIVE_LWIP_DEF_H
+
+#include <arpa/inet.h>
+
+#endif
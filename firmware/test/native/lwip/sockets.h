@@ -0,0 +1,48 @@
+#ifndef NATIVE_LWIP_SOCKETS_H
+#define NATIVE_LWIP_SOCKETS_H
+
+// lwip's socket API is BSD sockets under other names
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static inline int lwip_socket(int domain, int type, int protocol)
+{
+    return ::socket(domain, type, protocol);
+}
+
+static inline int lwip_close(int s)
+{
+    return ::close(s);
+}
+
+static inline int lwip_close_r(int s)
+{
+    return ::close(s);
+}
+
+static inline int lwip_accept_r(int s, struct sockaddr *addr, socklen_t *addrlen)
+{
+    return ::accept(s, addr, addrlen);
+}
+
+static inline int lwip_connect_r(int s, const struct sockaddr *name, socklen_t namelen)
+{
+    return ::connect(s, name, namelen);
+}
+
+static inline int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset, struct timeval *timeout)
+{
+    return ::select(maxfdp1, readset, writeset, exceptset, timeout);
+}
+
+#define closesocket(s) lwip_close(s)
+
+#endif
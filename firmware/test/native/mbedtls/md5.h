@@ -0,0 +1,20 @@
+#ifndef NATIVE_MBEDTLS_MD5_H
+#define NATIVE_MBEDTLS_MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t total[2];
+    uint32_t state[4];
+    unsigned char buffer[64];
+} mbedtls_md5_context;
+
+void mbedtls_md5_init(mbedtls_md5_context *ctx);
+void mbedtls_md5_free(mbedtls_md5_context *ctx);
+void mbedtls_md5_starts(mbedtls_md5_context *ctx);
+void mbedtls_md5_update(mbedtls_md5_context *ctx, const unsigned char *input, size_t ilen);
+void mbedtls_md5_finish(mbedtls_md5_context *ctx, unsigned char output[16]);
+
+#endif
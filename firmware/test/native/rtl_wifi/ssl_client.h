@@ -0,0 +1,33 @@
+#ifndef NATIVE_SSL_CLIENT_H
+#define NATIVE_SSL_CLIENT_H
+
+// The rpc TLS client API. host_tls.cpp stands in for it with plain TCP and a
+// one line handshake, so session reuse can be tested against a local server.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct sslclient_context
+{
+    int socket;
+    int handshake_timeout;
+} sslclient_context;
+
+sslclient_context *ssl_client_create();
+void ssl_client_destroy(sslclient_context *ssl_client);
+void ssl_init(sslclient_context *ssl_client);
+void ssl_set_socket(sslclient_context *ssl_client, int socket);
+void ssl_set_timeout(sslclient_context *ssl_client, unsigned long handshake_timeout);
+int ssl_get_socket(sslclient_context *ssl_client);
+int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, int timeout, const char *rootCABuff,
+                     const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey);
+void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key);
+int data_to_read(sslclient_context *ssl_client);
+int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, uint16_t len);
+int get_ssl_receive(sslclient_context *ssl_client, uint8_t *data, int length);
+bool verify_ssl_fingerprint(sslclient_context *ssl_client, const char *fp, const char *domain_name);
+bool verify_ssl_dn(sslclient_context *ssl_client, const char *domain_name);
+int ssl_get_peer_fingerprint(sslclient_context *ssl_client, char *out, size_t size);
+void ssl_strerror(int err, char *buf, size_t size);
+
+#endif
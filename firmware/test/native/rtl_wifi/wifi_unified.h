@@ -0,0 +1,98 @@
+#ifndef NATIVE_WIFI_UNIFIED_H
+#define NATIVE_WIFI_UNIFIED_H
+
+// The types the WiFi class headers take from the rpc layer. On the host the
+// radio is simulated by host_wifi.cpp, so nothing here talks to a module.
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define RTW_SUCCESS 0
+
+#define BIT0 (1 << 0)
+#define BIT1 (1 << 1)
+#define BIT2 (1 << 2)
+#define BIT3 (1 << 3)
+#define BIT4 (1 << 4)
+#define BIT5 (1 << 5)
+#define BIT6 (1 << 6)
+#define BIT7 (1 << 7)
+#define BIT8 (1 << 8)
+#define BIT9 (1 << 9)
+#define BIT10 (1 << 10)
+#define BIT11 (1 << 11)
+#define BIT12 (1 << 12)
+#define BIT13 (1 << 13)
+#define BIT14 (1 << 14)
+#define BIT15 (1 << 15)
+
+typedef enum
+{
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+    WIFI_MODE_MAX
+} wifi_mode_t;
+
+typedef enum
+{
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK,
+    WIFI_AUTH_WPA2_ENTERPRISE,
+    WIFI_AUTH_MAX
+} wifi_auth_mode_t;
+
+typedef enum
+{
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_SCAN_DONE,
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_STOP,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+    SYSTEM_EVENT_STA_GOT_IP,
+    SYSTEM_EVENT_STA_LOST_IP,
+    SYSTEM_EVENT_AP_START,
+    SYSTEM_EVENT_AP_STOP,
+    SYSTEM_EVENT_AP_STACONNECTED,
+    SYSTEM_EVENT_AP_STADISCONNECTED,
+    SYSTEM_EVENT_MAX
+} system_event_id_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t reason;
+} system_event_sta_disconnected_t;
+
+typedef union
+{
+    system_event_sta_disconnected_t disconnected;
+} system_event_info_t;
+
+typedef struct
+{
+    system_event_id_t event_id;
+    system_event_info_t event_info;
+} system_event_t;
+
+// One scan result, as WiFiScan hands them out through getScanInfoByIndex()
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+} wifi_ap_record_t;
+
+#endif
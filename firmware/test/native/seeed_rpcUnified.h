@@ -0,0 +1,7 @@
+#ifndef NATIVE_SEEED_RPCUNIFIED_H
+#define NATIVE_SEEED_RPCUNIFIED_H
+
+#include <Arduino.h>
+#include "esp/esp_hal_log.h"
+
+#endif
@@ -0,0 +1,257 @@
+// HTTPClient::onBody() against getString() and writeToStream(), fetching a
+// 1 MB body from a loopback server plain and chunked
+#include <HTTPClient.h>
+#include <unity.h>
+#include "host.h"
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define BODY_SIZE (1024 * 1024)
+
+static std::string body;
+static uint32_t bodySum;
+static uint16_t port;
+static int listener;
+static std::thread server;
+
+static uint32_t checksum(uint32_t sum, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        sum = sum * 31 + data[i];
+    return sum;
+}
+
+// Heap in use now, what a board would see as free heap going down. Large
+// blocks are mmap()ed by glibc and counted apart.
+static size_t heapInUse()
+{
+#ifdef __GLIBC__
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// Answers one request with the body, either with a Content-Length or in
+// chunks of uneven size, or with a 404 page
+static void serveOnce(const char *how)
+{
+    std::string mode = how;
+    server = std::thread([mode]() {
+        int fd = accept(listener, NULL, NULL);
+        char request[2048];
+        recv(fd, request, sizeof(request), 0);
+        std::string head;
+        if (mode == "identity")
+        {
+            head = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+            hostWriteAll(fd, head.data(), head.size());
+            hostWriteAll(fd, body.data(), body.size());
+        }
+        else if (mode == "chunked")
+        {
+            head = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+            hostWriteAll(fd, head.data(), head.size());
+            static const size_t sizes[] = {1, 8192, 3001, 1460, 17, 65536};
+            for (size_t offset = 0, i = 0; offset < body.size(); i++)
+            {
+                size_t length = min(sizes[i % 6], body.size() - offset);
+                char size[16];
+                snprintf(size, sizeof(size), "%zx\r\n", length);
+                std::string chunk = size + body.substr(offset, length) + "\r\n";
+                hostWriteAll(fd, chunk.data(), chunk.size());
+                offset += length;
+            }
+            hostWriteAll(fd, "0\r\n\r\n", 5);
+        }
+        else
+        {
+            head = "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\nnot there";
+            hostWriteAll(fd, head.data(), head.size());
+        }
+        hostReadAll(fd, 1000);
+        close(fd);
+    });
+}
+
+void setUp(void)
+{
+    port = hostFreePort();
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listener, 1);
+}
+
+void tearDown(void)
+{
+    if (server.joinable())
+        server.join();
+    close(listener);
+}
+
+struct Received
+{
+    int code;
+    size_t bytes = 0;
+    size_t calls = 0;
+    size_t largestSlice = 0;
+    size_t peakHeap = 0; // above what was in use before the request
+    uint32_t sum = 0;
+    String after; // getString() once the callback had the body
+};
+
+static Received fetchWithCallback(const char *how)
+{
+    serveOnce(how);
+    Received r;
+    WiFiClient client;
+    HTTPClient http;
+    http.setTimeout(5000);
+    http.begin(client, "127.0.0.1", port, "/history", false);
+    size_t before = heapInUse();
+    http.onBody([&r, before](const uint8_t *data, size_t length) {
+        r.calls++;
+        r.bytes += length;
+        r.largestSlice = max(r.largestSlice, length);
+        r.peakHeap = max(r.peakHeap, heapInUse() - before);
+        r.sum = checksum(r.sum, data, length);
+    });
+    r.code = http.GET();
+    r.after = http.getString();
+    http.end();
+    server.join();
+    return r;
+}
+
+static void test_identity_body_in_slices(void)
+{
+    Received r = fetchWithCallback("identity");
+    TEST_ASSERT_EQUAL(200, r.code);
+    TEST_ASSERT_EQUAL(BODY_SIZE, r.bytes);
+    TEST_ASSERT_EQUAL_UINT32(bodySum, r.sum);
+    TEST_ASSERT_LESS_OR_EQUAL(HTTP_TCP_BUFFER_SIZE, r.largestSlice);
+    TEST_ASSERT_GREATER_OR_EQUAL(BODY_SIZE / HTTP_TCP_BUFFER_SIZE, r.calls);
+    // Delivered once, not kept for getString() as well
+    TEST_ASSERT_EQUAL(0, r.after.length());
+}
+
+static void test_chunked_body_arrives_dechunked(void)
+{
+    Received r = fetchWithCallback("chunked");
+    TEST_ASSERT_EQUAL(200, r.code);
+    TEST_ASSERT_EQUAL(BODY_SIZE, r.bytes);
+    TEST_ASSERT_EQUAL_UINT32(bodySum, r.sum);
+    TEST_ASSERT_LESS_OR_EQUAL(HTTP_TCP_BUFFER_SIZE, r.largestSlice);
+}
+
+static void test_error_pages_are_left_to_the_caller(void)
+{
+    Received r = fetchWithCallback("missing");
+    TEST_ASSERT_EQUAL(404, r.code);
+    TEST_ASSERT_EQUAL(0, r.calls);
+    TEST_ASSERT_EQUAL_STRING("not there", r.after.c_str());
+}
+
+// Reads the body with writeToStream(), keeping only a checksum
+class ChecksumStream : public Stream
+{
+public:
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        peakHeap = max(peakHeap, heapInUse() - before);
+        sum = checksum(sum, data, length);
+        return length;
+    }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override {}
+
+    size_t before = heapInUse();
+    size_t peakHeap = 0;
+    uint32_t sum = 0;
+};
+
+static void test_peak_heap(void)
+{
+#ifndef __GLIBC__
+    TEST_IGNORE_MESSAGE("heap figures need glibc's mallinfo2()");
+#else
+    const size_t bound = 16 * 1024;
+    char message[160];
+    for (const char *how : {"identity", "chunked"})
+    {
+        Received callback = fetchWithCallback(how);
+        TEST_ASSERT_EQUAL_UINT32(bodySum, callback.sum);
+        TEST_ASSERT_LESS_OR_EQUAL(bound, callback.peakHeap);
+
+        serveOnce(how);
+        size_t streamed, buffered;
+        {
+            WiFiClient client;
+            HTTPClient http;
+            http.setTimeout(5000);
+            http.begin(client, "127.0.0.1", port, "/history", false);
+            ChecksumStream sink;
+            TEST_ASSERT_EQUAL(200, http.GET());
+            TEST_ASSERT_EQUAL(BODY_SIZE, http.writeToStream(&sink));
+            TEST_ASSERT_EQUAL_UINT32(bodySum, sink.sum);
+            TEST_ASSERT_LESS_OR_EQUAL(bound, sink.peakHeap);
+            streamed = sink.peakHeap;
+            http.end();
+        }
+        server.join();
+
+        serveOnce(how);
+        {
+            WiFiClient client;
+            HTTPClient http;
+            http.setTimeout(5000);
+            http.begin(client, "127.0.0.1", port, "/history", false);
+            size_t before = heapInUse();
+            TEST_ASSERT_EQUAL(200, http.GET());
+            String all = http.getString();
+            buffered = heapInUse() - before;
+            TEST_ASSERT_EQUAL(BODY_SIZE, all.length());
+            TEST_ASSERT_GREATER_OR_EQUAL(BODY_SIZE, buffered);
+            http.end();
+        }
+        server.join();
+
+        snprintf(message, sizeof(message), "1 MB %s: heap %zu B with onBody(), %zu B with writeToStream(), %zu B with getString()",
+                 how, callback.peakHeap, streamed, buffered);
+        TEST_MESSAGE(message);
+    }
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    body.resize(BODY_SIZE);
+    for (size_t i = 0; i < body.size(); i++)
+        body[i] = 'a' + (i * 7) % 26;
+    bodySum = checksum(0, (const uint8_t *)body.data(), body.size());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_identity_body_in_slices);
+    RUN_TEST(test_chunked_body_arrives_dechunked);
+    RUN_TEST(test_error_pages_are_left_to_the_caller);
+    RUN_TEST(test_peak_heap);
+    return UNITY_END();
+}
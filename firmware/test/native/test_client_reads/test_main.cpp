@@ -0,0 +1,174 @@
+// Bulk reads through WiFiClient over loopback: the data arrives intact
+// whatever the receive buffer size or read call, and how many recv() calls
+// it takes.
+#include <WiFiClient.h>
+#include <unity.h>
+#include "host.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#define DOWNLOAD_SIZE (32 * 1024 * 1024)
+#define BLOCK_SIZE 1460 // what HTTPClient::writeToStreamDataBlock() asks for
+
+static int listener;
+static uint16_t port;
+static std::thread sender;
+
+static uint8_t pattern(size_t offset)
+{
+    return (uint8_t)(offset * 31 % 251);
+}
+
+void setUp(void)
+{
+    port = hostFreePort();
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listener, 1);
+}
+
+void tearDown(void)
+{
+    if (sender.joinable())
+        sender.join();
+    close(listener);
+}
+
+// Serves size bytes of the pattern to the next connection, then closes
+static void serve(size_t size)
+{
+    sender = std::thread([size]() {
+        int fd = accept(listener, NULL, NULL);
+        uint8_t block[65536];
+        for (size_t sent = 0; sent < size;)
+        {
+            size_t length = std::min(sizeof(block), size - sent);
+            for (size_t i = 0; i < length; i++)
+                block[i] = pattern(sent + i);
+            if (!hostWriteAll(fd, block, length))
+                break;
+            sent += length;
+        }
+        close(fd);
+    });
+}
+
+struct Download
+{
+    size_t bytes;
+    bool intact;
+    unsigned long recvCalls;
+    double seconds;
+};
+
+// Reads until the server closes, one way or another
+template <typename Read>
+static Download download(size_t rxBufferSize, Read readSome)
+{
+    serve(DOWNLOAD_SIZE);
+    WiFiClient client;
+    client.setRxBufferSize(rxBufferSize);
+    TEST_ASSERT_TRUE(client.connect(IPAddress(127, 0, 0, 1), port));
+    hostResetRecvCalls();
+    Download result = {0, true, 0, 0};
+    uint8_t buf[BLOCK_SIZE];
+    auto start = std::chrono::steady_clock::now();
+    while (result.bytes < DOWNLOAD_SIZE && (client.connected() || client.available()))
+    {
+        int length = readSome(client, buf, sizeof(buf));
+        for (int i = 0; i < length; i++)
+            result.intact = result.intact && buf[i] == pattern(result.bytes + i);
+        if (length > 0)
+            result.bytes += length;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.recvCalls = hostRecvCalls();
+    client.stop();
+    return result;
+}
+
+static void report(const char *name, const Download &result)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%-28s %6lu recv (%5.0f B each), %6.0f MB/s", name, result.recvCalls,
+             (double)result.bytes / result.recvCalls, result.bytes / result.seconds / 1e6);
+    TEST_MESSAGE(message);
+}
+
+static int readBlock(WiFiClient &client, uint8_t *buf, size_t size)
+{
+    return client.read(buf, size);
+}
+
+// Larger blocks than the buffer bypass it, smaller ones are served from it
+static void test_reads_are_intact(void)
+{
+    size_t sizes[] = {512, 1024, 4096, 8192};
+    for (size_t size : sizes)
+    {
+        Download result = download(size, readBlock);
+        TEST_ASSERT_EQUAL(DOWNLOAD_SIZE, result.bytes);
+        TEST_ASSERT_TRUE(result.intact);
+        tearDown();
+        setUp();
+    }
+}
+
+// readv() fills its buffers in order, a short one included
+static void test_readv_is_intact(void)
+{
+    Download result = download(1024, [](WiFiClient &client, uint8_t *buf, size_t size) {
+        WiFiClientIOVec iov[] = {{buf, 7}, {buf + 7, 900}, {buf + 907, size - 907}};
+        return client.readv(iov, 3);
+    });
+    TEST_ASSERT_EQUAL(DOWNLOAD_SIZE, result.bytes);
+    TEST_ASSERT_TRUE(result.intact);
+}
+
+// 32 MB in BLOCK_SIZE reads. The first line is the path HTTPClient took
+// before: Stream::readBytes(), one read() per byte, through a 1 KB buffer.
+static void test_download_recv_calls(void)
+{
+    Download perByte = download(1024, [](WiFiClient &client, uint8_t *buf, size_t size) {
+        return (int)client.readBytes(buf, size);
+    });
+    report("readBytes(), 1 KB buffer", perByte);
+    TEST_ASSERT_TRUE(perByte.intact);
+
+    size_t sizes[] = {512, 1024, 4096, 8192};
+    unsigned long calls[4];
+    for (int i = 0; i < 4; i++)
+    {
+        tearDown();
+        setUp();
+        Download result = download(sizes[i], readBlock);
+        char name[48];
+        snprintf(name, sizeof(name), "read(%d), %zu B buffer", BLOCK_SIZE, sizes[i]);
+        report(name, result);
+        TEST_ASSERT_TRUE(result.intact);
+        calls[i] = result.recvCalls;
+    }
+    // a buffer at least as large as the reads takes whole socket chunks
+    TEST_ASSERT_LESS_THAN(perByte.recvCalls, calls[3]);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_reads_are_intact);
+    RUN_TEST(test_readv_is_intact);
+    RUN_TEST(test_download_recv_calls);
+    return UNITY_END();
+}
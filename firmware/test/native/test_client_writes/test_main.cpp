@@ -0,0 +1,138 @@
+// Non-blocking writes through WiFiClient over loopback: what write() accepted
+// reaches the peer even when stop() comes right after, and a peer that stops
+// reading holds stop() up for a bounded time only.
+#include <WiFiClient.h>
+#include <unity.h>
+#include "host.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#define RING_SIZE 16384
+#define SLACK_MS 700
+
+static int listener;
+static uint16_t port;
+
+static uint8_t pattern(size_t offset)
+{
+    return (uint8_t)(offset * 31 % 251);
+}
+
+void setUp(void)
+{
+    port = hostFreePort();
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listener, 1);
+}
+
+void tearDown(void)
+{
+    close(listener);
+}
+
+static unsigned long since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Writes the pattern until the socket and then the ring are full, returns
+// how much write() accepted
+static size_t fill(WiFiClient &client)
+{
+    uint8_t block[4096];
+    size_t accepted = 0;
+    for (;;)
+    {
+        for (size_t i = 0; i < sizeof(block); i++)
+            block[i] = pattern(accepted + i);
+        size_t taken = client.write(block, sizeof(block));
+        accepted += taken;
+        if (taken < sizeof(block))
+            return accepted;
+    }
+}
+
+static void test_stop_sends_what_was_queued(void)
+{
+    WiFiClient client;
+    client.setNonBlocking(true, RING_SIZE);
+    TEST_ASSERT_TRUE(client.connect(IPAddress(127, 0, 0, 1), port));
+    int peer = accept(listener, NULL, NULL);
+
+    size_t accepted = fill(client);
+    TEST_ASSERT_GREATER_THAN(0, client.writePending());
+
+    // the peer only starts reading once stop() is under way
+    std::string received;
+    std::thread reader([peer, &received]() {
+        usleep(200 * 1000);
+        received = hostReadAll(peer, 5000);
+    });
+    client.stop();
+    reader.join();
+    close(peer);
+
+    TEST_ASSERT_EQUAL(accepted, received.size());
+    bool intact = true;
+    for (size_t i = 0; i < received.size(); i++)
+        intact = intact && (uint8_t)received[i] == pattern(i);
+    TEST_ASSERT_TRUE(intact);
+}
+
+static void test_stop_gives_up_on_a_stalled_peer(void)
+{
+    WiFiClient client;
+    client.setNonBlocking(true, RING_SIZE);
+    TEST_ASSERT_TRUE(client.connect(IPAddress(127, 0, 0, 1), port));
+    int peer = accept(listener, NULL, NULL);
+    fill(client);
+
+    auto start = std::chrono::steady_clock::now();
+    client.stop();
+    unsigned long took = since(start);
+    close(peer);
+    TEST_ASSERT_GREATER_OR_EQUAL(WIFI_CLIENT_STOP_DRAIN_MS, took);
+    TEST_ASSERT_LESS_THAN(WIFI_CLIENT_STOP_DRAIN_MS + SLACK_MS, took);
+}
+
+// A copy that lives on keeps the connection and its ring: stopping the other
+// one neither waits nor sends anything early
+static void test_stopping_a_copy_does_not_wait(void)
+{
+    WiFiClient client;
+    client.setNonBlocking(true, RING_SIZE);
+    TEST_ASSERT_TRUE(client.connect(IPAddress(127, 0, 0, 1), port));
+    int peer = accept(listener, NULL, NULL);
+    fill(client);
+
+    WiFiClient copy(client);
+    size_t pending = copy.writePending();
+    auto start = std::chrono::steady_clock::now();
+    client.stop();
+    TEST_ASSERT_LESS_THAN(SLACK_MS, since(start));
+    TEST_ASSERT_TRUE(copy.connected());
+    TEST_ASSERT_EQUAL(pending, copy.writePending());
+    close(peer);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_stop_sends_what_was_queued);
+    RUN_TEST(test_stop_gives_up_on_a_stalled_peer);
+    RUN_TEST(test_stopping_a_copy_does_not_wait);
+    return UNITY_END();
+}
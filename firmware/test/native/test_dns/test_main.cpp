@@ -0,0 +1,214 @@
+// DNSServer answers over UDP loopback, and how many queries a second it keeps up with
+#include <DNSServer.h>
+#include <unity.h>
+#include "host.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+static uint16_t port;
+static DNSServer *server;
+static int client;
+
+// Sorted by name, then type
+static const DNSRecord zone[] = {
+    {"printer.lan", DNS_TYPE_A, 120, {10, 0, 0, 7}},
+    {"sensor.lan", DNS_TYPE_A, 30, {10, 0, 0, 21}},
+    {"sensor.lan", DNS_TYPE_A, 30, {10, 0, 0, 22}},
+    {"sensor.lan", DNS_TYPE_AAAA, 30, {0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x21}},
+};
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new DNSServer();
+    server->start(port, "www.Portal.local", IPAddress(192, 168, 4, 1));
+    client = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(client, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+void tearDown(void)
+{
+    close(client);
+    delete server;
+    server = NULL;
+}
+
+static std::string query(uint16_t id, const char *name, uint16_t type)
+{
+    std::string packet;
+    packet += (char)(id >> 8);
+    packet += (char)id;
+    packet += std::string("\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00", 10); // RD, one question
+    while (*name)
+    {
+        const char *dot = strchr(name, '.');
+        size_t label = dot ? dot - name : strlen(name);
+        packet += (char)label;
+        packet.append(name, label);
+        name += label + (dot ? 1 : 0);
+    }
+    packet += '\0';
+    packet += (char)(type >> 8);
+    packet += (char)type;
+    packet += std::string("\x00\x01", 2);
+    return packet;
+}
+
+// Send one packet, let the server handle it, return the reply or "" if none
+static std::string ask(const std::string &packet)
+{
+    send(client, packet.data(), packet.size(), 0);
+    for (int i = 0; i < 100 && !server->processNextRequest(); i++)
+        usleep(100);
+    char reply[DNS_MAX_PACKET_SIZE];
+    struct pollfd pfd = {client, POLLIN, 0};
+    if (poll(&pfd, 1, 100) <= 0)
+        return std::string();
+    ssize_t length = recv(client, reply, sizeof(reply), 0);
+    return length > 0 ? std::string(reply, length) : std::string();
+}
+
+static uint16_t field(const std::string &packet, size_t offset)
+{
+    return (uint8_t)packet[offset] << 8 | (uint8_t)packet[offset + 1];
+}
+
+#define RCODE(reply) (field(reply, 2) & 0x0f)
+#define ANCOUNT(reply) field(reply, 6)
+#define NSCOUNT(reply) field(reply, 8)
+
+static void test_answers_the_portal_name(void)
+{
+    std::string q = query(0x1234, "WWW.portal.LOCAL", DNS_TYPE_A);
+    std::string reply = ask(q);
+    TEST_ASSERT_EQUAL(q.size() + DNS_ANSWER_SIZE, reply.size());
+    TEST_ASSERT_EQUAL_HEX16(0x1234, field(reply, 0));
+    TEST_ASSERT_TRUE(field(reply, 2) & 0x8000); // a response
+    TEST_ASSERT_EQUAL(0, RCODE(reply));
+    TEST_ASSERT_EQUAL(1, ANCOUNT(reply));
+    TEST_ASSERT_TRUE(reply.compare(DNS_HEADER_SIZE, q.size() - DNS_HEADER_SIZE, q, DNS_HEADER_SIZE, std::string::npos) == 0);
+    TEST_ASSERT_EQUAL(DNS_DEFAULT_TTL, field(reply, q.size() + 8));
+    TEST_ASSERT_TRUE(reply.compare(q.size(), 6, std::string("\xc0\x0c\x00\x01\x00\x01", 6)) == 0);
+    TEST_ASSERT_TRUE(reply.compare(reply.size() - 4, 4, "\xc0\xa8\x04\x01") == 0);
+
+    reply = ask(query(1, "portal.local", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL(1, ANCOUNT(reply));
+}
+
+static void test_other_names_and_types(void)
+{
+    // No AAAA for the portal: empty answer plus SOA
+    std::string reply = ask(query(2, "portal.local", DNS_TYPE_AAAA));
+    TEST_ASSERT_EQUAL(0, RCODE(reply));
+    TEST_ASSERT_EQUAL(0, ANCOUNT(reply));
+    TEST_ASSERT_EQUAL(1, NSCOUNT(reply));
+
+    reply = ask(query(3, "portal.local.evil", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL((int)DNSReplyCode::NonExistentDomain, RCODE(reply));
+    TEST_ASSERT_EQUAL(0, ANCOUNT(reply));
+    TEST_ASSERT_EQUAL(1, NSCOUNT(reply));
+
+    server->setErrorReplyCode(DNSReplyCode::Refused);
+    reply = ask(query(4, "example.com", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL((int)DNSReplyCode::Refused, RCODE(reply));
+    TEST_ASSERT_EQUAL(0, NSCOUNT(reply));
+}
+
+static void test_zone_records(void)
+{
+    TEST_ASSERT_TRUE(server->setZone(zone, sizeof(zone) / sizeof(zone[0])));
+    std::string reply = ask(query(5, "Sensor.lan", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL(2, ANCOUNT(reply));
+    TEST_ASSERT_TRUE(reply.compare(reply.size() - 4, 4, std::string("\x0a\x00\x00\x16", 4)) == 0);
+
+    reply = ask(query(6, "sensor.lan", DNS_TYPE_AAAA));
+    TEST_ASSERT_EQUAL(1, ANCOUNT(reply));
+    TEST_ASSERT_EQUAL(DNS_RDLENGTH_IPV6, field(reply, reply.size() - 18));
+
+    // Known name without the type asked for
+    reply = ask(query(7, "printer.lan", DNS_TYPE_AAAA));
+    TEST_ASSERT_EQUAL(0, RCODE(reply));
+    TEST_ASSERT_EQUAL(1, NSCOUNT(reply));
+
+    // The portal name still resolves next to the zone
+    reply = ask(query(8, "portal.local", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL(1, ANCOUNT(reply));
+
+    static const DNSRecord unsorted[] = {
+        {"b.lan", DNS_TYPE_A, 1, {1, 1, 1, 1}},
+        {"a.lan", DNS_TYPE_A, 1, {1, 1, 1, 2}},
+    };
+    TEST_ASSERT_FALSE(server->setZone(unsorted, 2));
+}
+
+static void test_malformed_packets(void)
+{
+    // Runts and responses are dropped without a word
+    TEST_ASSERT_EQUAL(0, ask(std::string("\x00\x01\x01", 3)).size());
+    std::string response = query(9, "portal.local", DNS_TYPE_A);
+    response[2] |= 0x80;
+    TEST_ASSERT_EQUAL(0, ask(response).size());
+
+    // Two questions get a bare error header
+    std::string twice = query(10, "portal.local", DNS_TYPE_A);
+    twice[5] = 2;
+    std::string reply = ask(twice);
+    TEST_ASSERT_EQUAL(DNS_HEADER_SIZE, reply.size());
+    TEST_ASSERT_EQUAL(0, field(reply, 4));
+
+    // A label running past the end of the packet
+    std::string truncated = query(11, "portal.local", DNS_TYPE_A);
+    truncated[DNS_HEADER_SIZE] = 60;
+    TEST_ASSERT_EQUAL(DNS_HEADER_SIZE, ask(truncated).size());
+}
+
+static void test_queries_per_second(void)
+{
+    const int burst = 64, rounds = 500;
+    std::string q = query(0, "www.portal.local", DNS_TYPE_A);
+    char reply[DNS_MAX_PACKET_SIZE];
+    int answered = 0;
+#ifdef __GLIBC__
+    size_t heap = mallinfo2().uordblks;
+#endif
+    auto started = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < burst; i++)
+            send(client, q.data(), q.size(), 0);
+        while (server->processNextRequest())
+            ;
+        while (recv(client, reply, sizeof(reply), MSG_DONTWAIT) > 0)
+            answered++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    TEST_ASSERT_EQUAL(burst * rounds, answered);
+#ifdef __GLIBC__
+    TEST_ASSERT_EQUAL(heap, mallinfo2().uordblks);
+#endif
+    char message[64];
+    snprintf(message, sizeof(message), "%.0f queries/s answered", answered / seconds);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_answers_the_portal_name);
+    RUN_TEST(test_other_names_and_types);
+    RUN_TEST(test_zone_records);
+    RUN_TEST(test_malformed_packets);
+    RUN_TEST(test_queries_per_second);
+    return UNITY_END();
+}
@@ -0,0 +1,294 @@
+// GzipEncoder on the host: what it writes inflates back to the input, one
+// encoder serves stream after stream, and what it costs against what it saves
+// for the payloads a device serves.
+#include <detail/GzipEncoder.h>
+#include <unity.h>
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+
+static std::string output;
+static GzipEncoder *encoder;
+
+void setUp(void)
+{
+    output.clear();
+    encoder = new GzipEncoder();
+}
+
+void tearDown(void)
+{
+    delete encoder;
+    encoder = NULL;
+}
+
+// Inflates what the encoder writes: a gzip member of fixed Huffman blocks.
+// Throws on anything else, or on a CRC or length that does not match.
+class Inflater
+{
+public:
+    explicit Inflater(const std::string &in) : _in(in), _pos(10), _bit(0) {}
+
+    std::string run()
+    {
+        if (_in.size() < 18 || (uint8_t)_in[0] != 0x1F || (uint8_t)_in[1] != 0x8B || _in[2] != 8 || _in[3] != 0)
+            throw std::runtime_error("bad header");
+        std::string out;
+        bool last;
+        do
+        {
+            last = bits(1);
+            if (bits(2) != 1)
+                throw std::runtime_error("not a fixed Huffman block");
+            for (;;)
+            {
+                int symbol = literalLength();
+                if (symbol < 256)
+                {
+                    out += (char)symbol;
+                    continue;
+                }
+                if (symbol == 256)
+                    break;
+                static const uint16_t lengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+                                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+                static const uint8_t lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                      2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+                static const uint16_t distanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                                        193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                                        6145, 8193, 12289, 16385, 24577};
+                static const uint8_t distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                                        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+                int code = symbol - 257;
+                if (code > 28)
+                    throw std::runtime_error("bad length code");
+                size_t length = lengthBase[code] + bits(lengthExtra[code]);
+                code = huffman(5);
+                if (code > 29)
+                    throw std::runtime_error("bad distance code");
+                size_t distance = distanceBase[code] + bits(distanceExtra[code]);
+                if (distance > out.size())
+                    throw std::runtime_error("distance before the start");
+                for (size_t i = 0; i < length; i++)
+                    out += out[out.size() - distance];
+            }
+        } while (!last);
+        if (_bit)
+        {
+            _pos++;
+            _bit = 0;
+        }
+        if (_pos + 8 != _in.size())
+            throw std::runtime_error("trailer misplaced");
+        if (word(_pos) != crc32(out) || word(_pos + 4) != (uint32_t)out.size())
+            throw std::runtime_error("trailer does not match");
+        return out;
+    }
+
+private:
+    uint32_t bits(int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (_pos >= _in.size())
+                throw std::runtime_error("truncated");
+            value |= (uint32_t)(((uint8_t)_in[_pos] >> _bit) & 1) << i;
+            if (++_bit == 8)
+            {
+                _bit = 0;
+                _pos++;
+            }
+        }
+        return value;
+    }
+
+    // Huffman codes come most significant bit first
+    int huffman(int count)
+    {
+        int code = 0;
+        for (int i = 0; i < count; i++)
+            code = (code << 1) | bits(1);
+        return code;
+    }
+
+    int literalLength()
+    {
+        int code = huffman(7);
+        if (code <= 0x17)
+            return 256 + code;
+        code = (code << 1) | bits(1);
+        if (code >= 0x30 && code <= 0xBF)
+            return code - 0x30;
+        if (code >= 0xC0 && code <= 0xC7)
+            return 280 + code - 0xC0;
+        code = (code << 1) | bits(1);
+        return 144 + code - 0x190;
+    }
+
+    uint32_t word(size_t at)
+    {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; i--)
+            value = (value << 8) | (uint8_t)_in[at + i];
+        return value;
+    }
+
+    static uint32_t crc32(const std::string &data)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (unsigned char c : data)
+        {
+            crc ^= c;
+            for (int k = 0; k < 8; k++)
+                crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+        return ~crc;
+    }
+
+    const std::string &_in;
+    size_t _pos;
+    int _bit;
+};
+
+static std::string compress(const std::string &input, size_t pieceSize)
+{
+    output.clear();
+    TEST_ASSERT_TRUE(encoder->begin([](const uint8_t *data, size_t length) { output.append((const char *)data, length); }));
+    for (size_t pos = 0; pos < input.size(); pos += pieceSize)
+        encoder->write((const uint8_t *)input.data() + pos, std::min(pieceSize, input.size() - pos));
+    encoder->finish();
+    TEST_ASSERT_FALSE(encoder->active());
+    return output;
+}
+
+static bool roundTrips(const std::string &input, size_t pieceSize)
+{
+    std::string gz = compress(input, pieceSize);
+    try
+    {
+        return Inflater(gz).run() == input;
+    }
+    catch (const std::exception &e)
+    {
+        TEST_MESSAGE(e.what());
+        return false;
+    }
+}
+
+// What an API handler returns: records with repeated keys, varying values
+static std::string json(size_t size)
+{
+    std::string out = "{\"transactions\":[";
+    for (int i = 0; out.size() < size; i++)
+    {
+        char record[160];
+        snprintf(record, sizeof(record),
+                 "%s{\"id\":%d,\"timestamp\":\"2024-05-%02dT%02d:%02d:00Z\",\"amount\":%d.%02d,"
+                 "\"currency\":\"EUR\",\"status\":\"%s\"}",
+                 i ? "," : "", 100000 + i * 7, 1 + i % 28, i % 24, (i * 13) % 60, (i * 37) % 500, (i * 11) % 100,
+                 i % 5 ? "settled" : "pending");
+        out += record;
+    }
+    out += "]}";
+    return out;
+}
+
+// What a status page renders: a table of readings
+static std::string html(size_t size)
+{
+    std::string out = "<!DOCTYPE html><html><head><title>Status</title></head><body><table>"
+                      "<tr><th>Sensor</th><th>Value</th><th>Updated</th></tr>";
+    for (int i = 0; out.size() < size; i++)
+    {
+        char row[128];
+        snprintf(row, sizeof(row), "<tr><td>sensor-%d</td><td>%d.%d &deg;C</td><td>%d s ago</td></tr>", i,
+                 18 + i % 9, i % 10, (i * 17) % 300);
+        out += row;
+    }
+    return out + "</table></body></html>";
+}
+
+static std::string noise(size_t size)
+{
+    std::string out;
+    uint32_t x = 2463534242u;
+    while (out.size() < size)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out += (char)x;
+    }
+    return out;
+}
+
+static void test_round_trips(void)
+{
+    TEST_ASSERT_TRUE(roundTrips("", 1));
+    TEST_ASSERT_TRUE(roundTrips("a", 1));
+    TEST_ASSERT_TRUE(roundTrips(std::string(100000, 'a'), 4096));
+    // pieces that straddle the window slide at every offset
+    TEST_ASSERT_TRUE(roundTrips(json(20000), 1));
+    TEST_ASSERT_TRUE(roundTrips(json(20000), 1000));
+    TEST_ASSERT_TRUE(roundTrips(html(5000), 333));
+    TEST_ASSERT_TRUE(roundTrips(noise(20000), 2 * GZIP_WINDOW_SIZE));
+}
+
+// The buffers stay with the encoder, and nothing of one stream leaks into
+// the next: a stream started over writes what a fresh encoder would
+static void test_encoder_is_reused(void)
+{
+    std::string first = compress(json(20000), 512);
+    compress(html(5000), 512);
+    encoder->begin([](const uint8_t *, size_t) {});
+    encoder->write((const uint8_t *)"dropped", 7);
+    encoder->cancel();
+    TEST_ASSERT_FALSE(encoder->active());
+    TEST_ASSERT_TRUE(first == compress(json(20000), 512));
+    encoder->end();
+    TEST_ASSERT_TRUE(roundTrips(json(20000), 512));
+}
+
+// Ratio and encode speed per payload, the host is many times faster than the
+// boards but the relation between payloads holds
+static void test_compression_tradeoff(void)
+{
+    struct
+    {
+        const char *name;
+        std::string data;
+        double maxRatio;
+    } payloads[] = {
+        {"500 B JSON", json(500), 0.60},
+        {"5 KB HTML", html(5000), 0.30},
+        {"20 KB JSON", json(20000), 0.35},
+        {"20 KB noise", noise(20000), 1.10},
+    };
+    for (auto &payload : payloads)
+    {
+        const int rounds = 200;
+        size_t compressed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+            compressed = compress(payload.data, 1460).size();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double ratio = (double)compressed / payload.data.size();
+        char message[128];
+        snprintf(message, sizeof(message), "%-12s %6zu -> %6zu bytes (%5.1f%%), %6.1f MB/s, %5.1f us each", payload.name,
+                 payload.data.size(), compressed, 100 * ratio, payload.data.size() * rounds / seconds / 1e6,
+                 seconds / rounds * 1e6);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_TRUE(ratio <= payload.maxRatio);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trips);
+    RUN_TEST(test_encoder_is_reused);
+    RUN_TEST(test_compression_tradeoff);
+    return UNITY_END();
+}
@@ -0,0 +1,349 @@
+// HTTPClient with an HTTPRetryPolicy against a loopback server that fails on
+// cue and, like a backend should, commits a POST once per Idempotency-Key
+#include <HTTPClient.h>
+#include <unity.h>
+#include "host.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Logged
+{
+    std::string method;
+    std::string fault;
+    std::string key;
+};
+
+// Each request takes the next fault off the script, "ok" once it is empty:
+// lost     commits a POST but hangs up before answering
+// reset    hangs up without committing
+// slowN    answers after N ms
+// hang     never answers
+// 503[N]   busy, with Retry-After: N if given
+// 404      not found
+class FaultServer
+{
+public:
+    void start(std::initializer_list<const char *> faults)
+    {
+        _script.assign(faults.begin(), faults.end());
+        log.clear();
+        committed.clear();
+        port = hostFreePort();
+        _listener = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_listener, (struct sockaddr *)&addr, sizeof(addr));
+        listen(_listener, 8);
+        _running = true;
+        _acceptor = std::thread([this]() { acceptLoop(); });
+    }
+
+    void stop()
+    {
+        if (!_acceptor.joinable())
+            return;
+        _running = false;
+        _acceptor.join();
+        for (std::thread &t : _connections)
+            t.join();
+        _connections.clear();
+        close(_listener);
+    }
+
+    size_t requests()
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        return log.size();
+    }
+
+    uint16_t port;
+    std::vector<Logged> log;
+    std::map<std::string, std::string> committed; // Idempotency-Key to body
+
+private:
+    // Waits for input on fd, false once the server stops or the peer is gone
+    bool readable(int fd)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        while (_running)
+        {
+            if (poll(&pfd, 1, 10) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    void acceptLoop()
+    {
+        while (readable(_listener))
+        {
+            int fd = accept(_listener, NULL, NULL);
+            _connections.push_back(std::thread([this, fd]() { serve(fd); }));
+        }
+    }
+
+    // Head and body of the next request, false when the connection ends
+    bool readRequest(int fd, std::string &head, std::string &body)
+    {
+        std::string data;
+        char buf[1024];
+        size_t end;
+        while ((end = data.find("\r\n\r\n")) == std::string::npos)
+        {
+            ssize_t n = readable(fd) ? recv(fd, buf, sizeof(buf), 0) : 0;
+            if (n <= 0)
+                return false;
+            data.append(buf, n);
+        }
+        head = data.substr(0, end + 2);
+        body = data.substr(end + 4);
+        size_t length = 0;
+        size_t at = head.find("Content-Length: ");
+        if (at != std::string::npos)
+            length = atoi(head.c_str() + at + 16);
+        while (body.size() < length)
+        {
+            ssize_t n = readable(fd) ? recv(fd, buf, sizeof(buf), 0) : 0;
+            if (n <= 0)
+                return false;
+            body.append(buf, n);
+        }
+        return true;
+    }
+
+    void serve(int fd)
+    {
+        std::string head, body;
+        while (readRequest(fd, head, body))
+        {
+            std::string method = head.substr(0, head.find(' '));
+            std::string key;
+            size_t at = head.find(HTTPCLIENT_IDEMPOTENCY_HEADER ": ");
+            if (at != std::string::npos)
+            {
+                at += strlen(HTTPCLIENT_IDEMPOTENCY_HEADER ": ");
+                key = head.substr(at, head.find("\r\n", at) - at);
+            }
+            std::string fault = "ok";
+            {
+                std::lock_guard<std::mutex> lock(_lock);
+                if (!_script.empty())
+                {
+                    fault = _script.front();
+                    _script.pop_front();
+                }
+                log.push_back({method, fault, key});
+                if (method == "POST" && (fault == "ok" || fault == "lost"))
+                    committed.insert(std::make_pair(key.empty() ? std::to_string(committed.size()) : key, body));
+            }
+
+            std::string response;
+            if (fault.compare(0, 4, "slow") == 0)
+            {
+                usleep(atoi(fault.c_str() + 4) * 1000);
+                fault = "ok";
+            }
+            if (fault == "ok")
+                response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+            else if (fault.compare(0, 3, "503") == 0)
+                response = "HTTP/1.1 503 Service Unavailable\r\n" +
+                           (fault.size() > 3 ? "Retry-After: " + fault.substr(3) + "\r\n" : std::string()) +
+                           "Content-Length: 4\r\n\r\nbusy";
+            else if (fault == "404")
+                response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+            else if (fault == "hang")
+                while (readable(fd) && recv(fd, &head[0], 1, MSG_PEEK) > 0)
+                    usleep(1000);
+
+            if (response.empty())
+                break;
+            hostWriteAll(fd, response.data(), response.size());
+        }
+        close(fd);
+    }
+
+    std::mutex _lock;
+    std::deque<std::string> _script;
+    std::atomic<bool> _running{false};
+    int _listener;
+    std::thread _acceptor;
+    std::vector<std::thread> _connections;
+};
+
+static FaultServer server;
+static HTTPRetryPolicy *policy;
+
+void setUp(void)
+{
+    policy = new HTTPRetryPolicy();
+    policy->setBackoff(20, 2000);
+}
+
+void tearDown(void)
+{
+    server.stop();
+    delete policy;
+}
+
+static unsigned long elapsed; // ms the last request took
+
+static int request(const char *method)
+{
+    WiFiClient client;
+    HTTPClient http;
+    http.begin(client, "127.0.0.1", server.port, "/data", false);
+    http.setRetryPolicy(policy);
+    http.setTimeout(5000);
+    auto started = std::chrono::steady_clock::now();
+    int code = strcmp(method, "POST") == 0 ? http.POST(String("{\"t\":21.5}")) : http.GET();
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    http.end();
+    return code;
+}
+
+static void test_lost_answer_commits_once(void)
+{
+    server.start({"lost"});
+    TEST_ASSERT_EQUAL(200, request("POST"));
+    TEST_ASSERT_EQUAL(2, server.log.size());
+    TEST_ASSERT_EQUAL(32, server.log[0].key.size());
+    TEST_ASSERT_EQUAL_STRING(server.log[0].key.c_str(), server.log[1].key.c_str());
+    TEST_ASSERT_EQUAL(1, server.committed.size());
+    TEST_ASSERT_EQUAL_STRING("{\"t\":21.5}", server.committed.begin()->second.c_str());
+
+    // A new request gets a key of its own, GET none at all
+    TEST_ASSERT_EQUAL(200, request("POST"));
+    TEST_ASSERT_EQUAL(2, server.committed.size());
+    TEST_ASSERT_EQUAL(200, request("GET"));
+    TEST_ASSERT_EQUAL(0, server.log.back().key.size());
+}
+
+static void test_transient_failures_are_retried(void)
+{
+    server.start({"reset", "503", "ok"});
+    TEST_ASSERT_EQUAL(200, request("GET"));
+    TEST_ASSERT_EQUAL(3, server.requests());
+    TEST_ASSERT_EQUAL(HTTPRetryPolicy::CIRCUIT_CLOSED, policy->circuit());
+
+    // Out of attempts: the last answer is what the caller gets
+    server.stop();
+    server.start({"503", "503", "503", "ok"});
+    TEST_ASSERT_EQUAL(503, request("GET"));
+    TEST_ASSERT_EQUAL(HTTPCLIENT_RETRY_ATTEMPTS, server.requests());
+}
+
+static void test_client_errors_are_not_retried(void)
+{
+    server.start({"404"});
+    TEST_ASSERT_EQUAL(404, request("POST"));
+    TEST_ASSERT_EQUAL(1, server.requests());
+}
+
+static void test_retry_after_is_honoured(void)
+{
+    server.start({"5031"});
+    TEST_ASSERT_EQUAL(200, request("GET"));
+    TEST_ASSERT_EQUAL(2, server.requests());
+    TEST_ASSERT_GREATER_OR_EQUAL(1000, elapsed);
+
+    // Longer than the policy would ever wait: given up on at once
+    server.stop();
+    server.start({"50360"});
+    TEST_ASSERT_EQUAL(503, request("GET"));
+    TEST_ASSERT_EQUAL(1, server.requests());
+    TEST_ASSERT_LESS_THAN(1000, elapsed);
+}
+
+static void test_timeouts_follow_the_server(void)
+{
+    policy->setAttempts(2);
+    server.start({"slow30", "slow40", "slow30", "slow50", "slow40", "slow30", "slow40", "slow30", "hang"});
+    TEST_ASSERT_EQUAL(5000, policy->responseTimeout(5000));
+    for (int i = 0; i < 8; i++)
+        TEST_ASSERT_EQUAL(200, request("GET"));
+    // A fast server brings the timeout down to its lower bound
+    TEST_ASSERT_EQUAL(HTTPCLIENT_RETRY_TIMEOUT_MIN, policy->responseTimeout(5000));
+
+    // So a hung request is given up on after a second, not five
+    TEST_ASSERT_EQUAL(200, request("GET"));
+    TEST_ASSERT_EQUAL(10, server.requests());
+    TEST_ASSERT_LESS_THAN(2500, elapsed);
+    TEST_ASSERT_GREATER_OR_EQUAL(HTTPCLIENT_RETRY_TIMEOUT_MIN, elapsed);
+}
+
+static void test_circuit_breaker(void)
+{
+    policy->setBreaker(3, 300);
+    server.start({"503", "503", "503", "503", "ok"});
+    TEST_ASSERT_EQUAL(503, request("GET"));
+    TEST_ASSERT_EQUAL(HTTPRetryPolicy::CIRCUIT_OPEN, policy->circuit());
+
+    // Open: fails without a request
+    TEST_ASSERT_EQUAL(HTTPC_ERROR_CIRCUIT_OPEN, request("GET"));
+    TEST_ASSERT_EQUAL(3, server.requests());
+    TEST_ASSERT_LESS_THAN(50, elapsed);
+
+    // After the cooldown a single trial goes out; it fails, so open again
+    usleep(350000);
+    TEST_ASSERT_EQUAL(503, request("GET"));
+    TEST_ASSERT_EQUAL(4, server.requests());
+    TEST_ASSERT_EQUAL(HTTPRetryPolicy::CIRCUIT_OPEN, policy->circuit());
+
+    usleep(350000);
+    TEST_ASSERT_EQUAL(200, request("GET"));
+    TEST_ASSERT_EQUAL(HTTPRetryPolicy::CIRCUIT_CLOSED, policy->circuit());
+    TEST_ASSERT_EQUAL(200, request("GET"));
+}
+
+struct JitterProbe : HTTPRetryPolicy
+{
+    using HTTPRetryPolicy::backoff;
+};
+
+static void test_backoff_is_jittered_and_capped(void)
+{
+    JitterProbe probe;
+    probe.setBackoff(100, 1000);
+    for (uint8_t retry = 0; retry < 8; retry++)
+    {
+        uint32_t cap = min(100u << retry, 1000u), lowest = cap, highest = 0;
+        for (int i = 0; i < 200; i++)
+        {
+            uint32_t wait = probe.backoff(retry);
+            lowest = min(lowest, wait);
+            highest = max(highest, wait);
+        }
+        TEST_ASSERT_LESS_OR_EQUAL(cap, highest);
+        TEST_ASSERT_LESS_THAN(cap / 4, lowest);
+        TEST_ASSERT_GREATER_THAN(cap * 3 / 4, highest);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_lost_answer_commits_once);
+    RUN_TEST(test_transient_failures_are_retried);
+    RUN_TEST(test_client_errors_are_not_retried);
+    RUN_TEST(test_retry_after_is_honoured);
+    RUN_TEST(test_timeouts_follow_the_server);
+    RUN_TEST(test_circuit_breaker);
+    RUN_TEST(test_backoff_is_jittered_and_capped);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+// Content types for static files by extension: the hashed lookup against the
+// whole table, and what it saves over the scan it replaced on a realistic mix
+// of paths.
+#include <Arduino.h>
+#include <detail/mimetable.h>
+#include <unity.h>
+#include <chrono>
+#include <string.h>
+
+using namespace mime;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static const char *lookup(const char *path)
+{
+    return getContentType(path, strlen(path));
+}
+
+// The lookup StaticRequestHandler used before: every suffix copied out of
+// the table and compared, the result copied into a new String
+static String scanContentType(const String &path)
+{
+    char buff[sizeof(mimeTable[0].mimeType)];
+    for (size_t i = 0; i < sizeof(mimeTable) / sizeof(mimeTable[0]) - 1; i++)
+    {
+        strcpy_P(buff, mimeTable[i].endsWith);
+        if (path.endsWith(buff))
+        {
+            strcpy_P(buff, mimeTable[i].mimeType);
+            return String(buff);
+        }
+    }
+    strcpy_P(buff, mimeTable[sizeof(mimeTable) / sizeof(mimeTable[0]) - 1].mimeType);
+    return String(buff);
+}
+
+static void test_every_extension_is_found(void)
+{
+    for (int i = 0; i < none; i++)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/static/file%s", mimeTable[i].endsWith);
+        TEST_ASSERT_TRUE(lookup(path) == mimeTable[i].mimeType);
+        for (char *c = path; *c; c++)
+            *c = toupper(*c);
+        TEST_ASSERT_TRUE(lookup(path) == mimeTable[i].mimeType);
+    }
+}
+
+// Extensions that share a slot or a prefix with a known one, and paths with
+// no extension to speak of
+static void test_unknown_extensions_are_octet_stream(void)
+{
+    const char *paths[] = {"/", "/update", "/a.", "/.", "/dir.js/file", "/app.jsx", "/page.htmlx", "/x.j",
+                           "/font.woff3", "/backup.tar", "/a.appcachex", "/a.verylongextension"};
+    for (const char *path : paths)
+        TEST_ASSERT_EQUAL_STRING("application/octet-stream", lookup(path));
+    TEST_ASSERT_EQUAL_STRING("application/x-gzip", lookup("/logs/archive.tar.gz"));
+    TEST_ASSERT_EQUAL_STRING("application/javascript", lookup("/v1.2/app.min.js"));
+    TEST_ASSERT_EQUAL_STRING("text/html", lookup("/.html"));
+}
+
+// What a browser asks a device's web UI for on a page load
+static const char *const pathMix[] = {
+    "/index.html",         "/css/style.css",   "/js/app.js",         "/js/vendor.min.js", "/favicon.ico",
+    "/img/logo.png",       "/img/bg.jpg",      "/img/icons.svg",     "/api/status.json",  "/fonts/roboto.woff2",
+    "/fonts/roboto.woff",  "/manifest.json",   "/settings.htm",      "/update",           "/docs/manual.pdf",
+    "/logs/today.txt",     "/app.appcache",    "/js/chart.js",       "/css/theme.css",    "/img/spinner.gif",
+};
+
+static void test_lookup_speed(void)
+{
+    const size_t count = sizeof(pathMix) / sizeof(pathMix[0]);
+    String paths[count];
+    for (size_t i = 0; i < count; i++)
+    {
+        paths[i] = pathMix[i];
+        TEST_ASSERT_EQUAL_STRING(scanContentType(paths[i]).c_str(), getContentType(paths[i].c_str(), paths[i].length()));
+    }
+
+    const int rounds = 20000;
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < count; i++)
+            sink += scanContentType(paths[i]).length();
+    double scan = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < count; i++)
+            sink += strlen(getContentType(paths[i].c_str(), paths[i].length()));
+    double hashed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double lookups = (double)rounds * count;
+    char message[128];
+    snprintf(message, sizeof(message), "scan %.0f ns, hashed %.1f ns per lookup (%.0fx), checksum %zu",
+             scan / lookups * 1e9, hashed / lookups * 1e9, scan / hashed, sink);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(hashed < scan);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_extension_is_found);
+    RUN_TEST(test_unknown_extensions_are_octet_stream);
+    RUN_TEST(test_lookup_speed);
+    return UNITY_END();
+}
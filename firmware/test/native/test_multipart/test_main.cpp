@@ -0,0 +1,160 @@
+// Multipart uploads through WebServer over loopback: the file arrives byte
+// exact in whole-sector callbacks, and how fast.
+#include <WebServer.h>
+#include <unity.h>
+#include "host.h"
+#include <chrono>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
+
+#define BOUNDARY "----hostboundary7MA4YWxkTrZu0gW"
+
+static uint16_t port;
+static WebServer *server;
+static HostPoller poller;
+
+static std::string received;
+static std::vector<size_t> writes;
+static String fieldValue;
+static int finished;
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new WebServer(port);
+    received.clear();
+    writes.clear();
+    fieldValue = String();
+    finished = 0;
+    server->on(
+        "/upload", HTTP_POST,
+        []() {
+            fieldValue = server->arg("note");
+            server->send(200, "text/plain", "ok");
+        },
+        []() {
+            HTTPUpload &upload = server->upload();
+            if (upload.status == UPLOAD_FILE_START)
+            {
+                received.clear();
+            }
+            else if (upload.status == UPLOAD_FILE_WRITE)
+            {
+                received.append((const char *)upload.buf, upload.currentSize);
+                writes.push_back(upload.currentSize);
+            }
+            else if (upload.status == UPLOAD_FILE_END)
+            {
+                finished++;
+            }
+        });
+    server->begin();
+    poller.start([]() { server->handleClient(); });
+}
+
+void tearDown(void)
+{
+    poller.stop();
+    delete server;
+    server = NULL;
+}
+
+// Bytes that trip a naive scan: CRs, LFs, dashes and near misses of the
+// delimiter, which itself never occurs in a valid body
+static std::string awkwardFile(size_t size)
+{
+    static const char *traps[] = {"\r", "\r\n", "\r\n-", "\r\n--", "\r\n----hostboundary7MA4YWxkTrZu0g!", "\r\n--ab", "\r\r\n--"};
+    std::string file;
+    uint32_t x = 12345;
+    while (file.size() < size)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if (x % 61 == 0)
+            file += traps[x % 7];
+        else
+            file += (char)x;
+    }
+    file.resize(size);
+    return file;
+}
+
+// Posts one file and one field, returns the status line of the response
+static std::string upload(const std::string &file, size_t writeSize)
+{
+    std::string body = "--" BOUNDARY "\r\nContent-Disposition: form-data; name=\"note\"\r\n\r\nhello there\r\n"
+                       "--" BOUNDARY "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"data.bin\"\r\n"
+                       "Content-Type: application/octet-stream\r\n\r\n" +
+                       file + "\r\n--" BOUNDARY "--\r\n";
+    std::string head = "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n"
+                       "Content-Type: multipart/form-data; boundary=" BOUNDARY "\r\n"
+                       "Content-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n";
+    int fd = hostConnect(port);
+    if (fd < 0)
+        return std::string();
+    hostWriteAll(fd, head.data(), head.size());
+    for (size_t pos = 0; pos < body.size(); pos += writeSize)
+        hostWriteAll(fd, body.data() + pos, std::min(writeSize, body.size() - pos));
+    std::string response = hostReadAll(fd, 10000);
+    close(fd);
+    return response.substr(0, response.find("\r\n"));
+}
+
+static void test_upload_is_byte_exact(void)
+{
+    std::string file = awkwardFile(300000);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", upload(file, 65536).c_str());
+    poller.stop();
+    TEST_ASSERT_EQUAL(1, finished);
+    TEST_ASSERT_EQUAL(file.size(), received.size());
+    TEST_ASSERT_TRUE(file == received);
+    TEST_ASSERT_EQUAL_STRING("hello there", fieldValue.c_str());
+}
+
+// A delimiter split across reads must not leak into the data
+static void test_upload_survives_small_reads(void)
+{
+    std::string file = awkwardFile(20000);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", upload(file, 7).c_str());
+    poller.stop();
+    TEST_ASSERT_TRUE(file == received);
+}
+
+static void test_upload_writes_whole_sectors(void)
+{
+    std::string file = awkwardFile(10 * HTTP_UPLOAD_BUFLEN + 100);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", upload(file, 1000).c_str());
+    poller.stop();
+    TEST_ASSERT_EQUAL(11, writes.size());
+    for (size_t i = 0; i + 1 < writes.size(); i++)
+        TEST_ASSERT_EQUAL(HTTP_UPLOAD_BUFLEN, writes[i]);
+    TEST_ASSERT_EQUAL(100, writes.back());
+    TEST_ASSERT_EQUAL(0, HTTP_UPLOAD_BUFLEN % 512);
+}
+
+static void test_upload_throughput(void)
+{
+    std::string file = awkwardFile(16 * 1024 * 1024);
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", upload(file, 65536).c_str());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    poller.stop();
+    TEST_ASSERT_TRUE(file == received);
+    char message[64];
+    snprintf(message, sizeof(message), "16 MB upload at %.1f MB/s", 16 / seconds);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_upload_is_byte_exact);
+    RUN_TEST(test_upload_survives_small_reads);
+    RUN_TEST(test_upload_writes_whole_sectors);
+    RUN_TEST(test_upload_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// Heap use of WebServer under a steady stream of requests over loopback:
+// what the server thread allocates per request, its high-water mark, and
+// that neither grows with the number of requests served.
+#include <WebServer.h>
+#include <unity.h>
+#include "host.h"
+#include <atomic>
+#include <chrono>
+#include <malloc.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define WARMUP_REQUESTS 50
+#define LOAD_REQUESTS 1000
+
+// Every allocation of the thread running handleClient() is counted, glibc
+// does the actual work
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static thread_local bool serverThread;
+static std::atomic<long> heapLive;
+static std::atomic<long> heapPeak;
+static std::atomic<unsigned long> heapAllocs;
+
+static void heapTake(void *ptr)
+{
+    if (!serverThread || !ptr)
+        return;
+    heapAllocs++;
+    long live = heapLive += malloc_usable_size(ptr);
+    long peak = heapPeak;
+    while (live > peak && !heapPeak.compare_exchange_weak(peak, live))
+        ;
+}
+
+static void heapGive(void *ptr)
+{
+    if (serverThread && ptr)
+        heapLive -= malloc_usable_size(ptr);
+}
+
+extern "C" void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    heapTake(ptr);
+    return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    heapTake(ptr);
+    return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    heapGive(ptr);
+    void *moved = __libc_realloc(ptr, size);
+    heapTake(moved ? moved : ptr);
+    return moved;
+}
+
+extern "C" void free(void *ptr)
+{
+    heapGive(ptr);
+    __libc_free(ptr);
+}
+
+static uint16_t port;
+static WebServer *server;
+static HostPoller poller;
+static size_t plainLength;
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new WebServer(port);
+    const char *headers[] = {"X-Token"};
+    server->collectHeaders(headers, 1);
+    server->on("/args", []() {
+        char reply[64];
+        snprintf(reply, sizeof(reply), "%d %s %s", server->args(), server->arg("name").c_str(),
+                 server->header("X-Token").c_str());
+        server->send(200, "text/plain", reply);
+    });
+    server->on("/form", HTTP_POST, []() { server->send(200, "text/plain", server->arg("note")); });
+    server->on("/plain", HTTP_POST, []() {
+        plainLength = server->arg("plain").length();
+        server->send(200, "text/plain", "ok");
+    });
+    server->begin();
+    poller.start([]() {
+        serverThread = true;
+        server->handleClient();
+    });
+}
+
+void tearDown(void)
+{
+    poller.stop();
+    delete server;
+    server = NULL;
+}
+
+static std::string statusLine(int fd)
+{
+    std::string response = hostReadResponse(fd, 5000);
+    close(fd);
+    return response.substr(0, response.find("\r\n"));
+}
+
+static std::string request(const std::string &head, const std::string &body = std::string())
+{
+    int fd = hostConnect(port);
+    if (fd < 0)
+        return std::string();
+    hostWriteAll(fd, head.data(), head.size());
+    hostWriteAll(fd, body.data(), body.size());
+    return statusLine(fd);
+}
+
+static std::string post(const char *path, const char *type, const std::string &body)
+{
+    return request(std::string("POST ") + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n"
+                                                 "Content-Type: " + type + "\r\nContent-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n",
+                   body);
+}
+
+// The mix a device sees: a query string, a kept header and a form post
+static void serve(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        std::string status;
+        if (i % 2 == 0)
+            status = request("GET /args?name=sensor%20" + std::to_string(i) +
+                             "&unit=C&mode=avg HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                             "User-Agent: load/1.0\r\nX-Token: abc123\r\nConnection: close\r\n\r\n");
+        else
+            status = post("/form", "application/x-www-form-urlencoded", "note=hello+there&n=" + std::to_string(i));
+        TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", status.c_str());
+    }
+    // the last client's close is seen on the next poll
+    usleep(50 * 1000);
+}
+
+static void resetPeak(void)
+{
+    heapPeak = heapLive.load();
+    heapAllocs = 0;
+}
+
+// Neither what stays allocated nor the high-water mark depends on how many
+// requests went through
+static void test_heap_does_not_grow_under_load(void)
+{
+    serve(WARMUP_REQUESTS);
+    long idle = heapLive;
+    resetPeak();
+    serve(WARMUP_REQUESTS);
+    long firstPeak = heapPeak;
+
+    resetPeak();
+    auto start = std::chrono::steady_clock::now();
+    serve(LOAD_REQUESTS);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long peak = heapPeak;
+    unsigned long allocs = heapAllocs;
+
+    TEST_ASSERT_EQUAL(idle, heapLive.load());
+    TEST_ASSERT_EQUAL(firstPeak, peak);
+    TEST_ASSERT_LESS_OR_EQUAL(WEBSERVER_ARENA_SIZE, server->arenaHighWater());
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%d requests at %.0f/s: heap high water %ld bytes over idle, %.1f allocations per request, "
+             "arena high water %zu of %d bytes",
+             LOAD_REQUESTS, LOAD_REQUESTS / seconds, peak - idle, (double)allocs / LOAD_REQUESTS,
+             server->arenaHighWater(), WEBSERVER_ARENA_SIZE);
+    TEST_MESSAGE(message);
+}
+
+// A plain body past the arena takes a heap buffer for its request only
+static void test_large_body_is_given_back(void)
+{
+    serve(WARMUP_REQUESTS);
+    long idle = heapLive;
+    resetPeak();
+    std::string body(10 * 1024, 'x');
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", post("/plain", "text/plain", body).c_str());
+    usleep(50 * 1000);
+    TEST_ASSERT_EQUAL(body.size(), plainLength);
+    TEST_ASSERT_GREATER_OR_EQUAL(idle + (long)body.size(), heapPeak.load());
+    TEST_ASSERT_EQUAL(idle, heapLive.load());
+
+    std::string tooLarge(WEBSERVER_MAX_BODY_SIZE + 1, 'x');
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 413 Request Entity Too Large", post("/plain", "text/plain", tooLarge).c_str());
+    usleep(50 * 1000);
+    TEST_ASSERT_EQUAL(idle, heapLive.load());
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_heap_does_not_grow_under_load);
+    RUN_TEST(test_large_body_is_given_back);
+    return UNITY_END();
+}
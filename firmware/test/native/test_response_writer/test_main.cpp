@@ -0,0 +1,183 @@
+// Response writing in WebServer over loopback: headers, chunk framing and
+// small payloads leave in segment sized send() calls.
+#include <WebServer.h>
+#include <unity.h>
+#include "host.h"
+#include <chrono>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+static uint16_t port;
+static WebServer *server;
+static HostPoller poller;
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new WebServer(port);
+    server->on("/small", []() { server->send(200, "text/plain", "hello"); });
+    server->on("/lines", []() {
+        server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server->send(200, "text/plain", "");
+        for (int i = 0; i < 200; i++)
+            server->sendContent(String("line ") + i + "\n");
+    });
+    server->on("/large", []() {
+        String body;
+        for (int i = 0; i < 64 * 1024; i++)
+            body += (char)('a' + i % 26);
+        server->send(200, "text/plain", body);
+    });
+    server->on("/flush", []() {
+        server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server->send(200, "text/plain", "");
+        server->sendContent("first");
+        server->flush();
+        delay(500);
+        server->sendContent("second");
+    });
+    server->begin();
+    poller.start([]() { server->handleClient(); });
+}
+
+void tearDown(void)
+{
+    poller.stop();
+    delete server;
+    server = NULL;
+}
+
+static std::string get(const char *path)
+{
+    int fd = hostConnect(port);
+    if (fd < 0)
+        return std::string();
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    hostWriteAll(fd, request.data(), request.size());
+    std::string response = hostReadResponse(fd, 5000);
+    close(fd);
+    return response;
+}
+
+static std::string body(const std::string &response)
+{
+    size_t end = response.find("\r\n\r\n");
+    return end == std::string::npos ? std::string() : response.substr(end + 4);
+}
+
+// Undoes chunked framing, empty if the framing is broken
+static std::string dechunk(const std::string &framed)
+{
+    std::string out;
+    size_t pos = 0;
+    for (;;)
+    {
+        size_t eol = framed.find("\r\n", pos);
+        if (eol == std::string::npos)
+            return std::string();
+        size_t size = strtoul(framed.c_str() + pos, NULL, 16);
+        pos = eol + 2;
+        if (size == 0)
+            return framed.compare(pos, 2, "\r\n") == 0 ? out : std::string();
+        if (framed.compare(pos + size, 2, "\r\n") != 0)
+            return std::string();
+        out.append(framed, pos, size);
+        pos += size + 2;
+    }
+}
+
+static void test_small_response_is_one_send(void)
+{
+    hostResetSendCalls();
+    std::string response = get("/small");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_EQUAL_STRING("hello", body(response).c_str());
+    TEST_ASSERT_EQUAL(1, hostSendCalls());
+}
+
+static void test_chunks_are_coalesced(void)
+{
+    hostResetSendCalls();
+    std::string response = get("/lines");
+    std::string expected;
+    for (int i = 0; i < 200; i++)
+        expected += "line " + std::to_string(i) + "\n";
+    TEST_ASSERT_TRUE(dechunk(body(response)) == expected);
+    // three writes a chunk used to make 600 sends
+    TEST_ASSERT_LESS_OR_EQUAL(response.size() / HTTP_OUTPUT_BUFLEN + 1, hostSendCalls());
+}
+
+static void test_large_body_is_intact(void)
+{
+    std::string response = get("/large");
+    std::string content = body(response);
+    TEST_ASSERT_EQUAL(64 * 1024, content.size());
+    for (size_t i = 0; i < content.size(); i++)
+    {
+        if (content[i] != (char)('a' + i % 26))
+            TEST_FAIL_MESSAGE("body differs");
+    }
+}
+
+// flush() hands over what is buffered while the handler is still running
+static void test_flush_sends_early(void)
+{
+    int fd = hostConnect(port);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    const char request[] = "GET /flush HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    hostWriteAll(fd, request, strlen(request));
+    std::string response;
+    char buf[1024];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (response.find("first") == std::string::npos && poll(&pfd, 1, 250) > 0)
+    {
+        ssize_t res = read(fd, buf, sizeof(buf));
+        if (res <= 0)
+            break;
+        response.append(buf, res);
+    }
+    TEST_ASSERT_TRUE(response.find("first") != std::string::npos);
+    TEST_ASSERT_TRUE(response.find("second") == std::string::npos);
+    while (dechunk(body(response)).empty() && poll(&pfd, 1, 2000) > 0)
+    {
+        ssize_t res = read(fd, buf, sizeof(buf));
+        if (res <= 0)
+            break;
+        response.append(buf, res);
+    }
+    close(fd);
+    TEST_ASSERT_EQUAL_STRING("firstsecond", dechunk(body(response)).c_str());
+}
+
+static void test_syscalls_and_latency(void)
+{
+    const int responses = 10;
+    double seconds = 0;
+    hostResetSendCalls();
+    for (int i = 0; i < responses; i++)
+    {
+        // the server notices a closed connection half a second after accepting it
+        delay(600);
+        auto start = std::chrono::steady_clock::now();
+        if (dechunk(body(get("/lines"))).empty())
+            TEST_FAIL_MESSAGE("no body");
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "200 chunked lines: %.1f send() and %.0f us per response",
+             (double)hostSendCalls() / responses, seconds * 1e6 / responses);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_small_response_is_one_send);
+    RUN_TEST(test_chunks_are_coalesced);
+    RUN_TEST(test_large_body_is_intact);
+    RUN_TEST(test_flush_sends_early);
+    RUN_TEST(test_syscalls_and_latency);
+    return UNITY_END();
+}
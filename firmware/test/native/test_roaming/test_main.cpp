@@ -0,0 +1,159 @@
+// WiFiMulti roaming on the simulated radio, minutes of walking around in
+// virtual time
+#include <WiFiMulti.h>
+#include <unity.h>
+#include "host.h"
+
+static const uint8_t bssidA[6] = {0x02, 0, 0, 0, 0, 0x0a};
+static const uint8_t bssidB[6] = {0x02, 0, 0, 0, 0, 0x0b};
+
+struct Drive
+{
+    unsigned long down = 0;      // ms without a link
+    unsigned long maxOutage = 0; // longest of those
+    int roams = 0;               // moves from one access point to another
+};
+
+void setUp(void)
+{
+    hostVirtualClock(true);
+    hostRadioReset();
+}
+
+void tearDown(void)
+{
+    hostVirtualClock(false);
+}
+
+// From a to b dBm between the times from and to (ms)
+static int fade(unsigned long t, unsigned long from, unsigned long to, int a, int b)
+{
+    if (t <= from)
+        return a;
+    if (t >= to)
+        return b;
+    return a + (int)((long)(b - a) * (long)(t - from) / (long)(to - from));
+}
+
+// Calls run() every step ms, the way a sketch's loop() would
+static Drive drive(WiFiMulti &multi, unsigned long until, unsigned long step = 100)
+{
+    Drive d;
+    int last = hostRadioAssociated();
+    bool out = false;
+    unsigned long outSince = 0;
+    while ((long)(millis() - until) < 0)
+    {
+        unsigned long before = millis();
+        multi.run(3000);
+        int now = hostRadioAssociated();
+        if (now < 0 && !out)
+        {
+            out = true;
+            outSince = before;
+        }
+        if (now >= 0 && out)
+        {
+            out = false;
+            d.down += millis() - outSince;
+            d.maxOutage = max(d.maxOutage, millis() - outSince);
+        }
+        if (now >= 0 && now != last)
+        {
+            if (last >= 0)
+                d.roams++;
+            last = now;
+        }
+        hostAdvance(step);
+    }
+    return d;
+}
+
+static void test_walking_from_one_access_point_to_the_next(void)
+{
+    unsigned long start = millis();
+    hostRadioAdd("home", bssidA, 1, [start](unsigned long t) { return fade(t - start, 10000, 130000, -50, -95); });
+    size_t b = hostRadioAdd("home", bssidB, 11, [start](unsigned long t) { return fade(t - start, 10000, 130000, -95, -50); });
+    WiFiMulti multi;
+    multi.addAP("home", "secret");
+    Drive d = drive(multi, start + 160000);
+
+    const HostRadioCounters &counters = hostRadioCounters();
+    TEST_ASSERT_EQUAL(b, hostRadioAssociated());
+    TEST_ASSERT_EQUAL(1, d.roams);
+    TEST_ASSERT_EQUAL(2, counters.connects);
+    // The handover happens before the old link breaks
+    TEST_ASSERT_EQUAL(0, d.down);
+    // One full scan to start with, the rest only look at known channels
+    TEST_ASSERT_GREATER_OR_EQUAL(1, counters.partialScans);
+    TEST_ASSERT_LESS_OR_EQUAL(2, counters.scans - counters.partialScans);
+    char message[128];
+    snprintf(message, sizeof(message), "walk: %u scans (%u partial), %u connects, %u RSSI reads in %lu s",
+             counters.scans, counters.partialScans, counters.connects, counters.rssiReads, (millis() - start) / 1000);
+    TEST_MESSAGE(message);
+}
+
+static void test_close_access_points_do_not_flap(void)
+{
+    hostRadioAdd("home", bssidA, 1, [](unsigned long t) { return -76 + (int)((t / 700) % 7) - 3; });
+    hostRadioAdd("home", bssidB, 6, [](unsigned long t) { return -74 + (int)((t / 900) % 7) - 3; });
+    WiFiMulti multi;
+    multi.addAP("home", "secret");
+    Drive d = drive(multi, millis() + 600000);
+
+    TEST_ASSERT_EQUAL(0, d.roams);
+    TEST_ASSERT_EQUAL(1, hostRadioCounters().connects);
+    TEST_ASSERT_EQUAL(0, d.down);
+}
+
+static void test_failover_without_a_scan(void)
+{
+    hostRadioAdd("home", bssidA, 1, [](unsigned long) { return -74; });
+    hostRadioAdd("home", bssidB, 6, [](unsigned long) { return -70; });
+    WiFiMulti multi;
+    multi.addAP("home", "secret");
+    drive(multi, millis() + 60000);
+    int first = hostRadioAssociated();
+    TEST_ASSERT_GREATER_OR_EQUAL(0, first);
+
+    hostRadioAccessPoint(first).on = false;
+    unsigned scans = hostRadioCounters().scans;
+    unsigned long off = millis();
+    while (hostRadioAssociated() < 0 || hostRadioAssociated() == first)
+    {
+        TEST_ASSERT_LESS_THAN(off + 10000, millis());
+        multi.run(3000);
+        if (hostRadioAssociated() < 0)
+            hostAdvance(100);
+    }
+
+    TEST_ASSERT_EQUAL(1 - first, hostRadioAssociated());
+    TEST_ASSERT_EQUAL(scans, hostRadioCounters().scans);
+    // Noticed on the next run() and joined right away
+    TEST_ASSERT_LESS_OR_EQUAL(HOST_ASSOCIATE_MS + 200, millis() - off);
+}
+
+static void test_refusing_access_point_is_backed_off(void)
+{
+    size_t office = hostRadioAdd("office", bssidA, 1, [](unsigned long) { return -40; });
+    size_t home = hostRadioAdd("home", bssidB, 6, [](unsigned long) { return -60; });
+    hostRadioAccessPoint(office).accepts = false;
+    WiFiMulti multi;
+    multi.addAP("office", "secret");
+    multi.addAP("home", "secret");
+    drive(multi, millis() + 120000);
+
+    TEST_ASSERT_EQUAL(home, hostRadioAssociated());
+    // The strongest is tried once, not on every run()
+    TEST_ASSERT_LESS_OR_EQUAL(3, hostRadioCounters().connects);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_walking_from_one_access_point_to_the_next);
+    RUN_TEST(test_close_access_points_do_not_flap);
+    RUN_TEST(test_failover_without_a_scan);
+    RUN_TEST(test_refusing_access_point_is_backed_off);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+// Clients that hold WebServer's only slot: each phase of a request has its
+// own deadline, and a client over its rate is turned away before it is read.
+#include <WebServer.h>
+#include <unity.h>
+#include "host.h"
+#include <chrono>
+#include <signal.h>
+#include <thread>
+#include <unistd.h>
+
+#define BOUNDARY "----hostboundary7MA4YWxkTrZu0gW"
+#define SLACK_MS 700 // loopback, polling and scheduling on top of a deadline
+
+static uint16_t port;
+static WebServer *server;
+static HostPoller poller;
+static int uploadsFinished;
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new WebServer(port);
+    uploadsFinished = 0;
+    server->on("/", []() { server->send(200, "text/plain", "ok"); });
+    server->on(
+        "/upload", HTTP_POST, []() { server->send(200, "text/plain", "ok"); },
+        []() {
+            if (server->upload().status == UPLOAD_FILE_END)
+                uploadsFinished++;
+        });
+}
+
+void tearDown(void)
+{
+    poller.stop();
+    delete server;
+    server = NULL;
+}
+
+static void startServer(void)
+{
+    server->begin();
+    poller.start([]() { server->handleClient(); });
+}
+
+static unsigned long since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Sends data a byte every interval_ms until it is all out or the server
+// closed on us, returns how long the connection lasted after the first byte
+static unsigned long trickle(int fd, const std::string &data, unsigned long interval_ms)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::thread reader([fd]() { hostReadAll(fd, 30000); });
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        if (write(fd, data.data() + i, 1) != 1)
+            break;
+        usleep(interval_ms * 1000);
+    }
+    reader.join();
+    return since(start);
+}
+
+static std::string get(void)
+{
+    int fd = hostConnect(port);
+    const char request[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    hostWriteAll(fd, request, sizeof(request) - 1);
+    std::string response = hostReadResponse(fd, 5000);
+    close(fd);
+    return response;
+}
+
+static std::string statusLine(const std::string &response)
+{
+    return response.substr(0, response.find("\r\n"));
+}
+
+// A connection that never says anything is dropped after the first byte wait
+static void test_silent_client_is_dropped(void)
+{
+    startServer();
+    auto start = std::chrono::steady_clock::now();
+    int fd = hostConnect(port);
+    std::string response = hostReadAll(fd, 10000);
+    unsigned long held = since(start);
+    close(fd);
+    TEST_ASSERT_EQUAL_STRING("", response.c_str());
+    TEST_ASSERT_GREATER_OR_EQUAL(HTTP_MAX_FIRST_BYTE_WAIT, held);
+    TEST_ASSERT_LESS_THAN(HTTP_MAX_FIRST_BYTE_WAIT + SLACK_MS, held);
+    // and the slot is free again
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", statusLine(get()).c_str());
+}
+
+// Headers sent a byte at a time cannot outlast the header deadline, however
+// steadily they come
+static void test_trickled_header_is_cut_off(void)
+{
+    startServer();
+    int fd = hostConnect(port);
+    std::string request = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nX-Slow: ";
+    request.append(200, 'a');
+    request += "\r\n\r\n";
+    unsigned long held = trickle(fd, request, 50);
+    close(fd);
+    TEST_ASSERT_LESS_THAN(HTTP_MAX_HEADER_WAIT + SLACK_MS, held);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", statusLine(get()).c_str());
+}
+
+// A multipart body gets HTTP_MAX_POST_WAIT plus its length at
+// HTTP_MIN_UPLOAD_RATE, not a fresh timeout per byte
+static void test_trickled_upload_is_cut_off(void)
+{
+    startServer();
+    std::string body = "--" BOUNDARY "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"a.bin\"\r\n"
+                       "Content-Type: application/octet-stream\r\n\r\n";
+    body.append(500, 'b');
+    body += "\r\n--" BOUNDARY "--\r\n";
+    std::string head = "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                       "Content-Type: multipart/form-data; boundary=" BOUNDARY "\r\n"
+                       "Content-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n";
+    int fd = hostConnect(port);
+    hostWriteAll(fd, head.data(), head.size());
+    unsigned long held = trickle(fd, body, 20);
+    close(fd);
+    // the whole body would take over 13 s at this pace
+    TEST_ASSERT_LESS_THAN(HTTP_MAX_POST_WAIT + SLACK_MS, held);
+    TEST_ASSERT_EQUAL(0, uploadsFinished);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", statusLine(get()).c_str());
+}
+
+// Past its burst an address is answered 503 with Retry-After straight away,
+// and served again once it earned a request back
+static void test_rate_limited_address_is_rejected(void)
+{
+    server->enableRateLimit();
+    startServer();
+    for (int i = 0; i < WEBSERVER_RATE_BURST; i++)
+        TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", statusLine(get()).c_str());
+    auto start = std::chrono::steady_clock::now();
+    std::string rejected = get();
+    unsigned long took = since(start);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 503 Service Unavailable", statusLine(rejected).c_str());
+    TEST_ASSERT_TRUE(rejected.find("\r\nRetry-After: 1\r\n") != std::string::npos);
+    TEST_ASSERT_LESS_THAN(WEBSERVER_RATE_REFILL, took);
+    usleep((WEBSERVER_RATE_REFILL + 50) * 1000);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK", statusLine(get()).c_str());
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_silent_client_is_dropped);
+    RUN_TEST(test_trickled_header_is_cut_off);
+    RUN_TEST(test_trickled_upload_is_cut_off);
+    RUN_TEST(test_rate_limited_address_is_rejected);
+    return UNITY_END();
+}
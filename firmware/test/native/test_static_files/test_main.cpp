@@ -0,0 +1,155 @@
+// serveStatic() revalidation over loopback: ETag and Last-Modified on a 200,
+// a bare 304 for a matching If-None-Match or If-Modified-Since
+#include <WebServer.h>
+#include <Seeed_FS.h>
+#include <unity.h>
+#include "host.h"
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+static char root[] = "/tmp/static_files_XXXXXX";
+static uint16_t port;
+static WebServer *server;
+static fs::FS *files;
+static HostPoller poller;
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new WebServer(port);
+    server->serveStatic("/app.js", *files, "/app.js", "max-age=60");
+    server->begin();
+    poller.start([]() { server->handleClient(); });
+}
+
+void tearDown(void)
+{
+    poller.stop();
+    delete server;
+    server = NULL;
+}
+
+// Head of the response, and the body if it has a Content-Length
+static std::string get(const char *path, const std::string &headers = "")
+{
+    int fd = hostConnect(port);
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n" + headers + "Connection: close\r\n\r\n";
+    hostWriteAll(fd, request.data(), request.size());
+    std::string response;
+    char buf[1024];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    size_t end;
+    while ((end = response.find("\r\n\r\n")) == std::string::npos && poll(&pfd, 1, 2000) > 0)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        response.append(buf, n);
+    }
+    size_t at = response.find("\r\nContent-Length: ");
+    if (end != std::string::npos && at != std::string::npos && at < end)
+    {
+        size_t total = end + 4 + atoi(response.c_str() + at + 18);
+        while (response.size() < total && poll(&pfd, 1, 2000) > 0)
+        {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            response.append(buf, n);
+        }
+    }
+    close(fd);
+    return response;
+}
+
+static std::string header(const std::string &response, const char *name)
+{
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t at = response.find(key);
+    if (at == std::string::npos || at > response.find("\r\n\r\n"))
+        return std::string();
+    at += key.size();
+    return response.substr(at, response.find("\r\n", at) - at);
+}
+
+static bool has(const std::string &response, const char *name)
+{
+    size_t at = response.find(std::string("\r\n") + name + ":");
+    return at != std::string::npos && at < response.find("\r\n\r\n");
+}
+
+static void test_full_response_carries_validators(void)
+{
+    std::string response = get("/app.js");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_NOT_EQUAL(0, header(response, "ETag").size());
+    TEST_ASSERT_NOT_EQUAL(0, header(response, "Last-Modified").size());
+    TEST_ASSERT_EQUAL_STRING("max-age=60", header(response, "Cache-Control").c_str());
+    TEST_ASSERT_EQUAL_STRING("14", header(response, "Content-Length").c_str());
+    TEST_ASSERT_EQUAL(0, response.compare(response.size() - 14, 14, "console.log(1)"));
+}
+
+static void test_matching_etag_gets_a_bare_304(void)
+{
+    std::string etag = header(get("/app.js"), "ETag");
+    std::string response = get("/app.js", "If-None-Match: " + etag + "\r\n");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 304 "));
+    TEST_ASSERT_EQUAL_STRING(etag.c_str(), header(response, "ETag").c_str());
+    TEST_ASSERT_EQUAL_STRING("max-age=60", header(response, "Cache-Control").c_str());
+    TEST_ASSERT_FALSE(has(response, "Content-Length"));
+    TEST_ASSERT_FALSE(has(response, "Content-Type"));
+    TEST_ASSERT_FALSE(has(response, "Transfer-Encoding"));
+    TEST_ASSERT_EQUAL(response.size(), response.find("\r\n\r\n") + 4);
+
+    // One of several, and the wildcard
+    response = get("/app.js", "If-None-Match: \"other\", " + etag + "\r\n");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 304 "));
+    response = get("/app.js", "If-None-Match: *\r\n");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 304 "));
+}
+
+static void test_stale_etag_gets_the_file(void)
+{
+    std::string lastModified = header(get("/app.js"), "Last-Modified");
+    // If-None-Match wins over a matching If-Modified-Since
+    std::string response = get("/app.js", "If-None-Match: \"stale\"\r\nIf-Modified-Since: " + lastModified + "\r\n");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_EQUAL_STRING("14", header(response, "Content-Length").c_str());
+}
+
+static void test_matching_date_gets_a_bare_304(void)
+{
+    std::string lastModified = header(get("/app.js"), "Last-Modified");
+    std::string response = get("/app.js", "If-Modified-Since: " + lastModified + "\r\n");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 304 "));
+    TEST_ASSERT_FALSE(has(response, "Content-Length"));
+    TEST_ASSERT_FALSE(has(response, "Content-Type"));
+
+    response = get("/app.js", "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n");
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 200 OK\r\n"));
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    mkdtemp(root);
+    std::string path = std::string(root) + "/app.js";
+    FILE *f = fopen(path.c_str(), "w");
+    fputs("console.log(1)", f);
+    fclose(f);
+    fs::FS fs(root);
+    files = &fs;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_response_carries_validators);
+    RUN_TEST(test_matching_etag_gets_a_bare_304);
+    RUN_TEST(test_stale_etag_gets_the_file);
+    RUN_TEST(test_matching_date_gets_a_bare_304);
+    int failures = UNITY_END();
+    unlink(path.c_str());
+    rmdir(root);
+    return failures;
+}
@@ -0,0 +1,245 @@
+// WiFiClientSecure sessions parked by stop() and taken over by the next
+// connect(), against the TLS stand-in and a line server on loopback
+#include <WiFiClientSecure.h>
+#include <unity.h>
+#include "host.h"
+#include <atomic>
+#include <chrono>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+// Answers "ping" with "pong", "twice" with two of them and closes on "bye".
+// Every accepted connection is a full handshake on the board.
+class LineServer
+{
+public:
+    void start()
+    {
+        port = hostFreePort();
+        _listener = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_listener, (struct sockaddr *)&addr, sizeof(addr));
+        listen(_listener, 8);
+        accepted = 0;
+        _poller.start([this]() { serve(); });
+    }
+
+    void stop()
+    {
+        _poller.stop();
+        for (int fd : _clients)
+            close(fd);
+        _clients.clear();
+        close(_listener);
+    }
+
+    uint16_t port;
+    std::atomic<int> accepted;
+
+private:
+    void serve()
+    {
+        std::vector<struct pollfd> fds(1, {_listener, POLLIN, 0});
+        for (int fd : _clients)
+            fds.push_back({fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), 10) <= 0)
+            return;
+        if (fds[0].revents & POLLIN)
+        {
+            _clients.push_back(accept(_listener, NULL, NULL));
+            accepted++;
+        }
+        for (size_t i = 1; i < fds.size(); i++)
+        {
+            if (!fds[i].revents)
+                continue;
+            char line[64];
+            ssize_t length = recv(fds[i].fd, line, sizeof(line), 0);
+            std::string request(line, length > 0 ? length : 0);
+            if (length <= 0 || request == "bye\n")
+            {
+                close(fds[i].fd);
+                _clients.erase(std::find(_clients.begin(), _clients.end(), fds[i].fd));
+            }
+            else if (request == "twice\n")
+            {
+                hostWriteAll(fds[i].fd, "pong\npong\n", 10);
+            }
+            else
+            {
+                hostWriteAll(fds[i].fd, "pong\n", 5);
+            }
+        }
+    }
+
+    int _listener;
+    std::vector<int> _clients;
+    HostPoller _poller;
+};
+
+static LineServer server, other, third;
+
+void setUp(void)
+{
+    server.start();
+    hostResetTlsHandshakes();
+}
+
+void tearDown(void)
+{
+    hostVirtualClock(false);
+    WiFiClientSecure::clearSessionCache();
+    server.stop();
+}
+
+// Sends request and reads the first reply line
+static bool exchange(WiFiClientSecure &client, const char *request)
+{
+    client.write((const uint8_t *)request, strlen(request));
+    char reply[5];
+    size_t got = 0;
+    struct pollfd pfd = {client.fd(), POLLIN, 0};
+    while (got < sizeof(reply) && poll(&pfd, 1, 1000) > 0)
+    {
+        int res = client.read((uint8_t *)reply + got, sizeof(reply) - got);
+        if (res <= 0)
+            break;
+        got += res;
+    }
+    return got == sizeof(reply) && memcmp(reply, "pong\n", 5) == 0;
+}
+
+static bool call(uint16_t port, const char *request = "ping\n", bool reuse = true)
+{
+    WiFiClientSecure client;
+    client.setSessionReuse(reuse);
+    bool ok = client.connect("127.0.0.1", port) && exchange(client, request);
+    client.stop();
+    return ok;
+}
+
+static void test_repeat_calls_reuse_one_session(void)
+{
+    for (int i = 0; i < 10; i++)
+        TEST_ASSERT_TRUE(call(server.port));
+    TEST_ASSERT_EQUAL(1, hostTlsHandshakes());
+    TEST_ASSERT_EQUAL(1, server.accepted);
+
+    for (int i = 0; i < 3; i++)
+        TEST_ASSERT_TRUE(call(server.port, "ping\n", false));
+    TEST_ASSERT_EQUAL(4, hostTlsHandshakes());
+}
+
+static void test_unread_data_is_not_parked(void)
+{
+    TEST_ASSERT_TRUE(call(server.port, "twice\n"));
+    usleep(10000);
+    TEST_ASSERT_TRUE(call(server.port));
+    TEST_ASSERT_EQUAL(2, hostTlsHandshakes());
+}
+
+static void test_sessions_closed_meanwhile_are_replaced(void)
+{
+    hostVirtualClock(true);
+    // The server hangs up on "bye", a session it closed is never handed out again
+    TEST_ASSERT_FALSE(call(server.port, "bye\n"));
+    usleep(10000);
+    TEST_ASSERT_TRUE(call(server.port));
+    TEST_ASSERT_EQUAL(2, hostTlsHandshakes());
+
+    TEST_ASSERT_TRUE(call(server.port));
+    hostAdvance(WIFI_CLIENT_SECURE_SESSION_IDLE + 1);
+    TEST_ASSERT_TRUE(call(server.port));
+    TEST_ASSERT_EQUAL(3, hostTlsHandshakes());
+}
+
+// A handshake that fails its pin while the client still holds an earlier
+// connection must not be parked under the earlier host
+static void test_failed_connect_parks_nothing(void)
+{
+    static const WiFiClientSecurePin pins[] = {{"localhost", "00"}};
+    other.start();
+    {
+        WiFiClientSecure client;
+        TEST_ASSERT_TRUE(client.connect("127.0.0.1", server.port));
+        TEST_ASSERT_TRUE(exchange(client, "ping\n"));
+        client.setPins(pins, 1);
+        TEST_ASSERT_FALSE(client.connect("localhost", other.port));
+    }
+    TEST_ASSERT_EQUAL(2, hostTlsHandshakes());
+    {
+        WiFiClientSecure client;
+        client.setPins(pins, 1);
+        TEST_ASSERT_TRUE(client.connect("127.0.0.1", server.port));
+        TEST_ASSERT_TRUE(exchange(client, "ping\n"));
+    }
+    TEST_ASSERT_EQUAL(3, hostTlsHandshakes());
+    other.stop();
+}
+
+static void test_cache_keeps_the_newest_hosts(void)
+{
+    other.start();
+    third.start();
+    TEST_ASSERT_TRUE(call(server.port));
+    TEST_ASSERT_TRUE(call(other.port));
+    TEST_ASSERT_TRUE(call(third.port)); // takes the place of the first
+    TEST_ASSERT_EQUAL(3, hostTlsHandshakes());
+    TEST_ASSERT_TRUE(call(other.port));
+    TEST_ASSERT_TRUE(call(third.port));
+    TEST_ASSERT_EQUAL(3, hostTlsHandshakes());
+    TEST_ASSERT_TRUE(call(server.port));
+    TEST_ASSERT_EQUAL(4, hostTlsHandshakes());
+
+    WiFiClientSecure::clearSessionCache();
+    TEST_ASSERT_TRUE(call(third.port));
+    TEST_ASSERT_EQUAL(5, hostTlsHandshakes());
+    other.stop();
+    third.stop();
+}
+
+static double callMicros(int calls, bool reuse)
+{
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++)
+        TEST_ASSERT_TRUE(call(server.port, "ping\n", reuse));
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count() / calls;
+}
+
+static void test_handshakes_and_timing(void)
+{
+    const int calls = 200;
+    double full = callMicros(calls, false);
+    unsigned long fullHandshakes = hostTlsHandshakes();
+    hostResetTlsHandshakes();
+    double reused = callMicros(calls, true);
+    TEST_ASSERT_EQUAL(calls, fullHandshakes);
+    TEST_ASSERT_EQUAL(1, hostTlsHandshakes());
+    char message[128];
+    snprintf(message, sizeof(message), "%d calls: %lu handshakes and %.0f us each without reuse, %lu and %.0f us with",
+             calls, fullHandshakes, full, hostTlsHandshakes(), reused);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_repeat_calls_reuse_one_session);
+    RUN_TEST(test_unread_data_is_not_parked);
+    RUN_TEST(test_sessions_closed_meanwhile_are_replaced);
+    RUN_TEST(test_failed_connect_parks_nothing);
+    RUN_TEST(test_cache_keeps_the_newest_hosts);
+    RUN_TEST(test_handshakes_and_timing);
+    return UNITY_END();
+}
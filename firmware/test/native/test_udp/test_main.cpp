@@ -0,0 +1,227 @@
+// WiFiUDP datagram and batch calls over loopback, against the Stream style ones
+#include <WiFiUdp.h>
+#include <unity.h>
+#include "host.h"
+#include <chrono>
+#include <string>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define BATCH 32
+
+static uint16_t port;
+static WiFiUDP *receiver;
+static WiFiUDP *sender;
+static const IPAddress loopback(127, 0, 0, 1);
+
+void setUp(void)
+{
+    port = hostFreePort();
+    receiver = new WiFiUDP();
+    sender = new WiFiUDP();
+    receiver->begin(port);
+    sender->begin(hostFreePort());
+}
+
+void tearDown(void)
+{
+    delete receiver;
+    delete sender;
+}
+
+static std::string pattern(size_t length, unsigned seed)
+{
+    std::string data(length, 0);
+    for (size_t i = 0; i < length; i++)
+        data[i] = (char)(i * 31 + seed);
+    return data;
+}
+
+// Loopback delivers at once, but give it a moment
+static int waitForPacket()
+{
+    int length = 0;
+    for (int i = 0; i < 100 && !(length = receiver->parsePacket()); i++)
+        delay(1);
+    return length;
+}
+
+static void test_stream_calls_round_trip(void)
+{
+    std::string data = pattern(1000, 1);
+    TEST_ASSERT_EQUAL(1, sender->beginPacket(loopback, port));
+    TEST_ASSERT_EQUAL(10, sender->write((const uint8_t *)data.data(), 10));
+    for (size_t i = 10; i < 20; i++)
+        sender->write((uint8_t)data[i]);
+    TEST_ASSERT_EQUAL(980, sender->write((const uint8_t *)data.data() + 20, 980));
+    TEST_ASSERT_EQUAL(1, sender->endPacket());
+
+    TEST_ASSERT_EQUAL(1000, waitForPacket());
+    TEST_ASSERT_EQUAL((uint8_t)data[0], receiver->peek());
+    TEST_ASSERT_EQUAL((uint8_t)data[0], receiver->read());
+    char buffer[WIFIUDP_MAX_DATAGRAM];
+    TEST_ASSERT_EQUAL(999, receiver->read(buffer, sizeof(buffer)));
+    TEST_ASSERT_TRUE(data.compare(1, 999, buffer, 999) == 0);
+    TEST_ASSERT_EQUAL(0, receiver->available());
+    TEST_ASSERT_TRUE(receiver->remoteIP() == loopback);
+    TEST_ASSERT_EQUAL(0, receiver->parsePacket());
+}
+
+// Answering the sender of the last packet with write() and endPacket() alone
+static void test_reply_without_begin_packet(void)
+{
+    TEST_ASSERT_EQUAL(1, sender->sendPacket((const uint8_t *)"ping", 4, loopback, port));
+    TEST_ASSERT_EQUAL(4, waitForPacket());
+    TEST_ASSERT_EQUAL(3, receiver->write((const uint8_t *)"ac", 2) + receiver->write('k'));
+    TEST_ASSERT_EQUAL(1, receiver->endPacket());
+
+    uint8_t buffer[16];
+    int length = 0;
+    for (int i = 0; i < 100 && !(length = sender->recvPacket(buffer, sizeof(buffer))); i++)
+        delay(1);
+    TEST_ASSERT_EQUAL(3, length);
+    TEST_ASSERT_EQUAL(0, memcmp(buffer, "ack", 3));
+}
+
+static void test_packet_calls(void)
+{
+    std::string data = pattern(600, 2);
+    TEST_ASSERT_EQUAL(1, sender->sendPacket((const uint8_t *)data.data(), data.size(), loopback, port));
+    TEST_ASSERT_EQUAL(1, sender->sendPacket((const uint8_t *)data.data(), data.size(), loopback, port));
+
+    uint8_t buffer[WIFIUDP_MAX_DATAGRAM];
+    int length = 0;
+    for (int i = 0; i < 100 && !(length = receiver->recvPacket(buffer, sizeof(buffer))); i++)
+        delay(1);
+    TEST_ASSERT_EQUAL(600, length);
+    TEST_ASSERT_TRUE(data.compare(0, 600, (const char *)buffer, 600) == 0);
+    TEST_ASSERT_TRUE(receiver->remoteIP() == loopback);
+    TEST_ASSERT_NOT_EQUAL(0, receiver->remotePort());
+
+    // A short buffer truncates the datagram, the rest is gone
+    TEST_ASSERT_EQUAL(100, receiver->recvPacket(buffer, 100));
+    TEST_ASSERT_TRUE(data.compare(0, 100, (const char *)buffer, 100) == 0);
+    TEST_ASSERT_EQUAL(0, receiver->recvPacket(buffer, sizeof(buffer)));
+}
+
+static void test_batches_keep_order(void)
+{
+    std::string payloads[BATCH];
+    UDPDatagram out[BATCH];
+    for (size_t i = 0; i < BATCH; i++)
+    {
+        payloads[i] = pattern(1 + i * 40, i);
+        out[i].data = (uint8_t *)&payloads[i][0];
+        out[i].length = payloads[i].size();
+        out[i].ip = loopback;
+        out[i].port = port;
+    }
+    TEST_ASSERT_EQUAL(BATCH, sender->sendBatch(out, BATCH));
+
+    static uint8_t buffers[8][WIFIUDP_MAX_DATAGRAM];
+    UDPDatagram in[8];
+    for (size_t i = 0; i < 8; i++)
+    {
+        in[i].data = buffers[i];
+        in[i].size = WIFIUDP_MAX_DATAGRAM;
+    }
+    size_t received = 0;
+    for (int tries = 0; tries < 100 && received < BATCH; tries++)
+    {
+        int n = receiver->recvBatch(in, 8);
+        TEST_ASSERT_LESS_OR_EQUAL(8, n);
+        for (int i = 0; i < n; i++)
+        {
+            TEST_ASSERT_EQUAL(payloads[received].size(), in[i].length);
+            TEST_ASSERT_TRUE(payloads[received].compare(0, in[i].length, (const char *)in[i].data, in[i].length) == 0);
+            TEST_ASSERT_TRUE(in[i].ip == loopback);
+            received++;
+        }
+        if (!n)
+            delay(1);
+    }
+    TEST_ASSERT_EQUAL(BATCH, received);
+    TEST_ASSERT_EQUAL(0, receiver->recvBatch(in, 8));
+}
+
+// Datagrams a second, BATCH sent and then drained at a time so the socket
+// buffer never drops any
+static double classicRate(const std::string &data, int rounds)
+{
+    char buffer[WIFIUDP_MAX_DATAGRAM];
+    long received = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < BATCH; i++)
+        {
+            sender->beginPacket(loopback, port);
+            sender->write((const uint8_t *)data.data(), data.size());
+            sender->endPacket();
+        }
+        while (receiver->parsePacket())
+        {
+            receiver->read(buffer, sizeof(buffer));
+            received++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    TEST_ASSERT_EQUAL((long)rounds * BATCH, received);
+    return received / seconds;
+}
+
+static double batchRate(const std::string &data, int rounds)
+{
+    static uint8_t buffers[BATCH][WIFIUDP_MAX_DATAGRAM];
+    UDPDatagram out[BATCH], in[BATCH];
+    for (size_t i = 0; i < BATCH; i++)
+    {
+        out[i].data = (uint8_t *)data.data();
+        out[i].length = data.size();
+        out[i].ip = loopback;
+        out[i].port = port;
+        in[i].data = buffers[i];
+        in[i].size = WIFIUDP_MAX_DATAGRAM;
+    }
+    long received = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        sender->sendBatch(out, BATCH);
+        received += receiver->recvBatch(in, BATCH);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    TEST_ASSERT_EQUAL((long)rounds * BATCH, received);
+    return received / seconds;
+}
+
+static void test_throughput(void)
+{
+    const int rounds = 2000;
+    std::string data = pattern(512, 3);
+    double classic = classicRate(data, rounds);
+#ifdef __GLIBC__
+    size_t heap = mallinfo2().uordblks;
+#endif
+    double batch = batchRate(data, rounds);
+#ifdef __GLIBC__
+    // The batch calls never touch the heap
+    TEST_ASSERT_EQUAL(heap, mallinfo2().uordblks);
+#endif
+    char message[128];
+    snprintf(message, sizeof(message), "512 byte datagrams/s: %.0f parsePacket/read, %.0f recvBatch/sendBatch",
+             classic, batch);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_calls_round_trip);
+    RUN_TEST(test_reply_without_begin_packet);
+    RUN_TEST(test_packet_calls);
+    RUN_TEST(test_batches_keep_order);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,287 @@
+// WebSocket endpoints of WebServer against a small RFC 6455 client on loopback
+#include <WebServer.h>
+#include <unity.h>
+#include "host.h"
+#include <mutex>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
+
+static uint16_t port;
+static WebServer *server;
+static HostPoller poller;
+static std::mutex eventLock;
+static std::vector<std::pair<WebSocketEvent, std::string>> events;
+
+// Echoes messages, "all:" ones to every client
+static void onEvent(uint8_t client, WebSocketEvent event, const uint8_t *payload, size_t length)
+{
+    std::string message = payload ? std::string((const char *)payload, length) : std::string();
+    {
+        std::lock_guard<std::mutex> lock(eventLock);
+        events.push_back(std::make_pair(event, message));
+    }
+    if (event == WS_TEXT && message.compare(0, 4, "all:") == 0)
+        server->broadcastText(String(message.c_str() + 4));
+    else if (event == WS_TEXT)
+        server->sendText(client, String(message.c_str()));
+    else if (event == WS_BINARY)
+        server->sendBinary(client, payload, length);
+}
+
+void setUp(void)
+{
+    port = hostFreePort();
+    server = new WebServer(port);
+    events.clear();
+    server->onWebSocket("/ws", onEvent);
+    server->begin();
+    poller.start([]() { server->handleClient(); });
+}
+
+void tearDown(void)
+{
+    poller.stop();
+    delete server;
+    server = NULL;
+}
+
+static std::string upgrade(int fd, const char *key, const char *version = "13")
+{
+    std::string request = std::string("GET /ws HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+                                      "Connection: Upgrade\r\nSec-WebSocket-Key: ") +
+                          key + "\r\nSec-WebSocket-Version: " + version + "\r\n\r\n";
+    hostWriteAll(fd, request.data(), request.size());
+    std::string response;
+    char c;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (response.find("\r\n\r\n") == std::string::npos && poll(&pfd, 1, 2000) > 0 && read(fd, &c, 1) == 1)
+        response += c;
+    return response;
+}
+
+static int connectWebSocket()
+{
+    int fd = hostConnect(port);
+    if (fd >= 0 && upgrade(fd, "dGhlIHNhbXBsZSBub25jZQ==").compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static void sendFrame(int fd, uint8_t opcode, const std::string &payload, bool fin = true, bool masked = true)
+{
+    static const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+    std::string frame;
+    frame += (char)((fin ? 0x80 : 0) | opcode);
+    uint8_t maskBit = masked ? 0x80 : 0;
+    if (payload.size() < 126)
+    {
+        frame += (char)(maskBit | payload.size());
+    }
+    else
+    {
+        frame += (char)(maskBit | 126);
+        frame += (char)(payload.size() >> 8);
+        frame += (char)payload.size();
+    }
+    if (masked)
+        frame.append((const char *)mask, 4);
+    for (size_t i = 0; i < payload.size(); i++)
+        frame += masked ? (char)(payload[i] ^ mask[i & 3]) : payload[i];
+    hostWriteAll(fd, frame.data(), frame.size());
+}
+
+static bool readExactly(int fd, void *buf, size_t length)
+{
+    uint8_t *p = (uint8_t *)buf;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (length)
+    {
+        if (poll(&pfd, 1, 2000) <= 0)
+            return false;
+        ssize_t res = read(fd, p, length);
+        if (res <= 0)
+            return false;
+        p += res;
+        length -= res;
+    }
+    return true;
+}
+
+// Opcode of the next frame from the server, -1 if none came
+static int readFrame(int fd, std::string &payload)
+{
+    uint8_t header[2];
+    if (!readExactly(fd, header, 2) || (header[1] & 0x80))
+        return -1;
+    size_t length = header[1] & 0x7f;
+    if (length == 126)
+    {
+        uint8_t ext[2];
+        if (!readExactly(fd, ext, 2))
+            return -1;
+        length = ext[0] << 8 | ext[1];
+    }
+    payload.resize(length);
+    if (length && !readExactly(fd, &payload[0], length))
+        return -1;
+    return header[0] & 0x0f;
+}
+
+static void waitForClients(int count)
+{
+    for (int i = 0; i < 100 && server->webSocketClients() != count; i++)
+        delay(10);
+}
+
+static void test_handshake_answers_rfc_key(void)
+{
+    int fd = hostConnect(port);
+    std::string response = upgrade(fd, "dGhlIHNhbXBsZSBub25jZQ==");
+    close(fd);
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 101 Switching Protocols\r\n"));
+    TEST_ASSERT_TRUE(response.find("\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+}
+
+static void test_handshake_refuses_other_versions(void)
+{
+    int fd = hostConnect(port);
+    std::string response = upgrade(fd, "dGhlIHNhbXBsZSBub25jZQ==", "8");
+    close(fd);
+    TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 426"));
+    TEST_ASSERT_TRUE(response.find("\r\nSec-WebSocket-Version: 13\r\n") != std::string::npos);
+}
+
+static void test_masked_frames_echo(void)
+{
+    int fd = connectWebSocket();
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    std::string payload;
+    sendFrame(fd, 0x1, "hello");
+    TEST_ASSERT_EQUAL(0x1, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL_STRING("hello", payload.c_str());
+
+    std::string big(2000, 'x');
+    for (size_t i = 0; i < big.size(); i++)
+        big[i] = (char)i;
+    sendFrame(fd, 0x2, big);
+    TEST_ASSERT_EQUAL(0x2, readFrame(fd, payload));
+    TEST_ASSERT_TRUE(big == payload);
+    close(fd);
+}
+
+// A ping may sit between the fragments of a message
+static void test_fragments_and_ping(void)
+{
+    int fd = connectWebSocket();
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    std::string payload;
+    sendFrame(fd, 0x1, "one ", false);
+    sendFrame(fd, 0x9, "are you there");
+    sendFrame(fd, 0x0, "two ", false);
+    sendFrame(fd, 0x0, "three");
+    TEST_ASSERT_EQUAL(0xA, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL_STRING("are you there", payload.c_str());
+    TEST_ASSERT_EQUAL(0x1, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL_STRING("one two three", payload.c_str());
+    close(fd);
+}
+
+static void test_protocol_errors_close(void)
+{
+    std::string payload;
+    int fd = connectWebSocket();
+    sendFrame(fd, 0x1, "bare", true, false);
+    TEST_ASSERT_EQUAL(0x8, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL(2, payload.size());
+    TEST_ASSERT_EQUAL(1002, (uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+    close(fd);
+
+    fd = connectWebSocket();
+    sendFrame(fd, 0x2, std::string(WEBSOCKET_MAX_MESSAGE, 'a'), false);
+    sendFrame(fd, 0x0, "a");
+    TEST_ASSERT_EQUAL(0x8, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL(1009, (uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+    close(fd);
+}
+
+// Header of a masked frame with the 64-bit length form, no payload follows
+static void sendLongHeader(int fd, uint8_t opcode, uint64_t length)
+{
+    uint8_t header[14] = {opcode, 0x80 | 127};
+    for (int i = 0; i < 8; i++)
+        header[2 + i] = (uint8_t)(length >> (56 - 8 * i));
+    hostWriteAll(fd, header, sizeof(header));
+}
+
+static void test_huge_lengths_close(void)
+{
+    std::string payload;
+    // Would wrap messageLength + length around to 0
+    int fd = connectWebSocket();
+    sendFrame(fd, 0x1, std::string(100, 'a'), false);
+    sendLongHeader(fd, 0x0, 0 - (uint64_t)100);
+    TEST_ASSERT_EQUAL(0x8, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL(1002, (uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+    close(fd);
+
+    fd = connectWebSocket();
+    sendFrame(fd, 0x1, std::string(100, 'a'), false);
+    sendLongHeader(fd, 0x0, (uint64_t)1 << 40);
+    TEST_ASSERT_EQUAL(0x8, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL(1009, (uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+    close(fd);
+}
+
+static void test_broadcast_reaches_everyone(void)
+{
+    int first = connectWebSocket();
+    int second = connectWebSocket();
+    waitForClients(2);
+    TEST_ASSERT_EQUAL(2, server->webSocketClients());
+    std::string payload;
+    sendFrame(first, 0x1, "all:news");
+    TEST_ASSERT_EQUAL(0x1, readFrame(first, payload));
+    TEST_ASSERT_EQUAL_STRING("news", payload.c_str());
+    TEST_ASSERT_EQUAL(0x1, readFrame(second, payload));
+    TEST_ASSERT_EQUAL_STRING("news", payload.c_str());
+    close(first);
+    close(second);
+}
+
+static void test_close_handshake(void)
+{
+    int fd = connectWebSocket();
+    waitForClients(1);
+    std::string payload;
+    sendFrame(fd, 0x8, std::string("\x03\xe8", 2));
+    TEST_ASSERT_EQUAL(0x8, readFrame(fd, payload));
+    TEST_ASSERT_EQUAL(1000, (uint8_t)payload[0] << 8 | (uint8_t)payload[1]);
+    close(fd);
+    waitForClients(0);
+    TEST_ASSERT_EQUAL(0, server->webSocketClients());
+    std::lock_guard<std::mutex> lock(eventLock);
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_EQUAL(WS_CONNECTED, events[0].first);
+    TEST_ASSERT_EQUAL_STRING("/ws", events[0].second.c_str());
+    TEST_ASSERT_EQUAL(WS_DISCONNECTED, events[1].first);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_handshake_answers_rfc_key);
+    RUN_TEST(test_handshake_refuses_other_versions);
+    RUN_TEST(test_masked_frames_echo);
+    RUN_TEST(test_fragments_and_ping);
+    RUN_TEST(test_protocol_errors_close);
+    RUN_TEST(test_huge_lengths_close);
+    RUN_TEST(test_broadcast_reaches_everyone);
+    RUN_TEST(test_close_handshake);
+    return UNITY_END();
+}